@@ -47,6 +47,9 @@ namespace Caramel{
 
         Float surface_area() const;
 
+        // Box around the transformed corners
+        AABB transformed(const Matrix44f &mat) const;
+
         static AABB merge(const AABB &a, const AABB &b) {
             return {{std::min(a.m_min[0], b.m_min[0]),
                      std::min(a.m_min[1], b.m_min[1]),
@@ -0,0 +1,79 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <common.h>
+
+namespace Caramel{
+
+    // Process-wide registry of loaded assets, e.g. mesh templates and images, so that every reference to
+    // the same file shares one copy. Assets are keyed by kind, canonical path, modification time of the
+    // file and load parameters, so an edited file is loaded again. The registry holds weak references :
+    // an asset is freed when its last user releases it.
+    class AssetRegistry{
+    public:
+        static AssetRegistry& instance() {
+            static AssetRegistry registry;
+            return registry;
+        }
+
+        // Asset for the key, loaded by `load` if it is not alive. Concurrent requests of the same key
+        // wait for one load, requests of other keys load in parallel.
+        template <typename T, typename F>
+        std::shared_ptr<const T> get(const std::string &kind, const std::filesystem::path &path, const std::string &params, F &&load) {
+            return std::static_pointer_cast<const T>(get_erased(key(kind, path, params), [&load]() -> std::shared_ptr<const void> {
+                return std::shared_ptr<const T>(load());
+            }));
+        }
+
+        // Number of assets alive
+        Index size() const;
+
+        static std::string key(const std::string &kind, const std::filesystem::path &path, const std::string &params);
+
+    private:
+        AssetRegistry() = default;
+
+        struct Entry{
+            std::mutex mutex;
+            std::weak_ptr<const void> asset;
+        };
+
+        std::shared_ptr<const void> get_erased(const std::string &key, const std::function<std::shared_ptr<const void>()> &load);
+
+        static constexpr std::size_t MIN_PRUNE_SIZE = 64;
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, std::shared_ptr<Entry>> m_entries;
+        std::size_t m_prune_size = MIN_PRUNE_SIZE;
+    };
+
+}
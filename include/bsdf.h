@@ -28,11 +28,11 @@
 #include <unordered_map>
 
 #include <common.h>
+#include <textures.h>
 
 namespace Caramel{
 
     class Sampler;
-    class Texture;
 
     // Commonly used functions for bsdfs
 
@@ -88,17 +88,20 @@ namespace Caramel{
     public:
         virtual ~BSDF() = default;
         // Given incoming dir, returns sampled recursive ray direction, reflectance * cos / pdf, and its pdf if non-discrete,
-        virtual std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const Vector2f &uv, Sampler &sampler) const = 0;
+        virtual std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const TextureCoord &uv, Sampler &sampler) const = 0;
 
         // calculate pdf()
         virtual Float pdf(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir) const = 0;
 
         // Given incoming & outgoing dir, returns reflectance
-        virtual Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const Vector2f &uv) const = 0;
+        virtual Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const TextureCoord &uv) const = 0;
 
         // Returns whether bsdf is discrete (mirror, etc) or continuous (diffuse, etc).
         virtual bool is_discrete(bool frontside) const = 0;
 
+        // IOR of the side a ray arrives from over the IOR of the other side, for refracted ray differentials
+        virtual Float eta(bool /*frontside*/) const{ return Float1; }
+
         template <typename Type, typename ...Param>
         static BSDF* Create(Param ...args){
             return dynamic_cast<BSDF*>(new Type(args...));
@@ -110,9 +113,9 @@ namespace Caramel{
         explicit Diffuse(const Vector3f &albedo = Vector3f{Float0, Float0, Float0});
         explicit Diffuse(Texture *texture);
         virtual ~Diffuse();
-        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &, const Vector2f &uv, Sampler &sampler) const override;
+        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &, const TextureCoord &uv, Sampler &sampler) const override;
         Float pdf(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir) const override;
-        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const Vector2f &uv) const override;
+        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const TextureCoord &uv) const override;
         bool is_discrete(bool /*frontside*/) const override;
     private:
         const Vector3f m_albedo;
@@ -122,19 +125,20 @@ namespace Caramel{
     class Mirror final : public BSDF{
     public:
         explicit Mirror();
-        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const Vector2f &, Sampler &) const override;
+        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const TextureCoord &, Sampler &) const override;
         Float pdf(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir) const override;
-        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const Vector2f &) const override;
+        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const TextureCoord &) const override;
         bool is_discrete(bool /*frontside*/) const override;
     };
 
     class Dielectric final : public BSDF{
     public:
         explicit Dielectric(Float in_ior = IOR::GLASS, Float ex_ior = IOR::VACUUM);
-        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const Vector2f &, Sampler &) const override;
+        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const TextureCoord &, Sampler &) const override;
         Float pdf(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir) const override;
-        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const Vector2f &) const override;
+        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const TextureCoord &) const override;
         bool is_discrete(bool /*frontside*/) const override;
+        Float eta(bool frontside) const override;
 
     private:
         Float m_in_index_of_refraction;
@@ -144,9 +148,9 @@ namespace Caramel{
     class Conductor final : public BSDF{
     public:
         Conductor(const Conductors &mat, Float ex_ior);
-        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const Vector2f &, Sampler &) const override;
+        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const TextureCoord &, Sampler &) const override;
         Float pdf(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir) const override;
-        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const Vector2f &) const override;
+        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const TextureCoord &) const override;
         bool is_discrete(bool /*frontside*/) const override;
 
     private:
@@ -158,9 +162,9 @@ namespace Caramel{
     class Microfacet final : public BSDF{
     public:
         Microfacet(Float alpha, Float in_ior, Float ex_ior, const Vector3f &kd);
-        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const Vector2f &, Sampler &) const override;
+        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const TextureCoord &, Sampler &) const override;
         Float pdf(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir) const override;
-        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const Vector2f &) const override;
+        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const TextureCoord &) const override;
         bool is_discrete(bool /*frontside*/) const override;
 
     private:
@@ -177,9 +181,9 @@ namespace Caramel{
     class OrenNayar final : public BSDF{
     public:
         OrenNayar(const Vector3f &reflection, Float sigma);
-        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const Vector2f &, Sampler &sampler) const override;
+        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const TextureCoord &, Sampler &sampler) const override;
         Float pdf(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir) const override;
-        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const Vector2f &) const override;
+        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const TextureCoord &) const override;
         bool is_discrete(bool /*frontside*/) const override;
 
     private:
@@ -191,10 +195,11 @@ namespace Caramel{
     class TwoSided final : public BSDF{
     public:
         TwoSided(BSDF *front, BSDF *back);
-        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const Vector2f &uv, Sampler &sampler) const override;
+        std::tuple<Vector3f, Vector3f, Float> sample_recursive_dir(const Vector3f &local_incoming_dir, const TextureCoord &uv, Sampler &sampler) const override;
         Float pdf(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir) const override;
-        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const Vector2f &uv) const override;
+        Vector3f get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const TextureCoord &uv) const override;
         bool is_discrete(bool frontside) const override;
+        Float eta(bool frontside) const override;
 
     private:
         const BSDF *m_front;
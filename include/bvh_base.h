@@ -26,6 +26,7 @@
 
 #include <vector>
 #include <memory>
+#include <span>
 
 #include <common.h>
 #include <aabb.h>
@@ -79,12 +80,23 @@ namespace Caramel{
 
         BVHTree(std::vector<Primitive> primitives, const Traits &traits,
                 Float cost_traversal, Float cost_intersection, int subspace_count, int max_primitive_num);
+        // Tree built before, e.g. stored in a file. Arrays are not copied and should outlive the tree.
+        BVHTree(std::span<const LinearBVHNode> nodes, std::span<const Primitive> ordered_primitives, const Traits &traits);
+        // Views would point to arrays of the copied tree
+        BVHTree(const BVHTree&) = delete;
+        BVHTree& operator=(const BVHTree&) = delete;
         std::pair<bool, RayIntersectInfo> ray_intersect(const Ray &ray, Float maxt) const;
 
+        std::span<const LinearBVHNode> nodes() const { return m_node_view; }
+        std::span<const Primitive> ordered_primitives() const { return m_primitive_view; }
+
     private:
         Traits m_traits;
         std::vector<LinearBVHNode> m_nodes;
         std::vector<Primitive> m_ordered_primitives;
+        // Point to above vectors, or to arrays given to the constructor
+        std::span<const LinearBVHNode> m_node_view;
+        std::span<const Primitive> m_primitive_view;
     };
 
     // Traits for scene-level BVH (Shape pointers)
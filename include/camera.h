@@ -25,6 +25,7 @@
 #pragma once
 
 #include <common.h>
+#include <image.h>
 
 namespace Caramel{
     class Ray;
@@ -56,6 +57,11 @@ namespace Caramel{
             m_h = height;
         }
 
+        // Pixels rendered unless `RenderConfig::region` is given, in full resolution coordinates
+        // (empty = whole image)
+        void set_crop(const ImageRegion &crop);
+        const ImageRegion &get_crop() const{ return m_crop; }
+
         Matrix44f get_cam_to_world() const{ return m_cam_to_world; }
         Float get_fov_x() const{ return m_fov_x; }
 
@@ -70,6 +76,7 @@ namespace Caramel{
         Float m_far;
         Matrix44f m_sample_to_camera;
         Matrix44f m_cam_to_world;
+        ImageRegion m_crop;
     };
 
     class Pinhole : public Camera {
@@ -70,6 +70,17 @@ namespace Caramel{
             }
         }
 
+        // Already normalized pdf and cdf, e.g. values of another distribution
+        Distrib1D(std::vector<Float> pdf, std::vector<Float> cdf) : m_pdf{std::move(pdf)}, m_cdf{std::move(cdf)} {}
+
+        const std::vector<Float> &pdf_values() const{
+            return m_pdf;
+        }
+
+        const std::vector<Float> &cdf_values() const{
+            return m_cdf;
+        }
+
         Index sample(Float x) const{
             const auto iter = std::ranges::upper_bound(m_cdf, x);
             return iter - m_cdf.begin();
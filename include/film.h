@@ -0,0 +1,111 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <common.h>
+#include <image.h>
+
+namespace Caramel{
+
+    // Per-pixel accumulation buffer of a rendering.
+    // Each pixel keeps the running mean of its samples and the running variance of their
+    // luminance (Welford's algorithm), so the estimate can be read or refined at any time
+    // and its error decides how many more samples the pixel needs.
+    class Film{
+    public:
+        struct Pixel{
+            Vector3f mean = vec3f_zero;
+            // Sum of squared differences of the sample luminance from the mean
+            Float lum_m2 = 0;
+            Index spp = 0;
+        };
+
+        Film(Index width, Index height);
+        // Empty film, takes the resolution of the first file merged into it
+        Film();
+
+        // Not thread safe for the same pixel, each pixel should be owned by a single thread.
+        void add_sample(Index x, Index y, const Vector3f &rgb);
+
+        const Pixel &pixel(Index x, Index y) const;
+        Index spp(Index x, Index y) const;
+        // Standard error of the pixel's mean luminance relative to the mean itself.
+        // Returns INF if there are not enough samples to estimate it.
+        Float relative_error(Index x, Index y) const;
+        // Whether the pixel needs no more samples for `threshold`. Below `min_spp` samples the error
+        // estimate itself is not trusted, e.g. a pixel whose first samples all missed a small light.
+        bool is_converged(Index x, Index y, Float threshold, Index min_spp) const;
+
+        Index width() const{ return m_width; }
+        Index height() const{ return m_height; }
+        ImageRegion full_region() const{ return {0, 0, m_width, m_height}; }
+
+        // Write mean of each pixel in the region
+        void write_to(Image &output, const ImageRegion &region) const;
+        // Write sample count of each pixel in the region to all channels
+        void write_spp_to(Image &output, const ImageRegion &region) const;
+
+        // Film file, used both for checkpoints and for partial films of distributed renders.
+        // It holds the pixels of `region`, the index of the pass to render next and the seed of the
+        // render, from which every sampler of the remaining passes is derived.
+        // The file is replaced atomically, so an interrupted write keeps the previous one.
+        void save(const std::string &filename, const ImageRegion &region, Index next_pass = 0, Index seed = 0) const;
+        // Replace pixels of `region` with those of a file saved with the same resolution and region.
+        // Returns {next_pass, seed} stored in the file.
+        std::pair<Index, Index> load(const std::string &filename, const ImageRegion &region);
+        // Combine pixels of a file into this film, weighting by sample counts
+        void merge(const std::string &filename);
+
+        // Statistics of the union of both sample sets (Chan et al.)
+        static Pixel combine(const Pixel &a, const Pixel &b);
+
+    private:
+        static constexpr char FILE_MAGIC[8] = {'C', 'R', 'M', 'F', 'I', 'L', 'M', '1'};
+
+        struct FileHeader{
+            Index float_size;
+            Index width;
+            Index height;
+            ImageRegion region;
+            Index next_pass;
+            Index seed;
+        };
+        static FileHeader read_header(std::istream &stream, const std::string &filename);
+        static Pixel read_pixel(std::istream &stream);
+
+        // Lower bound of the relative error denominator, to not chase noise in black pixels
+        static constexpr Float MIN_LUMINANCE = static_cast<Float>(1e-3);
+
+        Index m_width;
+        Index m_height;
+        std::vector<Pixel> m_pixels;
+    };
+
+}
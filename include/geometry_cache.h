@@ -0,0 +1,124 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <common.h>
+
+namespace Caramel{
+    class LazyMesh;
+    class TriangleMesh;
+
+    // Process-wide budget for meshes of lazily loaded shapes. When loading a mesh brings the resident
+    // meshes over the budget, the least recently used ones are evicted until it fits again. A mesh in use
+    // by a ray is freed once the ray is done with it, and loaded again by the next ray reaching its bounds.
+    class GeometryCache{
+    public:
+        // Marks the calling thread as tracing rays for a while, e.g. a tile of a render. Rays inside a
+        // scope read a loaded mesh with a plain load instead of taking a reference to it on every ray,
+        // and a mesh evicted meanwhile is freed once every scope which began before the eviction has
+        // ended or moved on to its next lazy mesh (epoch based reclamation). Scopes of a thread may nest.
+        class ReadScope{
+        public:
+            ReadScope();
+            ~ReadScope();
+            ReadScope(const ReadScope&) = delete;
+            ReadScope& operator=(const ReadScope&) = delete;
+        };
+
+        static GeometryCache& instance() {
+            static GeometryCache cache;
+            return cache;
+        }
+
+        // 0 means no limit, which is the default
+        void set_budget(std::size_t bytes);
+        std::size_t budget() const;
+
+        std::size_t resident_bytes() const;
+        Index load_count() const;
+        Index eviction_count() const;
+        // Evicted meshes which are not freed yet, as a read scope may still use them
+        Index retired_count() const;
+
+        // Advanced on every load. Meshes remember the time of their last use, so that the order of use is
+        // known without locking on every ray.
+        std::uint64_t clock() const{ return m_clock.load(std::memory_order_relaxed); }
+
+    private:
+        friend class LazyMesh;
+
+        GeometryCache() = default;
+
+        // Called by a mesh which finished loading, may evict other meshes
+        void loaded(const LazyMesh *mesh, std::size_t bytes);
+        // Called by a mesh which is destroyed
+        void remove(const LazyMesh *mesh);
+
+        // Epoch at which a thread entered its outermost scope, 0 outside scopes
+        struct Reader{
+            std::atomic<std::uint64_t> epoch = 0;
+        };
+        struct ThreadState;
+        static ThreadState &thread_state();
+        static bool in_read_scope();
+        // Called by a mesh before a ray of a scope reads it. A thread uses no mesh between rays, so it
+        // moves to the current epoch, which is a plain load unless a mesh was evicted meanwhile.
+        void enter_mesh();
+
+        // Take the evicted meshes no scope can read anymore, called with the mutex locked.
+        // They are destroyed by the caller after unlocking.
+        std::vector<std::shared_ptr<const TriangleMesh>> collect();
+
+        struct Resident{
+            const LazyMesh *mesh;
+            std::size_t bytes;
+        };
+        struct Retired{
+            std::shared_ptr<const TriangleMesh> mesh;
+            std::uint64_t epoch;
+        };
+
+        mutable std::mutex m_mutex;
+        std::vector<Resident> m_resident;
+        std::size_t m_resident_bytes = 0;
+        std::size_t m_budget = 0;
+        Index m_load_count = 0;
+        Index m_eviction_count = 0;
+        std::atomic<std::uint64_t> m_clock = 0;
+
+        // Readers of exited threads are only held here, and are dropped by `collect()`
+        std::vector<std::shared_ptr<Reader>> m_readers;
+        std::vector<Retired> m_retired;
+        // Read without locking when a scope ends
+        std::atomic<std::size_t> m_retired_count = 0;
+        std::atomic<std::uint64_t> m_epoch = 1;
+    };
+
+}
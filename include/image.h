@@ -24,12 +24,26 @@
 
 #pragma once
 
+#include <memory>
 #include <vector>
+#include <span>
 #include <string>
 
 #include <common.h>
 
 namespace Caramel {
+    // Pixel rectangle [x_min, x_max) x [y_min, y_max)
+    struct ImageRegion{
+        Index x_min = 0;
+        Index y_min = 0;
+        Index x_max = 0;
+        Index y_max = 0;
+
+        bool is_empty() const{ return x_min >= x_max || y_min >= y_max; }
+        bool contains(Index x, Index y) const{ return x_min <= x && x < x_max && y_min <= y && y < y_max; }
+        Index area() const{ return is_empty() ? 0 : (x_max - x_min) * (y_max - y_min); }
+    };
+
     // Caramel considers only RGB(BGR) 3 channel image.
     class Image {
     public:
@@ -37,11 +51,17 @@ namespace Caramel {
 
         Image(Index width, Index height);
         explicit Image(const std::string &filename);
+        // Read-only view of RGB pixels owned by `owner`, e.g. a mapped scene snapshot, which is kept
+        // alive while the image exists
+        Image(Index width, Index height, std::span<const Float> pixels, std::shared_ptr<const void> owner);
         void write_exr(const std::string &filename) const;
+        // Write only the pixels of `data_window`, keeping the full image as the display window
+        void write_exr(const std::string &filename, const ImageRegion &data_window) const;
 
         void set_pixel_value(int w, int h, Float r, Float g, Float b);
         Vector3f get_pixel_value(int w, int h) const;
         Vector2ui size() const;
+        std::span<const Float> pixels() const;
 
         std::vector<std::vector<Float>> get_data_for_sampling(bool sin_weight) const;
 
@@ -57,5 +77,8 @@ namespace Caramel {
         Index m_width;
         Index m_height;
         std::vector<Float> m_data;
+        // Non-null when the image views external pixels instead of m_data
+        const Float *m_external_data = nullptr;
+        std::shared_ptr<const void> m_external_owner;
     };
 }
\ No newline at end of file
@@ -25,13 +25,23 @@
 #pragma once
 
 #include <atomic>
+#include <string>
+#include <vector>
 
 #include <common.h>
+#include <film.h>
+#include <scheduler.h>
 
 namespace Caramel{
+    class Camera;
     class Image;
     class Scene;
     class Sampler;
+    class RayIntersectInfo;
+    class BSDF;
+    class DTree;
+    class SDTree;
+    struct GuidingRecord;
 
     inline Float balance_heuristic(Float a, Float b){
         return a / (a + b);
@@ -43,6 +53,36 @@ namespace Caramel{
         bool random_seed = false;
         // External stop flag — checked per column
         std::atomic<bool> *should_stop = nullptr;
+        // If given, receives the number of samples taken at each pixel
+        Image *spp_aov = nullptr;
+        // Wall-clock budget in seconds (0 = unlimited). Sample passes are repeated until it is
+        // used up, and `spp` (if given) caps the samples per pixel.
+        Float time_budget = 0;
+        // Stop sampling pixels whose relative error falls below it (0 = disabled)
+        Float target_error = 0;
+        // If given, the film is saved there after a pass once `checkpoint_interval` seconds
+        // passed since the last save, and when the render ends without interruption.
+        std::string checkpoint_path;
+        Float checkpoint_interval = 60;
+        // Continue from `checkpoint_path`, with the same settings as the checkpointed render
+        bool resume = false;
+        // Render only pixels inside `region`, in full resolution coordinates.
+        // If empty, the camera's crop window is used (or the whole image if it has none).
+        ImageRegion region;
+        // Render only the `tile_index`-th of every `tile_count` tiles of the region, so that jobs
+        // with the same count and different indices split an image between them
+        Index tile_count = 1;
+        Index tile_index = 0;
+        // If given, the film of the region is saved there when the render ends, see `Film::merge()`
+        std::string film_path;
+        // If given, columns are rendered as tasks of this job of `JobScheduler` instead of taking
+        // all threads, so that concurrent renders share workers by priority
+        JobScheduler::Job *job = nullptr;
+        // If given, rendered instead of the scene camera, so that jobs can view one scene from
+        // different cameras at the same time
+        const Camera *camera = nullptr;
+
+        const Camera &camera_of(const Scene &scene) const;
     };
 
     class Integrator{
@@ -52,7 +92,7 @@ namespace Caramel{
         Image render(const Scene &scene, const RenderConfig &config = {});
 
         virtual ~Integrator() = default;
-        virtual void pre_process(const Scene &scene) = 0;
+        virtual void pre_process(Scene &scene) = 0;
         virtual void render(const Scene &scene, Image &output, const RenderConfig &config = {}) = 0;
 
         template <typename Type, typename ...Param>
@@ -64,40 +104,64 @@ namespace Caramel{
     class MCIntegrator : public Integrator{
     public:
         explicit MCIntegrator(Index m_spp = 1);
-        void pre_process(const Scene &scene) override;
+        void pre_process(Scene &scene) override;
         void render(const Scene &scene, Image &output, const RenderConfig &config = {}) override;
 
-        virtual Vector3f get_pixel_value(const Scene &scene, Float i, Float j, Sampler &sampler) = 0;
+        // `spp` is the number of samples the render takes per pixel, which scales the footprint of a sample
+        virtual Vector3f get_pixel_value(const Scene &scene, const Camera &camera, Float i, Float j, Index spp, Sampler &sampler) = 0;
 
         Index get_spp() const{ return m_spp; }
 
+        // Take samples in rounds of `round_spp` per pixel, and stop sampling a pixel once the
+        // relative error of its estimate falls below `threshold` (or it reaches m_spp samples).
+        // The error is only trusted after `min_spp` samples, 0 uses max(MIN_ERROR_SPP, 2 * round_spp).
+        void set_adaptive(Float threshold, Index round_spp, Index min_spp = 0);
+        bool is_adaptive() const{ return m_adaptive_threshold > 0; }
+
     protected:
         Index m_spp;
+
+    private:
+        // Samples per pixel of a pass in time budgeted / target error mode, when not adaptive
+        static constexpr Index PROGRESSIVE_PASS_SPP = 4;
+        // Lower bound of the samples a pixel takes before its error estimate stops sampling it
+        static constexpr Index MIN_ERROR_SPP = 16;
+        // Size of the tiles distributed by `RenderConfig::tile_count`
+        static constexpr Index TILE_SIZE = 32;
+
+        // Render in passes over a film, used for adaptive sampling, time budget and target error
+        void render_progressive(const Scene &scene, Image &output, const RenderConfig &config);
+        ImageRegion render_region(const Scene &scene, const RenderConfig &config) const;
+
+        // 0 disables adaptive sampling
+        Float m_adaptive_threshold = 0;
+        Index m_adaptive_round_spp = 0;
+        Index m_adaptive_min_spp = 0;
     };
 
     class DepthIntegrator final : public MCIntegrator{
     public:
         DepthIntegrator();
-        Vector3f get_pixel_value(const Scene &scene, Float i, Float j, Sampler &sampler) override;
+        Vector3f get_pixel_value(const Scene &scene, const Camera &camera, Float i, Float j, Index spp, Sampler &sampler) override;
 
     };
 
     class UVIntegrator final : public MCIntegrator{
     public:
         UVIntegrator();
-        Vector3f get_pixel_value(const Scene &scene, Float i, Float j, Sampler &sampler) override;
+        Vector3f get_pixel_value(const Scene &scene, const Camera &camera, Float i, Float j, Index spp, Sampler &sampler) override;
     };
 
     class HitPosIntegrator final : public MCIntegrator{
     public:
         HitPosIntegrator();
-        Vector3f get_pixel_value(const Scene &scene, Float i, Float j, Sampler &sampler) override;
+        Vector3f get_pixel_value(const Scene &scene, const Camera &camera, Float i, Float j, Index spp, Sampler &sampler) override;
     };
 
     class NormalIntegrator final : public MCIntegrator{
     public:
         NormalIntegrator();
-        Vector3f get_pixel_value(const Scene &scene, Float i, Float j, Sampler &sampler) override;
+        Vector3f get_pixel_value(const Scene &scene, const Camera &camera, Float i, Float j, Index spp, Sampler &sampler) override;
     };
 
     // class DirectIntegrator final : public MCIntegrator{
@@ -111,14 +175,46 @@ namespace Caramel{
 
     class PathIntegrator final : public MCIntegrator{
     public:
-        PathIntegrator(Index rr_depth, Index max_depth, Index spp);
-        Vector3f get_pixel_value(const Scene &scene, Float i, Float j, Sampler &sampler) override;
+        // Path guiding (Müller et al. 2017) : probability to sample the bsdf instead of the learned distribution
+        static constexpr Float GUIDING_BSDF_FRACTION = static_cast<Float>(0.5);
+        // Spatial leaf is split when it records more than GUIDING_SPATIAL_THRESHOLD * sqrt(spp of the pass) vertices
+        static constexpr Float GUIDING_SPATIAL_THRESHOLD = static_cast<Float>(12000);
+        // Directional quadrant is subdivided when it holds more than this fraction of the energy
+        static constexpr Float GUIDING_DIRECTIONAL_THRESHOLD = static_cast<Float>(0.01);
+        static constexpr Index GUIDING_MAX_VERTICES = 32;
+        // Seed of the training samplers, so that training paths differ from rendered ones
+        static constexpr uint64_t GUIDING_SEED = 0x6775696465ULL;
+        // Camera ray differentials are scaled by 1/sqrt(spp) of the render down to this, so that textures are not
+        // blurred more than samples of a pixel resolve
+        static constexpr Float MIN_DIFFERENTIAL_SCALE = static_cast<Float>(0.125);
+
+        // light_cache_res == 0 disables the spatial light cache, see `LightCache`
+        // ris_candidates > 1 enables resampled importance sampling for emitter sampling
+        // guiding_spp == 0 disables path guiding, otherwise it is the total spp of training passes
+        PathIntegrator(Index rr_depth, Index max_depth, Index spp, Index light_cache_res = 0, Index light_cache_spp = 0,
+                       Index ris_candidates = 1, Index guiding_spp = 0);
+        ~PathIntegrator();
+        void pre_process(Scene &scene) override;
+        Vector3f get_pixel_value(const Scene &scene, const Camera &camera, Float i, Float j, Index spp, Sampler &sampler) override;
 
     private:
-        Vector3f mis_sampling_path(const Scene &scene, Float i, Float j, Sampler &sampler) const;
+        // Radiance arriving at guided vertices is appended to `records` if it is given
+        Vector3f mis_sampling_path(const Scene &scene, const Camera &camera, Float i, Float j, Index spp, Sampler &sampler,
+                                   std::vector<GuidingRecord> *records = nullptr) const;
+        Vector3f ris_direct_lighting(const Scene &scene, const RayIntersectInfo &info, const Vector3f &local_ray_dir,
+                                     const DTree *guide, Sampler &sampler) const;
+        // Probability of sampling the recursive direction, mixture of bsdf and guiding distribution if `guide` is given
+        Float scattering_pdf(const BSDF *bsdf, const DTree *guide, const RayIntersectInfo &info,
+                             const Vector3f &local_ray_dir, const Vector3f &local_dir) const;
+        void train_guiding(const Scene &scene);
 
         Index m_rr_depth;
         Index m_max_depth;
+        Index m_light_cache_res;
+        Index m_light_cache_spp;
+        Index m_ris_candidates;
+        Index m_guiding_spp;
+        SDTree *m_sd_tree;
     };
 
 
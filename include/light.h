@@ -24,7 +24,9 @@
 
 #pragma once
 
+#include <memory>
 #include <tuple>
+#include <vector>
 
 #include <common.h>
 #include <distribution.h>
@@ -36,15 +38,36 @@ namespace Caramel{
     class Image;
     class RayIntersectInfo;
 
+    // Result of `Light::sample_direct_contribution()`
+    // Zero radiance means that the sample failed or is occluded
+    struct LightSample {
+        Vector3f radiance; // Emitted radiance toward the shading point, including visibility
+        Vector3f pos;      // Sampled point on the light
+        Vector3f normal;   // Light normal at the sampled point
+        Float pdf;         // Probability respect to solid angle from the shading point, 0 for delta lights
+        Float dist;        // Distance between the shading point and the sampled point
+
+        static LightSample invalid() {
+            return {vec3f_zero, vec3f_zero, vec3f_zero, Float0, Float0};
+        }
+    };
+
     class Light{
     public:
         Light() {}
+        virtual ~Light() = default;
+
+        // Sample a point on the light from given pos, visibility is already tested
+        // Same pdf as `pdf_solidangle()` is stored in the record so callers don't have to evaluate it again
+        virtual LightSample sample_direct_contribution(const Scene &scene,
+                                                       const RayIntersectInfo &hitpos_info,
+                                                       Sampler &sampler) const = 0;
 
-        // Sample a point on the light from given pos
-        // returns emitted radiance, sampled point on the light, normal at the sampled point
-        virtual std::tuple<Vector3f, Vector3f, Vector3f> sample_direct_contribution(const Scene &scene,
-                                                                                    const RayIntersectInfo &hitpos_info,
-                                                                                    Sampler &sampler) const = 0;
+        // Same as `sample_direct_contribution()` without the visibility test,
+        // used to generate cheap candidates that are tested later with `Scene::is_visible()`
+        virtual LightSample sample_unoccluded(const Scene &scene,
+                                              const RayIntersectInfo &hitpos_info,
+                                              Sampler &sampler) const = 0;
 
         // Probability of hitpos_world sampled from hitpos_world respect to solid angle
         // This function should not be used from delta lights since they don't have to be sampled
@@ -76,9 +99,12 @@ namespace Caramel{
 
         Float power() const override;
         Vector3f radiance(const Vector3f &hitpos, const Vector3f &lightpos, const Vector3f &) const override;
-        std::tuple<Vector3f, Vector3f, Vector3f> sample_direct_contribution(const Scene &scene,
-                                                                            const RayIntersectInfo &hitpos_info,
-                                                                            Sampler &) const override;
+        LightSample sample_direct_contribution(const Scene &scene,
+                                               const RayIntersectInfo &hitpos_info,
+                                               Sampler &sampler) const override;
+        LightSample sample_unoccluded(const Scene &scene,
+                                      const RayIntersectInfo &hitpos_info,
+                                      Sampler &sampler) const override;
 
         Float pdf_solidangle(const Vector3f &hitpos_world, const Vector3f &lightpos_world, const Vector3f &light_normal_world) const override;
 
@@ -99,9 +125,12 @@ namespace Caramel{
         
         Float power() const override;
         Vector3f radiance(const Vector3f &hitpos, const Vector3f &lightpos, const Vector3f &light_normal_world) const override;
-        std::tuple<Vector3f, Vector3f, Vector3f> sample_direct_contribution(const Scene &scene,
-                                                                            const RayIntersectInfo &hitpos_info,
-                                                                            Sampler &sampler) const override;
+        LightSample sample_direct_contribution(const Scene &scene,
+                                               const RayIntersectInfo &hitpos_info,
+                                               Sampler &sampler) const override;
+        LightSample sample_unoccluded(const Scene &scene,
+                                      const RayIntersectInfo &hitpos_info,
+                                      Sampler &sampler) const override;
 
         Float pdf_solidangle(const Vector3f &hitpos_world, const Vector3f &lightpos_world, const Vector3f &light_normal_world) const override;
 
@@ -116,6 +145,9 @@ namespace Caramel{
         Shape *m_shape;
         Vector3f m_radiance;
         static constexpr bool TRY_SOLID_ANGLE_SAMPLING = true;
+
+    private:
+        LightSample sample(const Scene &scene, const RayIntersectInfo &hitpos_info, Sampler &sampler, bool test_visibility) const;
     };
 
     class ConstantEnvLight final : public Light {
@@ -124,9 +156,12 @@ namespace Caramel{
 
         Float power() const override;
         Vector3f radiance(const Vector3f &hitpos, const Vector3f &lightpos, const Vector3f &light_normal_world) const override;
-        std::tuple<Vector3f, Vector3f, Vector3f> sample_direct_contribution(const Scene &scene,
-                                                                            const RayIntersectInfo &hitpos_info,
-                                                                            Sampler &sampler) const override;
+        LightSample sample_direct_contribution(const Scene &scene,
+                                               const RayIntersectInfo &hitpos_info,
+                                               Sampler &sampler) const override;
+        LightSample sample_unoccluded(const Scene &scene,
+                                      const RayIntersectInfo &hitpos_info,
+                                      Sampler &sampler) const override;
 
         Float pdf_solidangle(const Vector3f &hitpos_world, const Vector3f &lightpos_world, const Vector3f &light_normal_world) const override;
 
@@ -145,12 +180,16 @@ namespace Caramel{
         static constexpr bool MIS_COMPENSATION = true;
 
         ImageEnvLight(const std::string &path, Float scale, const Matrix44f &to_world);
+        ImageEnvLight(std::shared_ptr<const Image> image, Float scale, const Matrix44f &to_world);
 
         Float power() const override;
         Vector3f radiance(const Vector3f &hitpos, const Vector3f &lightpos, const Vector3f &light_normal_world) const override;
-        std::tuple<Vector3f, Vector3f, Vector3f> sample_direct_contribution(const Scene &scene,
-                                                                            const RayIntersectInfo &hitpos_info,
-                                                                            Sampler &sampler) const override;
+        LightSample sample_direct_contribution(const Scene &scene,
+                                               const RayIntersectInfo &hitpos_info,
+                                               Sampler &sampler) const override;
+        LightSample sample_unoccluded(const Scene &scene,
+                                      const RayIntersectInfo &hitpos_info,
+                                      Sampler &sampler) const override;
 
         Float pdf_solidangle(const Vector3f &hitpos_world, const Vector3f &lightpos_world, const Vector3f &light_normal_world) const override;
 
@@ -160,7 +199,8 @@ namespace Caramel{
         void set_scene_radius(Float radius) override;
 
         const Float m_scale;
-        const Image *m_image;
+        // Shared with other users of the same file through the asset registry
+        const std::shared_ptr<const Image> m_image;
         const Distrib2D m_imageDistrib;
         const int m_width;
         const int m_height;
@@ -168,6 +208,17 @@ namespace Caramel{
         const Matrix33f m_to_world;
         const Matrix33f m_to_local;
         Float m_scene_radius;
+
+        // Precomputed tables for trigonometry-free direction <-> texel mapping of the equirectangular map
+        std::vector<Float> m_row_cos_bounds;    // cos(theta) at row boundaries, size height + 1, decreasing
+        std::vector<Float> m_col_pseudo_bounds; // pseudo-angle of phi at column boundaries, size width + 1, increasing
+        std::vector<Float> m_row_sin, m_row_cos; // sin/cos of theta at row centers
+        std::vector<Float> m_col_sin, m_col_cos; // sin/cos of phi at column centers
+
+    private:
+        // Same texel as `vec_to_normalized_uv()` followed by nearest pixel lookup
+        Vector2i direction_to_texel(const Vector3f &local_dir) const;
+        Float pdf_local(const Vector3f &local_dir) const;
     };
 
 }
@@ -0,0 +1,69 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <vector>
+
+#include <aabb.h>
+#include <common.h>
+#include <distribution.h>
+
+namespace Caramel{
+    class Scene;
+
+    // Uniform grid over the scene bounds whose cells hold their own light selection distribution.
+    // Each cell learns how much every light contributes to shading points inside it, including
+    // visibility, from a short training pass traced from the camera. Lights which are occluded from
+    // a cell are rarely picked there, while cells without training data fall back to the scene's
+    // global power-based distribution.
+    class LightCache{
+    public:
+        // Share of the global power distribution mixed into every learned cell distribution,
+        // so that each light with nonzero power keeps nonzero probability everywhere.
+        static constexpr Float GLOBAL_MIX = static_cast<Float>(0.1);
+        // Maximum number of bounces of a training path
+        static constexpr Index TRAINING_DEPTH = 3;
+        // Seed of the training samplers, so that training paths differ from rendered ones
+        static constexpr uint64_t TRAINING_SEED = 0x6c63616368ULL;
+
+        LightCache(const Scene &scene, Index resolution, Index training_spp);
+
+        // Sample light index at given shading position
+        Index sample(const Vector3f &pos, Float u) const;
+        // Probability to select `light_idx` at given shading position
+        Float pdf(const Vector3f &pos, Index light_idx) const;
+
+    private:
+        Index cell_index(const Vector3f &pos) const;
+
+        AABB m_aabb;
+        Index m_res[3];
+        Vector3f m_cell_size_inv;
+
+        // m_distribs[0] is the global distribution, cells without training data point to it
+        std::vector<Distrib1D> m_distribs;
+        std::vector<Index> m_cell_distrib_idx;
+    };
+}
@@ -25,6 +25,7 @@
 #pragma once
 
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <filesystem>
 
@@ -32,25 +33,42 @@ namespace Caramel {
 
     class Logger {
     public:
+        // Logs and progress go to stdout unless redirected, e.g. by the render server whose
+        // responses use stdout
+        static std::ostream &stream() {
+            return *s_stream;
+        }
+
+        static void set_stream(std::ostream &stream) {
+            s_stream = &stream;
+        }
+
         static void print_log(const std::string &file,
                                      int line,
                                      const std::string &msg) {
-            std::cout << log_prefix() << "In " << get_filename(file) << " " << line << " : " << msg << std::endl;
+            std::lock_guard<std::mutex> lock(s_mutex);
+            stream() << log_prefix() << "In " << get_filename(file) << " " << line << " : " << msg << std::endl;
         }
 
         static void print_err(const std::string &file,
                                      int line,
                                      const std::string &msg) {
-            std::cout << err_prefix() << "In " << get_filename(file) << " " << line << " : " << msg << std::endl;
+            std::lock_guard<std::mutex> lock(s_mutex);
+            stream() << err_prefix() << "In " << get_filename(file) << " " << line << " : " << msg << std::endl;
         }
 
         static void print_warn(const std::string &file,
                                       int line,
                                       const std::string &msg) {
-            std::cout << warn_prefix() << "In " << get_filename(file) << " " << line << " : " << msg << std::endl;
+            std::lock_guard<std::mutex> lock(s_mutex);
+            stream() << warn_prefix() << "In " << get_filename(file) << " " << line << " : " << msg << std::endl;
         }
 
     private:
+        static inline std::ostream *s_stream = &std::cout;
+        // Scenes are loaded by several threads
+        static inline std::mutex s_mutex;
+
         static std::string current_time_string() {
             const std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
@@ -0,0 +1,56 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+namespace Caramel{
+
+    // Read-only view of a whole file. It is memory mapped where supported, so that large meshes are
+    // paged in by the OS while they are parsed instead of being copied through stream buffers.
+    class MappedFile{
+    public:
+        // How the file is read, so that the OS reads ahead for sequential parsing but not for scattered reads
+        enum class Access{ Sequential, Random };
+
+        explicit MappedFile(const std::filesystem::path &path, Access access = Access::Sequential);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char *data() const{ return m_data; }
+        std::size_t size() const{ return m_size; }
+
+    private:
+        const char *m_data = nullptr;
+        std::size_t m_size = 0;
+        bool m_mapped = false;
+        // Contents of the file where it is not mapped
+        std::vector<char> m_buffer;
+    };
+
+}
@@ -97,8 +97,12 @@ namespace Caramel{
                 Float cost_traversal, Float cost_intersection, int subspace_count, int max_primitive_num);
 
         void build() override;
+        // Use a tree built before instead of `build()`, arrays should outlive this
+        void build_from(std::span<const LinearBVHNode> nodes, std::span<const Index> ordered_primitives);
         std::pair<bool, RayIntersectInfo> ray_intersect(const Ray &ray, Float maxt) override;
 
+        const BVHTree<BVHMeshTraits> &tree() const { return *m_root; }
+
     private:
         BVHMeshTraits m_traits;
         Float m_cost_traversal;
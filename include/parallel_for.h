@@ -24,83 +24,262 @@
 
 #pragma once
 
+#include <algorithm>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <optional>
 #include <vector>
 #include <functional>
 #include <condition_variable>
 #include <mutex>
+#include <type_traits>
 
 namespace Caramel{
 
-    // Persistent thread pool with task queue
+    // Persistent thread pool shared by every parallel_for of the process.
+    // The calling thread works on its own loop together with the pool's workers and returns once
+    // every iteration finished. A parallel_for called from inside another one (e.g. a mesh parsed
+    // in parallel while shapes are loaded in parallel) queues its iterations to the same workers
+    // instead of starting threads of its own, and the newest loop is served first so an outer
+    // iteration waiting for its inner loop is not left behind.
     class ThreadPool {
     public:
+        // Loops of one group (the tile loops of one render job, see `JobScheduler`) compete with other
+        // groups for the workers. A free worker takes an iteration of the group with the highest
+        // priority, and among equal priorities of the group which used the least worker time per
+        // weight. A group never runs on more than `max_threads` threads (0 = no cap).
+        // Loops without a group are served before any group, since an iteration waits for them.
+        struct Group {
+            int priority = 0;
+            double weight = 1;
+            unsigned int max_threads = 0;
+            // Guarded by the pool's mutex
+            unsigned int running = 0;
+            double virtual_time = 0;
+        };
+
         static ThreadPool& instance() {
-            static ThreadPool pool;
+            static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
             return pool;
         }
 
+        // thread_count includes the calling thread, so thread_count - 1 workers are started.
+        // When it is 1, the calling thread does all work.
+        explicit ThreadPool(unsigned int thread_count) : m_thread_count{std::max(1u, thread_count)} {
+            for (unsigned int i = 1; i < thread_count; ++i) {
+                m_workers.emplace_back([this]() { worker_loop(); });
+            }
+        }
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_shutdown = true;
+            }
+            m_task_cv.notify_all();
+            for (auto& w : m_workers) {
+                w.join();
+            }
+        }
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        unsigned int thread_count() const { return m_thread_count; }
+
+        // If an iteration throws, iterations not started yet are skipped and the first exception
+        // is rethrown on the calling thread after the running ones finished.
+        // The calling thread of a loop with a group only works while fewer than `thread_count()`
+        // threads are busy, so that concurrent jobs do not run on more threads than the pool has.
         template <typename F>
-        void parallel_for(int start_idx, int end_idx, F &&func) {
+        void parallel_for(int start_idx, int end_idx, F &&func, Group *group = nullptr) {
             if (start_idx >= end_idx) return;
 
-            const int task_count = end_idx - start_idx;
-            std::atomic<int> next_task{0};
-            std::atomic<int> completed_tasks{0};
-            std::mutex completion_mutex;
-            std::condition_variable completion_cv;
+            using Func = std::remove_reference_t<F>;
+            Batch batch;
+            batch.func = const_cast<void*>(static_cast<const void*>(std::addressof(func)));
+            batch.run = [](void *f, int i) { (*static_cast<Func*>(f))(i); };
+            batch.next = start_idx;
+            batch.end = end_idx;
+            batch.remaining = end_idx - start_idx;
+            batch.group = group;
 
-            auto worker_func = [&]() {
-                while (true) {
-                    int task_idx = next_task.fetch_add(1);
-                    if (task_idx >= task_count) break;
-                    func(start_idx + task_idx);
-                    if (completed_tasks.fetch_add(1) + 1 == task_count) {
-                        completion_cv.notify_one();
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (group) {
+                // A group which was idle does not get back the worker time others used meanwhile
+                for (const Batch *b : m_batches) {
+                    if (b->group && b->group != group && b->group->priority == group->priority) {
+                        group->virtual_time = std::max(group->virtual_time, b->group->virtual_time);
                     }
                 }
-            };
+            }
+            m_batches.push_back(&batch);
+            m_task_cv.notify_all();
+
+            // Calling thread participates in work
+            if (!group) {
+                while (batch.next < batch.end) {
+                    run_task(batch, lock);
+                }
+                m_done_cv.wait(lock, [&]() { return batch.remaining == 0; });
+            }
+            else {
+                m_waiting++;
+                while (true) {
+                    Batch *next = nullptr;
+                    m_task_cv.wait(lock, [&]() {
+                        return batch.remaining == 0 || (m_busy < m_thread_count && (next = pick_batch()) != nullptr);
+                    });
+                    if (batch.remaining == 0) break;
+                    run_task(*next, lock);
+                }
+                m_waiting--;
+            }
 
-            // Launch worker threads (N-1 workers + main thread)
-            // Note: When hardware_concurrency() returns 0 or 1, m_thread_count is 1,
-            // so no worker threads are created and main thread does all work.
-            std::vector<std::thread> workers;
-            const unsigned int worker_count = m_thread_count - 1;
-            workers.reserve(worker_count);
-            for (unsigned int i = 0; i < worker_count; ++i) {
-                workers.emplace_back(worker_func);
+            if (batch.exception) {
+                std::rethrow_exception(batch.exception);
             }
+        }
 
-            // Main thread participates in work
-            worker_func();
+    private:
+        // Iterations of one parallel_for call, lives on the stack of the calling thread
+        struct Batch {
+            void *func;
+            void (*run)(void*, int);
+            // Guarded by m_mutex
+            int next;
+            int end;
+            int remaining;
+            std::exception_ptr exception;
+            Group *group;
+        };
 
-            // Wait for completion
-            {
-                std::unique_lock<std::mutex> lock(completion_mutex);
-                completion_cv.wait(lock, [&]() {
-                    return completed_tasks >= task_count;
-                });
+        void worker_loop() {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (true) {
+                Batch *batch = nullptr;
+                m_task_cv.wait(lock, [&]() { return m_shutdown || (batch = pick_batch()) != nullptr; });
+                if (m_shutdown) return;
+                run_task(*batch, lock);
             }
+        }
 
-            // Join all worker threads
-            for (auto& w : workers) {
-                w.join();
+        // Batch to take an iteration from, nullptr if there is none. Called with the mutex locked.
+        Batch *pick_batch() const {
+            Batch *best = nullptr;
+            for (auto it = m_batches.rbegin(); it != m_batches.rend(); ++it) {
+                Batch *batch = *it;
+                if (!batch->group) {
+                    return batch;
+                }
+                const Group &g = *batch->group;
+                if (g.max_threads > 0 && g.running >= g.max_threads) {
+                    continue;
+                }
+                if (best == nullptr || g.priority > best->group->priority ||
+                    (g.priority == best->group->priority && g.virtual_time < best->group->virtual_time)) {
+                    best = batch;
+                }
             }
+            return best;
         }
 
-    private:
-        ThreadPool() : m_thread_count(std::max(1u, std::thread::hardware_concurrency())) {}
-        ~ThreadPool() = default;
-        ThreadPool(const ThreadPool&) = delete;
-        ThreadPool& operator=(const ThreadPool&) = delete;
+        // Run the next iteration of the batch, called with the mutex locked
+        void run_task(Batch &batch, std::unique_lock<std::mutex> &lock) {
+            const int task_idx = batch.next++;
+            // Only batches with iterations left to take are queued
+            if (batch.next == batch.end) {
+                m_batches.erase(std::find(m_batches.begin(), m_batches.end(), &batch));
+            }
+            Group *group = batch.group;
+            if (group) {
+                group->running++;
+            }
+            m_busy++;
+            const auto start = std::chrono::steady_clock::now();
+            lock.unlock();
+            std::exception_ptr exception;
+            try {
+                batch.run(batch.func, task_idx);
+            }
+            catch (...) {
+                exception = std::current_exception();
+            }
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            lock.lock();
+            m_busy--;
+            if (group) {
+                group->running--;
+                group->virtual_time += elapsed / group->weight;
+            }
 
-        unsigned int m_thread_count;
+            if (exception) {
+                if (!batch.exception) {
+                    batch.exception = exception;
+                    // Skip the iterations nobody took yet
+                    if (batch.next < batch.end) {
+                        batch.remaining -= batch.end - batch.next;
+                        batch.next = batch.end;
+                        m_batches.erase(std::find(m_batches.begin(), m_batches.end(), &batch));
+                    }
+                }
+            }
+            // The batch is not touched after its last iteration is counted
+            if (--batch.remaining == 0) {
+                m_done_cv.notify_all();
+            }
+            // A thread slot, or a slot under a group's thread cap, became free
+            if (m_waiting > 0 || (group && group->max_threads > 0)) {
+                m_task_cv.notify_all();
+            }
+        }
+
+        const unsigned int m_thread_count;
+        std::mutex m_mutex;
+        std::condition_variable m_task_cv;
+        std::condition_variable m_done_cv;
+        std::vector<Batch*> m_batches;
+        std::vector<std::thread> m_workers;
+        // Threads running an iteration, and callers of a loop with a group waiting for a slot
+        unsigned int m_busy = 0;
+        unsigned int m_waiting = 0;
+        bool m_shutdown = false;
     };
 
+    // Lock-free accumulation into a value shared between workers
+    // (`std::atomic<float>::fetch_add()` is not available on every toolchain we build with)
+    template <typename T>
+    inline void atomic_add(std::atomic<T> &dst, T val) {
+        T current = dst.load(std::memory_order_relaxed);
+        while (!dst.compare_exchange_weak(current, current + val, std::memory_order_relaxed)) {}
+    }
+
     template <typename F>
     inline void parallel_for(int start_idx, int end_idx, F &&func) {
         ThreadPool::instance().parallel_for(start_idx, end_idx, std::forward<F>(func));
     }
 
-}
\ No newline at end of file
+    // parallel_for whose iterations each produce a result, which `reduce(i, result)` receives in
+    // index order, one at a time, on the thread which finished the next iteration in order.
+    // Floating point sums accumulated in `reduce` then do not depend on how iterations were
+    // scheduled, so that repeated runs give bit-identical results.
+    template <typename T, typename Map, typename Reduce>
+    inline void ordered_parallel_for(int start_idx, int end_idx, Map &&map, Reduce &&reduce) {
+        if (start_idx >= end_idx) return;
+        std::mutex mutex;
+        std::vector<std::optional<T>> pending(end_idx - start_idx);
+        int next = start_idx;
+        parallel_for(start_idx, end_idx, [&](int i) {
+            T result = map(i);
+            std::lock_guard<std::mutex> lock(mutex);
+            pending[i - start_idx] = std::move(result);
+            while (next < end_idx && pending[next - start_idx]) {
+                reduce(next, std::move(*pending[next - start_idx]));
+                pending[next - start_idx].reset();
+                next++;
+            }
+        });
+    }
+
+}
@@ -24,18 +24,42 @@
 
 #pragma once
 
+#include <optional>
+
 #include <common.h>
 
 namespace Caramel{
+    // Rays through the neighbouring pixels in x and y, which estimate the footprint of a ray on the
+    // surfaces it hits (ray differentials)
+    struct RayDifferential{
+        Vector3f rx_o;
+        Vector3f rx_d;
+        Vector3f ry_o;
+        Vector3f ry_d;
+    };
+
     class Ray{
     public:
         Ray(const Vector3f &o, const Vector3f &d) : m_o{o}, m_d{d.normalize()},
             m_d_recip{Float1/m_d[0], Float1/m_d[1], Float1/m_d[2]},
             m_d_near_zero{Peanut::is_zero(m_d[0]), Peanut::is_zero(m_d[1]), Peanut::is_zero(m_d[2])} {}
 
+        // Shrink the differentials when a pixel takes several samples, each of which covers a part of it
+        void scale_differentials(Float s){
+            if(m_differential){
+                RayDifferential &rd = *m_differential;
+                rd.rx_o = m_o + (rd.rx_o - m_o) * s;
+                rd.ry_o = m_o + (rd.ry_o - m_o) * s;
+                rd.rx_d = m_d + (rd.rx_d - m_d) * s;
+                rd.ry_d = m_d + (rd.ry_d - m_d) * s;
+            }
+        }
+
         Vector3f m_o;
         Vector3f m_d;
         Vector3f m_d_recip;
         bool m_d_near_zero[3];
+        // Only camera rays and rays continuing their paths have them
+        std::optional<RayDifferential> m_differential;
     };
 }
@@ -24,23 +24,51 @@
 
 #pragma once
 
+#include <optional>
+
 #include <common.h>
 #include <coordinate.h>
+#include <textures.h>
 
 namespace Caramel{
     class Shape;
     class Ray;
+    struct RayDifferential;
 
     class RayIntersectInfo {
     public:
         RayIntersectInfo();
         Ray recursive_ray_to(const Vector3f &local_next_dir) const;
 
+        // Set `dpdu` and `dpdv` of a triangle with texture coordinates uv0, uv1, uv2 at p0, p1, p2
+        void set_triangle_derivatives(const Vector3f &p0, const Vector3f &p1, const Vector3f &p2,
+                                      const Vector2f &uv0, const Vector2f &uv1, const Vector2f &uv2);
+
+        // Footprint of the differentials of `ray` on the tangent plane of the hit, and the texture filter
+        // width it covers. Nothing is estimated for rays without differentials.
+        void compute_differentials(const Ray &ray);
+
+        TextureCoord tex_coord() const{ return {tex_uv, tex_width}; }
+
+        // Differentials of a ray continuing in `next_dir` (world space) from this hit of `ray`,
+        // following its differentials through a mirror reflection or a refraction of IOR ratio `eta`
+        std::optional<RayDifferential> specular_differential(const Ray &ray, const Vector3f &next_dir, Float eta) const;
+        // Differentials of a ray continuing in `next_dir` (world space) sampled with solid angle `pdf`
+        // from a rough bsdf. They spread over the cone of solid angle 1/pdf, the share of the lobe the
+        // sample stands for.
+        std::optional<RayDifferential> rough_differential(const Vector3f &next_dir, Float pdf) const;
+
         Vector3f p;   // World position where ray hits
         Coordinate sh_coord; // Coordinate initialized using world normal
         Float t;      // Length of the ray from origin to hitpoint
         const Shape *shape;    // Shape index in a scene
         Vector2f tex_uv; // Texture coordinate
         Index tri_index; // Triangle index within mesh (used by TriangleMesh)
+
+        Vector3f dpdu, dpdv; // Derivatives of `p` along the texture coordinates
+        // Set by `compute_differentials()`
+        bool has_differentials;
+        Vector3f dpdx, dpdy; // Offsets of the hits of the differential rays from `p`
+        Float tex_width;     // Texture filter width
     };
 }
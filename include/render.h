@@ -30,7 +30,10 @@ namespace Caramel{
     class Image;
     class Scene;
     class Integrator;
+    struct RenderConfig;
 
+    // `scene_path` is a scene description or a snapshot written by `SceneSnapshot::write()`
     std::pair<Scene*, Integrator*> build_scene(const std::filesystem::path &scene_path);
-    Image render(const Scene *scene, Integrator *integrator);
+    Image render(Scene *scene, Integrator *integrator);
+    Image render(Scene *scene, Integrator *integrator, const RenderConfig &config);
 }
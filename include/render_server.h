@@ -0,0 +1,134 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <json.hpp>
+
+#include <scene_updater.h>
+#include <scheduler.h>
+
+namespace Caramel{
+    class Scene;
+    class Integrator;
+    class Camera;
+
+    // Long running render process which keeps scenes resident between jobs, so that scene parsing,
+    // mesh loading and acceleration structure builds are paid once per scene.
+    // It reads one JSON request per line and answers each with one JSON line :
+    //   {"cmd" : "load", "id" : "box", "scene" : "box/scene.json"}
+    //   {"cmd" : "render", "id" : "box", "output" : "out.exr", "spp" : 64, "time_budget" : 2.5,
+    //    "target_error" : 0.01, "crop" : {"x_min" : 0, "y_min" : 0, "x_max" : 32, "y_max" : 32},
+    //    "camera" : {...}, "job" : "preview", "priority" : 1, "weight" : 1, "max_threads" : 2}
+    //   {"cmd" : "update", "id" : "box", "scene" : "box/scene.json"}
+    //   {"cmd" : "quit"}
+    // Keys of "render" other than "id" and "output" are optional. "camera" has the same format as in
+    // scene files and replaces the scene camera for the job. Relative paths are resolved against the
+    // working directory the server started in.
+    // Render jobs run in the background and share the workers of `JobScheduler` by their priority,
+    // weight and thread cap, so their responses may come in any order and carry the "job" name.
+    // Jobs on the same scene run concurrently too, except that a job with another camera than the
+    // previous one waits for the running jobs of the scene, since it repeats the training passes
+    // (light cache, path guiding) from its camera. "quit" waits for running jobs.
+    // "update" applies an edited scene file to a loaded scene, rebuilding only what changed
+    // (see `SceneUpdater`). It waits for running jobs first.
+    class RenderServer{
+        using Json = nlohmann::json;
+
+    public:
+        using Respond = std::function<void(const std::string&)>;
+
+        RenderServer();
+        ~RenderServer();
+
+        // Serve requests until "quit" or the end of input
+        void serve(std::istream &in, std::ostream &out);
+        // Serve clients of a UNIX domain socket one after another, until a client sends "quit"
+        void serve_socket(const std::string &socket_path);
+
+        // Handle a request line and pass its response line to `respond`, which is called later
+        // from a job thread for render requests. `respond` should stay valid until `wait_jobs()`.
+        void handle(const std::string &request, const Respond &respond);
+        void wait_jobs();
+        bool is_quit() const{ return m_quit; }
+
+    private:
+        struct ResidentScene{
+            std::unique_ptr<SceneUpdater> updater;
+            Scene *scene;
+            Integrator *integrator;
+            const Camera *scene_camera;
+            // Camera of the last job which had one, reused while jobs send the same camera
+            Camera *job_camera = nullptr;
+            std::string job_camera_json;
+            // Shared by the jobs rendering the scene, exclusive while one of them changes the camera
+            std::unique_ptr<std::shared_mutex> mutex = std::make_unique<std::shared_mutex>();
+        };
+
+        struct JobThread{
+            std::thread thread;
+            // Set by the thread when its job has responded
+            std::atomic<bool> done = false;
+        };
+
+        Json load(const Json &request);
+        Json update(const Json &request);
+        // Called from a job thread
+        Json render(const Json &request, ResidentScene &resident, JobScheduler::Job *job,
+                    std::chrono::steady_clock::time_point received);
+        // Camera of the job if the scene is trained for it, nullptr otherwise. Called with `resident.mutex` held.
+        static const Camera *trained_camera(const Json &request, const ResidentScene &resident);
+        // Set the job's camera as the scene camera and repeat the training passes.
+        // Called with `resident.mutex` held exclusively.
+        static void train_camera(const Json &request, ResidentScene &resident);
+        // Responses of concurrent jobs are not interleaved
+        void send(const Respond &respond, const Json &response);
+        // Join threads of finished jobs, so a long running server does not keep one per job
+        void reap_jobs();
+
+        std::filesystem::path resolve(const std::string &path) const;
+
+        std::filesystem::path m_base_dir;
+        std::unordered_map<std::string, ResidentScene> m_scenes;
+        std::list<JobThread> m_job_threads;
+        Index m_job_count = 0;
+        std::mutex m_respond_mutex;
+        bool m_quit = false;
+    };
+
+}
@@ -43,6 +43,10 @@ namespace Caramel{
         explicit UniformStdSampler(uint64_t seed, uint64_t stream = 1);
         Float sample_1d() override;
 
+        // Sampler for the samples of pixel (x, y) taken in a given pass. Its sequence depends only
+        // on these values and `seed`, not on which thread, tile or process renders the pixel.
+        static UniformStdSampler for_pixel(Index x, Index y, Index pass, uint64_t seed = 0);
+
     private:
         uint32_t next_uint32();
 
@@ -40,21 +40,34 @@ namespace Caramel{
     class Sampler;
     class ConstantEnvLight;
     class SceneAccel;
+    class LightCache;
 
     class Scene{
     public:
         Scene();
 
-        void set_camera(Camera *camera);
+        void set_camera(const Camera *camera);
 
         std::pair<bool, RayIntersectInfo> ray_intersect(const Ray &ray, Float maxt=INF) const;
         void add_mesh_and_arealight(const Shape *shape);
         void add_light(Light *light);
+        // Replace every shape, used by incremental updates. Lights are kept, call `build_accel()` after.
+        void set_meshes(const std::vector<const Shape*> &shapes);
+        // Replace every light with area lights of the shapes and `lights`, call `build_light_pdf()` after.
+        void set_lights(const std::vector<Light*> &lights);
         bool is_visible(const Vector3f &pos1, const Vector3f &pos2) const;
         std::pair<const Light*, Float> sample_light(Sampler &sampler) const;
+        // Select a light for shading position `pos`, using the light cache if it is built
+        std::pair<const Light*, Float> sample_light(const Vector3f &pos, Sampler &sampler) const;
         Float pdf_light(const Light *light) const;
+        // Probability that `light` is selected at shading position `pos`, matches `sample_light(pos, sampler)`
+        Float pdf_light(const Light *light, const Vector3f &pos) const;
         void build_accel();
         void build_light_pdf();
+        // Should be called after `build_accel()`, `build_light_pdf()` and `set_camera()`
+        void build_light_cache(Index resolution, Index training_spp);
+        // Lights are selected by their power again, the cache refers to the lights it was trained with
+        void clear_light_cache();
 
         std::vector<const Light*> m_lights;
         Distrib1D m_lights_pdf;
@@ -66,7 +79,10 @@ namespace Caramel{
         Float m_sceneRadius;
         AABB m_aabb;
         const Camera *m_cam;
+        // Every view of the scene file, `m_cam` is the one being rendered
+        std::vector<const Camera*> m_cameras;
         SceneAccel *m_accel;
+        LightCache *m_light_cache;
 
     };
 }
@@ -41,17 +41,19 @@ namespace Caramel{
     // Divide a single mesh
     class SceneAccel{
     public:
+        virtual ~SceneAccel() = default;
         virtual void build(const std::vector<const Shape*> &shapes) = 0;
         virtual std::pair<bool, RayIntersectInfo> ray_intersect(const Ray &ray, Float maxt) const = 0;
     };
 
     class BVHScene final : public SceneAccel {
     public:
+        ~BVHScene() override;
         void build(const std::vector<const Shape*> &shapes) override;
         std::pair<bool, RayIntersectInfo> ray_intersect(const Ray &ray, Float maxt) const override;
 
     public:
-        BVHTree<BVHSceneTraits> *m_bvh_root;
+        BVHTree<BVHSceneTraits> *m_bvh_root = nullptr;
     };
 
 
@@ -25,8 +25,11 @@
 #pragma once
 
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <ranges>
 #include <string>
+#include <tuple>
 #include <vector>
 #include <unordered_map>
 
@@ -43,30 +46,84 @@ namespace Caramel{
     class Light;
     class AreaLight;
     class Texture;
+    class SceneSnapshot;
+    enum class MeshStorage;
 
     class SceneParser{
         using Json = nlohmann::json;
 
     public:
         explicit SceneParser(const std::filesystem::path &path);
+        // Parse an already loaded description, e.g. a camera sent to the render server
+        explicit SceneParser(const nlohmann::json &scene_json);
+        // Parse the description of a snapshot, whose meshes and images are used from the snapshot
+        explicit SceneParser(std::shared_ptr<const SceneSnapshot> snapshot);
 
         void parse_bsdfs_map();
 
         Integrator* parse_integrator() const;
 
+        // Parse a single camera object
         Camera* parse_camera() const;
 
+        // Parse every view of the scene. "camera" is a camera object, an array of camera objects,
+        // or a camera object with a keyframed path :
+        //   "camera" : {"type" : "pinhole", ..., "frames" : 48,
+        //               "keyframes" : [{"time" : 0, "pos" : [...], "dir" : [...], "up" : [...]}, ...]}
+        // `frames` views are placed evenly from the first to the last keyframe time, pos, dir and up
+        // of a view are interpolated linearly between the surrounding keyframes.
+        std::vector<Camera*> parse_cameras() const;
+
+        // Shapes and lights are loaded in parallel on the thread pool, in the order of the scene file
         std::vector<Shape*> parse_shapes() const;
 
         std::vector<Light*> parse_lights() const;
 
+        // Load every image texture of the scene in parallel, so that parsing BSDFs finds them loaded
+        void load_textures() const;
+
+        // Share loaded image textures with other parsers, e.g. across updates of a scene.
+        // Textures are keyed by path and modification time of the image.
+        void set_texture_cache(std::unordered_map<std::string, Texture*> *cache){
+            m_texture_cache = cache;
+        }
+
     private:
+        // Parses shapes and lights entry by entry
+        friend class SceneUpdater;
+        // Loads the geometry of mesh entries while writing
+        friend class SceneSnapshot;
+
+        Camera* parse_camera(const Json &camera_json) const;
+
         Shape* parse_shape(const Json &shape_json) const;
 
+        // Where the mesh of an "obj", "ply" or "crmesh" entry, or of a mesh stored in the snapshot, is loaded from
+        struct MeshSource;
+        MeshSource parse_mesh_source(const Json &shape_json) const;
+
+        Shape* load_mesh(const Json &shape_json, BSDF *bsdf, AreaLight *arealight, const Matrix44f &transform) const;
+
+        // "eager" (default) or "lazy", see `LazyMesh`
+        bool parse_lazy_load(const Json &shape_json) const;
+
+        // Kind, path and load parameters of the geometry of a mesh entry in the asset registry
+        std::tuple<std::string, std::filesystem::path, std::string> mesh_template_id(const Json &shape_json, bool apply_to_world) const;
+
+        // Geometry of a mesh entry without material and emission, shared through the asset registry.
+        // It is in the space of the file, or transformed by "to_world" of the entry if `apply_to_world`.
+        std::shared_ptr<const Shape> parse_mesh_template(const Json &shape_json, bool apply_to_world) const;
+
+        // Whether the geometry of a mesh entry is referenced by several entries of "shape"
+        bool is_repeated_mesh(const Json &shape_json) const;
+
         // Expands a {"type":"instance", "shapes":[...], "instances":[...]} entry into one
         // Instance per (template sub-shape x placement); templates are loaded once and shared.
         void parse_instanced_shapes(const Json &shape_json, std::vector<Shape*> &out) const;
 
+        // "full" (default), "compact" or "quantized", see `MeshStorage`
+        MeshStorage parse_mesh_storage(const Json &shape_json) const;
+
         Light* parse_light(const Json &light_json) const;
 
         // Other lights are handled in `parse_light()`
@@ -76,6 +133,12 @@ namespace Caramel{
 
         Texture* parse_texture(const Json &texture_json) const;
 
+        // Loaded once per path and modification time, may be called by several threads
+        Texture* load_image_texture(const std::string &path) const;
+
+        // Unique paths of image textures anywhere in the description
+        std::vector<std::string> image_texture_paths() const;
+
         Json get_unique_first_elem(const Json &parent, const std::string &key, bool optional=false) const;
 
         Vector3f parse_vector3f(const Json &parent, const std::string &key) const;
@@ -93,7 +156,15 @@ namespace Caramel{
         Matrix44f parse_matrix44f(const Json &parent, const std::string &key) const;
 
         Json m_scene_json;
+        std::shared_ptr<const SceneSnapshot> m_snapshot;
         std::unordered_map<std::string, BSDF*> m_bsdf_map;
+        std::unordered_map<std::string, Texture*> *m_texture_cache = nullptr;
+        // Used when no cache is shared
+        mutable std::unordered_map<std::string, Texture*> m_texture_map;
+        mutable std::mutex m_texture_mutex;
+        // Number of entries referencing each mesh template, counted on first use
+        mutable std::unordered_map<std::string, Index> m_mesh_references;
+        mutable std::once_flag m_mesh_references_once;
     };
 
 }
@@ -0,0 +1,99 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <json.hpp>
+
+#include <common.h>
+
+namespace Caramel{
+    class Image;
+    class MappedFile;
+    class TiledImage;
+
+    // Built scene in a single file, so that rendering starts without parsing meshes, building their BVHs
+    // or decoding images. Written by `write()` from a scene description :
+    //   - every mesh entry (obj, ply, crmesh, including sub-shapes of instances) is loaded, transformed to
+    //     its world space and stored as a crmesh with its BVH, triangle distribution and boundary polygon
+    //   - image textures are stored as tiled mip pyramids and environment maps as decoded pixels
+    //   - the description itself, whose mesh entries refer to the stored meshes
+    // Meshes of full storage and environment maps are used in place from the memory mapped file, texture
+    // tiles are read from it on demand. The scene BVH, the light selection pdf and environment map
+    // distributions are rebuilt, which takes milliseconds.
+    class SceneSnapshot{
+    public:
+        using Json = nlohmann::json;
+
+        explicit SceneSnapshot(const std::filesystem::path &path);
+        ~SceneSnapshot();
+
+        SceneSnapshot(const SceneSnapshot&) = delete;
+        SceneSnapshot& operator=(const SceneSnapshot&) = delete;
+
+        // Relative paths of the description are resolved against its directory, as in `build_scene()`
+        static void write(const std::filesystem::path &scene_path, const std::filesystem::path &snapshot_path);
+
+        static bool is_snapshot(const std::filesystem::path &path);
+
+        const std::filesystem::path &path() const{ return m_path; }
+
+        const Json &scene_json() const{ return m_scene_json; }
+
+        const std::shared_ptr<const MappedFile> &file() const{ return m_file; }
+
+        // Image stored for `path` of the description, viewing the mapped pixels, or nullptr
+        Image *create_image(const std::string &path) const;
+        // Mip pyramid stored for the image texture at `path` of the description, or nullptr
+        std::shared_ptr<const TiledImage> create_tiled_image(const std::string &path) const;
+
+    private:
+        static constexpr char FILE_MAGIC[8] = {'C', 'R', 'M', 'S', 'C', 'N', 'E', '1'};
+
+        struct FileHeader{
+            std::uint32_t float_size;
+            std::uint32_t padding;
+            std::uint64_t json_offset;
+            std::uint64_t json_size;
+        };
+
+        struct ImageEntry{
+            std::uint64_t offset;
+            Index width;
+            Index height;
+        };
+
+        std::filesystem::path m_path;
+        std::shared_ptr<const MappedFile> m_file;
+        Json m_scene_json;
+        std::unordered_map<std::string, ImageEntry> m_images;
+        std::unordered_map<std::string, std::uint64_t> m_tiled_images;
+    };
+
+}
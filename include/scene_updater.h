@@ -0,0 +1,104 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <json.hpp>
+
+#include <common.h>
+
+namespace Caramel{
+    class Scene;
+    class Integrator;
+    class Camera;
+    class Shape;
+    class Light;
+    class Texture;
+
+    // Keeps a scene up to date with edits of its description, for interactive look development.
+    // `update()` diffs the new description against the previous one and rebuilds only what changed :
+    //   - shapes with unchanged geometry (type, transform, mesh file and its modification time, ...)
+    //     keep their mesh BVH, a changed material or emission is swapped in place
+    //   - the scene BVH is rebuilt only when shapes are added, removed or rebuilt
+    //   - the light selection pdf is rebuilt only when emitters change
+    //   - image textures stay in memory while their files are unchanged
+    // The first update builds the whole scene. Instanced shape entries are rebuilt as a whole.
+    class SceneUpdater{
+    public:
+        using Json = nlohmann::json;
+
+        struct UpdateStats{
+            Index shapes_kept = 0;
+            Index shapes_built = 0;
+            Index shapes_removed = 0;
+            Index materials_changed = 0;
+            Index lights_built = 0;
+            bool accel_rebuilt = false;
+            bool light_pdf_rebuilt = false;
+            bool camera_changed = false;
+            bool integrator_changed = false;
+        };
+
+        SceneUpdater();
+        ~SceneUpdater();
+
+        // Relative paths in the file are resolved against its directory, which becomes the working directory
+        UpdateStats update(const std::filesystem::path &scene_path);
+        // Relative paths are resolved against the working directory
+        UpdateStats update(const Json &scene_json);
+
+        // Owned by the updater, the integrator and cameras of the scene are replaced when they change
+        Scene *scene() const{ return m_scene; }
+        Integrator *integrator() const{ return m_integrator; }
+
+    private:
+        struct ShapeEntry{
+            // Description without material and emission
+            std::string geometry_key;
+            // Material with referenced BSDFs resolved
+            std::string bsdf_key;
+            std::string light_key;
+            std::vector<Shape*> shapes;
+        };
+
+        struct LightEntry{
+            std::string key;
+            Light *light;
+        };
+
+        Scene *m_scene;
+        Integrator *m_integrator = nullptr;
+        std::vector<Camera*> m_cameras;
+        std::string m_integrator_key;
+        std::string m_camera_key;
+        std::vector<ShapeEntry> m_shape_entries;
+        std::vector<LightEntry> m_light_entries;
+        std::unordered_map<std::string, Texture*> m_textures;
+    };
+
+}
@@ -0,0 +1,107 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <list>
+#include <mutex>
+
+#include <common.h>
+#include <parallel_for.h>
+
+namespace Caramel{
+
+    // Runs the tasks of concurrent render jobs on the workers of a `ThreadPool`, so that jobs and
+    // every other parallel_for of the process share one set of threads.
+    // Whenever a worker is free it takes one task (a tile) of the runnable job with the highest
+    // priority. Jobs of equal priority share the workers in proportion to their weights, by taking
+    // the job which used the least worker time per weight. A job never runs on more workers than
+    // its thread cap. Jobs are switched between tasks, so a higher priority job preempts lower ones
+    // at tile granularity without stopping them. See `ThreadPool::Group`.
+    class JobScheduler{
+    public:
+        struct JobOptions{
+            // Higher runs first
+            int priority = 0;
+            // Share of workers among jobs of the same priority
+            Float weight = 1;
+            // 0 = no cap
+            Index max_threads = 0;
+        };
+
+        struct JobStats{
+            Index tasks_done = 0;
+            // Worker time spent on the job's tasks
+            double busy_seconds = 0;
+            // From the first submitted task until a worker started it
+            double queue_seconds = 0;
+            // From creation of the job until now
+            double wall_seconds = 0;
+        };
+
+        class Job{
+        public:
+            // Run func(i) for i in [start_idx, end_idx) as tasks of this job, returns when all are done.
+            // If a task throws, tasks not started yet are dropped and the first exception is rethrown here.
+            void parallel_for(int start_idx, int end_idx, const std::function<void(int)> &func);
+            JobStats stats() const;
+
+        private:
+            friend class JobScheduler;
+            using Clock = std::chrono::steady_clock;
+
+            Job(JobScheduler &scheduler, const JobOptions &options);
+
+            JobScheduler &m_scheduler;
+            // Priority, weight and thread cap of the job's loops in the pool
+            ThreadPool::Group m_group;
+
+            mutable std::mutex m_stats_mutex;
+            JobStats m_stats;
+            const Clock::time_point m_created;
+            Clock::time_point m_first_submit;
+            bool m_started = false;
+        };
+
+        // Scheduler on the workers of `ThreadPool::instance()`
+        static JobScheduler& instance();
+
+        explicit JobScheduler(ThreadPool &pool);
+        ~JobScheduler();
+
+        Job *create_job(const JobOptions &options);
+        // The job should not be running a parallel_for
+        void destroy_job(Job *job);
+
+        Index thread_count() const{ return static_cast<Index>(m_pool.thread_count()); }
+
+    private:
+        ThreadPool &m_pool;
+        std::mutex m_mutex;
+        std::list<Job*> m_jobs;
+    };
+
+}
@@ -0,0 +1,121 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include <aabb.h>
+#include <common.h>
+
+namespace Caramel{
+    class Sampler;
+
+    // Directional quadtree over the sphere of directions (Müller et al. 2017, "Practical Path Guiding
+    // for Efficient Light-Transport Simulation"). Directions are mapped to the unit square with the
+    // equal-area cylindrical mapping (cos(theta), phi), so the quadtree is a piecewise-constant
+    // density over the square whose nodes are subdivided where most energy is found.
+    class DTree{
+    public:
+        static constexpr Index MAX_DEPTH = 20;
+
+        DTree();
+
+        // Accumulate `value` (incident radiance / sampling pdf) in every node containing `dir`, thread-safe
+        void record(const Vector3f &dir, Float value);
+
+        // Probability of sampling `dir` respect to solid angle
+        Float pdf(const Vector3f &dir) const;
+        Vector3f sample(Sampler &sampler) const;
+
+        Float total() const;
+        Index node_num() const;
+
+        // Returns a tree with zero energy whose structure follows the energy distribution of this tree :
+        // quadrants holding more than `threshold` of the total energy are subdivided.
+        DTree refined(Float threshold) const;
+
+    private:
+        struct Node{
+            Node();
+            Node(const Node &node);
+            Node &operator=(const Node &node);
+
+            bool is_leaf(Index quadrant) const { return child[quadrant] == 0; }
+            Float total() const;
+
+            std::array<std::atomic<Float>, 4> sum;
+            std::array<Index, 4> child; // 0 means leaf quadrant, root is never a child
+        };
+
+        void build_refined(DTree &out, Index out_idx, const Node *node, const std::array<Float, 4> &energy,
+                           Float energy_threshold, Index depth) const;
+
+        std::vector<Node> m_nodes;
+    };
+
+    // Spatial binary tree over the scene bounds whose leaves hold directional quadtrees.
+    // `sampling` is learned from the previous training pass and used for path guiding, while
+    // `building` collects radiance of the current pass. `refine()` splits leaves which received many
+    // samples and moves the collected distribution into `sampling`.
+    class SDTree{
+    public:
+        struct Leaf{
+            Leaf() = default;
+            Leaf(const Leaf &leaf);
+
+            DTree sampling;
+            DTree building;
+            std::atomic<Index> sample_num = 0;
+        };
+
+        explicit SDTree(const AABB &aabb);
+
+        Leaf &lookup(const Vector3f &pos);
+
+        // spatial_threshold : number of recorded vertices to split a spatial leaf
+        // directional_threshold : energy fraction to subdivide a directional quadrant
+        void refine(Float spatial_threshold, Float directional_threshold);
+
+        Index leaf_num() const;
+
+    private:
+        struct Node{
+            Index axis;
+            Index child[2]; // 0 means leaf, root is never a child
+            Index leaf_idx;
+        };
+
+        static constexpr Index MAX_DEPTH = 48;
+
+        void split(Index node_idx, Float spatial_threshold, Index depth);
+
+        AABB m_aabb;
+        Vector3f m_extent_inv;
+        std::vector<Node> m_nodes;
+        std::vector<Leaf> m_leaves;
+    };
+}
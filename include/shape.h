@@ -24,9 +24,17 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <vector>
 #include <tuple>
 #include <filesystem>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <span>
 
 #include <aabb.h>
 #include <common.h>
@@ -42,6 +50,7 @@ namespace Caramel{
     class Sampler;
     class Distrib1D;
     struct MeshAccel;
+    class MappedFile;
 
     class Shape{
     public:
@@ -74,6 +83,12 @@ namespace Caramel{
             return m_bsdf;
         }
 
+        // Material and emission can change without rebuilding the geometry
+        void set_bsdf(BSDF *bsdf){
+            m_bsdf = bsdf;
+        }
+        void set_arealight(AreaLight *arealight);
+
         template <typename Type, typename ...Param>
         static Shape* Create(Param ...args){
             return dynamic_cast<Shape*>(new Type(args...));
@@ -123,6 +138,16 @@ namespace Caramel{
         const bool is_tx_exists;
     };
 
+    // How triangle meshes store their vertex attributes
+    enum class MeshStorage{
+        // Float positions, normals and texture coordinates
+        Full,
+        // Octahedral 32 bit normals and 16 bit texture coordinates
+        Compact,
+        // Compact, and positions quantized to 16 bits per axis in the mesh bounding box
+        Quantized
+    };
+
     class TriangleMesh : public Shape{
     public:
         TriangleMesh(BSDF *bsdf, AreaLight *arealight);
@@ -137,7 +162,7 @@ namespace Caramel{
         bool is_solid_angle_sampling_possible() const override;
         const std::vector<Vector3f>& get_polygon_vertices() const override;
 
-        Index get_triangle_num() const { return m_face_indices.size(); }
+        Index get_triangle_num() const { return m_face_view.size(); }
         std::pair<bool, RayIntersectInfo> get_triangle_ray_intersect(Index i, const Ray &ray, Float maxt) const;
         AABB get_triangle_aabb(Index i) const;
         Float get_triangle_area(Index i) const;
@@ -146,8 +171,12 @@ namespace Caramel{
         Index sample_triangle_index(Float u) const;
         Float triangle_select_pdf(Index i) const;
 
+        // Bytes of attributes, faces, triangle distribution and BVH of the mesh
+        std::size_t memory_size() const;
+
     protected:
-        void finalize(AreaLight *arealight, const std::string &name);
+        // Loaders fill the float attribute arrays, which are packed here according to `storage`
+        void finalize(AreaLight *arealight, const std::string &name, MeshStorage storage = MeshStorage::Full);
 
         Distrib1D m_triangle_pdf;
         Float m_area = Float0;
@@ -159,20 +188,127 @@ namespace Caramel{
         std::vector<Vector3f> m_normals;
         std::vector<Vector2f> m_tex_coords;
         std::vector<Vector3i> m_face_indices;
+        // Arrays read by the mesh, which point to above vectors or to a mapped file
+        std::span<const Vector3f> m_vertex_view;
+        std::span<const Vector3f> m_normal_view;
+        std::span<const Vector2f> m_tex_coord_view;
+        std::span<const Vector3i> m_face_view;
 
         // for solid angle sampling
         std::vector<Vector3f> m_polygon_vertices;
         bool m_is_solid_angle_sampling_possible = false;
+
+        void set_polygon_vertices(std::vector<Vector3f> polygon, const std::string &name);
+        // Boundary of a planar mesh as a polygon for solid angle sampling, empty if it is not a simple polygon
+        std::vector<Vector3f> boundary_polygon() const;
+        void log_memory(const std::string &name) const;
+
+    private:
+        friend class CRMesh;
+
+        void bind_views();
+        void compute_aabb();
+        void pack_attributes(MeshStorage storage);
+
+        // Attributes of i-th vertex, decoded from packed arrays if needed
+        Vector3f vertex(Int i) const;
+        Vector3f vertex_normal(Int i) const;
+        Vector2f vertex_tex_coord(Int i) const;
+
+        MeshStorage m_storage = MeshStorage::Full;
+        // Used instead of m_vertices for MeshStorage::Quantized
+        std::vector<std::array<std::uint16_t, 3>> m_quantized_vertices;
+        Vector3f m_quantize_origin;
+        Vector3f m_quantize_scale;
+        // Used instead of m_normals and m_tex_coords for compact storages
+        std::vector<std::uint32_t> m_packed_normals;
+        std::vector<std::uint32_t> m_packed_tex_coords;
+        // Texture coordinates are 16 bit unorm if all of them are in [0, 1], half floats otherwise
+        bool m_tex_coords_unorm = false;
     };
 
     class PLYMesh final : public TriangleMesh{
     public:
-        PLYMesh(const std::filesystem::path &path, BSDF *bsdf, AreaLight *arealight = nullptr, const Matrix44f &transform = Matrix44f::identity());
+        PLYMesh(const std::filesystem::path &path, BSDF *bsdf, AreaLight *arealight = nullptr, const Matrix44f &transform = Matrix44f::identity(),
+                MeshStorage storage = MeshStorage::Full);
+
+        // Bounds of the transformed vertex positions, read without faces or building the mesh
+        static AABB read_aabb(const std::filesystem::path &path, const Matrix44f &transform = Matrix44f::identity());
+
+    private:
+        // Streams binary elements from the memory mapped file, returns false for ascii files
+        bool load_binary(const std::filesystem::path &path, const Matrix44f &transform);
+        void load_happly(const std::filesystem::path &path, const Matrix44f &transform);
     };
 
     class OBJMesh final : public TriangleMesh{
     public:
-        OBJMesh(const std::filesystem::path &path, BSDF *bsdf, AreaLight *arealight = nullptr, const Matrix44f &transform = Matrix44f::identity());
+        OBJMesh(const std::filesystem::path &path, BSDF *bsdf, AreaLight *arealight = nullptr, const Matrix44f &transform = Matrix44f::identity(),
+                MeshStorage storage = MeshStorage::Full);
+
+        // Bounds of the transformed vertex positions, read without faces or building the mesh.
+        // Vertices no face refers to are included, so they may be larger than the bounds of the mesh.
+        static AABB read_aabb(const std::filesystem::path &path, const Matrix44f &transform = Matrix44f::identity());
+
+    private:
+        // Memory mapped file parsed in parallel chunks, returns false for polygons with more than 4 vertices
+        bool load_fast(const std::filesystem::path &path, const Matrix44f &transform);
+        void load_tinyobj(const std::filesystem::path &path, const Matrix44f &transform);
+    };
+
+    // Mesh in the binary .crmesh format written by `convert()`. Vertex and face arrays and the BVH are used in place
+    // in the memory mapped file, so loading does not parse or build anything and the pages are shared between
+    // processes. Arrays are copied and rebuilt only if a transform or a compact storage is given.
+    class CRMesh final : public TriangleMesh{
+    public:
+        CRMesh(const std::filesystem::path &path, BSDF *bsdf, AreaLight *arealight = nullptr, const Matrix44f &transform = Matrix44f::identity(),
+               MeshStorage storage = MeshStorage::Full);
+        // Mesh written by `write()` at `offset` of an already mapped file, e.g. a scene snapshot
+        CRMesh(std::shared_ptr<const MappedFile> file, std::uint64_t offset, const std::string &name, BSDF *bsdf,
+               AreaLight *arealight = nullptr, const Matrix44f &transform = Matrix44f::identity(), MeshStorage storage = MeshStorage::Full);
+        ~CRMesh() override;
+
+        // Write a mesh of full storage with its BVH, triangle distribution and boundary polygon
+        static void convert(const TriangleMesh &mesh, const std::filesystem::path &path);
+        // Same contents as `convert()` at the current position of `stream`, which should be a multiple of
+        // SECTION_ALIGNMENT so that arrays are aligned when mapped
+        static void write(const TriangleMesh &mesh, std::ostream &stream);
+
+        // Bounds stored in the header, without loading the mesh
+        static AABB read_aabb(const std::filesystem::path &path);
+        static AABB read_aabb(const MappedFile &file, std::uint64_t offset, const std::string &name);
+
+        // Arrays are aligned to this in the file
+        static constexpr std::uint64_t SECTION_ALIGNMENT = 64;
+
+    private:
+        static constexpr char FILE_MAGIC[8] = {'C', 'R', 'M', 'M', 'E', 'S', 'H', '1'};
+
+        enum Section{ VERTICES, NORMALS, TEX_COORDS, FACES, TRIANGLE_PDF, TRIANGLE_CDF, BVH_NODES, BVH_PRIMITIVES, POLYGON, SECTION_COUNT };
+
+        struct FileHeader{
+            std::uint32_t float_size;
+            std::uint32_t has_normals;
+            std::uint32_t has_tex_coords;
+            std::uint32_t padding;
+            std::uint64_t vertex_count;
+            std::uint64_t face_count;
+            std::uint64_t bvh_node_count;
+            std::uint64_t bvh_primitive_count;
+            std::uint64_t polygon_vertex_count;
+            Float area;
+            Float aabb_min[3];
+            Float aabb_max[3];
+            // Byte offsets of sections from the beginning of the mesh
+            std::uint64_t offsets[SECTION_COUNT];
+        };
+
+        static std::shared_ptr<const MappedFile> map_file(const std::filesystem::path &path);
+        // Validated header of the mesh at `offset`
+        static FileHeader read_header(const MappedFile &file, std::uint64_t offset, const std::string &name);
+
+        // Shared with other meshes of the same snapshot, null if the mesh is copied
+        std::shared_ptr<const MappedFile> m_file;
     };
 
     class InlineTriangleMesh final : public TriangleMesh{
@@ -181,7 +317,8 @@ namespace Caramel{
                            std::vector<Vector3i> indices,
                            std::vector<Vector3f> normals,
                            BSDF *bsdf, AreaLight *arealight = nullptr,
-                           const Matrix44f &transform = Matrix44f::identity());
+                           const Matrix44f &transform = Matrix44f::identity(),
+                           MeshStorage storage = MeshStorage::Full);
     };
 
     // Instanced geometry. Shares a template Shape (kept in LOCAL space) and
@@ -193,6 +330,8 @@ namespace Caramel{
         // the top-level Shape* (this Instance), so the integrator reads get_bsdf()
         // from here, not from the template.
         Instance(const Shape *geometry, const Matrix44f &to_world, BSDF *bsdf, AreaLight *arealight = nullptr);
+        // The template is released with its last placement
+        Instance(std::shared_ptr<const Shape> geometry, const Matrix44f &to_world, BSDF *bsdf, AreaLight *arealight = nullptr);
 
         std::pair<bool, RayIntersectInfo> ray_intersect(const Ray &ray, Float maxt) const override;
         AABB get_aabb() const override;
@@ -207,6 +346,7 @@ namespace Caramel{
 
     private:
         const Shape *m_geometry;       // shared template, LOCAL space (intersection only)
+        std::shared_ptr<const Shape> m_geometry_owner;
         Matrix44f m_to_world;
         Matrix44f m_to_local;          // Inverse(to_world)
         AABB m_world_aabb;
@@ -215,6 +355,44 @@ namespace Caramel{
         std::vector<Vector3f> m_world_polygon_vertices;
     };
 
+    // Stands in for a mesh which is loaded when a ray first reaches its bounds, so that scenes larger than
+    // memory can be rendered with `GeometryCache`. The loaded mesh may be evicted and loaded again later.
+    // Meshes of lazy shapes do not emit, as sampling an emitter needs the whole mesh.
+    class LazyMesh final : public Shape{
+    public:
+        // `loader` is called from any thread, and may be called several times
+        LazyMesh(std::function<TriangleMesh*()> loader, const AABB &aabb, BSDF *bsdf);
+        ~LazyMesh() override;
+
+        std::pair<bool, RayIntersectInfo> ray_intersect(const Ray &ray, Float maxt) const override;
+        AABB get_aabb() const override;
+        Float get_area() const override;
+        std::tuple<Vector3f, Vector3f, Float> sample_point(Sampler &sampler) const override;
+        Float pdf_solidangle(const Vector3f &hitpos_world, const Vector3f &shapepos_world, const Vector3f &shape_normal_world) const override;
+        bool is_solid_angle_sampling_possible() const override;
+        const std::vector<Vector3f>& get_polygon_vertices() const override;
+
+        bool is_loaded() const;
+
+    private:
+        friend class GeometryCache;
+
+        // Loaded mesh, kept alive by the caller while it is used
+        std::shared_ptr<const TriangleMesh> acquire() const;
+        // Returns the mesh, which the cache frees once no ray can be reading it
+        std::shared_ptr<const TriangleMesh> evict() const;
+        void touch() const;
+        std::uint64_t last_use() const{ return m_last_use.load(std::memory_order_relaxed); }
+
+        std::function<TriangleMesh*()> m_loader;
+        AABB m_aabb;
+        mutable std::atomic<std::shared_ptr<const TriangleMesh>> m_mesh;
+        // Same mesh as `m_mesh`, read by rays inside a `GeometryCache::ReadScope`
+        mutable std::atomic<const TriangleMesh*> m_raw = nullptr;
+        mutable std::mutex m_load_mutex;
+        mutable std::atomic<std::uint64_t> m_last_use = 0;
+    };
+
     // u, v, t
     std::tuple<Float, Float, Float> moller_trumbore(const Ray &ray, const Vector3f &p0, const Vector3f &p1, const Vector3f &p2, Float maxt);
     // u, v, t
@@ -0,0 +1,106 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <common.h>
+
+namespace Caramel{
+    class TiledImage;
+
+    // Process-wide cache of tiles of TiledImages, which keeps texture memory under a budget however
+    // many textures a scene references. Tiles are read on their first lookup, and the least recently
+    // used ones are dropped when the cache is over the budget.
+    // Every thread keeps its last few tiles in a small cache of its own, so that lookups hitting them
+    // take no lock. Tiles are shared, a tile dropped by the cache is freed once no thread holds it.
+    class TextureCache{
+    public:
+        static TextureCache& instance() {
+            static TextureCache cache;
+            return cache;
+        }
+
+        static constexpr std::size_t DEFAULT_BUDGET = std::size_t(256) * 1024 * 1024;
+        // Tiles kept by each thread
+        static constexpr Index THREAD_CACHE_SIZE = 16;
+
+        // 0 means no limit
+        void set_budget(std::size_t bytes);
+        std::size_t budget() const;
+
+        std::size_t resident_bytes() const;
+        Index load_count() const;
+        Index eviction_count() const;
+
+        // Texel of a tile, the coordinates are in the level and inside it
+        Vector3f texel(const TiledImage &image, Index level, Index x, Index y);
+
+        // Drop the tiles of an image, called when it is destroyed
+        void remove(std::uint64_t image_id);
+
+    private:
+        TextureCache() = default;
+
+        struct TileKey{
+            std::uint64_t image_id;
+            Index level;
+            Index tile;
+
+            bool operator==(const TileKey &other) const = default;
+        };
+
+        struct TileKeyHash{
+            std::size_t operator()(const TileKey &key) const{
+                return std::hash<std::uint64_t>()(key.image_id * 0x9E3779B97F4A7C15ull ^ (std::uint64_t(key.level) << 32 | key.tile));
+            }
+        };
+
+        using Tile = std::vector<Float>;
+
+        struct Entry{
+            std::shared_ptr<const Tile> tile;
+            std::list<TileKey>::iterator lru;
+        };
+
+        // Tile from the shared cache, read from the image if it is not there
+        std::shared_ptr<const Tile> fetch(const TiledImage &image, const TileKey &key, Index tile_x, Index tile_y);
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<TileKey, Entry, TileKeyHash> m_tiles;
+        // Most recently used first
+        std::list<TileKey> m_lru;
+        std::size_t m_resident_bytes = 0;
+        std::size_t m_budget = DEFAULT_BUDGET;
+        Index m_load_count = 0;
+        Index m_eviction_count = 0;
+    };
+
+}
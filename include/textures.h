@@ -24,19 +24,29 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 
 #include <common.h>
 
 namespace Caramel{
-    class Image;
+    class TiledImage;
+
+    // Texture coordinate with the width of the footprint to filter around it, in texture space.
+    // Width 0 looks up the finest detail.
+    struct TextureCoord{
+        TextureCoord(const Vector2f &uv, Float width = Float0) : uv{uv}, width{width} {}
+
+        Vector2f uv;
+        Float width;
+    };
 
     class Texture{
     public:
         Texture() = default;
         virtual ~Texture() = default;
 
-        virtual Vector3f get_val(const Vector2f &uv) const = 0;
+        virtual Vector3f get_val(const Vector2f &uv, Float width) const = 0;
 
         template <typename Type, typename ...Param>
         static Texture* Create(Param ...args){
@@ -47,11 +57,17 @@ namespace Caramel{
     class ImageTexture final : public Texture {
     public:
         explicit ImageTexture(const std::string &path);
-        virtual ~ImageTexture();
-        Vector3f get_val(const Vector2f &uv) const override;
+        explicit ImageTexture(std::shared_ptr<const TiledImage> image);
+        // Nearest texel of the finest level for width 0, otherwise trilinear filtering between the
+        // two mip levels whose texels are closest to the width
+        Vector3f get_val(const Vector2f &uv, Float width) const override;
 
     private:
-        Image *m_img;
+        // Read tile by tile through the texture cache, shared with other textures of the same file
+        // through the asset registry
+        std::shared_ptr<const TiledImage> m_img;
+
+        Vector3f bilinear(Index level, const Vector2f &uv) const;
     };
 
 }
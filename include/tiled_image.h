@@ -0,0 +1,111 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include <common.h>
+
+namespace Caramel{
+    class Image;
+    class MappedFile;
+
+    // Mip pyramid of an image stored as square tiles in a .crtex file, read tile by tile through the
+    // TextureCache, so that a texture never needs to be resident as a whole :
+    //   - level 0 is the image, every next level halves the previous one with a box filter down to 1x1
+    //   - levels are split into TILE_SIZE x TILE_SIZE tiles of RGB texels, stored row by row. Tiles on
+    //     the right and bottom edges are padded with the last texels.
+    // The pyramid of an image file is built on its first use and cached in the temporary directory,
+    // where it is rebuilt when the file changes.
+    class TiledImage{
+    public:
+        static constexpr Index TILE_SIZE = 64;
+        static constexpr std::size_t TILE_BYTES = TILE_SIZE * TILE_SIZE * 3 * sizeof(Float);
+
+        // Pyramid of the image file
+        explicit TiledImage(const std::filesystem::path &image_path);
+        // Pyramid written by `write()` at `offset` of the file, e.g. in a scene snapshot
+        TiledImage(const std::filesystem::path &file_path, std::uint64_t offset);
+
+        TiledImage(const TiledImage&) = delete;
+        TiledImage& operator=(const TiledImage&) = delete;
+        ~TiledImage();
+
+        // Unique for the process, tiles in the TextureCache are keyed by it
+        std::uint64_t id() const{ return m_id; }
+        Index level_count() const{ return static_cast<Index>(m_levels.size()); }
+        Vector2ui size(Index level) const{ return Vector2ui{m_levels[level].width, m_levels[level].height}; }
+
+        // Texel of the level through the TextureCache, coordinates are clamped to the level
+        Vector3f texel(Index level, Int x, Int y) const;
+
+        // Texels of a tile, read from the file. Threads read tiles at the same time.
+        std::vector<Float> read_tile(Index level, Index tile_x, Index tile_y) const;
+
+        // Write the pyramid of `image`. `source_size` and `source_time` identify the file it is
+        // built from, a cached pyramid of other values is rebuilt.
+        static void write(const Image &image, std::ostream &stream, std::uint64_t source_size = 0, std::int64_t source_time = 0);
+
+        // Where the pyramid of the image file is cached
+        static std::filesystem::path cache_path(const std::filesystem::path &image_path);
+
+    private:
+        static constexpr char FILE_MAGIC[8] = {'C', 'R', 'M', 'T', 'E', 'X', '0', '1'};
+
+        struct FileHeader{
+            std::uint32_t float_size;
+            std::uint32_t tile_size;
+            std::uint32_t width;
+            std::uint32_t height;
+            std::uint64_t source_size;
+            std::int64_t source_time;
+        };
+
+        struct Level{
+            Index width;
+            Index height;
+            Index tiles_x;
+            // Of its first tile, from the start of the file
+            std::uint64_t offset;
+        };
+
+        // Levels of an image, with offsets of a pyramid starting at `offset`
+        static std::vector<Level> levels(Index width, Index height, std::uint64_t offset);
+        // Header of the pyramid at `offset` of the stream, false if it is not a pyramid of this build
+        static bool read_header(std::istream &stream, std::uint64_t offset, FileHeader &header);
+
+        void open(const std::filesystem::path &file_path, std::uint64_t offset);
+
+        std::uint64_t m_id;
+        std::vector<Level> m_levels;
+        // Tiles are copied from the mapped file, so that reads need no lock
+        std::unique_ptr<const MappedFile> m_file;
+    };
+
+}
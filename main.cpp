@@ -25,23 +25,226 @@
 #include "scene.h"
 
 
+#include <cstdio>
+#include <future>
+#include <memory>
+
+#include <camera.h>
+#include <film.h>
+#include <geometry_cache.h>
 #include <image.h>
+#include <integrators.h>
 #include <logger.h>
 #include <render.h>
+#include <render_server.h>
+#include <scene_snapshot.h>
+#include <shape.h>
+#include <texture_cache.h>
 
 using namespace Caramel;
 
 int main(int argc, char* argv[]) {
 
     if(argc <= 1){
-        CRM_ERROR("Usage : ./caramel [path to scene file]")
+        CRM_ERROR("Usage : ./caramel [path to scene file] [--time seconds] [--target-error relative error] "
+                  "[--checkpoint file] [--checkpoint-interval seconds] [--resume file] "
+                  "[--region x_min,y_min,x_max,y_max] [--tiles index/count] [--film file] [--geometry-budget MB] [--texture-budget MB]\n"
+                  "        ./caramel --merge [output exr] [film files...]\n"
+                  "        ./caramel --convert [input obj or ply] [output crmesh]\n"
+                  "        ./caramel --snapshot [scene file] [output crscene]\n"
+                  "        ./caramel --server [socket path]")
+    }
+
+    // Keep scenes resident and render jobs read from stdin, or from a UNIX domain socket if given
+    if(std::string(argv[1]) == "--server"){
+        RenderServer server;
+        if(argc > 2){
+            server.serve_socket(argv[2]);
+        }
+        else{
+            // stdout carries the responses
+            Logger::set_stream(std::cerr);
+            server.serve(std::cin, std::cout);
+        }
+        return 0;
+    }
+
+    // Assemble partial films of a distributed render into one image
+    if(std::string(argv[1]) == "--merge"){
+        if(argc <= 3){
+            CRM_ERROR("Usage : ./caramel --merge [output exr] [film files...]")
+        }
+        Film film;
+        for(int i=3;i<argc;i++){
+            film.merge(argv[i]);
+        }
+        Image img(film.width(), film.height());
+        film.write_to(img, film.full_region());
+        img.write_exr(argv[2]);
+        return 0;
+    }
+
+    // Write a mesh in the binary format loaded by "crmesh" shapes
+    if(std::string(argv[1]) == "--convert"){
+        if(argc != 4){
+            CRM_ERROR("Usage : ./caramel --convert [input obj or ply] [output crmesh]")
+        }
+        const std::filesystem::path input(argv[2]);
+        std::unique_ptr<TriangleMesh> mesh;
+        if(input.extension() == ".obj"){
+            mesh = std::make_unique<OBJMesh>(input, nullptr);
+        }
+        else if(input.extension() == ".ply"){
+            mesh = std::make_unique<PLYMesh>(input, nullptr);
+        }
+        else{
+            CRM_ERROR("Unsupported mesh file : " + input.string())
+        }
+        CRMesh::convert(*mesh, argv[3]);
+        return 0;
+    }
+
+    // Write the built scene, which is rendered like a scene file and starts without loading assets
+    if(std::string(argv[1]) == "--snapshot"){
+        if(argc != 4){
+            CRM_ERROR("Usage : ./caramel --snapshot [scene file] [output crscene]")
+        }
+        SceneSnapshot::write(argv[2], argv[3]);
+        return 0;
+    }
+
+    // --time : render passes until the wall-clock budget is used up
+    // --target-error : stop sampling pixels whose relative error falls below it
+    // --checkpoint : periodically save the render progress to the file
+    // --resume : continue the render saved in the file, and keep checkpointing to it
+    // --region : render only pixels in [x_min, x_max) x [y_min, y_max)
+    // --tiles : render only the index-th of every count tiles, to split an image between jobs
+    // --film : save the film of the rendered pixels to the file, to be merged with `--merge`
+    // --geometry-budget : memory for meshes of shapes with "load" : "lazy", least recently used ones are evicted
+    // --texture-budget : memory for tiles of image textures, 256MB by default
+    RenderConfig config;
+    const auto parse_positive = [](const std::string &option, const std::string &value){
+        const Float v = std::stof(value);
+        if(v <= 0){
+            CRM_ERROR("Value of option should be positive : " + option)
+        }
+        return v;
+    };
+    for(int i=2;i<argc;i++){
+        const std::string option(argv[i]);
+        if(i + 1 >= argc){
+            CRM_ERROR("Missing value of option : " + option)
+        }
+        const std::string value(argv[++i]);
+        if(option == "--time"){
+            config.time_budget = parse_positive(option, value);
+        }
+        else if(option == "--target-error"){
+            config.target_error = parse_positive(option, value);
+        }
+        else if(option == "--checkpoint"){
+            config.checkpoint_path = std::filesystem::absolute(value).string();
+        }
+        else if(option == "--checkpoint-interval"){
+            config.checkpoint_interval = parse_positive(option, value);
+        }
+        else if(option == "--resume"){
+            config.checkpoint_path = std::filesystem::absolute(value).string();
+            config.resume = true;
+        }
+        else if(option == "--region"){
+            ImageRegion &r = config.region;
+            if(std::sscanf(value.c_str(), "%u,%u,%u,%u", &r.x_min, &r.y_min, &r.x_max, &r.y_max) != 4 || r.is_empty()){
+                CRM_ERROR("Invalid region : " + value)
+            }
+        }
+        else if(option == "--tiles"){
+            if(std::sscanf(value.c_str(), "%u/%u", &config.tile_index, &config.tile_count) != 2 ||
+               config.tile_index >= config.tile_count){
+                CRM_ERROR("Invalid tiles : " + value)
+            }
+        }
+        else if(option == "--film"){
+            config.film_path = std::filesystem::absolute(value).string();
+        }
+        else if(option == "--geometry-budget"){
+            GeometryCache::instance().set_budget(static_cast<std::size_t>(parse_positive(option, value) * 1024 * 1024));
+        }
+        else if(option == "--texture-budget"){
+            TextureCache::instance().set_budget(static_cast<std::size_t>(parse_positive(option, value) * 1024 * 1024));
+        }
+        else{
+            CRM_ERROR("Unknown option : " + option)
+        }
     }
 
     const std::filesystem::path scene_path((std::string(argv[1])));
     auto [scene, integrator] = build_scene(scene_path);
 
-    Image img = render(scene, integrator);
-    img.write_exr(scene_path.stem().string() + ".exr");
+    const std::string stem = scene_path.stem().string();
+    // Checkpoints and films hold a single image
+    const std::vector<const Camera*> views = scene->m_cameras;
+    if(views.size() > 1 && (!config.checkpoint_path.empty() || !config.film_path.empty())){
+        CRM_ERROR("--checkpoint, --resume and --film can not be used with multiple cameras")
+    }
+
+    const MCIntegrator *mc_integrator = dynamic_cast<MCIntegrator*>(integrator);
+    const bool progressive = config.time_budget > 0 || config.target_error > 0 || !config.checkpoint_path.empty() ||
+                             config.tile_count > 1 || !config.film_path.empty();
+    // A job which saves its film leaves the image to `--merge`, so jobs of a split render
+    // sharing a directory do not overwrite each other's EXR
+    const bool write_image = config.film_path.empty();
+    // Also write how many samples each pixel took
+    const bool write_spp = write_image && mc_integrator && (progressive || mc_integrator->is_adaptive());
+
+    // Views are rendered one after another with the same scene, and the images of a view are
+    // written while the next one is traced. Multiple views are written as <stem>_0000.exr, ...
+    // and a tile set of `--tiles index/count` as <stem>_tile<index>of<count>.exr
+    std::future<void> pending_write;
+    for(Index i=0;i<views.size();i++){
+        scene->set_camera(views[i]);
+
+        std::string name = stem;
+        if(views.size() > 1){
+            char frame[16];
+            std::snprintf(frame, sizeof(frame), "_%04u", i);
+            name += frame;
+        }
+        if(config.tile_count > 1){
+            name += "_tile" + std::to_string(config.tile_index) + "of" + std::to_string(config.tile_count);
+        }
+        // A cropped render is written with its region as the EXR data window
+        const ImageRegion crop = !config.region.is_empty() ? config.region : views[i]->get_crop();
+
+        const auto [width, height] = views[i]->get_size();
+        auto spp_img = write_spp ? std::make_unique<Image>(width, height) : nullptr;
+        config.spp_aov = spp_img.get();
+        Image img = render(scene, integrator, config);
+        if(!write_image){
+            continue;
+        }
+
+        if(pending_write.valid()){
+            pending_write.get();
+        }
+        pending_write = std::async(std::launch::async, [name, crop, img = std::move(img), spp_img = std::move(spp_img)](){
+            const auto write_exr = [&crop](const Image &image, const std::string &filename){
+                if(crop.is_empty()){
+                    image.write_exr(filename);
+                }
+                else{
+                    image.write_exr(filename, crop);
+                }
+            };
+            write_exr(img, name + ".exr");
+            if(spp_img){
+                write_exr(*spp_img, name + "_spp.exr");
+            }
+        });
+    }
+    if(pending_write.valid()){
+        pending_write.get();
+    }
 
     return 0;
 }
@@ -27,6 +27,7 @@
 
 #include <common.h>
 #include <ray.h>
+#include <transform.h>
 
 namespace Caramel{
     AABB::AABB() : m_min{INF, INF, INF}, m_max{-INF, -INF, -INF} {}
@@ -56,6 +57,19 @@ namespace Caramel{
                m_min[2] <= vec[2] && vec[2] <= m_max[2];
     }
 
+    AABB AABB::transformed(const Matrix44f &mat) const{
+        Vector3f mn{INF, INF, INF};
+        Vector3f mx{-INF, -INF, -INF};
+        for(Index i = 0; i < 8; ++i){
+            const Vector3f c = transform_point(corner(i), mat);
+            for(int a = 0; a < 3; ++a){
+                mn[a] = std::min(mn[a], c[a]);
+                mx[a] = std::max(mx[a], c[a]);
+            }
+        }
+        return {mn, mx};
+    }
+
     Vector3f AABB::corner(Index i) const{
         return {i & 1 ? m_min[0] : m_max[0],
                 i & 2 ? m_min[1] : m_max[1],
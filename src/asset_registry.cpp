@@ -0,0 +1,77 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <algorithm>
+
+#include <asset_registry.h>
+
+namespace Caramel{
+
+    std::string AssetRegistry::key(const std::string &kind, const std::filesystem::path &path, const std::string &params) {
+        std::error_code ec;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(path, ec);
+        if(ec){
+            canonical = std::filesystem::absolute(path);
+        }
+        const auto mtime = std::filesystem::last_write_time(canonical, ec);
+        return kind + ":" + canonical.string() + "@" + std::to_string(ec ? 0 : mtime.time_since_epoch().count()) + ":" + params;
+    }
+
+    std::shared_ptr<const void> AssetRegistry::get_erased(const std::string &key, const std::function<std::shared_ptr<const void>()> &load) {
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // Drop entries of released assets now and then, so that keys of edited files do not pile up.
+            // Entries used by another request are kept, their asset may be loading.
+            if(m_entries.size() >= m_prune_size){
+                std::erase_if(m_entries, [](const auto &item){
+                    return item.second.use_count() == 1 && item.second->asset.expired();
+                });
+                m_prune_size = std::max<std::size_t>(m_entries.size() * 2, MIN_PRUNE_SIZE);
+            }
+            auto &slot = m_entries[key];
+            if(slot == nullptr){
+                slot = std::make_shared<Entry>();
+            }
+            entry = slot;
+        }
+
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if(auto asset = entry->asset.lock()){
+            return asset;
+        }
+        auto asset = load();
+        entry->asset = asset;
+        return asset;
+    }
+
+    Index AssetRegistry::size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Index count = 0;
+        for(const auto &[key, entry] : m_entries){
+            count += entry->asset.expired() ? 0 : 1;
+        }
+        return count;
+    }
+
+}
@@ -39,7 +39,7 @@ namespace Caramel{
         m_in_ior_img = IOR::k_map.find(mat)->second;
     }
 
-    std::tuple<Vector3f, Vector3f, Float> Conductor::sample_recursive_dir(const Vector3f &local_incoming_dir, const Vector2f &, Sampler &sampler) const {
+    std::tuple<Vector3f, Vector3f, Float> Conductor::sample_recursive_dir(const Vector3f &local_incoming_dir, const TextureCoord &, Sampler &sampler) const {
         const Vector3f local_outgoing{local_incoming_dir[0], local_incoming_dir[1], -local_incoming_dir[2]};
         const Float local_incoming_cos = -local_incoming_dir[2];
 
@@ -54,7 +54,7 @@ namespace Caramel{
         return Float0;
     }
 
-    Vector3f Conductor::get_reflection(const Vector3f &, const Vector3f &, const Vector2f &) const {
+    Vector3f Conductor::get_reflection(const Vector3f &, const Vector3f &, const TextureCoord &) const {
         return vec3f_zero;
     }
 
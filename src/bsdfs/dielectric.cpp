@@ -31,7 +31,7 @@ namespace Caramel{
 
     Dielectric::Dielectric(Float in_ior, Float ex_ior) : m_in_index_of_refraction{in_ior}, m_ex_index_of_refraction{ex_ior} {}
 
-    std::tuple<Vector3f, Vector3f, Float> Dielectric::sample_recursive_dir(const Vector3f &local_incoming_dir, const Vector2f &, Sampler &sampler) const {
+    std::tuple<Vector3f, Vector3f, Float> Dielectric::sample_recursive_dir(const Vector3f &local_incoming_dir, const TextureCoord &, Sampler &sampler) const {
         // Multiply -1 to calculate cosine, since we use incoming direction as point-toward direction
         // Values varies on `local_incoming_cos`
         Vector3f n{Float0, Float0, Float1};
@@ -67,7 +67,7 @@ namespace Caramel{
         return Float0;
     }
 
-    Vector3f Dielectric::get_reflection(const Vector3f &, const Vector3f &, const Vector2f &) const {
+    Vector3f Dielectric::get_reflection(const Vector3f &, const Vector3f &, const TextureCoord &) const {
         return vec3f_zero;
     }
 
@@ -75,5 +75,10 @@ namespace Caramel{
         return true;
     }
 
+    Float Dielectric::eta(bool frontside) const {
+        return frontside ? m_ex_index_of_refraction / m_in_index_of_refraction :
+                           m_in_index_of_refraction / m_ex_index_of_refraction;
+    }
+
 
 }
\ No newline at end of file
@@ -39,22 +39,22 @@ namespace Caramel{
         delete m_texture;
     }
 
-    std::tuple<Vector3f, Vector3f, Float> Diffuse::sample_recursive_dir(const Vector3f &, const Vector2f &uv, Sampler &sampler) const {
+    std::tuple<Vector3f, Vector3f, Float> Diffuse::sample_recursive_dir(const Vector3f &, const TextureCoord &tex, Sampler &sampler) const {
         auto [local_outgoing, dir_pdf] = sample_unit_hemisphere_cosine(sampler);
-        return {local_outgoing, m_texture == nullptr ? m_albedo : m_texture->get_val(uv), dir_pdf};
+        return {local_outgoing, m_texture == nullptr ? m_albedo : m_texture->get_val(tex.uv, tex.width), dir_pdf};
     }
 
     Float Diffuse::pdf(const Vector3f &, const Vector3f &local_outgoing_dir) const{
         return sample_unit_hemisphere_cosine_pdf(local_outgoing_dir);
     }
 
-    Vector3f Diffuse::get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const Vector2f &uv) const {
+    Vector3f Diffuse::get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const TextureCoord &tex) const {
         if(local_incoming_dir[2] >= Float0 || local_outgoing_dir[2] <= Float0){
             // Not allow ray from backside
             return vec3f_zero;
         }
 
-        return (m_texture == nullptr ? m_albedo : m_texture->get_val(uv)) * PI_INV;
+        return (m_texture == nullptr ? m_albedo : m_texture->get_val(tex.uv, tex.width)) * PI_INV;
     }
 
     bool Diffuse::is_discrete(bool /*frontside*/) const{
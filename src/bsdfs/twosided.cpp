@@ -35,7 +35,7 @@ namespace Caramel{
 
     TwoSided::TwoSided(BSDF *front, BSDF *back) : m_front{front}, m_back{back} {}
 
-    std::tuple<Vector3f, Vector3f, Float> TwoSided::sample_recursive_dir(const Vector3f &local_incoming_dir, const Vector2f &uv, Sampler &sampler) const {
+    std::tuple<Vector3f, Vector3f, Float> TwoSided::sample_recursive_dir(const Vector3f &local_incoming_dir, const TextureCoord &uv, Sampler &sampler) const {
         const bool frontside = local_incoming_dir[2] < Float0;
         const Vector3f flipped_in = frontside ? local_incoming_dir : flip_z(local_incoming_dir);
         const BSDF *bsdf = frontside ? m_front : m_back;
@@ -51,7 +51,7 @@ namespace Caramel{
                            m_back->pdf(flip_z(local_incoming_dir), flip_z(local_outgoing_dir));
     }
 
-    Vector3f TwoSided::get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const Vector2f &uv) const {
+    Vector3f TwoSided::get_reflection(const Vector3f &local_incoming_dir, const Vector3f &local_outgoing_dir, const TextureCoord &uv) const {
         const bool frontside = local_incoming_dir[2] < Float0;
         return frontside ? m_front->get_reflection(local_incoming_dir, local_outgoing_dir, uv) :
                            m_back->get_reflection(flip_z(local_incoming_dir), flip_z(local_outgoing_dir), uv);
@@ -61,4 +61,8 @@ namespace Caramel{
         return (frontside ? m_front : m_back)->is_discrete(true);
     }
 
+    Float TwoSided::eta(bool frontside) const {
+        return (frontside ? m_front : m_back)->eta(true);
+    }
+
 }
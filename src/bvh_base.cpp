@@ -183,8 +183,14 @@ namespace Caramel{
         root.create_child(traits, cost_traversal, cost_intersection, subspace_count, max_primitive_num);
         int offset = 0;
         root.flatten_recursive(m_nodes, m_ordered_primitives, offset);
+        m_node_view = m_nodes;
+        m_primitive_view = m_ordered_primitives;
     }
 
+    template<typename Traits>
+    BVHTree<Traits>::BVHTree(std::span<const LinearBVHNode> nodes, std::span<const Primitive> ordered_primitives, const Traits &traits)
+    : m_traits{traits}, m_node_view{nodes}, m_primitive_view{ordered_primitives} {}
+
     template<typename Traits>
     std::pair<bool, RayIntersectInfo> BVHTree<Traits>::ray_intersect(const Ray &ray, Float maxt) const{
         bool is_hit = false;
@@ -196,13 +202,13 @@ namespace Caramel{
         int current = 0;
 
         while (true) {
-            const LinearBVHNode &node = m_nodes[current];
+            const LinearBVHNode &node = m_node_view[current];
 
             if (node.aabb.ray_intersect(ray, info.t).first) {
                 if (node.n_primitives > 0) {
                     // Leaf: test primitives
                     for (int i = 0; i < node.n_primitives; i++) {
-                        auto [hit, tmp_info] = m_traits.ray_intersect(m_ordered_primitives[node.offset + i], ray, info.t);
+                        auto [hit, tmp_info] = m_traits.ray_intersect(m_primitive_view[node.offset + i], ray, info.t);
                         if (hit) {
                             is_hit = true;
                             info = tmp_info;
@@ -27,6 +27,7 @@
 #include <common.h>
 #include <transform.h>
 #include <ray.h>
+#include <logger.h>
 
 namespace Caramel{
 
@@ -83,4 +84,11 @@ namespace Caramel{
 
         m_sample_to_camera = Inverse(camera_to_sample);
     }
+
+    void Camera::set_crop(const ImageRegion &crop) {
+        if(!crop.is_empty() && (crop.x_max > m_w || crop.y_max > m_h)){
+            CRM_ERROR("Crop window is out of the image");
+        }
+        m_crop = crop;
+    }
 }
@@ -38,12 +38,18 @@ namespace Caramel{
         : Camera(pos, dir, up, w, h, fov_x) {}
 
     [[nodiscard]] Ray Pinhole::sample_ray(Float w, Float h, Sampler &) const{
-        Vector4f local_d = (m_sample_to_camera * Vector4f(w / static_cast<Float>(m_w),
-                                                          h / static_cast<Float>(m_h),
-                                                          Float0, Float1));
-        local_d[3] = Float0;
-        const Vector3f d = Block<0,0,3,1>(m_cam_to_world * local_d);
+        const auto direction = [this](Float w, Float h){
+            Vector4f local_d = (m_sample_to_camera * Vector4f(w / static_cast<Float>(m_w),
+                                                              h / static_cast<Float>(m_h),
+                                                              Float0, Float1));
+            local_d[3] = Float0;
+            const Vector3f d = Block<0,0,3,1>(m_cam_to_world * local_d);
+            return d.normalize();
+        };
 
-        return {m_pos, d.normalize()};
+        Ray ray{m_pos, direction(w, h)};
+        // Rays through the next pixels share the origin
+        ray.m_differential = RayDifferential{m_pos, direction(w + Float1, h), m_pos, direction(w, h + Float1)};
+        return ray;
     }
 }
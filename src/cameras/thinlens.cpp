@@ -41,14 +41,23 @@ namespace Caramel{
     [[nodiscard]] Ray ThinLens::sample_ray(Float w, Float h, Sampler &sampler) const{
         // 1. Calculate ray direction for a pinhole camera
         // Pinhole ray direction in camera space (origin is 0,0,0)
-        Vector3f local_d_pinhole = Vector3f(Block<0,0,3,1>(m_sample_to_camera * Vector4f(w / static_cast<Float>(m_w),
-                                                                                         h / static_cast<Float>(m_h),
-                                                                                         Float0, Float1))).normalize();
+        const auto pinhole_direction = [this](Float w, Float h){
+            return Vector3f(Block<0,0,3,1>(m_sample_to_camera * Vector4f(w / static_cast<Float>(m_w),
+                                                                         h / static_cast<Float>(m_h),
+                                                                         Float0, Float1))).normalize();
+        };
+        const auto to_world_dir = [this](const Vector3f &d){
+            return Vector3f(Block<0,0,3,1>(m_cam_to_world * Vector4f{d[0], d[1], d[2], Float0})).normalize();
+        };
+        const Vector3f local_d_pinhole = pinhole_direction(w, h);
+        const Vector3f local_dx_pinhole = pinhole_direction(w + Float1, h);
+        const Vector3f local_dy_pinhole = pinhole_direction(w, h + Float1);
 
         // If lens radius is effectively zero, behave like a pinhole
         if (m_lens_radius <= Float0) {
-             const Vector3f d = Block<0,0,3,1>(m_cam_to_world * Vector4f{local_d_pinhole[0], local_d_pinhole[1], local_d_pinhole[2], Float0});
-             return {m_pos, d.normalize()};
+             Ray ray{m_pos, to_world_dir(local_d_pinhole)};
+             ray.m_differential = RayDifferential{m_pos, to_world_dir(local_dx_pinhole), m_pos, to_world_dir(local_dy_pinhole)};
+             return ray;
         }
 
         // 2. Sample point on the lens
@@ -56,17 +65,22 @@ namespace Caramel{
         Vector3f p_lens_cam{lens_sample_uv[0] * m_lens_radius, lens_sample_uv[1] * m_lens_radius, Float0};
 
         // 3. Calculate point on the focal plane
-        Float ft = m_focal_dist / local_d_pinhole[2];
-        Vector3f p_focus_cam = local_d_pinhole * ft;
+        const auto focus_point = [this](const Vector3f &local_d){
+            return local_d * (m_focal_dist / local_d[2]);
+        };
+        Vector3f p_focus_cam = focus_point(local_d_pinhole);
 
         // 4. Calculate new ray direction (from p_lens to p_focus)
         Vector3f new_ray_dir_cam = Vector3f(p_focus_cam - p_lens_cam).normalize();
 
         // 5. Transform to world space
         Vector3f origin_world = Block<0,0,3,1>(m_cam_to_world * Vector4f{p_lens_cam[0], p_lens_cam[1], p_lens_cam[2], Float1});
-        Vector3f dir_world = Block<0,0,3,1>(m_cam_to_world * Vector4f{new_ray_dir_cam[0], new_ray_dir_cam[1], new_ray_dir_cam[2], Float0});
 
-        return {origin_world, dir_world.normalize()};
+        // Rays through the next pixels start from the same point on the lens and meet at their focus points
+        Ray ray{origin_world, to_world_dir(new_ray_dir_cam)};
+        ray.m_differential = RayDifferential{origin_world, to_world_dir(Vector3f(focus_point(local_dx_pinhole) - p_lens_cam).normalize()),
+                                             origin_world, to_world_dir(Vector3f(focus_point(local_dy_pinhole) - p_lens_cam).normalize())};
+        return ray;
     }
 
 }
@@ -0,0 +1,202 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <film.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <image.h>
+#include <logger.h>
+
+namespace Caramel{
+
+    Film::Film(Index width, Index height)
+        : m_width{width}, m_height{height}, m_pixels(width * height) {}
+
+    Film::Film() : m_width{0}, m_height{0} {}
+
+    void Film::add_sample(Index x, Index y, const Vector3f &rgb) {
+        Pixel &p = m_pixels[y * m_width + x];
+        const Float old_lum = luminance(p.mean);
+        p.spp++;
+        p.mean = p.mean + (rgb - p.mean) / static_cast<Float>(p.spp);
+        const Float lum = luminance(rgb);
+        p.lum_m2 += (lum - old_lum) * (lum - luminance(p.mean));
+    }
+
+    const Film::Pixel &Film::pixel(Index x, Index y) const {
+        return m_pixels[y * m_width + x];
+    }
+
+    Index Film::spp(Index x, Index y) const {
+        return pixel(x, y).spp;
+    }
+
+    Float Film::relative_error(Index x, Index y) const {
+        const Pixel &p = pixel(x, y);
+        if(p.spp < 2){
+            return INF;
+        }
+        const Float n = static_cast<Float>(p.spp);
+        const Float variance = p.lum_m2 / (n - Float1);
+        return std::sqrt(variance / n) / std::max(luminance(p.mean), MIN_LUMINANCE);
+    }
+
+    bool Film::is_converged(Index x, Index y, Float threshold, Index min_spp) const {
+        return spp(x, y) >= std::max<Index>(min_spp, 2) && relative_error(x, y) <= threshold;
+    }
+
+    void Film::write_to(Image &output, const ImageRegion &region) const {
+        for(Index y=region.y_min;y<region.y_max;y++){
+            for(Index x=region.x_min;x<region.x_max;x++){
+                const Vector3f &mean = pixel(x, y).mean;
+                output.set_pixel_value(x, y, mean[0], mean[1], mean[2]);
+            }
+        }
+    }
+
+    void Film::write_spp_to(Image &output, const ImageRegion &region) const {
+        for(Index y=region.y_min;y<region.y_max;y++){
+            for(Index x=region.x_min;x<region.x_max;x++){
+                const Float spp = static_cast<Float>(pixel(x, y).spp);
+                output.set_pixel_value(x, y, spp, spp, spp);
+            }
+        }
+    }
+
+    void Film::save(const std::string &filename, const ImageRegion &region, Index next_pass, Index seed) const {
+        if(region.is_empty() || region.x_max > m_width || region.y_max > m_height){
+            CRM_ERROR("Film region is out of the image : " + filename);
+        }
+        const std::string tmp_filename = filename + ".tmp";
+        {
+            std::ofstream stream(tmp_filename, std::ios::binary | std::ios::trunc);
+            if(!stream){
+                CRM_ERROR("Cannot write film : " + tmp_filename);
+            }
+            const FileHeader header{static_cast<Index>(sizeof(Float)), m_width, m_height, region, next_pass, seed};
+            stream.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+            stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for(Index y=region.y_min;y<region.y_max;y++){
+                for(Index x=region.x_min;x<region.x_max;x++){
+                    const Pixel &p = pixel(x, y);
+                    const Float values[] = {p.mean[0], p.mean[1], p.mean[2], p.lum_m2};
+                    stream.write(reinterpret_cast<const char*>(values), sizeof(values));
+                    stream.write(reinterpret_cast<const char*>(&p.spp), sizeof(p.spp));
+                }
+            }
+            if(!stream){
+                CRM_ERROR("Failed to write film : " + tmp_filename);
+            }
+        }
+        std::filesystem::rename(tmp_filename, filename);
+    }
+
+    std::pair<Index, Index> Film::load(const std::string &filename, const ImageRegion &region) {
+        std::ifstream stream(filename, std::ios::binary);
+        const FileHeader header = read_header(stream, filename);
+        if(header.width != m_width || header.height != m_height ||
+           std::memcmp(&header.region, &region, sizeof(ImageRegion)) != 0){
+            CRM_ERROR("Resolution or region of the film file does not match the render : " + filename);
+        }
+        for(Index y=region.y_min;y<region.y_max;y++){
+            for(Index x=region.x_min;x<region.x_max;x++){
+                m_pixels[y * m_width + x] = read_pixel(stream);
+            }
+        }
+        if(!stream){
+            CRM_ERROR("Truncated film file : " + filename);
+        }
+        return {header.next_pass, header.seed};
+    }
+
+    void Film::merge(const std::string &filename) {
+        std::ifstream stream(filename, std::ios::binary);
+        const FileHeader header = read_header(stream, filename);
+        if(m_pixels.empty()){
+            m_width = header.width;
+            m_height = header.height;
+            m_pixels.resize(m_width * m_height);
+        }
+        if(header.width != m_width || header.height != m_height){
+            CRM_ERROR("Resolution of the film file does not match : " + filename);
+        }
+        const ImageRegion &region = header.region;
+        for(Index y=region.y_min;y<region.y_max;y++){
+            for(Index x=region.x_min;x<region.x_max;x++){
+                Pixel &p = m_pixels[y * m_width + x];
+                p = combine(p, read_pixel(stream));
+            }
+        }
+        if(!stream){
+            CRM_ERROR("Truncated film file : " + filename);
+        }
+    }
+
+    Film::Pixel Film::combine(const Pixel &a, const Pixel &b) {
+        if(a.spp == 0){
+            return b;
+        }
+        if(b.spp == 0){
+            return a;
+        }
+        const Float na = static_cast<Float>(a.spp);
+        const Float nb = static_cast<Float>(b.spp);
+        const Float n = na + nb;
+        const Float delta = luminance(b.mean) - luminance(a.mean);
+        Pixel ret;
+        ret.spp = a.spp + b.spp;
+        ret.mean = a.mean * (na / n) + b.mean * (nb / n);
+        ret.lum_m2 = a.lum_m2 + b.lum_m2 + delta * delta * na * nb / n;
+        return ret;
+    }
+
+    Film::FileHeader Film::read_header(std::istream &stream, const std::string &filename) {
+        char magic[sizeof(FILE_MAGIC)];
+        FileHeader header{};
+        stream.read(magic, sizeof(magic));
+        stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if(!stream || std::memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0 || header.float_size != sizeof(Float)){
+            CRM_ERROR("Invalid film file : " + filename);
+        }
+        const ImageRegion &region = header.region;
+        if(region.is_empty() || region.x_max > header.width || region.y_max > header.height){
+            CRM_ERROR("Invalid region in film file : " + filename);
+        }
+        return header;
+    }
+
+    Film::Pixel Film::read_pixel(std::istream &stream) {
+        Float values[4];
+        Pixel p;
+        stream.read(reinterpret_cast<char*>(values), sizeof(values));
+        stream.read(reinterpret_cast<char*>(&p.spp), sizeof(p.spp));
+        p.mean = Vector3f{values[0], values[1], values[2]};
+        p.lum_m2 = values[3];
+        return p;
+    }
+
+}
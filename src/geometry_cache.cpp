@@ -0,0 +1,181 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <algorithm>
+
+#include <geometry_cache.h>
+
+#include <limits>
+
+#include <shape.h>
+
+namespace Caramel{
+
+    struct GeometryCache::ThreadState{
+        std::shared_ptr<Reader> reader;
+        Index depth = 0;
+    };
+
+    GeometryCache::ThreadState &GeometryCache::thread_state() {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    bool GeometryCache::in_read_scope() {
+        return thread_state().depth > 0;
+    }
+
+    GeometryCache::ReadScope::ReadScope() {
+        ThreadState &state = thread_state();
+        if(state.depth++ > 0){
+            return;
+        }
+        GeometryCache &cache = instance();
+        if(!state.reader){
+            state.reader = std::make_shared<Reader>();
+            std::lock_guard<std::mutex> lock(cache.m_mutex);
+            cache.m_readers.push_back(state.reader);
+        }
+        state.reader->epoch.store(cache.m_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+        // Pairs with the fence of an eviction, so that either the rays of this scope see the evicted
+        // mesh gone, or the eviction sees this scope
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void GeometryCache::enter_mesh() {
+        Reader &reader = *thread_state().reader;
+        const std::uint64_t epoch = m_epoch.load(std::memory_order_acquire);
+        if(reader.epoch.load(std::memory_order_relaxed) != epoch){
+            reader.epoch.store(epoch, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    GeometryCache::ReadScope::~ReadScope() {
+        ThreadState &state = thread_state();
+        if(--state.depth > 0){
+            return;
+        }
+        state.reader->epoch.store(0, std::memory_order_release);
+        GeometryCache &cache = instance();
+        if(cache.m_retired_count.load(std::memory_order_relaxed) > 0){
+            std::vector<std::shared_ptr<const TriangleMesh>> freed;
+            std::lock_guard<std::mutex> lock(cache.m_mutex);
+            freed = cache.collect();
+        }
+    }
+
+    void GeometryCache::set_budget(std::size_t bytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget = bytes;
+    }
+
+    std::size_t GeometryCache::budget() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_budget;
+    }
+
+    std::size_t GeometryCache::resident_bytes() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_resident_bytes;
+    }
+
+    Index GeometryCache::load_count() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_load_count;
+    }
+
+    Index GeometryCache::eviction_count() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_eviction_count;
+    }
+
+    Index GeometryCache::retired_count() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return static_cast<Index>(m_retired.size());
+    }
+
+    void GeometryCache::loaded(const LazyMesh *mesh, std::size_t bytes) {
+        std::vector<std::shared_ptr<const TriangleMesh>> freed;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_clock.fetch_add(1, std::memory_order_relaxed);
+        m_resident.push_back({mesh, bytes});
+        m_resident_bytes += bytes;
+        m_load_count++;
+        if(m_budget == 0 || m_resident_bytes <= m_budget){
+            return;
+        }
+
+        // Oldest first, the mesh just loaded is kept even if it alone is over the budget
+        std::sort(m_resident.begin(), m_resident.end() - 1, [](const Resident &a, const Resident &b){
+            return a.mesh->last_use() < b.mesh->last_use();
+        });
+        std::vector<std::shared_ptr<const TriangleMesh>> evicted;
+        auto it = m_resident.begin();
+        for(; it != m_resident.end() - 1 && m_resident_bytes > m_budget; ++it){
+            evicted.push_back(it->mesh->evict());
+            m_resident_bytes -= it->bytes;
+            m_eviction_count++;
+        }
+        m_resident.erase(m_resident.begin(), it);
+
+        // Scopes which began before this point may still be reading the evicted meshes
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const std::uint64_t epoch = m_epoch.fetch_add(1, std::memory_order_acq_rel);
+        for(auto &m : evicted){
+            m_retired.push_back({std::move(m), epoch});
+        }
+        freed = collect();
+    }
+
+    std::vector<std::shared_ptr<const TriangleMesh>> GeometryCache::collect() {
+        std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+        std::erase_if(m_readers, [](const std::shared_ptr<Reader> &r){ return r.use_count() == 1; });
+        for(const auto &r : m_readers){
+            const std::uint64_t epoch = r->epoch.load(std::memory_order_acquire);
+            if(epoch != 0){
+                oldest = std::min(oldest, epoch);
+            }
+        }
+        std::vector<std::shared_ptr<const TriangleMesh>> freed;
+        std::erase_if(m_retired, [&](Retired &r){
+            if(r.epoch >= oldest){
+                return false;
+            }
+            freed.push_back(std::move(r.mesh));
+            return true;
+        });
+        m_retired_count.store(m_retired.size(), std::memory_order_relaxed);
+        return freed;
+    }
+
+    void GeometryCache::remove(const LazyMesh *mesh) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = std::find_if(m_resident.begin(), m_resident.end(), [mesh](const Resident &r){ return r.mesh == mesh; });
+        if(it != m_resident.end()){
+            m_resident_bytes -= it->bytes;
+            m_resident.erase(it);
+        }
+    }
+
+}
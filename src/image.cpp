@@ -24,6 +24,9 @@
 
 #include <image.h>
 
+#include <cstdint>
+#include <cstdio>
+
 #include <common.h>
 #include <logger.h>
 
@@ -50,6 +53,13 @@ namespace Caramel{
     Image::Image(unsigned int width, unsigned int height, const std::vector<Float> &data)
         : m_width{width}, m_height{height}, m_data{data} {}
 
+    Image::Image(unsigned int width, unsigned int height, std::span<const Float> pixels, std::shared_ptr<const void> owner)
+        : m_width{width}, m_height{height}, m_external_data{pixels.data()}, m_external_owner{std::move(owner)} {
+        if(pixels.size() != static_cast<size_t>(width) * height * CHANNEL_NUM){
+            CRM_ERROR("Pixel count does not match the image size");
+        }
+    }
+
     Image::Image(const std::string &filename) {
         if(filename.ends_with(".jpg")){
             CRM_LOG("Load .jpg image");
@@ -84,10 +94,11 @@ namespace Caramel{
         std::vector<Float> g(m_width*m_height);
         std::vector<Float> b(m_width*m_height);
 
+        const std::span<const Float> data = pixels();
         for(int i=0;i<m_width*m_height;i++){
-            r[i] = m_data[i*CHANNEL_NUM+0];
-            g[i] = m_data[i*CHANNEL_NUM+1];
-            b[i] = m_data[i*CHANNEL_NUM+2];
+            r[i] = data[i*CHANNEL_NUM+0];
+            g[i] = data[i*CHANNEL_NUM+1];
+            b[i] = data[i*CHANNEL_NUM+2];
         }
 
         Float *image_ptr[CHANNEL_NUM];
@@ -127,10 +138,98 @@ namespace Caramel{
         free(header.requested_pixel_types);
     }
 
+    // tinyexr always writes the data window as the whole image, so cropped images are written here
+    // as uncompressed scanline EXR (little endian hosts only).
+    void Image::write_exr(const std::string &filename, const ImageRegion &data_window) const{
+        if(data_window.is_empty() || data_window.x_max > m_width || data_window.y_max > m_height){
+            CRM_ERROR("Data window is out of the image : " + filename);
+        }
+
+        std::vector<char> buf;
+        const auto put = [&buf](const auto &value){
+            const char *p = reinterpret_cast<const char*>(&value);
+            buf.insert(buf.end(), p, p + sizeof(value));
+        };
+        const auto put_str = [&buf](const char *str){
+            buf.insert(buf.end(), str, str + strlen(str) + 1);
+        };
+        const auto put_attr_header = [&](const char *name, const char *type, int32_t size){
+            put_str(name);
+            put_str(type);
+            put(size);
+        };
+        const auto put_box = [&](const char *name, int32_t x_min, int32_t y_min, int32_t x_max, int32_t y_max){
+            put_attr_header(name, "box2i", 16);
+            put(x_min); put(y_min); put(x_max); put(y_max);
+        };
+
+        put(int32_t{20000630});
+        put(int32_t{2});
+
+        // Channels in alphabetical order, 32-bit float without subsampling
+        const char *channel_names[CHANNEL_NUM] = {"B", "G", "R"};
+        put_attr_header("channels", "chlist", CHANNEL_NUM * 18 + 1);
+        for(const char *name : channel_names){
+            put_str(name);
+            put(int32_t{2});
+            put(int32_t{0});
+            put(int32_t{1});
+            put(int32_t{1});
+        }
+        put('\0');
+        put_attr_header("compression", "compression", 1);
+        put(uint8_t{0});
+        put_box("dataWindow", data_window.x_min, data_window.y_min, data_window.x_max - 1, data_window.y_max - 1);
+        put_box("displayWindow", 0, 0, m_width - 1, m_height - 1);
+        put_attr_header("lineOrder", "lineOrder", 1);
+        put(uint8_t{0});
+        put_attr_header("pixelAspectRatio", "float", 4);
+        put(1.0f);
+        put_attr_header("screenWindowCenter", "v2f", 8);
+        put(0.0f); put(0.0f);
+        put_attr_header("screenWindowWidth", "float", 4);
+        put(1.0f);
+        put('\0');
+
+        // Offset table followed by one chunk per scanline
+        const Index width = data_window.x_max - data_window.x_min;
+        const Index height = data_window.y_max - data_window.y_min;
+        const int32_t line_size = static_cast<int32_t>(width * CHANNEL_NUM * sizeof(float));
+        const uint64_t first_chunk = buf.size() + height * sizeof(uint64_t);
+        for(Index y=0;y<height;y++){
+            put(static_cast<uint64_t>(first_chunk + y * (2 * sizeof(int32_t) + line_size)));
+        }
+        const std::span<const Float> data = pixels();
+        for(Index y=data_window.y_min;y<data_window.y_max;y++){
+            put(static_cast<int32_t>(y));
+            put(line_size);
+            // Channel data is stored in B, G, R order, while pixels hold R, G, B
+            for(int c=CHANNEL_NUM-1;c>=0;c--){
+                for(Index x=data_window.x_min;x<data_window.x_max;x++){
+                    put(static_cast<float>(data[(x + y * m_width) * CHANNEL_NUM + c]));
+                }
+            }
+        }
+
+        FILE *file = fopen(filename.c_str(), "wb");
+        if(file == nullptr){
+            CRM_ERROR("Can not open " + filename);
+        }
+        const size_t written = fwrite(buf.data(), 1, buf.size(), file);
+        fclose(file);
+        if(written != buf.size()){
+            CRM_ERROR("Error occurs while save " + filename);
+        }
+        CRM_LOG("Saved exr file :" + filename);
+    }
+
     void Image::set_pixel_value(int w, int h, Float r, Float g, Float b) {
         if(w<0 || m_width<=w || h<0 || m_height<=h){
             CRM_ERROR("unavailable image pixel position");
         }
+        if(m_external_data != nullptr){
+            CRM_ERROR("Can not modify a read-only image");
+        }
 
         m_data[(w + h * m_width)*3] = r;
         m_data[(w + h * m_width)*3 + 1] = g;
@@ -138,9 +237,17 @@ namespace Caramel{
     }
 
     Vector3f Image::get_pixel_value(int w, int h) const{
-        return {m_data[(w + h * m_width)*3],
-                m_data[(w + h * m_width)*3 + 1],
-                m_data[(w + h * m_width)*3 + 2]};
+        const Float *data = m_external_data != nullptr ? m_external_data : m_data.data();
+        return {data[(w + h * m_width)*3],
+                data[(w + h * m_width)*3 + 1],
+                data[(w + h * m_width)*3 + 2]};
+    }
+
+    std::span<const Float> Image::pixels() const{
+        if(m_external_data != nullptr){
+            return {m_external_data, static_cast<size_t>(m_width) * m_height * CHANNEL_NUM};
+        }
+        return m_data;
     }
 
     /*
@@ -30,8 +30,12 @@
 #include <camera.h>
 
 namespace Caramel{
+    const Camera &RenderConfig::camera_of(const Scene &scene) const {
+        return camera ? *camera : *scene.m_cam;
+    }
+
     Image Integrator::render(const Scene &scene, const RenderConfig &config) {
-        auto size = scene.m_cam->get_size();
+        auto size = config.camera_of(scene).get_size();
         Image img(size.first, size.second);
         render(scene, img, config);
         return img;
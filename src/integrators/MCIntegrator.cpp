@@ -24,10 +24,14 @@
 
 #include <chrono>
 #include <functional>
+#include <limits>
 #include <random>
+#include <tuple>
 
 #include <integrators.h>
 
+#include <film.h>
+#include <geometry_cache.h>
 #include <image.h>
 #include <light.h>
 #include <parallel_for.h>
@@ -38,26 +42,58 @@
 #include <sampler.h>
 
 namespace Caramel{
+    namespace {
+        // Columns are the tiles of a render, scheduled as tasks of the job if it is given
+        void for_each_column(const RenderConfig &config, int start_idx, int end_idx, const std::function<void(int)> &func){
+            const std::function<void(int)> column = [&func](int i){
+                GeometryCache::ReadScope scope;
+                func(i);
+            };
+            if(config.job){
+                config.job->parallel_for(start_idx, end_idx, column);
+            }
+            else{
+                parallel_for(start_idx, end_idx, column);
+            }
+        }
+    }
+
     MCIntegrator::MCIntegrator(Index spp) : Integrator(), m_spp{spp} {}
 
+    void MCIntegrator::set_adaptive(Float threshold, Index round_spp, Index min_spp) {
+        m_adaptive_threshold = threshold;
+        m_adaptive_round_spp = round_spp;
+        m_adaptive_min_spp = min_spp;
+    }
+
     void MCIntegrator::render(const Scene &scene, Image &output, const RenderConfig &config){
-        auto size = scene.m_cam->get_size();
         const Index real_spp = config.spp > 0 ? config.spp : m_spp;
+        const Camera &camera = config.camera_of(scene);
+
+        if(is_adaptive() || config.time_budget > 0 || config.target_error > 0 || !config.checkpoint_path.empty() ||
+           config.tile_count > 1 || !config.film_path.empty()){
+            render_progressive(scene, output, config);
+            return;
+        }
+
+        std::random_device rd;
+        const Index base_seed = config.random_seed ? static_cast<Index>(rd()) : 0;
+
+        // Only pixels of the region are traced, pixels outside keep their values in `output`
+        const ImageRegion region = render_region(scene, config);
 
 #if ENABLE_PROGRESS
-        ProgressBar progress_bar(size.first);
+        ProgressBar progress_bar(region.x_max - region.x_min);
         CRM_LOG("Render start...");
         const auto time1 = std::chrono::high_resolution_clock::now();
 #endif
-
-        parallel_for(0, size.first, std::function([&](int i){
+        for_each_column(config, region.x_min, region.x_max, std::function([&](int i){
                          if(config.should_stop && config.should_stop->load()) return;
-                         std::random_device rd;
-                         UniformStdSampler sampler(config.random_seed ? static_cast<int>(rd()) : i);
-                         for(int j=0;j<size.second;j++){
+                         for(Index j=region.y_min;j<region.y_max;j++){
+                             UniformStdSampler sampler = UniformStdSampler::for_pixel(i, j, 0, base_seed);
                              Vector3f rgb = vec3f_zero;
                              for(Index s=0;s<real_spp;s++){
-                                 rgb = rgb + get_pixel_value(scene, i + sampler.sample_1d(), j + sampler.sample_1d(), sampler);
+                                 rgb = rgb + get_pixel_value(scene, camera, i + sampler.sample_1d(), j + sampler.sample_1d(), real_spp, sampler);
                              }
                              rgb = rgb / real_spp;
                              output.set_pixel_value(i, j, rgb[0], rgb[1], rgb[2]);
@@ -71,7 +107,153 @@ namespace Caramel{
         const auto time2 = std::chrono::high_resolution_clock::now();
         CRM_LOG("Render done in " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1).count() / 1000.0f) + " seconds");
 #endif
+
+        if(config.spp_aov){
+            const Float spp = static_cast<Float>(real_spp);
+            for(Index i=region.x_min;i<region.x_max;i++){
+                for(Index j=region.y_min;j<region.y_max;j++){
+                    config.spp_aov->set_pixel_value(i, j, spp, spp, spp);
+                }
+            }
+        }
+    }
+
+    ImageRegion MCIntegrator::render_region(const Scene &scene, const RenderConfig &config) const{
+        const Camera &camera = config.camera_of(scene);
+        const auto [width, height] = camera.get_size();
+        const ImageRegion &region = !config.region.is_empty() ? config.region : camera.get_crop();
+        if(region.is_empty()){
+            return {0, 0, width, height};
+        }
+        if(region.x_max > width || region.y_max > height){
+            CRM_ERROR("Render region is out of the image");
+        }
+        return region;
+    }
+
+    void MCIntegrator::render_progressive(const Scene &scene, Image &output, const RenderConfig &config){
+        const Camera &camera = config.camera_of(scene);
+        auto size = camera.get_size();
+        Film film(size.first, size.second);
+
+        // Without an explicit spp, a time budgeted render runs until its deadline
+        const Index max_spp = config.spp > 0 ? config.spp :
+                              config.time_budget > 0 ? std::numeric_limits<Index>::max() : m_spp;
+        const Float threshold = config.target_error > 0 ? config.target_error : m_adaptive_threshold;
+        const Index pass_spp = is_adaptive() ? m_adaptive_round_spp : PROGRESSIVE_PASS_SPP;
+        const Index min_spp = is_adaptive() && m_adaptive_min_spp > 0 ? m_adaptive_min_spp :
+                              std::max(MIN_ERROR_SPP, 2 * pass_spp);
+
+        const ImageRegion region = render_region(scene, config);
+        if(config.tile_index >= config.tile_count){
+            CRM_ERROR("Tile index should be less than tile count");
+        }
+        const Index tiles_per_row = (region.x_max - region.x_min + TILE_SIZE - 1) / TILE_SIZE;
+        const auto is_rendered = [&](Index i, Index j){
+            const Index tile = (j - region.y_min) / TILE_SIZE * tiles_per_row + (i - region.x_min) / TILE_SIZE;
+            return region.contains(i, j) && tile % config.tile_count == config.tile_index;
+        };
+        const auto is_active = [&](Index i, Index j){
+            return is_rendered(i, j) && film.spp(i, j) < max_spp && (threshold == 0 || !film.is_converged(i, j, threshold, min_spp));
+        };
+
+        using Clock = std::chrono::steady_clock;
+        const auto start = Clock::now();
+        const auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.time_budget));
+        const auto is_stopped = [&](){
+            return (config.should_stop && config.should_stop->load()) ||
+                   (config.time_budget > 0 && Clock::now() >= deadline);
+        };
+
+#if ENABLE_PROGRESS
+        CRM_LOG("Progressive render start...");
+#endif
+
+        std::random_device rd;
+        Index base_seed = config.random_seed ? static_cast<Index>(rd()) : 0;
+        Index next_pass = 0;
+        if(config.resume){
+            std::tie(next_pass, base_seed) = film.load(config.checkpoint_path, region);
+            CRM_LOG("Resume from pass " + std::to_string(next_pass) + " : " + config.checkpoint_path);
+        }
+
+        auto last_pass_time = Clock::duration::zero();
+        auto last_checkpoint = Clock::now();
+        bool interrupted = false;
+        for(;;){
+            const Index pass = next_pass;
+            // Do not start a pass which is not expected to end before the deadline
+            const auto pass_start = Clock::now();
+            if(is_stopped() || (config.time_budget > 0 && pass_start + last_pass_time > deadline)){
+                break;
+            }
+
+            std::atomic<Index> active_pixels{0};
+            std::atomic<bool> skipped_columns{false};
+            for_each_column(config, region.x_min, region.x_max, std::function([&](int i){
+                             // Columns which already started finish, so every pixel holds whole samples
+                             if(is_stopped()){
+                                 skipped_columns = true;
+                                 return;
+                             }
+                             for(Index j=region.y_min;j<region.y_max;j++){
+                                 if(!is_active(i, j)) continue;
+                                 // Each pass draws from its own stream, so passes do not repeat samples
+                                 UniformStdSampler sampler = UniformStdSampler::for_pixel(i, j, pass, base_seed);
+                                 active_pixels++;
+                                 const Index n = std::min(pass_spp, max_spp - film.spp(i, j));
+                                 for(Index s=0;s<n;s++){
+                                     film.add_sample(i, j, get_pixel_value(scene, camera, i + sampler.sample_1d(), j + sampler.sample_1d(), max_spp, sampler));
+                                 }
+                             }
+                         }));
+            last_pass_time = Clock::now() - pass_start;
+
+            // The film now holds a partial pass which cannot be checkpointed
+            if(skipped_columns){
+                interrupted = true;
+                break;
+            }
+            next_pass++;
+            if(active_pixels == 0){
+                break;
+            }
+            if(!config.checkpoint_path.empty() &&
+               Clock::now() - last_checkpoint >= std::chrono::duration<double>(config.checkpoint_interval)){
+                film.save(config.checkpoint_path, region, next_pass, base_seed);
+                last_checkpoint = Clock::now();
+            }
+#if ENABLE_PROGRESS
+            CRM_LOG("Pass " + std::to_string(pass) + " : " + std::to_string(active_pixels.load()) + " active pixels");
+#endif
+        }
+
+        if(!config.checkpoint_path.empty() && !interrupted){
+            film.save(config.checkpoint_path, region, next_pass, base_seed);
+        }
+        // Pixels of a partial pass are fine here, as each one is weighted by its own sample count
+        if(!config.film_path.empty()){
+            film.save(config.film_path, region, next_pass, base_seed);
+        }
+
+        // Each pixel is normalized by its own sample count
+        film.write_to(output, region);
+        if(config.spp_aov){
+            film.write_spp_to(*config.spp_aov, region);
+        }
+
+#if ENABLE_PROGRESS
+        Index total_spp = 0;
+        for(Index i=region.x_min;i<region.x_max;i++){
+            for(Index j=region.y_min;j<region.y_max;j++){
+                total_spp += film.spp(i, j);
+            }
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+        CRM_LOG("Render done in " + std::to_string(elapsed / 1000.0f) + " seconds, average " +
+                std::to_string(static_cast<Float>(total_spp) / static_cast<Float>(region.area())) + " spp");
+#endif
     }
 
-    void MCIntegrator::pre_process(const Scene &scene) {}
+    void MCIntegrator::pre_process(Scene &scene) {}
 }
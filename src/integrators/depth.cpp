@@ -32,8 +32,8 @@
 namespace Caramel{
     DepthIntegrator::DepthIntegrator() : MCIntegrator(1) {}
 
-    Vector3f DepthIntegrator::get_pixel_value(const Scene &scene, Float i, Float j, Sampler &sampler) {
-        const Ray ray = scene.m_cam->sample_ray(i, j, sampler);
+    Vector3f DepthIntegrator::get_pixel_value(const Scene &scene, const Camera &camera, Float i, Float j, Index spp, Sampler &sampler) {
+        const Ray ray = camera.sample_ray(i, j, sampler);
         auto [is_hit, info] = scene.ray_intersect(ray);
         return is_hit ? Vector3f(info.t, info.t, info.t) : vec3f_zero;
     }
@@ -22,6 +22,9 @@
 // SOFTWARE.
 //
 
+#include <optional>
+#include <vector>
+
 #include <integrators.h>
 
 #include <light.h>
@@ -32,34 +35,148 @@
 #include <bsdf.h>
 #include <sampler.h>
 #include <rayintersectinfo.h>
+#include <sd_tree.h>
+#include <geometry_cache.h>
+#include <logger.h>
+#include <parallel_for.h>
 
 namespace Caramel{
-    PathIntegrator::PathIntegrator(Index rr_depth, Index max_depth, Index spp)
-        : MCIntegrator(spp), m_rr_depth{rr_depth}, m_max_depth{max_depth} {}
+    // Path vertex whose incident radiance along the sampled direction is recorded for path guiding
+    struct GuidingVertex{
+        SDTree::Leaf *leaf;
+        Vector3f dir;        // Sampled direction in world space
+        Vector3f throughput; // Path throughput including the sampled direction
+        Vector3f radiance;   // Radiance arriving from `dir`, accumulated while tracing
+        Float pdf;           // Probability of sampling `dir`
+    };
+
+    // Incident radiance of a training path vertex, to be recorded into `leaf->building`
+    struct GuidingRecord{
+        SDTree::Leaf *leaf;
+        Vector3f dir;
+        Float value;
+    };
+
+    PathIntegrator::PathIntegrator(Index rr_depth, Index max_depth, Index spp, Index light_cache_res, Index light_cache_spp,
+                                   Index ris_candidates, Index guiding_spp)
+        : MCIntegrator(spp), m_rr_depth{rr_depth}, m_max_depth{max_depth},
+          m_light_cache_res{light_cache_res}, m_light_cache_spp{light_cache_spp}, m_ris_candidates{ris_candidates},
+          m_guiding_spp{guiding_spp}, m_sd_tree{nullptr} {}
+
+    PathIntegrator::~PathIntegrator(){
+        delete m_sd_tree;
+    }
+
+    void PathIntegrator::pre_process(Scene &scene) {
+        if(m_light_cache_res > 0){
+            scene.build_light_cache(m_light_cache_res, m_light_cache_spp);
+        }
+        else{
+            // The scene may hold a cache built for another integrator
+            scene.clear_light_cache();
+        }
+        if(m_guiding_spp > 0){
+            train_guiding(scene);
+        }
+    }
+
+    // Training passes with doubling spp (1, 2, 4, ...) as in Müller et al.
+    // Each pass guides with the distribution learned so far and records into a refined one.
+    // Training images are discarded, the final render uses the distribution of the last pass.
+    void PathIntegrator::train_guiding(const Scene &scene) {
+        delete m_sd_tree;
+        m_sd_tree = new SDTree(scene.m_aabb);
+
+        const auto [width, height] = scene.m_cam->get_size();
+        Index trained_spp = 0;
+        Index pass = 0;
+        for(Index pass_spp=1; trained_spp + pass_spp <= m_guiding_spp; pass_spp*=2, pass++){
+            // Records of a column are applied in column order, so that the trained distribution (and
+            // a render resumed from a checkpoint, which trains it again) does not depend on thread timing
+            ordered_parallel_for<std::vector<GuidingRecord>>(0, width, [&](int i){
+                GeometryCache::ReadScope scope;
+                std::vector<GuidingRecord> records;
+                for(Index j=0;j<height;j++){
+                    UniformStdSampler sampler = UniformStdSampler::for_pixel(i, j, pass, GUIDING_SEED);
+                    for(Index s=0;s<pass_spp;s++){
+                        mis_sampling_path(scene, *scene.m_cam, i + sampler.sample_1d(), j + sampler.sample_1d(), m_spp, sampler, &records);
+                    }
+                }
+                return records;
+            }, [](int, std::vector<GuidingRecord> &&records){
+                for(const GuidingRecord &record : records){
+                    record.leaf->building.record(record.dir, record.value);
+                }
+            });
+
+            using std::sqrt;
+            m_sd_tree->refine(GUIDING_SPATIAL_THRESHOLD * sqrt(static_cast<Float>(pass_spp)), GUIDING_DIRECTIONAL_THRESHOLD);
+            trained_spp += pass_spp;
+        }
+
+        CRM_LOG("Path guiding : trained " + std::to_string(pass) + " passes (" + std::to_string(trained_spp) + " spp), " +
+                std::to_string(m_sd_tree->leaf_num()) + " spatial leaves");
+    }
+
+    Float PathIntegrator::scattering_pdf(const BSDF *bsdf, const DTree *guide, const RayIntersectInfo &info,
+                                         const Vector3f &local_ray_dir, const Vector3f &local_dir) const{
+        const Float bsdf_pdf = bsdf->pdf(local_ray_dir, local_dir);
+        if(guide == nullptr){
+            return bsdf_pdf;
+        }
+        return GUIDING_BSDF_FRACTION * bsdf_pdf + (Float1 - GUIDING_BSDF_FRACTION) * guide->pdf(info.sh_coord.to_world(local_dir));
+    }
 
-    Vector3f PathIntegrator::get_pixel_value(const Scene &scene, Float i, Float j, Sampler &sampler) {
+    Vector3f PathIntegrator::get_pixel_value(const Scene &scene, const Camera &camera, Float i, Float j, Index spp, Sampler &sampler) {
         // See previous commits for brdf sampling / light sampling only
-        return mis_sampling_path(scene, i, j, sampler);
+        return mis_sampling_path(scene, camera, i, j, spp, sampler);
     }
 
-    Vector3f PathIntegrator::mis_sampling_path(const Scene &scene, Float i, Float j, Sampler &sampler) const{
-        Ray ray = scene.m_cam->sample_ray(i, j, sampler);
+    Vector3f PathIntegrator::mis_sampling_path(const Scene &scene, const Camera &camera, Float i, Float j, Index spp, Sampler &sampler,
+                                               std::vector<GuidingRecord> *records) const{
+        Ray ray = camera.sample_ray(i, j, sampler);
+        // Each sample covers a part of the pixel
+        using std::sqrt;
+        ray.scale_differentials(std::max(MIN_DIFFERENTIAL_SCALE, Float1 / sqrt(static_cast<Float>(spp))));
         Vector3f current_brdf = vec3f_one;
         Vector3f ret = vec3f_zero;
         bool from_specular = true;
         Float prev_brdf_pdf = Float1;
+        // Shading position where the current ray is spawned, light selection pdf depends on it
+        Vector3f prev_pos = ray.m_o;
+
+        // Only training paths record their vertices, rendered paths do not construct the buffer
+        std::optional<std::array<GuidingVertex, GUIDING_MAX_VERTICES>> vertices;
+        if(records){
+            vertices.emplace();
+        }
+        Index vertex_num = 0;
+        // `last_vertex_contrib` is the estimate of incident radiance of the last vertex, which is
+        // different from `contrib` for emitters hit by the sampled direction (no MIS weight)
+        const auto add_contribution = [&](const Vector3f &contrib, const Vector3f &last_vertex_contrib){
+            ret = ret + contrib;
+            for(Index v=0;v<vertex_num;v++){
+                const Vector3f &c = (v + 1 == vertex_num) ? last_vertex_contrib : contrib;
+                for(int k=0;k<3;k++){
+                    GuidingVertex &vertex = (*vertices)[v];
+                    if(vertex.throughput[k] > Float0){
+                        vertex.radiance[k] += c[k] / vertex.throughput[k];
+                    }
+                }
+            }
+        };
 
         for(Index depth=1;depth<=m_max_depth;depth++){
-            const auto [is_hit, info] = scene.ray_intersect(ray);
+            auto [is_hit, info] = scene.ray_intersect(ray);
 
             if(!is_hit){
                 if (auto envmap_light = scene.m_envmap_light; envmap_light) {
                     const Float pdf_solidangle = envmap_light->pdf_solidangle(ray.m_o, ray.m_o + ray.m_d * scene.m_sceneRadius * 2, info.sh_coord.m_world_n);
-                    const Float pdf_pick_light = scene.pdf_light(envmap_light);
+                    const Float pdf_pick_light = scene.pdf_light(envmap_light, prev_pos);
                     const Float weight = balance_heuristic(prev_brdf_pdf, pdf_pick_light * pdf_solidangle);
                     const Vector3f contrib = envmap_light->radiance(ray.m_o, ray.m_o + (ray.m_d * scene.m_sceneRadius * 2), -ray.m_d) % current_brdf;
 
-                    ret = ret + (from_specular ? contrib : contrib * weight);
+                    add_contribution(from_specular ? contrib : contrib * weight, contrib);
                 }
                 break;
             }
@@ -71,11 +188,11 @@ namespace Caramel{
             if(shape->is_light()){
                 const auto light = shape->get_arealight();
                 const Float pdf_solidangle = light->pdf_solidangle(ray.m_o, info.p, info.sh_coord.m_world_n);
-                const Float pdf_pick_light = scene.pdf_light(light);
+                const Float pdf_pick_light = scene.pdf_light(light, prev_pos);
                 const Float weight = balance_heuristic(prev_brdf_pdf, pdf_pick_light * pdf_solidangle);
                 const Vector3f contrib = light->radiance(ray.m_o, info.p, info.sh_coord.m_world_n) % current_brdf;
 
-                ret = ret + (from_specular ? contrib : contrib * weight);
+                add_contribution(from_specular ? contrib : contrib * weight, contrib);
                 break;
             }
 
@@ -83,34 +200,48 @@ namespace Caramel{
                 break;
             }
 
+            // Footprint of the ray, which selects the detail of textures
+            info.compute_differentials(ray);
+
             // emitter sampling
             const bool is_current_specular = shape_bsdf->is_discrete(local_ray_dir[2] < Float0);
-            if(!is_current_specular){
-                auto [light, light_pick_pdf] = scene.sample_light(sampler);
 
-                auto [emitted_rad, light_pos, light_n_world] = light->sample_direct_contribution(scene, info, sampler);
+            // Guiding distribution learned at this position, used only if it received any radiance
+            SDTree::Leaf *guide_leaf = (m_sd_tree != nullptr && !is_current_specular) ? &m_sd_tree->lookup(info.p) : nullptr;
+            const DTree *guide = (guide_leaf != nullptr && guide_leaf->sampling.total() > Float0) ? &guide_leaf->sampling : nullptr;
+
+            if(!is_current_specular && m_ris_candidates > 1){
+                const Vector3f contrib = ris_direct_lighting(scene, info, local_ray_dir, guide, sampler) % current_brdf;
+                add_contribution(contrib, contrib);
+            }
+            else if(!is_current_specular){
+                auto [light, light_pick_pdf] = scene.sample_light(info.p, sampler);
+
+                const LightSample light_sample = light->sample_direct_contribution(scene, info, sampler);
+                const Vector3f &emitted_rad = light_sample.radiance;
 
                 // Continue if light sampling succeed
                 if(!is_zero(emitted_rad)){
-                    const Vector3f hitpos_to_light_local_normal = info.sh_coord.to_local(light_pos - info.p).normalize();
-                    const Vector3f fr = shape_bsdf->get_reflection(local_ray_dir, hitpos_to_light_local_normal, info.tex_uv);
+                    const Vector3f hitpos_to_light_local_normal = info.sh_coord.to_local(light_sample.pos - info.p).normalize();
+                    const Vector3f fr = shape_bsdf->get_reflection(local_ray_dir, hitpos_to_light_local_normal, info.tex_coord());
 
                     if (!is_zero(fr)) {
                         using std::abs;
                         if(light->is_delta()){
                             // We don't perform MIS for delta light
-                            ret = ret + (fr % emitted_rad % current_brdf) * abs(hitpos_to_light_local_normal[2]) / light_pick_pdf;
+                            const Vector3f contrib = (fr % emitted_rad % current_brdf) * abs(hitpos_to_light_local_normal[2]) / light_pick_pdf;
+                            add_contribution(contrib, contrib);
                         }
                         else{
                             // MIS for light sampling
-                            const Float pdf_solidangle = light->pdf_solidangle(info.p, light_pos, light_n_world);
-                            const Float bsdf_pdf = shape->get_bsdf()->pdf(local_ray_dir, hitpos_to_light_local_normal);
-                            const Float light_pdf = light_pick_pdf * pdf_solidangle;
+                            const Float bsdf_pdf = scattering_pdf(shape_bsdf, guide, info, local_ray_dir, hitpos_to_light_local_normal);
+                            const Float light_pdf = light_pick_pdf * light_sample.pdf;
                             // Guard against division by zero when light_pdf is zero
                             // (e.g. degenerate sample at a shared edge between geometry and light).
                             // See test_scenes/test3 for a scene that triggers this case.
                             if(light_pdf > Float0){
-                                ret = ret + (fr % emitted_rad % current_brdf) * abs(hitpos_to_light_local_normal[2]) * balance_heuristic(light_pdf, bsdf_pdf) / light_pdf;
+                                const Vector3f contrib = (fr % emitted_rad % current_brdf) * abs(hitpos_to_light_local_normal[2]) * balance_heuristic(light_pdf, bsdf_pdf) / light_pdf;
+                                add_contribution(contrib, contrib);
                             }
                         }
                     }
@@ -119,8 +250,10 @@ namespace Caramel{
 
             /* Russian roulette */{
                 if(!from_specular && depth >= m_rr_depth){
-                    if(current_brdf.max() > sampler.sample_1d()){
-                        current_brdf = current_brdf / current_brdf.max();
+                    // Guided sampling weights may exceed 1, survival probability is clamped to keep it unbiased
+                    const Float survival = std::min(current_brdf.max(), Float1);
+                    if(survival > sampler.sample_1d()){
+                        current_brdf = current_brdf / survival;
                     }
                     else{
                         break;
@@ -129,13 +262,115 @@ namespace Caramel{
             }
 
             /* brdf sampling */{
-                auto [local_recursive_dir, sampled_brdf, bsdf_pdf] = shape_bsdf->sample_recursive_dir(local_ray_dir, info.tex_uv, sampler);
+                auto [local_recursive_dir, sampled_brdf, bsdf_pdf] = shape_bsdf->sample_recursive_dir(local_ray_dir, info.tex_coord(), sampler);
+
+                // One-sample MIS of bsdf sampling and guided sampling
+                if(guide != nullptr){
+                    if(sampler.sample_1d() >= GUIDING_BSDF_FRACTION){
+                        local_recursive_dir = info.sh_coord.to_local(guide->sample(sampler));
+                        using std::abs;
+                        const Vector3f fr = shape_bsdf->get_reflection(local_ray_dir, local_recursive_dir, info.tex_coord());
+                        sampled_brdf = fr * abs(local_recursive_dir[2]);
+                    }
+                    else{
+                        // Convert reflectance * cos / pdf back to reflectance * cos
+                        sampled_brdf = sampled_brdf * bsdf_pdf;
+                    }
+                    bsdf_pdf = scattering_pdf(shape_bsdf, guide, info, local_ray_dir, local_recursive_dir);
+                    if(bsdf_pdf <= Float0 || is_zero(sampled_brdf)){
+                        break;
+                    }
+                    sampled_brdf = sampled_brdf / bsdf_pdf;
+                }
+
                 current_brdf = current_brdf % sampled_brdf;
                 from_specular = is_current_specular;
-                ray = info.recursive_ray_to(local_recursive_dir);
+                Ray next_ray = info.recursive_ray_to(local_recursive_dir);
+                next_ray.m_differential = is_current_specular ?
+                        info.specular_differential(ray, next_ray.m_d, shape_bsdf->eta(local_ray_dir[2] < Float0)) :
+                        info.rough_differential(next_ray.m_d, bsdf_pdf);
+                ray = next_ray;
                 prev_brdf_pdf = bsdf_pdf;
+                prev_pos = info.p;
+
+                if(records && guide_leaf != nullptr && vertex_num < GUIDING_MAX_VERTICES && bsdf_pdf > Float0){
+                    (*vertices)[vertex_num++] = {guide_leaf, ray.m_d, current_brdf, vec3f_zero, bsdf_pdf};
+                    guide_leaf->sample_num.fetch_add(1, std::memory_order_relaxed);
+                }
             }
         }
+
+        for(Index v=0;v<vertex_num;v++){
+            const GuidingVertex &vertex = (*vertices)[v];
+            records->push_back({vertex.leaf, vertex.dir, luminance(vertex.radiance) / vertex.pdf});
+        }
+
         return ret;
     }
+
+    // Resampled importance sampling (Talbot et al. 2005) of direct lighting.
+    // Draws M unoccluded candidates from the usual light selection and light sampling routines,
+    // resamples one in proportion to its unshadowed contribution, and traces a single shadow ray.
+    // The MIS weight against bsdf sampling uses the candidate's source pdf, which is the same pdf
+    // evaluated when bsdf sampling hits an emitter, so the combination stays unbiased.
+    Vector3f PathIntegrator::ris_direct_lighting(const Scene &scene, const RayIntersectInfo &info, const Vector3f &local_ray_dir,
+                                                 const DTree *guide, Sampler &sampler) const{
+        using std::abs;
+        const BSDF *bsdf = info.shape->get_bsdf();
+
+        const Light *selected_light = nullptr;
+        LightSample selected;
+        Vector3f selected_unshadowed = vec3f_zero;
+        Float selected_target = Float0;
+        Float selected_source_pdf = Float0;
+        Float weight_sum = Float0;
+
+        for(Index m=0;m<m_ris_candidates;m++){
+            const auto [light, light_pick_pdf] = scene.sample_light(info.p, sampler);
+            const LightSample candidate = light->sample_unoccluded(scene, info, sampler);
+            if(is_zero(candidate.radiance)){
+                continue;
+            }
+
+            // Delta lights are chosen from discrete probability only
+            const Float source_pdf = light->is_delta() ? light_pick_pdf : light_pick_pdf * candidate.pdf;
+            if(source_pdf <= Float0){
+                continue;
+            }
+
+            const Vector3f hitpos_to_light_local = info.sh_coord.to_local(candidate.pos - info.p).normalize();
+            const Vector3f fr = bsdf->get_reflection(local_ray_dir, hitpos_to_light_local, info.tex_coord());
+            const Vector3f unshadowed = (fr % candidate.radiance) * abs(hitpos_to_light_local[2]);
+            const Float target = luminance(unshadowed);
+            if(!(target > Float0)){
+                continue;
+            }
+
+            const Float weight = target / source_pdf;
+            weight_sum += weight;
+            if(sampler.sample_1d() * weight_sum < weight){
+                selected_light = light;
+                selected = candidate;
+                selected_unshadowed = unshadowed;
+                selected_target = target;
+                selected_source_pdf = source_pdf;
+            }
+        }
+
+        if(selected_light == nullptr || !scene.is_visible(info.p, selected.pos)){
+            return vec3f_zero;
+        }
+
+        // Unbiased contribution weight W = (1 / target(y)) * (1 / M) * sum(weights)
+        const Float ris_weight = weight_sum / (selected_target * static_cast<Float>(m_ris_candidates));
+
+        Float mis_weight = Float1;
+        if(!selected_light->is_delta()){
+            const Vector3f hitpos_to_light_local = info.sh_coord.to_local(selected.pos - info.p).normalize();
+            const Float bsdf_pdf = scattering_pdf(bsdf, guide, info, local_ray_dir, hitpos_to_light_local);
+            mis_weight = balance_heuristic(selected_source_pdf, bsdf_pdf);
+        }
+
+        return selected_unshadowed * (ris_weight * mis_weight);
+    }
 }
@@ -0,0 +1,174 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <utility>
+#include <string>
+
+#include <light_cache.h>
+
+#include <bsdf.h>
+#include <camera.h>
+#include <common.h>
+#include <geometry_cache.h>
+#include <light.h>
+#include <logger.h>
+#include <parallel_for.h>
+#include <ray.h>
+#include <rayintersectinfo.h>
+#include <sampler.h>
+#include <scene.h>
+#include <shape.h>
+
+namespace Caramel{
+    LightCache::LightCache(const Scene &scene, Index resolution, Index training_spp)
+        : m_aabb{scene.m_aabb} {
+        // Cells are roughly cubic, `resolution` cells along the longest axis
+        const Vector3f extent = m_aabb.m_max - m_aabb.m_min;
+        const Float longest = std::max({extent[0], extent[1], extent[2]});
+        for(int a=0;a<3;a++){
+            using std::ceil;
+            m_res[a] = longest > Float0 ? std::max(Index{1}, static_cast<Index>(ceil(resolution * extent[a] / longest))) : 1;
+            m_cell_size_inv[a] = extent[a] > Float0 ? static_cast<Float>(m_res[a]) / extent[a] : Float0;
+        }
+
+        const Index cell_num = m_res[0] * m_res[1] * m_res[2];
+        const Index light_num = scene.m_lights.size();
+
+        // Accumulated visible contribution of each light, per cell
+        std::vector<Float> contribution(cell_num * light_num, Float0);
+        std::vector<std::atomic<Index>> vertex_count(cell_num);
+
+        const auto [width, height] = scene.m_cam->get_size();
+
+        // Contributions of a column are summed in column order, so that the cache (and a render
+        // resumed from a checkpoint, which trains it again) does not depend on thread timing
+        using ColumnContribution = std::vector<std::pair<Index, Float>>;
+        ordered_parallel_for<ColumnContribution>(0, width, [&](int i){
+            GeometryCache::ReadScope scope;
+            ColumnContribution column;
+            for(Index j=0;j<height;j++){
+                UniformStdSampler sampler = UniformStdSampler::for_pixel(i, j, 0, TRAINING_SEED);
+                for(Index s=0;s<training_spp;s++){
+                    Ray ray = scene.m_cam->sample_ray(i + sampler.sample_1d(), j + sampler.sample_1d(), sampler);
+                    for(Index depth=0;depth<TRAINING_DEPTH;depth++){
+                        const auto [is_hit, info] = scene.ray_intersect(ray);
+                        if(!is_hit || info.shape->is_light()){
+                            break;
+                        }
+
+                        const BSDF *bsdf = info.shape->get_bsdf();
+                        const Vector3f local_ray_dir = info.sh_coord.to_local(ray.m_d);
+
+                        // Light sampling is not performed on specular vertices, so they don't need training
+                        if(!bsdf->is_discrete(local_ray_dir[2] < Float0)){
+                            const Index cell = cell_index(info.p);
+                            vertex_count[cell].fetch_add(1, std::memory_order_relaxed);
+
+                            for(Index l=0;l<light_num;l++){
+                                const Light *light = scene.m_lights[l];
+                                const LightSample light_sample = light->sample_direct_contribution(scene, info, sampler);
+                                if(is_zero(light_sample.radiance)){
+                                    continue;
+                                }
+
+                                using std::abs;
+                                const Vector3f hitpos_to_light = (light_sample.pos - info.p).normalize();
+                                Float value = luminance(light_sample.radiance) * abs(info.sh_coord.m_world_n.dot(hitpos_to_light));
+                                if(!light->is_delta()){
+                                    if(light_sample.pdf <= Float0){
+                                        continue;
+                                    }
+                                    value /= light_sample.pdf;
+                                }
+                                if(std::isfinite(value)){
+                                    column.emplace_back(cell * light_num + l, value);
+                                }
+                            }
+                        }
+
+                        const auto [local_recursive_dir, sampled_brdf, bsdf_pdf] = bsdf->sample_recursive_dir(local_ray_dir, info.tex_uv, sampler);
+                        if(is_zero(sampled_brdf)){
+                            break;
+                        }
+                        ray = info.recursive_ray_to(local_recursive_dir);
+                    }
+                }
+            }
+            return column;
+        }, [&](int, ColumnContribution &&column){
+            for(const auto &[idx, value] : column){
+                contribution[idx] += value;
+            }
+        });
+
+        m_distribs.emplace_back(scene.m_lights_pdf);
+        m_cell_distrib_idx.resize(cell_num, 0);
+
+        Index trained_cells = 0;
+        std::vector<Float> weights(light_num);
+        for(Index c=0;c<cell_num;c++){
+            if(vertex_count[c].load() == 0){
+                continue;
+            }
+
+            Float sum = Float0;
+            for(Index l=0;l<light_num;l++){
+                sum += contribution[c * light_num + l];
+            }
+            if(sum <= Float0){
+                continue;
+            }
+
+            for(Index l=0;l<light_num;l++){
+                weights[l] = (Float1 - GLOBAL_MIX) * contribution[c * light_num + l] / sum +
+                             GLOBAL_MIX * scene.m_lights_pdf.pdf(l);
+            }
+            m_cell_distrib_idx[c] = m_distribs.size();
+            m_distribs.emplace_back(weights);
+            trained_cells++;
+        }
+
+        CRM_LOG("Light cache : " + std::to_string(trained_cells) + " / " + std::to_string(cell_num) + " cells trained");
+    }
+
+    Index LightCache::cell_index(const Vector3f &pos) const{
+        Index idx[3];
+        for(int a=0;a<3;a++){
+            const Int i = static_cast<Int>((pos[a] - m_aabb.m_min[a]) * m_cell_size_inv[a]);
+            idx[a] = static_cast<Index>(std::clamp(i, Int0, static_cast<Int>(m_res[a]) - 1));
+        }
+        return (idx[2] * m_res[1] + idx[1]) * m_res[0] + idx[0];
+    }
+
+    Index LightCache::sample(const Vector3f &pos, Float u) const{
+        return m_distribs[m_cell_distrib_idx[cell_index(pos)]].sample(u);
+    }
+
+    Float LightCache::pdf(const Vector3f &pos, Index light_idx) const{
+        return m_distribs[m_cell_distrib_idx[cell_index(pos)]].pdf(light_idx);
+    }
+}
@@ -59,7 +59,15 @@ namespace Caramel{
         return m_radiance;
     }
 
-    std::tuple<Vector3f, Vector3f, Vector3f> AreaLight::sample_direct_contribution(const Scene &scene, const RayIntersectInfo &hitpos_info, Sampler &sampler) const{
+    LightSample AreaLight::sample_direct_contribution(const Scene &scene, const RayIntersectInfo &hitpos_info, Sampler &sampler) const{
+        return sample(scene, hitpos_info, sampler, true);
+    }
+
+    LightSample AreaLight::sample_unoccluded(const Scene &scene, const RayIntersectInfo &hitpos_info, Sampler &sampler) const{
+        return sample(scene, hitpos_info, sampler, false);
+    }
+
+    LightSample AreaLight::sample(const Scene &scene, const RayIntersectInfo &hitpos_info, Sampler &sampler, bool test_visibility) const{
         // Solid angle sampling of convex polygons.
         // Based on: Christoph Peters, 2021
         //   "BRDF Importance Sampling for Polygonal Lights", Section 5 & Supplement C
@@ -68,25 +76,36 @@ namespace Caramel{
             const auto& verts = m_shape->get_polygon_vertices();
             const auto polygon = prepare_solid_angle_polygon(verts.size(), verts.data(), hitpos_info.p);
             if(polygon.solid_angle <= Float0){
-                return {vec3f_zero, vec3f_zero, vec3f_zero};
+                return LightSample::invalid();
             }
 
             const Vector3f dir = sample_solid_angle_polygon(polygon, sampler.sample_1d(), sampler.sample_1d());
 
             if(std::isnan(dir[0]) || std::isnan(dir[1]) || std::isnan(dir[2])){
-                return {vec3f_zero, vec3f_zero, vec3f_zero};
+                return LightSample::invalid();
             }
 
-            // Use light mesh intersection for exact surface point
-            const Ray sample_ray(hitpos_info.p, dir);
-            const auto [hit, mesh_info] = m_shape->ray_intersect(sample_ray, INF);
+            bool hit;
+            RayIntersectInfo light_info;
+            if(test_visibility){
+                // Single scene traversal finds both the exact light surface point and visibility :
+                // the sampled direction lies inside the light's solid angle, so the light is
+                // visible iff it is the first surface hit along the ray.
+                // Origin offset is same as `Scene::is_visible()`.
+                std::tie(hit, light_info) = scene.ray_intersect(Ray(hitpos_info.p + (dir * EPSILON), dir));
+                hit = hit && light_info.shape == m_shape;
+            }
+            else{
+                // Use light mesh intersection for exact surface point
+                std::tie(hit, light_info) = m_shape->ray_intersect(Ray(hitpos_info.p, dir), INF);
+            }
 
             if(!hit){
-                return {vec3f_zero, vec3f_zero, vec3f_zero};
+                return LightSample::invalid();
             }
 
-            const Vector3f light_pos = mesh_info.p;
-            const Vector3f light_normal_world = mesh_info.sh_coord.m_world_n;
+            const Vector3f light_pos = light_info.p;
+            const Vector3f light_normal_world = light_info.sh_coord.m_world_n;
             const Vector3f light_to_hitpos = hitpos_info.p - light_pos;
 
             // Discard samples where the light point nearly coincides with the
@@ -94,32 +113,29 @@ namespace Caramel{
             // a degenerate normalize() and unstable MIS weights.
             // See test_scenes/test3 for a scene that triggers this case.
             if(light_to_hitpos.dot(light_to_hitpos) < EPSILON * EPSILON){
-                return {vec3f_zero, vec3f_zero, vec3f_zero};
+                return LightSample::invalid();
             }
 
             if(light_normal_world.dot(light_to_hitpos) <= Float0){
-                return {vec3f_zero, vec3f_zero, vec3f_zero};
-            }
-
-            if(!scene.is_visible(hitpos_info.p, light_pos)){
-                return {vec3f_zero, vec3f_zero, vec3f_zero};
+                return LightSample::invalid();
             }
 
-            return {m_radiance, light_pos, light_normal_world};
+            return {m_radiance, light_pos, light_normal_world, Float1 / polygon.solid_angle, light_to_hitpos.length()};
         }
         else /* Traditional uniform area sampling */{
             const auto [light_pos, light_normal_world, pos_pdf] = m_shape->sample_point(sampler);
             const Vector3f light_to_hitpos = hitpos_info.p - light_pos;
 
             if(light_normal_world.dot(light_to_hitpos) <= 0){
-                return {vec3f_zero, vec3f_zero, vec3f_zero};
+                return LightSample::invalid();
             }
 
-            if(!scene.is_visible(hitpos_info.p, light_pos)){
-                return {vec3f_zero, vec3f_zero, vec3f_zero};
+            if(test_visibility && !scene.is_visible(hitpos_info.p, light_pos)){
+                return LightSample::invalid();
             }
 
-            return {m_radiance, light_pos, light_normal_world};
+            return {m_radiance, light_pos, light_normal_world,
+                    m_shape->pdf_solidangle(hitpos_info.p, light_pos, light_normal_world), light_to_hitpos.length()};
         }
     }
 
@@ -61,17 +61,22 @@ namespace Caramel{
         m_scene_radius = radius;
     }
 
-    std::tuple<Vector3f, Vector3f, Vector3f> ConstantEnvLight::sample_direct_contribution(const Scene &scene, const RayIntersectInfo &hitpos_info, Sampler &sampler) const{
+    LightSample ConstantEnvLight::sample_direct_contribution(const Scene &scene, const RayIntersectInfo &hitpos_info, Sampler &sampler) const{
+        const LightSample light_sample = sample_unoccluded(scene, hitpos_info, sampler);
+        bool visible = scene.is_visible(light_sample.pos, hitpos_info.p);
+        if (!visible) {
+            return LightSample::invalid();
+        }
+
+        return light_sample;
+    }
+
+    LightSample ConstantEnvLight::sample_unoccluded(const Scene &, const RayIntersectInfo &hitpos_info, Sampler &sampler) const{
         const auto [pos_to_light_dir_local, pos_pdf] = sample_unit_sphere_uniformly(sampler);
         const auto pos_to_light_dir_world = hitpos_info.sh_coord.to_world(pos_to_light_dir_local);
 
         const Vector3f light_pos = hitpos_info.p + (pos_to_light_dir_world * m_scene_radius * 2);
-        bool visible = scene.is_visible(light_pos, hitpos_info.p);
-        if (!visible) {
-            return {vec3f_zero, vec3f_zero, vec3f_zero};
-        }
-
-        return {m_radiance, light_pos, -pos_to_light_dir_world};
+        return {m_radiance, light_pos, -pos_to_light_dir_world, PI_4_INV, m_scene_radius * 2};
     }
 
     Float ConstantEnvLight::pdf_solidangle(const Vector3f &hitpos_world, const Vector3f &lightpos_world, const Vector3f &light_normal_world) const{
@@ -28,6 +28,8 @@
 
 #include <light.h>
 
+#include <asset_registry.h>
+
 #include <ray.h>
 #include <common.h>
 #include <sampler.h>
@@ -81,11 +83,99 @@ namespace Caramel{
         return Distrib2D(data);
     }
 
+    // Monotonic substitute of atan2(b, a) in [0, 2pi), mapped to [0, 4)
+    // Only the ordering matters, so it is compared against precomputed values of column boundaries.
+    static Float pseudo_angle(Float a, Float b) {
+        if (a == Float0 && b == Float0) {
+            return Float0;
+        }
+        if (b >= Float0) {
+            return a >= Float0 ? b / (a + b) : Float1 - a / (b - a);
+        }
+        return a < Float0 ? 2 - b / (-a - b) : 3 + a / (a - b);
+    }
+
+    // Polynomial approximation of atan2(b, a) in [0, 2pi), |error| < 1e-5
+    static Float approx_phi(Float a, Float b) {
+        using std::abs;
+        const Float abs_a = abs(a);
+        const Float abs_b = abs(b);
+        const Float max_ab = std::max(abs_a, abs_b);
+        const Float t = max_ab > Float0 ? std::min(abs_a, abs_b) / max_ab : Float0;
+        const Float t2 = t * t;
+        Float r = t * (0.9998660f + t2 * (-0.3302995f + t2 * (0.1801410f + t2 * (-0.0851330f + t2 * 0.0208351f))));
+        if (abs_b > abs_a) r = PI_2 * static_cast<Float>(0.25) - r;
+        if (a < Float0) r = PI - r;
+        if (b < Float0) r = PI_2 - r;
+        return r;
+    }
+
+    // Polynomial approximation of acos(y), Abramowitz & Stegun 4.4.46, |error| < 2e-8
+    static Float approx_theta(Float y) {
+        using std::abs;
+        const Float x = abs(y);
+        const Float r = std::sqrt(std::max(Float0, Float1 - x)) *
+                        (1.5707963050f + x * (-0.2145988016f + x * (0.0889789874f + x * (-0.0501743046f +
+                         x * (0.0308918810f + x * (-0.0170881256f + x * (0.0066700901f + x * -0.0012624911f)))))));
+        return y < Float0 ? PI - r : r;
+    }
+
     ImageEnvLight::ImageEnvLight(const std::string &path, Float scale, const Matrix44f &to_world)
-        : m_scale(scale), m_image(new Image(path)), m_imageDistrib(build_sampling_distrib(m_image)),
+        : ImageEnvLight(AssetRegistry::instance().get<Image>("image", path, "", [&path](){ return new Image(path); }),
+                        scale, to_world) {}
+
+    ImageEnvLight::ImageEnvLight(std::shared_ptr<const Image> image, Float scale, const Matrix44f &to_world)
+        : m_scale(scale), m_image(std::move(image)), m_imageDistrib(build_sampling_distrib(m_image.get())),
           m_width(m_image->size()[0]), m_height(m_image->size()[1]), m_width_height(m_width * m_height),
           m_to_world{Block<0, 0, 3, 3>(to_world)}, m_to_local{Block<0, 0, 3, 3>(Inverse(to_world))} {
+        // (u, v) -> (phi, theta) = (u * 2 * PI, v * PI), see `normalized_uv_to_vec()`
+        using std::sin;
+        using std::cos;
+        m_row_cos_bounds.resize(m_height + 1);
+        m_row_sin.resize(m_height);
+        m_row_cos.resize(m_height);
+        for (int j = 0; j <= m_height; j++) {
+            m_row_cos_bounds[j] = cos(PI * static_cast<Float>(j) / m_height);
+        }
+        for (int j = 0; j < m_height; j++) {
+            const Float theta = PI * (static_cast<Float>(j) + Float0_5) / m_height;
+            m_row_sin[j] = sin(theta);
+            m_row_cos[j] = cos(theta);
+        }
 
+        m_col_pseudo_bounds.resize(m_width + 1);
+        m_col_sin.resize(m_width);
+        m_col_cos.resize(m_width);
+        for (int i = 0; i < m_width; i++) {
+            const Float phi = PI_2 * static_cast<Float>(i) / m_width;
+            m_col_pseudo_bounds[i] = pseudo_angle(cos(phi), sin(phi));
+        }
+        m_col_pseudo_bounds[m_width] = 4;
+        for (int i = 0; i < m_width; i++) {
+            const Float phi = PI_2 * (static_cast<Float>(i) + Float0_5) / m_width;
+            m_col_sin[i] = sin(phi);
+            m_col_cos[i] = cos(phi);
+        }
+    }
+
+    Vector2i ImageEnvLight::direction_to_texel(const Vector3f &local_dir) const {
+        // Column : phi = atan2(x, -z), row : theta = acos(y)
+        // Initial guess from polynomial approximations is corrected against the exact boundaries,
+        // so the result agrees with the trigonometric mapping up to rounding at texel borders.
+        const Float a = -local_dir[2];
+        const Float b = local_dir[0];
+        const Float y = local_dir[1];
+
+        const Float p = pseudo_angle(a, b);
+        int i = std::clamp(static_cast<int>(approx_phi(a, b) * (m_width * PI_2_INV)), 0, m_width - 1);
+        while (i > 0 && p < m_col_pseudo_bounds[i]) i--;
+        while (i < m_width - 1 && p >= m_col_pseudo_bounds[i + 1]) i++;
+
+        int j = std::clamp(static_cast<int>(approx_theta(y) * (m_height * PI_INV)), 0, m_height - 1);
+        while (j > 0 && y > m_row_cos_bounds[j]) j--;
+        while (j < m_height - 1 && y <= m_row_cos_bounds[j + 1]) j++;
+
+        return {i, j};
     }
 
     void ImageEnvLight::set_scene_radius(Float radius) {
@@ -121,32 +211,41 @@ namespace Caramel{
 
     Vector3f ImageEnvLight::radiance(const Vector3f &, const Vector3f &, const Vector3f &light_normal_world) const{
         const Vector3f dir = -light_normal_world.normalize();
-        Vector2f uv = vec_to_normalized_uv(m_to_local * dir);
+        const Vector2i texel = direction_to_texel(m_to_local * dir);
+        return m_image->get_pixel_value(texel[0], texel[1]);
+    }
 
-        const auto size = m_image->size();
-        return m_image->get_pixel_value(uv[0] * size[0], uv[1] * size[1]);
+    LightSample ImageEnvLight::sample_direct_contribution(const Scene &scene, const RayIntersectInfo &hitpos_info, Sampler &sampler) const{
+        const LightSample light_sample = sample_unoccluded(scene, hitpos_info, sampler);
+        bool visible = scene.is_visible(light_sample.pos, hitpos_info.p);
+        if (!visible) {
+            return LightSample::invalid();
+        }
+
+        return light_sample;
     }
 
-    std::tuple<Vector3f, Vector3f, Vector3f> ImageEnvLight::sample_direct_contribution(const Scene &scene, const RayIntersectInfo &hitpos_info, Sampler &sampler) const{
+    LightSample ImageEnvLight::sample_unoccluded(const Scene &, const RayIntersectInfo &hitpos_info, Sampler &sampler) const{
         const auto sampled_uv = m_imageDistrib.sample(sampler.sample_1d(), sampler.sample_1d());
-        const auto pos_to_light_local = normalized_uv_to_vec(Vector2f{static_cast<Float>(sampled_uv[0] + Float0_5) / m_width, static_cast<Float>(sampled_uv[1] + Float0_5) / m_height});
+        const Index i = sampled_uv[0];
+        const Index j = sampled_uv[1];
+        // Same as `normalized_uv_to_vec()` at the pixel center
+        const Vector3f pos_to_light_local{m_row_sin[j] * m_col_sin[i], m_row_cos[j], -m_row_sin[j] * m_col_cos[i]};
         const Vector3f pos_to_light_world = Vector3f(m_to_world * pos_to_light_local).normalize();
 
         const Vector3f light_pos = hitpos_info.p + (pos_to_light_world * m_scene_radius * 2);
 
-        bool visible = scene.is_visible(light_pos, hitpos_info.p);
-        if (!visible) {
-            return {vec3f_zero, vec3f_zero, vec3f_zero};
-        }
-
-        return {radiance(hitpos_info.p, light_pos, -pos_to_light_world), light_pos, -pos_to_light_world};
+        return {radiance(hitpos_info.p, light_pos, -pos_to_light_world), light_pos, -pos_to_light_world,
+                pdf_local(m_to_local * pos_to_light_world), m_scene_radius * 2};
     }
 
     Float ImageEnvLight::pdf_solidangle(const Vector3f &hitpos_world, const Vector3f &lightpos_world, const Vector3f &light_normal_world) const{
         const auto dir = Vector3f(lightpos_world - hitpos_world).normalize();
-        const Vector2f uv = vec_to_normalized_uv(m_to_local * dir);
-        using std::abs;
-        using std::sin;
+        return pdf_local(m_to_local * dir);
+    }
+
+    Float ImageEnvLight::pdf_local(const Vector3f &local_dir) const{
+        using std::sqrt;
 
         // 1.
         // (i,j) (discrete) -> (u, v) (continuous)
@@ -159,19 +258,16 @@ namespace Caramel{
         //
         // 3.
         // (theta, phi) -> (x, y, z) (solid angle vector)
-        // |j| is known as sin(theta)
+        // |j| is known as sin(theta) = sqrt(1 - y^2)
         //
 
-        if (abs(uv[1] - Float1) < 1e-6 || abs(uv[1] - Float0) < 1e-6) {
+        const Float sin_theta = sqrt(std::max(Float0, Float1 - local_dir[1] * local_dir[1]));
+        if (sin_theta < static_cast<Float>(1e-6)) {
             return 0;
         }
 
-        Vector2i pixel_idx(static_cast<int>(uv[0] * m_width), static_cast<int>(uv[1] * m_height));
-        if (pixel_idx[0] >=  m_width) {
-            pixel_idx[0] -= m_width;
-        }
-
-        return m_width_height * m_imageDistrib.pdf/*technically it's pmf*/(pixel_idx[0], pixel_idx[1]) / (2 * PI * PI * sin(uv[1] * PI)); // ???
+        const Vector2i texel = direction_to_texel(local_dir);
+        return m_width_height * m_imageDistrib.pdf/*technically it's pmf*/(texel[0], texel[1]) / (2 * PI * PI * sin_theta);
     }
 
     bool ImageEnvLight::is_delta() const {
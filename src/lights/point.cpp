@@ -48,18 +48,22 @@ namespace Caramel{
         return vec3f_zero;
     }
 
-    std::tuple<Vector3f, Vector3f, Vector3f> PointLight::sample_direct_contribution(const Scene &scene, const RayIntersectInfo &hitpos_info, Sampler &) const{
+    LightSample PointLight::sample_direct_contribution(const Scene &scene, const RayIntersectInfo &hitpos_info, Sampler &sampler) const{
         // If hitpoint and sampled point is not visible to each other, zero contribution
         bool is_visible = scene.is_visible(m_pos, hitpos_info.p);
 
         if(!is_visible){
-            return {vec3f_zero, vec3f_zero, vec3f_zero};
+            return LightSample::invalid();
         }
 
+        return sample_unoccluded(scene, hitpos_info, sampler);
+    }
+
+    LightSample PointLight::sample_unoccluded(const Scene &, const RayIntersectInfo &hitpos_info, Sampler &) const{
         const Vector3f light_to_hitpos = hitpos_info.p - m_pos;
+        const Float dist_sq = light_to_hitpos.dot(light_to_hitpos);
 
-        return {m_radiant_intensity / light_to_hitpos.dot(light_to_hitpos)/* = dist * dist*/,
-                m_pos, light_to_hitpos.normalize()};
+        return {m_radiant_intensity / dist_sq, m_pos, light_to_hitpos.normalize(), Float0, std::sqrt(dist_sq)};
     }
 
     Float PointLight::pdf_solidangle(const Vector3f &, const Vector3f &, const Vector3f &) const{
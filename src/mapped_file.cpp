@@ -0,0 +1,82 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <mapped_file.h>
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <logger.h>
+
+namespace Caramel{
+
+    MappedFile::MappedFile(const std::filesystem::path &path, [[maybe_unused]] Access access) {
+#ifndef _WIN32
+        const int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0){
+            CRM_ERROR("Can not open file : " + path.string());
+        }
+        struct stat st{};
+        if(fstat(fd, &st) != 0){
+            close(fd);
+            CRM_ERROR("Can not stat file : " + path.string());
+        }
+        m_size = static_cast<std::size_t>(st.st_size);
+        if(m_size > 0){
+            void *addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(addr != MAP_FAILED){
+                madvise(addr, m_size, access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+                m_data = static_cast<const char*>(addr);
+                m_mapped = true;
+            }
+        }
+        close(fd);
+        if(m_mapped || m_size == 0){
+            return;
+        }
+#endif
+        // Read the whole file where it can not be mapped
+        std::ifstream stream(path, std::ios::binary);
+        if(!stream){
+            CRM_ERROR("Can not open file : " + path.string());
+        }
+        m_buffer.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+    }
+
+    MappedFile::~MappedFile() {
+#ifndef _WIN32
+        if(m_mapped){
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+#endif
+    }
+
+}
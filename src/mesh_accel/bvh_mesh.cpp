@@ -45,6 +45,10 @@ namespace Caramel{
         m_root = std::make_unique<BVHTree<BVHMeshTraits>>(std::move(indices), m_traits, m_cost_traversal, m_cost_intersection, m_subspace_count, m_max_primitive_num);
     }
 
+    void BVHMesh::build_from(std::span<const LinearBVHNode> nodes, std::span<const Index> ordered_primitives) {
+        m_root = std::make_unique<BVHTree<BVHMeshTraits>>(nodes, ordered_primitives, m_traits);
+    }
+
     std::pair<bool, RayIntersectInfo> BVHMesh::ray_intersect(const Ray &ray, Float maxt) {
         return m_root->ray_intersect(ray, maxt);
     }
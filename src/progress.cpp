@@ -26,6 +26,8 @@
 
 #include <iostream>
 
+#include <logger.h>
+
 #ifdef _WIN32
 #include <windows.h>
 #else
@@ -58,8 +60,8 @@ void ProgressBar::increase(){
 
     const std::string done_str(static_cast<int>(done_len), '=');
     const std::string remain_str(static_cast<int>(max_len - done_len), '-');
-    std::cout<<"["<<done_str << remain_str << "] " << static_cast<int>(done_ratio * 100) << " %\r";
-    std::cout.flush();
+    Caramel::Logger::stream()<<"["<<done_str << remain_str << "] " << static_cast<int>(done_ratio * 100) << " %\r";
+    Caramel::Logger::stream().flush();
 }
 
 int ProgressBar::get_progress_width() {
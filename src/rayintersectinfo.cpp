@@ -22,13 +22,18 @@
 // SOFTWARE.
 //
 
+#include <algorithm>
+#include <cmath>
+
 #include <common.h>
 #include <rayintersectinfo.h>
 #include <ray.h>
 
 namespace Caramel{
 
-    RayIntersectInfo::RayIntersectInfo() : p{Float0, Float0, Float0}, sh_coord(), t(INF), shape(nullptr), tex_uv{INF, INF}, tri_index{0} {}
+    RayIntersectInfo::RayIntersectInfo() : p{Float0, Float0, Float0}, sh_coord(), t(INF), shape(nullptr), tex_uv{INF, INF}, tri_index{0},
+                                           dpdu{Float0, Float0, Float0}, dpdv{Float0, Float0, Float0}, has_differentials{false},
+                                           dpdx{Float0, Float0, Float0}, dpdy{Float0, Float0, Float0}, tex_width{Float0} {}
 
     // See also `Scene::is_visible()`
     Ray RayIntersectInfo::recursive_ray_to(const Vector3f &local_next_dir) const{
@@ -38,4 +43,114 @@ namespace Caramel{
         return {p + (world_d * EPSILON), world_d};
     }
 
+    void RayIntersectInfo::set_triangle_derivatives(const Vector3f &p0, const Vector3f &p1, const Vector3f &p2,
+                                                    const Vector2f &uv0, const Vector2f &uv1, const Vector2f &uv2) {
+        const Vector2f duv1 = uv1 - uv0;
+        const Vector2f duv2 = uv2 - uv0;
+        const Vector3f dp1 = p1 - p0;
+        const Vector3f dp2 = p2 - p0;
+        const Float det = duv1[0] * duv2[1] - duv1[1] * duv2[0];
+        using std::abs;
+        // Degenerate texture coordinates leave texture lookups unfiltered
+        if(abs(det) < static_cast<Float>(1e-12)){
+            return;
+        }
+        const Float inv_det = Float1 / det;
+        dpdu = (dp1 * duv2[1] - dp2 * duv1[1]) * inv_det;
+        dpdv = (dp2 * duv1[0] - dp1 * duv2[0]) * inv_det;
+    }
+
+    // Reference : https://pbr-book.org/3ed-2018/Texture/Sampling_and_Antialiasing#FindingtheTextureSamplingRate
+    void RayIntersectInfo::compute_differentials(const Ray &ray) {
+        has_differentials = false;
+        tex_width = Float0;
+        if(!ray.m_differential){
+            return;
+        }
+        const RayDifferential &rd = *ray.m_differential;
+
+        // Hits of the differential rays on the tangent plane
+        const Vector3f &n = sh_coord.m_world_n;
+        const Float nx = n.dot(rd.rx_d);
+        const Float ny = n.dot(rd.ry_d);
+        if(Peanut::is_zero(nx) || Peanut::is_zero(ny)){
+            return;
+        }
+        const Float d = n.dot(p);
+        dpdx = rd.rx_o + rd.rx_d * ((d - n.dot(rd.rx_o)) / nx) - p;
+        dpdy = rd.ry_o + rd.ry_d * ((d - n.dot(rd.ry_o)) / ny) - p;
+        if(!std::isfinite(dpdx.dot(dpdx)) || !std::isfinite(dpdy.dot(dpdy))){
+            return;
+        }
+        has_differentials = true;
+
+        // Solve dpdx = dpdu * dudx + dpdv * dvdx in the two axes the plane is least inclined to
+        using std::abs;
+        int dim0 = 1, dim1 = 2;
+        if(abs(n[0]) < abs(n[1]) || abs(n[0]) < abs(n[2])){
+            dim0 = 0;
+            dim1 = abs(n[1]) > abs(n[2]) ? 2 : 1;
+        }
+        const Float det = dpdu[dim0] * dpdv[dim1] - dpdv[dim0] * dpdu[dim1];
+        if(abs(det) < static_cast<Float>(1e-12)){
+            return;
+        }
+        const Float inv_det = Float1 / det;
+        const auto solve = [&](const Vector3f &dp){
+            return Vector2f{(dpdv[dim1] * dp[dim0] - dpdv[dim0] * dp[dim1]) * inv_det,
+                            (dpdu[dim0] * dp[dim1] - dpdu[dim1] * dp[dim0]) * inv_det};
+        };
+        const Vector2f duvdx = solve(dpdx);
+        const Vector2f duvdy = solve(dpdy);
+        const Float width = Float2 * std::max({abs(duvdx[0]), abs(duvdx[1]), abs(duvdy[0]), abs(duvdy[1])});
+        tex_width = std::isfinite(width) ? width : Float0;
+    }
+
+    // Reference : https://pbr-book.org/3ed-2018/Materials/Specular_Reflection_and_Transmission#x2-SpecularReflectionandTransmission
+    // Shading normals are taken as constant over the footprint
+    std::optional<RayDifferential> RayIntersectInfo::specular_differential(const Ray &ray, const Vector3f &next_dir, Float eta) const {
+        if(!has_differentials || !ray.m_differential){
+            return std::nullopt;
+        }
+        const RayDifferential &rd = *ray.m_differential;
+        const Vector3f wo = -ray.m_d;
+        const Vector3f wi = next_dir.normalize();
+        const Vector3f dwodx = -rd.rx_d - wo;
+        const Vector3f dwody = -rd.ry_d - wo;
+
+        RayDifferential ret{p + dpdx, wi, p + dpdy, wi};
+        Vector3f n = sh_coord.m_world_n;
+        if(wi.dot(n) * wo.dot(n) > Float0){
+            ret.rx_d = wi - dwodx + n * (Float2 * dwodx.dot(n));
+            ret.ry_d = wi - dwody + n * (Float2 * dwody.dot(n));
+        }
+        else{
+            if(wo.dot(n) < Float0){
+                n = -n;
+            }
+            using std::abs;
+            const Float cos_o = wo.dot(n);
+            const Float cos_i = abs(wi.dot(n));
+            if(Peanut::is_zero(cos_i)){
+                return std::nullopt;
+            }
+            const Float dmu = eta - (eta * eta * cos_o) / cos_i;
+            ret.rx_d = wi - dwodx * eta + n * (dmu * dwodx.dot(n));
+            ret.ry_d = wi - dwody * eta + n * (dmu * dwody.dot(n));
+        }
+        return ret;
+    }
+
+    std::optional<RayDifferential> RayIntersectInfo::rough_differential(const Vector3f &next_dir, Float pdf) const {
+        if(!has_differentials || !(pdf > Float0)){
+            return std::nullopt;
+        }
+        // Half angle of a cone of solid angle 1/pdf
+        using std::sqrt;
+        const Float spread = sqrt(Float1 / (PI * pdf));
+        const Coordinate frame(next_dir);
+        return RayDifferential{p + dpdx, (frame.m_world_n + frame.m_axis1 * spread).normalize(),
+                               p + dpdy, (frame.m_world_n + frame.m_axis2 * spread).normalize()};
+    }
+
 }
@@ -22,7 +22,12 @@
 // SOFTWARE.
 //
 
+#include <render.h>
+
+#include <future>
+
 #include <scene_parser.h>
+#include <scene_snapshot.h>
 #include <shape.h>
 #include <scene.h>
 #include <image.h>
@@ -37,30 +42,43 @@ namespace Caramel{
         // Set current path
         std::filesystem::current_path(scene_path.parent_path());
 
-        SceneParser parser(scene_path);
+        // A snapshot holds meshes with their BVHs and decoded images, which are used in place
+        SceneParser parser = SceneSnapshot::is_snapshot(scene_path) ?
+                             SceneParser(std::make_shared<const SceneSnapshot>(scene_path)) :
+                             SceneParser(scene_path);
         Integrator *integrator = parser.parse_integrator();
-        Camera *cam = parser.parse_camera();
+        const std::vector<Camera*> cameras = parser.parse_cameras();
+        parser.load_textures();
         parser.parse_bsdfs_map();
+        // Lights, e.g. environment maps, load while shapes load
+        auto lights_loaded = std::async(std::launch::async, [&parser](){ return parser.parse_lights(); });
         const std::vector<Shape*> shapes = parser.parse_shapes();
-        const std::vector<Light*> lights = parser.parse_lights();
 
         Scene *scene = new Scene();
         for(auto s : shapes){
             scene->add_mesh_and_arealight(s);
         }
+        // The scene BVH needs only the shapes
+        scene->build_accel();
+
+        const std::vector<Light*> lights = lights_loaded.get();
         for(auto l : lights){
             scene->add_light(l);
         }
         scene->build_light_pdf();
 
-        scene->set_camera(cam);
-        scene->build_accel();
+        scene->m_cameras.assign(cameras.begin(), cameras.end());
+        scene->set_camera(cameras.front());
 
         return {scene, integrator};
     }
 
-    Image render(const Scene *scene, Integrator *integrator){
+    Image render(Scene *scene, Integrator *integrator){
+        return render(scene, integrator, RenderConfig{});
+    }
+
+    Image render(Scene *scene, Integrator *integrator, const RenderConfig &config){
         integrator->pre_process(*scene);
-        return integrator->render(*scene);
+        return integrator->render(*scene, config);
     }
 }
@@ -0,0 +1,354 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <render_server.h>
+
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <camera.h>
+#include <image.h>
+#include <integrators.h>
+#include <logger.h>
+#include <scene.h>
+#include <scene_parser.h>
+
+namespace Caramel{
+
+    RenderServer::RenderServer() : m_base_dir{std::filesystem::current_path()} {}
+
+    RenderServer::~RenderServer() {
+        wait_jobs();
+    }
+
+    void RenderServer::serve(std::istream &in, std::ostream &out) {
+        const Respond respond = [&out](const std::string &response){
+            out << response << std::endl;
+        };
+        std::string line;
+        while(!m_quit && std::getline(in, line)){
+            if(line.empty()){
+                continue;
+            }
+            handle(line, respond);
+        }
+        wait_jobs();
+    }
+
+    void RenderServer::serve_socket(const std::string &socket_path) {
+#ifdef _WIN32
+        CRM_ERROR("UNIX domain socket server is not supported on Windows, use stdin instead");
+#else
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if(socket_path.size() >= sizeof(addr.sun_path)){
+            CRM_ERROR("Socket path is too long : " + socket_path);
+        }
+        std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+        // A client closing its connection early should not terminate the server
+        std::signal(SIGPIPE, SIG_IGN);
+
+        const int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socket_path.c_str());
+        if(server_fd < 0 || bind(server_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(server_fd, 8) != 0){
+            CRM_ERROR("Can not listen on socket : " + socket_path);
+        }
+        CRM_LOG("Render server listening on " + socket_path);
+
+        while(!m_quit){
+            const int client_fd = accept(server_fd, nullptr, nullptr);
+            if(client_fd < 0){
+                continue;
+            }
+            const Respond respond = [client_fd](const std::string &response){
+                const std::string line = response + "\n";
+                std::size_t sent = 0;
+                while(sent < line.size()){
+                    const ssize_t n = ::send(client_fd, line.data() + sent, line.size() - sent, 0);
+                    if(n <= 0){
+                        break;
+                    }
+                    sent += n;
+                }
+            };
+            std::string pending;
+            char buf[4096];
+            ssize_t received;
+            while(!m_quit && (received = recv(client_fd, buf, sizeof(buf), 0)) > 0){
+                pending.append(buf, received);
+                std::size_t newline;
+                while(!m_quit && (newline = pending.find('\n')) != std::string::npos){
+                    const std::string line = pending.substr(0, newline);
+                    pending.erase(0, newline + 1);
+                    if(line.empty()){
+                        continue;
+                    }
+                    handle(line, respond);
+                }
+            }
+            // Jobs of the client respond to it
+            wait_jobs();
+            close(client_fd);
+        }
+        close(server_fd);
+        unlink(socket_path.c_str());
+#endif
+    }
+
+    void RenderServer::handle(const std::string &request, const Respond &respond) {
+        const auto received = std::chrono::steady_clock::now();
+        Json response;
+        try{
+            const Json req = Json::parse(request);
+            const std::string cmd = req.at("cmd").get<std::string>();
+            if(cmd == "load"){
+                response = load(req);
+            }
+            else if(cmd == "update"){
+                response = update(req);
+            }
+            else if(cmd == "render"){
+                const std::string id = req.at("id").get<std::string>();
+                const auto it = m_scenes.find(id);
+                if(it == m_scenes.end()){
+                    send(respond, {{"status", "error"}, {"message", "Scene is not loaded : " + id}});
+                    return;
+                }
+                const std::string job_name = req.contains("job") ? req["job"].get<std::string>()
+                                                                 : std::to_string(m_job_count);
+                m_job_count++;
+
+                JobScheduler::JobOptions options;
+                options.priority = req.value("priority", 0);
+                options.weight = req.value("weight", Float1);
+                options.max_threads = req.value("max_threads", Index{0});
+                if(!(options.weight > Float0)){
+                    send(respond, {{"status", "error"}, {"job", job_name}, {"message", "Job weight should be positive"}});
+                    return;
+                }
+
+                ResidentScene &resident = it->second;
+                reap_jobs();
+                JobThread &job_thread = m_job_threads.emplace_back();
+                job_thread.thread = std::thread([this, req, &resident, options, job_name, received, respond,
+                                                 &done = job_thread.done](){
+                    Json job_response;
+                    try{
+                        JobScheduler::Job *job = JobScheduler::instance().create_job(options);
+                        try{
+                            job_response = render(req, resident, job, received);
+                        }
+                        catch(...){
+                            JobScheduler::instance().destroy_job(job);
+                            throw;
+                        }
+                        JobScheduler::instance().destroy_job(job);
+                    }
+                    catch(const std::exception &e){
+                        job_response = {{"status", "error"}, {"message", e.what()}};
+                    }
+                    job_response["job"] = job_name;
+                    send(respond, job_response);
+                    done = true;
+                });
+                return;
+            }
+            else if(cmd == "quit"){
+                wait_jobs();
+                m_quit = true;
+                response = {{"status", "ok"}};
+            }
+            else{
+                response = {{"status", "error"}, {"message", "Unknown command : " + cmd}};
+            }
+        }
+        catch(const std::exception &e){
+            // Details of errors raised by CRM_ERROR are in the log
+            response = {{"status", "error"}, {"message", e.what()}};
+        }
+        send(respond, response);
+    }
+
+    void RenderServer::wait_jobs() {
+        for(auto &job_thread : m_job_threads){
+            job_thread.thread.join();
+        }
+        m_job_threads.clear();
+    }
+
+    void RenderServer::reap_jobs() {
+        m_job_threads.remove_if([](JobThread &job_thread){
+            if(!job_thread.done){
+                return false;
+            }
+            job_thread.thread.join();
+            return true;
+        });
+    }
+
+    void RenderServer::send(const Respond &respond, const Json &response) {
+        std::lock_guard<std::mutex> lock(m_respond_mutex);
+        respond(response.dump());
+    }
+
+    RenderServer::Json RenderServer::load(const Json &request) {
+        const std::string id = request.at("id").get<std::string>();
+        if(m_scenes.contains(id)){
+            return {{"status", "error"}, {"message", "Scene is already loaded : " + id}};
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        auto updater = std::make_unique<SceneUpdater>();
+        updater->update(resolve(request.at("scene").get<std::string>()));
+        Scene *scene = updater->scene();
+        Integrator *integrator = updater->integrator();
+        integrator->pre_process(*scene);
+        m_scenes.emplace(id, ResidentScene{std::move(updater), scene, integrator, scene->m_cam});
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        return {{"status", "ok"}, {"id", id}, {"seconds", elapsed.count()}};
+    }
+
+    RenderServer::Json RenderServer::update(const Json &request) {
+        const std::string id = request.at("id").get<std::string>();
+        const auto it = m_scenes.find(id);
+        if(it == m_scenes.end()){
+            return {{"status", "error"}, {"message", "Scene is not loaded : " + id}};
+        }
+        ResidentScene &resident = it->second;
+        // Jobs submitted before the update render the scene as it was
+        wait_jobs();
+
+        const auto start = std::chrono::steady_clock::now();
+        const SceneUpdater::UpdateStats stats = resident.updater->update(resolve(request.at("scene").get<std::string>()));
+        resident.scene = resident.updater->scene();
+        resident.integrator = resident.updater->integrator();
+        resident.scene_camera = resident.scene->m_cameras.front();
+        resident.scene->set_camera(resident.scene_camera);
+        // Light cache and path guiding are trained on the old scene
+        resident.integrator->pre_process(*resident.scene);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        return {{"status", "ok"}, {"id", id}, {"seconds", elapsed.count()},
+                {"shapes_kept", stats.shapes_kept}, {"shapes_built", stats.shapes_built},
+                {"shapes_removed", stats.shapes_removed}, {"materials_changed", stats.materials_changed},
+                {"lights_built", stats.lights_built}, {"accel_rebuilt", stats.accel_rebuilt},
+                {"light_pdf_rebuilt", stats.light_pdf_rebuilt}};
+    }
+
+    RenderServer::Json RenderServer::render(const Json &request, ResidentScene &resident, JobScheduler::Job *job,
+                                            std::chrono::steady_clock::time_point received) {
+        const std::string id = request.at("id").get<std::string>();
+        const std::filesystem::path output = resolve(request.at("output").get<std::string>());
+
+        // Jobs rendering with the camera the scene was trained for run concurrently. A job with
+        // another camera waits for them to finish before it repeats the training passes.
+        std::shared_lock<std::shared_mutex> shared_lock(*resident.mutex);
+        const Camera *camera;
+        while((camera = trained_camera(request, resident)) == nullptr){
+            shared_lock.unlock();
+            {
+                std::lock_guard<std::shared_mutex> lock(*resident.mutex);
+                train_camera(request, resident);
+            }
+            shared_lock.lock();
+        }
+
+        RenderConfig config;
+        config.job = job;
+        config.camera = camera;
+        config.spp = request.value("spp", Index{0});
+        config.time_budget = request.value("time_budget", Float0);
+        config.target_error = request.value("target_error", Float0);
+        if(request.contains("crop")){
+            const Json &crop = request["crop"];
+            config.region = ImageRegion{crop.at("x_min").get<Index>(), crop.at("y_min").get<Index>(),
+                                        crop.at("x_max").get<Index>(), crop.at("y_max").get<Index>()};
+            if(config.region.is_empty()){
+                return {{"status", "error"}, {"message", "Crop window is empty"}};
+            }
+        }
+
+        const Image img = resident.integrator->render(*resident.scene, config);
+        const ImageRegion crop = !config.region.is_empty() ? config.region : camera->get_crop();
+        if(crop.is_empty()){
+            img.write_exr(output.string());
+        }
+        else{
+            img.write_exr(output.string(), crop);
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - received;
+        const JobScheduler::JobStats stats = job->stats();
+
+        return {{"status", "ok"}, {"id", id}, {"output", output.string()}, {"seconds", elapsed.count()},
+                {"queue_seconds", stats.queue_seconds}, {"tasks", stats.tasks_done}, {"busy_seconds", stats.busy_seconds}};
+    }
+
+    const Camera *RenderServer::trained_camera(const Json &request, const ResidentScene &resident) {
+        const Camera *camera = resident.scene_camera;
+        if(request.contains("camera")){
+            if(request["camera"].dump() != resident.job_camera_json){
+                return nullptr;
+            }
+            camera = resident.job_camera;
+        }
+        return resident.scene->m_cam == camera ? camera : nullptr;
+    }
+
+    void RenderServer::train_camera(const Json &request, ResidentScene &resident) {
+        // Another job may have trained it meanwhile
+        if(trained_camera(request, resident) != nullptr){
+            return;
+        }
+        const Camera *camera = resident.scene_camera;
+        if(request.contains("camera")){
+            const std::string camera_json = request["camera"].dump();
+            if(camera_json != resident.job_camera_json){
+                Camera *new_camera = SceneParser(Json{{"camera", request["camera"]}}).parse_camera();
+                delete resident.job_camera;
+                resident.job_camera = new_camera;
+                resident.job_camera_json = camera_json;
+                // The new camera may reuse the address of the deleted one
+                resident.scene->set_camera(nullptr);
+            }
+            camera = resident.job_camera;
+        }
+        resident.scene->set_camera(camera);
+        resident.integrator->pre_process(*resident.scene);
+    }
+
+    std::filesystem::path RenderServer::resolve(const std::string &path) const {
+        const std::filesystem::path p(path);
+        return p.is_absolute() ? p : m_base_dir / p;
+    }
+
+}
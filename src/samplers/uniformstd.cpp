@@ -28,6 +28,15 @@
 
 namespace Caramel{
 
+    namespace {
+        // SplitMix64 finalizer, decorrelates nearby integers
+        uint64_t mix64(uint64_t v) {
+            v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            v = (v ^ (v >> 27)) * 0x94d049bb133111ebULL;
+            return v ^ (v >> 31);
+        }
+    }
+
     UniformStdSampler::UniformStdSampler(uint64_t seed, uint64_t stream) {
         // Initialize PCG32
         // inc must be odd, so we use (stream << 1) | 1
@@ -40,6 +49,12 @@ namespace Caramel{
         next_uint32();
     }
 
+    UniformStdSampler UniformStdSampler::for_pixel(Index x, Index y, Index pass, uint64_t seed) {
+        // Pixel and seed select the starting state, the pass selects the PCG stream
+        const uint64_t pixel = (static_cast<uint64_t>(y) << 32) | x;
+        return UniformStdSampler(mix64(mix64(pixel) ^ seed), pass);
+    }
+
     uint32_t UniformStdSampler::next_uint32() {
         // Save old state for output function
         uint64_t oldstate = m_state;
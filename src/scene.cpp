@@ -31,6 +31,7 @@
 #include <camera.h>
 #include <common.h>
 #include <light.h>
+#include <light_cache.h>
 #include <ray.h>
 #include <rayintersectinfo.h>
 #include <sampler.h>
@@ -40,9 +41,9 @@
 namespace Caramel{
 
     Scene::Scene()
-    : m_envmap_light{nullptr}, m_sceneCenterPos{vec3f_zero}, m_sceneRadius{0.0f}, m_aabb{vec3f_zero, vec3f_zero}, m_cam{nullptr} {}
+    : m_envmap_light{nullptr}, m_sceneCenterPos{vec3f_zero}, m_sceneRadius{0.0f}, m_aabb{vec3f_zero, vec3f_zero}, m_cam{nullptr}, m_accel{nullptr}, m_light_cache{nullptr} {}
 
-    void Scene::set_camera(Camera *camera) {
+    void Scene::set_camera(const Camera *camera) {
         m_cam = camera;
     }
 
@@ -70,6 +71,33 @@ namespace Caramel{
         }
     }
 
+    void Scene::set_meshes(const std::vector<const Shape*> &shapes){
+        m_meshes.clear();
+        for(auto s : shapes){
+            m_meshes.emplace_back(s);
+            m_aabb = m_meshes.size() == 1 ? s->get_aabb() :
+                                            AABB::merge(m_aabb, s->get_aabb());
+        }
+        m_sceneCenterPos = (m_aabb.m_max + m_aabb.m_min) * 0.5f;
+        m_sceneRadius = Vector3f::L2(m_sceneCenterPos, m_aabb.m_max);
+        if(m_envmap_light != nullptr){
+            m_envmap_light->set_scene_radius(m_sceneRadius);
+        }
+    }
+
+    void Scene::set_lights(const std::vector<Light*> &lights){
+        m_lights.clear();
+        m_envmap_light = nullptr;
+        for(auto s : m_meshes){
+            if(s->is_light()){
+                m_lights.push_back(s->get_arealight());
+            }
+        }
+        for(auto l : lights){
+            add_light(l);
+        }
+    }
+
     // Similar with `RayIntersectInfo::recursive_ray_to()`
     bool Scene::is_visible(const Vector3f &pos1, const Vector3f &pos2) const{
         const Vector3f vec3_1_to_2(pos2 - pos1);
@@ -93,18 +121,36 @@ namespace Caramel{
         return {m_lights[idx], m_lights_pdf.pdf(idx)};
     }
 
+    std::pair<const Light*, Float> Scene::sample_light(const Vector3f &pos, Sampler &sampler) const{
+        if(m_light_cache == nullptr){
+            return sample_light(sampler);
+        }
+        const Index idx = m_light_cache->sample(pos, sampler.sample_1d());
+        return {m_lights[idx], m_light_cache->pdf(pos, idx)};
+    }
+
     Float Scene::pdf_light(const Light *light) const{
         return m_lights_pdf.pdf(m_light_idx_map.at(light));
     }
 
+    Float Scene::pdf_light(const Light *light, const Vector3f &pos) const{
+        if(m_light_cache == nullptr){
+            return pdf_light(light);
+        }
+        return m_light_cache->pdf(pos, m_light_idx_map.at(light));
+    }
+
     void Scene::build_accel() {
-        m_accel = new BVHScene();
+        if(m_accel == nullptr){
+            m_accel = new BVHScene();
+        }
         m_accel->build(m_meshes);
     }
 
     void Scene::build_light_pdf() {
         std::vector<Float> light_power;
         light_power.reserve(m_lights.size());
+        m_light_idx_map.clear();
 
         int i = 0;
         for (auto p : m_lights) {
@@ -114,4 +160,14 @@ namespace Caramel{
         }
         m_lights_pdf = Distrib1D(light_power);
     }
+
+    void Scene::build_light_cache(Index resolution, Index training_spp) {
+        delete m_light_cache;
+        m_light_cache = new LightCache(*this, resolution, training_spp);
+    }
+
+    void Scene::clear_light_cache() {
+        delete m_light_cache;
+        m_light_cache = nullptr;
+    }
 }
@@ -38,7 +38,13 @@ namespace Caramel{
     }
 
 
+    BVHScene::~BVHScene() {
+        delete m_bvh_root;
+    }
+
     void BVHScene::build(const std::vector<const Shape*> &shapes) {
+        // Rebuilt when shapes of the scene change
+        delete m_bvh_root;
         m_bvh_root = new BVHTree<BVHSceneTraits>(shapes, BVHSceneTraits{}, Float1, Float2, 12, 4);
     }
 
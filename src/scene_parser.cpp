@@ -22,21 +22,59 @@
 // SOFTWARE.
 //
 
+#include <algorithm>
+#include <exception>
 #include <fstream>
+#include <functional>
 
 #include <scene_parser.h>
 
+#include <asset_registry.h>
 #include <scene.h>
 #include <integrators.h>
 #include <camera.h>
 #include <bsdf.h>
+#include <image.h>
 #include <shape.h>
 #include <logger.h>
 #include <light.h>
+#include <parallel_for.h>
+#include <scene_snapshot.h>
 #include <textures.h>
+#include <tiled_image.h>
 #include <transform.h>
 
 namespace Caramel{
+
+    namespace{
+        // Entries whose geometry is loaded from a mesh file, or from a scene snapshot
+        bool is_mesh_file(const nlohmann::json &shape_json){
+            const std::string type = shape_json.value("type", "");
+            return type == "obj" || type == "ply" || type == "crmesh";
+        }
+
+        // Runs func(i) for i in [0, count) on the thread pool. An error is rethrown on the calling
+        // thread after every task finished, the one of the lowest index first, so that a failing
+        // load reports the same error as a sequential one.
+        template <typename F>
+        void parallel_load(Index count, F &&func){
+            std::vector<std::exception_ptr> errors(count);
+            parallel_for(0, static_cast<int>(count), [&](int i){
+                try{
+                    func(static_cast<Index>(i));
+                }
+                catch(...){
+                    errors[i] = std::current_exception();
+                }
+            });
+            for(const auto &e : errors){
+                if(e){
+                    std::rethrow_exception(e);
+                }
+            }
+        }
+    }
+
     SceneParser::SceneParser(const std::filesystem::path &path) {
         CRM_LOG("Parsing " + path.string());
         if(!std::filesystem::exists(path)){
@@ -47,6 +85,11 @@ namespace Caramel{
         m_scene_json = Json::parse(stream);
     }
 
+    SceneParser::SceneParser(const Json &scene_json) : m_scene_json(scene_json) {}
+
+    SceneParser::SceneParser(std::shared_ptr<const SceneSnapshot> snapshot)
+        : m_scene_json(snapshot->scene_json()), m_snapshot(std::move(snapshot)) {}
+
     void SceneParser::parse_bsdfs_map() {
         if(!m_scene_json.contains("bsdfs")){
             return;
@@ -89,9 +132,36 @@ namespace Caramel{
         //     return Integrator::Create<DirectIntegrator>(parse_positive_int(child, "spp"));
         // }
         else if(type=="path"){
-            return Integrator::Create<PathIntegrator>(parse_nonnegative_int(child, "depth_rr"),
-                                                      parse_nonnegative_int(child, "depth_max"),
-                                                      parse_positive_int(child, "spp"));
+            // Optional : "light_cache" : {"resolution" : 16, "training_spp" : 1}
+            Index light_cache_res = 0;
+            Index light_cache_spp = 0;
+            if(child.contains("light_cache")){
+                const Json light_cache = get_unique_first_elem(child, "light_cache");
+                light_cache_res = parse_positive_int(light_cache, "resolution");
+                light_cache_spp = parse_positive_int(light_cache, "training_spp");
+            }
+            // Optional : "ris_candidates" : 8
+            const Index ris_candidates = child.contains("ris_candidates") ? parse_positive_int(child, "ris_candidates") : 1;
+            // Optional : "guiding" : {"training_spp" : 63}
+            Index guiding_spp = 0;
+            if(child.contains("guiding")){
+                guiding_spp = parse_positive_int(get_unique_first_elem(child, "guiding"), "training_spp");
+            }
+            Integrator *integrator = Integrator::Create<PathIntegrator>(parse_nonnegative_int(child, "depth_rr"),
+                                                                        parse_nonnegative_int(child, "depth_max"),
+                                                                        parse_positive_int(child, "spp"),
+                                                                        light_cache_res,
+                                                                        light_cache_spp,
+                                                                        ris_candidates,
+                                                                        guiding_spp);
+            // Optional : "adaptive" : {"threshold" : 0.02, "round_spp" : 16, "min_spp" : 32}, "spp" becomes the maximum
+            if(child.contains("adaptive")){
+                const Json adaptive = get_unique_first_elem(child, "adaptive");
+                dynamic_cast<MCIntegrator*>(integrator)->set_adaptive(parse_positive_float(adaptive, "threshold"),
+                                                                      parse_positive_int(adaptive, "round_spp"),
+                                                                      adaptive.contains("min_spp") ? parse_positive_int(adaptive, "min_spp") : 0);
+            }
+            return integrator;
         }
         else{
             CRM_ERROR(type + "integrator is not supported : "+ to_string(child));
@@ -100,46 +170,153 @@ namespace Caramel{
 
     Camera* SceneParser::parse_camera() const {
         const Json child = get_unique_first_elem(m_scene_json, "camera");
+        if(!child.is_object() || child.contains("keyframes")){
+            CRM_ERROR("Single camera is expected : " + to_string(child));
+        }
+        return parse_camera(child);
+    }
+
+    std::vector<Camera*> SceneParser::parse_cameras() const {
+        const Json child = get_unique_first_elem(m_scene_json, "camera");
+        std::vector<Camera*> cameras;
+
+        if(child.is_array()){
+            if(child.empty()){
+                CRM_ERROR("Camera array is empty");
+            }
+            for(const auto &camera_json : child){
+                cameras.push_back(parse_camera(camera_json));
+            }
+            return cameras;
+        }
+        if(!child.contains("keyframes")){
+            cameras.push_back(parse_camera(child));
+            return cameras;
+        }
+
+        struct Keyframe{
+            Float time;
+            Vector3f pos;
+            Vector3f dir;
+            Vector3f up;
+        };
+        std::vector<Keyframe> keyframes;
+        for(const auto &key_json : get_unique_first_elem(child, "keyframes")){
+            const Vector3f dir = parse_vector3f(key_json, "dir");
+            const Vector3f up = parse_vector3f(key_json, "up");
+            const Vector3f left = Vector3f::cross(up, dir);
+            if(!(left.length() > EPSILON * dir.length() * up.length())){
+                CRM_ERROR("Camera keyframe dir and up should be nonzero and not parallel : " + to_string(key_json));
+            }
+            // Up is made orthogonal to dir, so each keyframe is a rotation of the camera
+            keyframes.push_back({parse_float(key_json, "time"),
+                                 parse_vector3f(key_json, "pos"),
+                                 dir.normalize(),
+                                 Vector3f::cross(dir, left).normalize()});
+        }
+        if(keyframes.empty()){
+            CRM_ERROR("Camera keyframes are empty : " + to_string(child));
+        }
+        for(Index i=1;i<keyframes.size();i++){
+            if(keyframes[i].time <= keyframes[i-1].time){
+                CRM_ERROR("Camera keyframe times should be increasing : " + to_string(child));
+            }
+        }
+
+        const Index frames = parse_positive_int(child, "frames");
+        const Float t0 = keyframes.front().time;
+        const Float t1 = keyframes.back().time;
+        Json frame_json = child;
+        frame_json.erase("keyframes");
+        frame_json.erase("frames");
+        frame_json.erase("matrix");
+        Index key = 0;
+        for(Index i=0;i<frames;i++){
+            const Float t = frames == 1 ? t0 : t0 + (t1 - t0) * static_cast<Float>(i) / static_cast<Float>(frames - 1);
+            while(key + 2 < keyframes.size() && keyframes[key + 1].time <= t){
+                key++;
+            }
+            const Keyframe &a = keyframes[key];
+            const Keyframe &b = keyframes[std::min<Index>(key + 1, keyframes.size() - 1)];
+            const Float alpha = b.time > a.time ? std::clamp((t - a.time) / (b.time - a.time), Float0, Float1) : Float0;
+            const Vector3f pos = a.pos * (Float1 - alpha) + b.pos * alpha;
+
+            // The orientation turns at constant speed along the shortest arc from a.dir to b.dir,
+            // and rolls around the view direction from the turned a.up to b.up
+            const auto rotate = [](const Vector3f &v, const Vector3f &axis, Float angle){
+                return v * std::cos(angle) + Vector3f::cross(axis, v) * std::sin(angle) +
+                       axis * (axis.dot(v) * (Float1 - std::cos(angle)));
+            };
+            const Vector3f turn_axis = Vector3f::cross(a.dir, b.dir);
+            const Float turn = std::acos(std::clamp(a.dir.dot(b.dir), -Float1, Float1));
+            // Opposite directions have no shortest arc, they turn around the up vector
+            const Vector3f axis = turn_axis.length() > static_cast<Float>(1e-6) ? turn_axis.normalize() : a.up;
+            const Vector3f turned_up = rotate(a.up, axis, turn);
+            const Float roll = std::atan2(Vector3f::cross(turned_up, b.up).dot(b.dir), turned_up.dot(b.up));
+            const Vector3f dir = rotate(a.dir, axis, turn * alpha);
+            const Vector3f up = rotate(rotate(a.up, axis, turn * alpha), dir, roll * alpha);
+            frame_json["pos"] = {pos[0], pos[1], pos[2]};
+            frame_json["dir"] = {dir[0], dir[1], dir[2]};
+            frame_json["up"] = {up[0], up[1], up[2]};
+            cameras.push_back(parse_camera(frame_json));
+        }
+        return cameras;
+    }
+
+    Camera* SceneParser::parse_camera(const Json &child) const {
         const std::string type = parse_string(child, "type");
+        Camera *camera = nullptr;
         if(type == "pinhole"){
             if(child.contains("pos")){
-                return Camera::Create<Pinhole>(parse_vector3f(child, "pos"),
-                                               parse_vector3f(child, "dir"),
-                                               parse_vector3f(child, "up"),
-                                               parse_positive_int(child, "width"),
-                                               parse_positive_int(child, "height"),
-                                               parse_positive_float(child, "fov"));
+                camera = Camera::Create<Pinhole>(parse_vector3f(child, "pos"),
+                                                 parse_vector3f(child, "dir"),
+                                                 parse_vector3f(child, "up"),
+                                                 parse_positive_int(child, "width"),
+                                                 parse_positive_int(child, "height"),
+                                                 parse_positive_float(child, "fov"));
             }
             else{
-                return Camera::Create<Pinhole>(parse_matrix44f(child, "matrix"),
-                                               parse_positive_int(child, "width"),
-                                               parse_positive_int(child, "height"),
-                                               parse_positive_float(child, "fov"));
+                camera = Camera::Create<Pinhole>(parse_matrix44f(child, "matrix"),
+                                                 parse_positive_int(child, "width"),
+                                                 parse_positive_int(child, "height"),
+                                                 parse_positive_float(child, "fov"));
             }
         }
         else if(type == "thinlens"){
             if(child.contains("pos")){
-                return Camera::Create<ThinLens>(parse_vector3f(child, "pos"),
-                                               parse_vector3f(child, "dir"),
-                                               parse_vector3f(child, "up"),
-                                               parse_positive_int(child, "width"),
-                                               parse_positive_int(child, "height"),
-                                               parse_positive_float(child, "fov"),
-                                               parse_positive_float(child, "lens_radius"),
-                                               parse_positive_float(child, "focal_dist"));
+                camera = Camera::Create<ThinLens>(parse_vector3f(child, "pos"),
+                                                 parse_vector3f(child, "dir"),
+                                                 parse_vector3f(child, "up"),
+                                                 parse_positive_int(child, "width"),
+                                                 parse_positive_int(child, "height"),
+                                                 parse_positive_float(child, "fov"),
+                                                 parse_positive_float(child, "lens_radius"),
+                                                 parse_positive_float(child, "focal_dist"));
             }
             else{
-                return Camera::Create<ThinLens>(parse_matrix44f(child, "matrix"),
-                                               parse_positive_int(child, "width"),
-                                               parse_positive_int(child, "height"),
-                                               parse_positive_float(child, "fov"),
-                                               parse_positive_float(child, "lens_radius"),
-                                               parse_positive_float(child, "focal_dist"));
+                camera = Camera::Create<ThinLens>(parse_matrix44f(child, "matrix"),
+                                                 parse_positive_int(child, "width"),
+                                                 parse_positive_int(child, "height"),
+                                                 parse_positive_float(child, "fov"),
+                                                 parse_positive_float(child, "lens_radius"),
+                                                 parse_positive_float(child, "focal_dist"));
             }
         }
         else{
             CRM_ERROR(type + " camera is not supported : "+ to_string(child));
         }
+
+        // Optional : "crop" : {"x_min" : 100, "y_min" : 50, "x_max" : 300, "y_max" : 250}
+        if(child.contains("crop")){
+            const Json crop = get_unique_first_elem(child, "crop");
+            const ImageRegion region{parse_nonnegative_int(crop, "x_min"), parse_nonnegative_int(crop, "y_min"),
+                                     parse_positive_int(crop, "x_max"), parse_positive_int(crop, "y_max")};
+            if(region.is_empty()){
+                CRM_ERROR("Crop window is empty : " + to_string(crop));
+            }
+            camera->set_crop(region);
+        }
+        return camera;
     }
 
     std::vector<Shape*> SceneParser::parse_shapes() const {
@@ -147,13 +324,19 @@ namespace Caramel{
 
         const Json child = get_unique_first_elem(m_scene_json, "shape");
         if(child.is_array()){
-            for(const auto &ch : child){
+            // Each entry loads its meshes and builds their BVHs as one task
+            std::vector<std::vector<Shape*>> entry_shapes(child.size());
+            parallel_load(static_cast<Index>(child.size()), [&](Index i){
+                const Json &ch = child[i];
                 if(parse_string(ch, "type") == "instance"){
-                    parse_instanced_shapes(ch, shapes);
+                    parse_instanced_shapes(ch, entry_shapes[i]);
                 }
                 else{
-                    shapes.emplace_back(parse_shape(ch));
+                    entry_shapes[i].emplace_back(parse_shape(ch));
                 }
+            });
+            for(const auto &s : entry_shapes){
+                shapes.insert(shapes.end(), s.begin(), s.end());
             }
         }
         return shapes;
@@ -162,7 +345,7 @@ namespace Caramel{
     void SceneParser::parse_instanced_shapes(const SceneParser::Json &shape_json, std::vector<Shape*> &out) const {
         // Build the template once (group-local space): parallel geometry + bsdf arrays.
         //   shapes-form : many sub-shapes, each carrying its own geometry + bsdf.
-        std::vector<const Shape*> geometries;
+        std::vector<std::shared_ptr<const Shape>> geometries;
         std::vector<BSDF*> bsdfs;
         std::vector<Vector3f> radiances;
 
@@ -178,11 +361,18 @@ namespace Caramel{
         }
 
         for(const auto &s : sub_shapes){
-            Json geom = s;
-            geom.erase("arealight");
-            Shape *geometry = parse_shape(geom);
-            geometries.emplace_back(geometry);
-            bsdfs.emplace_back(geometry->get_bsdf());
+            if(is_mesh_file(s)){
+                // Shared with other entries of the same file and transform
+                geometries.emplace_back(parse_mesh_template(s, true));
+                bsdfs.emplace_back(parse_bsdf(s));
+            }
+            else{
+                Json geom = s;
+                geom.erase("arealight");
+                Shape *geometry = parse_shape(geom);
+                geometries.emplace_back(geometry);
+                bsdfs.emplace_back(geometry->get_bsdf());
+            }
 
             if(s.contains("arealight")){
                 const Json al_child = get_unique_first_elem(s, "arealight");
@@ -209,43 +399,158 @@ namespace Caramel{
 
         const Json child = get_unique_first_elem(m_scene_json, "light", true/*optional*/);
         if(child.is_array()){
-            bool is_envmap_parsed = false;
+            lights.resize(child.size());
+            parallel_load(static_cast<Index>(child.size()), [&](Index i){
+                lights[i] = parse_light(child[i]);
+            });
 
-            for(const auto &ch : child){
-                auto light = parse_light(ch);
+            bool is_envmap_parsed = false;
+            for(auto light : lights){
                 if (light->is_envlight() && is_envmap_parsed) {
                     CRM_ERROR("Environment map can't be more than 1");
                 }
                 is_envmap_parsed |= light->is_envlight();
-                lights.emplace_back(light);
             }
         }
         return lights;
     }
 
+    struct SceneParser::MeshSource{
+        std::string type;
+        std::string path;
+        MeshStorage storage;
+        // Set for meshes stored in a snapshot
+        std::shared_ptr<const SceneSnapshot> snapshot;
+        std::uint64_t snapshot_offset = 0;
+
+        TriangleMesh* load(BSDF *bsdf, AreaLight *arealight, const Matrix44f &transform) const {
+            if(snapshot != nullptr){
+                return new CRMesh(snapshot->file(), snapshot_offset, path, bsdf, arealight, transform, storage);
+            }
+            if(type=="obj"){
+                return new OBJMesh(path, bsdf, arealight, transform, storage);
+            }
+            if(type=="ply"){
+                return new PLYMesh(path, bsdf, arealight, transform, storage);
+            }
+            return new CRMesh(path, bsdf, arealight, transform, storage);
+        }
+
+        // Bounds in the header of crmesh files, obj and ply files are scanned for vertex positions only
+        AABB aabb(const Matrix44f &transform) const {
+            if(snapshot != nullptr){
+                return CRMesh::read_aabb(*snapshot->file(), snapshot_offset, path).transformed(transform);
+            }
+            if(type=="obj"){
+                return OBJMesh::read_aabb(path, transform);
+            }
+            if(type=="ply"){
+                return PLYMesh::read_aabb(path, transform);
+            }
+            return CRMesh::read_aabb(path).transformed(transform);
+        }
+    };
+
+    SceneParser::MeshSource SceneParser::parse_mesh_source(const Json &shape_json) const {
+        MeshSource source{parse_string(shape_json, "type"), parse_string(shape_json, "path"), parse_mesh_storage(shape_json)};
+        if(shape_json.contains("snapshot_offset")){
+            if(m_snapshot == nullptr){
+                CRM_ERROR("snapshot_offset is only valid in a scene snapshot : " + to_string(shape_json));
+            }
+            source.snapshot = m_snapshot;
+            source.snapshot_offset = static_cast<std::uint64_t>(get_unique_first_elem(shape_json, "snapshot_offset"));
+        }
+        return source;
+    }
+
+    Shape* SceneParser::load_mesh(const Json &shape_json, BSDF *bsdf, AreaLight *arealight, const Matrix44f &transform) const {
+        return parse_mesh_source(shape_json).load(bsdf, arealight, transform);
+    }
+
+    bool SceneParser::parse_lazy_load(const Json &shape_json) const {
+        if(!shape_json.contains("load")){
+            return false;
+        }
+        const std::string load = parse_string(shape_json, "load");
+        if(load == "eager"){
+            return false;
+        }
+        else if(load == "lazy"){
+            return true;
+        }
+        CRM_ERROR("Unsupported mesh load : " + load);
+    }
+
+    std::tuple<std::string, std::filesystem::path, std::string> SceneParser::mesh_template_id(const Json &shape_json, bool apply_to_world) const {
+        std::string params = std::to_string(static_cast<int>(parse_mesh_storage(shape_json)));
+        if(apply_to_world && shape_json.contains("to_world")){
+            params += to_string(shape_json["to_world"]);
+        }
+        if(shape_json.contains("snapshot_offset")){
+            if(m_snapshot == nullptr){
+                CRM_ERROR("snapshot_offset is only valid in a scene snapshot : " + to_string(shape_json));
+            }
+            return {"snapshot_mesh", m_snapshot->path(), to_string(shape_json["snapshot_offset"]) + ":" + params};
+        }
+        return {parse_string(shape_json, "type"), parse_string(shape_json, "path"), params};
+    }
+
+    std::shared_ptr<const Shape> SceneParser::parse_mesh_template(const Json &shape_json, bool apply_to_world) const {
+        const Matrix44f transform = apply_to_world && shape_json.contains("to_world") ? parse_matrix44f(shape_json, "to_world") :
+                                                                                      Matrix44f::identity();
+        const auto [kind, path, params] = mesh_template_id(shape_json, apply_to_world);
+        return AssetRegistry::instance().get<Shape>(kind, path, params, [&](){
+            return load_mesh(shape_json, nullptr, nullptr, transform);
+        });
+    }
+
+    bool SceneParser::is_repeated_mesh(const Json &shape_json) const {
+        const auto key = [this](const Json &json){
+            return std::apply(AssetRegistry::key, mesh_template_id(json, false));
+        };
+        std::call_once(m_mesh_references_once, [&](){
+            const Json child = get_unique_first_elem(m_scene_json, "shape", true/*optional*/);
+            if(child.is_array()){
+                for(const auto &ch : child){
+                    if(is_mesh_file(ch)){
+                        m_mesh_references[key(ch)]++;
+                    }
+                }
+            }
+            for(const auto &[k, count] : m_mesh_references){
+                if(count > 1){
+                    CRM_LOG("Instancing " + std::to_string(count) + " references of " + k);
+                }
+            }
+        });
+        const auto it = m_mesh_references.find(key(shape_json));
+        return it != m_mesh_references.end() && it->second > 1;
+    }
+
     Shape* SceneParser::parse_shape(const SceneParser::Json &shape_json) const {
         const std::string type = parse_string(shape_json, "type");
-        if(type=="obj"){
-            return Shape::Create<OBJMesh>(parse_string(shape_json, "path"),
-                                          parse_bsdf(shape_json),
-                                          shape_json.contains("arealight") ?
-                                                                           parse_arealight(shape_json) :
-                                                                           nullptr,
-                                          shape_json.contains("to_world") ?
-                                                                          parse_matrix44f(shape_json, "to_world") :
-                                                                          Matrix44f::identity());
-        }
-        else if(type=="ply"){
-            return Shape::Create<PLYMesh>(parse_string(shape_json, "path"),
-                                          parse_bsdf(shape_json),
-                                          shape_json.contains("arealight") ?
-                                                                           parse_arealight(shape_json) :
-                                                                           nullptr,
-                                          shape_json.contains("to_world") ?
-                                                                          parse_matrix44f(shape_json, "to_world") :
-                                                                          Matrix44f::identity());
-        }
-        else if(type=="triangle"){
+        if(is_mesh_file(shape_json)){
+            BSDF *bsdf = parse_bsdf(shape_json);
+            AreaLight *arealight = shape_json.contains("arealight") ? parse_arealight(shape_json) : nullptr;
+            const Matrix44f to_world = shape_json.contains("to_world") ? parse_matrix44f(shape_json, "to_world") :
+                                                                         Matrix44f::identity();
+            // A file referenced by several entries is loaded once and placed as instances
+            if(is_repeated_mesh(shape_json)){
+                return Shape::Create<Instance>(parse_mesh_template(shape_json, false), to_world, bsdf, arealight);
+            }
+            if(parse_lazy_load(shape_json)){
+                if(arealight == nullptr){
+                    const MeshSource source = parse_mesh_source(shape_json);
+                    return Shape::Create<LazyMesh>(std::function<TriangleMesh*()>([source, to_world](){
+                                                       return source.load(nullptr, nullptr, to_world);
+                                                   }),
+                                                   source.aabb(to_world), bsdf);
+                }
+                CRM_WARNING("Emitting meshes are loaded eagerly : " + parse_string(shape_json, "path"));
+            }
+            return load_mesh(shape_json, bsdf, arealight, to_world);
+        }
+        if(type=="triangle"){
             if(shape_json.contains("n0") || shape_json.contains("n1") || shape_json.contains("n2")){
                 return Shape::Create<Triangle>(parse_vector3f(shape_json, "p0"),
                                                parse_vector3f(shape_json, "p1"),
@@ -299,13 +604,31 @@ namespace Caramel{
             return Shape::Create<InlineTriangleMesh>(positions, indices, normals,
                                                      parse_bsdf(shape_json),
                                                      shape_json.contains("arealight") ? parse_arealight(shape_json) : nullptr,
-                                                     shape_json.contains("to_world") ? parse_matrix44f(shape_json, "to_world") : Matrix44f::identity());
+                                                     shape_json.contains("to_world") ? parse_matrix44f(shape_json, "to_world") : Matrix44f::identity(),
+                                                     parse_mesh_storage(shape_json));
         }
 
         CRM_ERROR("Unsupported shape type : " + type);
         return nullptr;
     }
 
+    MeshStorage SceneParser::parse_mesh_storage(const SceneParser::Json &shape_json) const {
+        if(!shape_json.contains("storage")){
+            return MeshStorage::Full;
+        }
+        const std::string storage = parse_string(shape_json, "storage");
+        if(storage == "full"){
+            return MeshStorage::Full;
+        }
+        else if(storage == "compact"){
+            return MeshStorage::Compact;
+        }
+        else if(storage == "quantized"){
+            return MeshStorage::Quantized;
+        }
+        CRM_ERROR("Unsupported mesh storage : " + storage);
+    }
+
     Light* SceneParser::parse_light(const SceneParser::Json &light_json) const {
         const std::string type = parse_string(light_json, "type");
         if(type=="point"){
@@ -317,7 +640,14 @@ namespace Caramel{
                                               parse_positive_float(light_json, "scale"));
         }
         else if(type=="image_env"){
-            return Light::Create<ImageEnvLight>(parse_string(light_json, "path"),
+            const std::string path = parse_string(light_json, "path");
+            if(Image *image = m_snapshot != nullptr ? m_snapshot->create_image(path) : nullptr){
+                return Light::Create<ImageEnvLight>(std::shared_ptr<const Image>(image),
+                                                    parse_positive_float(light_json, "scale"),
+                                                    light_json.contains("to_world") ? parse_matrix44f(light_json, "to_world") :
+                                                                                      Matrix44f::identity());
+            }
+            return Light::Create<ImageEnvLight>(path,
                                                 parse_positive_float(light_json, "scale"),
                                                 light_json.contains("to_world") ? parse_matrix44f(light_json, "to_world") :
                                                                                   Matrix44f::identity());
@@ -393,11 +723,77 @@ namespace Caramel{
         const Json child = get_unique_first_elem(texture_json, "texture");
         const std::string type = parse_string(child, "type");
         if(type=="image"){
-            return Texture::Create<ImageTexture>(parse_string(child, "path"));
+            return load_image_texture(parse_string(child, "path"));
         }
         CRM_ERROR("Can not parse texture : " + to_string(child));
     }
 
+    Texture* SceneParser::load_image_texture(const std::string &path) const {
+        // Textures of a snapshot read their tiles from it
+        std::shared_ptr<const TiledImage> snapshot_image = m_snapshot != nullptr ? m_snapshot->create_tiled_image(path) : nullptr;
+        std::string key;
+        if(snapshot_image != nullptr){
+            key = "snapshot:" + path;
+        }
+        else{
+            std::error_code ec;
+            const auto mtime = std::filesystem::last_write_time(path, ec);
+            key = std::filesystem::absolute(path).string() + "@" +
+                  std::to_string(ec ? 0 : mtime.time_since_epoch().count());
+        }
+        auto &cache = m_texture_cache != nullptr ? *m_texture_cache : m_texture_map;
+        {
+            std::lock_guard<std::mutex> lock(m_texture_mutex);
+            const auto it = cache.find(key);
+            if(it != cache.end()){
+                return it->second;
+            }
+        }
+        // Loaded without the lock, another thread may have loaded the same image meanwhile
+        Texture *texture = snapshot_image != nullptr ? Texture::Create<ImageTexture>(snapshot_image) :
+                                                       Texture::Create<ImageTexture>(path);
+        std::lock_guard<std::mutex> lock(m_texture_mutex);
+        const auto [it, inserted] = cache.emplace(key, texture);
+        if(!inserted){
+            delete texture;
+        }
+        return it->second;
+    }
+
+    std::vector<std::string> SceneParser::image_texture_paths() const {
+        std::vector<std::string> paths;
+        const std::function<void(const Json&)> collect = [&](const Json &json){
+            if(json.is_object()){
+                if(json.contains("texture") && json["texture"].is_object()){
+                    const Json &texture = json["texture"];
+                    if(texture.value("type", "") == "image" && texture.contains("path") && texture["path"].is_string()){
+                        paths.push_back(texture["path"].get<std::string>());
+                    }
+                }
+                for(const auto &item : json.items()){
+                    collect(item.value());
+                }
+            }
+            else if(json.is_array()){
+                for(const auto &e : json){
+                    collect(e);
+                }
+            }
+        };
+        collect(m_scene_json);
+        std::ranges::sort(paths);
+        const auto [first, last] = std::ranges::unique(paths);
+        paths.erase(first, last);
+        return paths;
+    }
+
+    void SceneParser::load_textures() const {
+        const std::vector<std::string> paths = image_texture_paths();
+        parallel_load(static_cast<Index>(paths.size()), [&](Index i){
+            load_image_texture(paths[i]);
+        });
+    }
+
     SceneParser::Json SceneParser::get_unique_first_elem(const SceneParser::Json &parent, const std::string &key, bool optional) const {
         if(!parent.contains(key)){
             if(optional){
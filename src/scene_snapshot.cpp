@@ -0,0 +1,231 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <tuple>
+#include <unordered_map>
+
+#include <scene_snapshot.h>
+
+#include <asset_registry.h>
+#include <image.h>
+#include <logger.h>
+#include <mapped_file.h>
+#include <scene_parser.h>
+#include <shape.h>
+#include <tiled_image.h>
+
+namespace Caramel{
+
+    namespace{
+        bool is_mesh_entry(const nlohmann::json &shape_json){
+            const std::string type = shape_json.value("type", "");
+            return type == "obj" || type == "ply" || type == "crmesh";
+        }
+    }
+
+    void SceneSnapshot::write(const std::filesystem::path &scene_path, const std::filesystem::path &snapshot_path) {
+        const std::filesystem::path output = std::filesystem::absolute(snapshot_path);
+        const std::filesystem::path input = std::filesystem::absolute(scene_path);
+        std::filesystem::current_path(input.parent_path());
+        const SceneParser parser(input);
+        Json scene_json = parser.m_scene_json;
+
+        const std::string tmp_filename = output.string() + ".tmp";
+        std::ofstream stream(tmp_filename, std::ios::binary | std::ios::trunc);
+        if(!stream){
+            CRM_ERROR("Cannot write scene snapshot : " + tmp_filename);
+        }
+        FileHeader header{};
+        header.float_size = sizeof(Float);
+        stream.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        // Every block starts aligned, so that arrays in it are aligned when mapped
+        const auto align_stream = [&stream](){
+            const char zeros[CRMesh::SECTION_ALIGNMENT] = {};
+            const auto offset = static_cast<std::uint64_t>(stream.tellp());
+            stream.write(zeros, static_cast<std::streamsize>((CRMesh::SECTION_ALIGNMENT - offset % CRMesh::SECTION_ALIGNMENT) % CRMesh::SECTION_ALIGNMENT));
+            return static_cast<std::uint64_t>(stream.tellp());
+        };
+
+        // Mesh entries, including sub-shapes of instances. Files referenced by several entries are
+        // placed as instances, so their geometry is stored once in the space of the file.
+        struct MeshEntry{
+            Json *json;
+            bool instanced;
+        };
+        std::vector<MeshEntry> mesh_entries;
+        if(scene_json.contains("shape") && scene_json["shape"].is_array()){
+            for(Json &shape_json : scene_json["shape"]){
+                if(shape_json.value("type", "") == "instance" && shape_json.contains("shapes") && shape_json["shapes"].is_array()){
+                    for(Json &sub_shape : shape_json["shapes"]){
+                        if(is_mesh_entry(sub_shape)){
+                            mesh_entries.push_back({&sub_shape, false});
+                        }
+                    }
+                }
+                else if(is_mesh_entry(shape_json)){
+                    mesh_entries.push_back({&shape_json, parser.is_repeated_mesh(shape_json)});
+                }
+            }
+        }
+        std::unordered_map<std::string, std::uint64_t> mesh_offsets;
+        for(const auto &[entry, instanced] : mesh_entries){
+            // Only the geometry is stored, the material and emission are parsed when the snapshot is loaded
+            Json geometry = *entry;
+            geometry.erase("storage");
+            const std::string key = std::apply(AssetRegistry::key, parser.mesh_template_id(geometry, !instanced));
+            auto [it, inserted] = mesh_offsets.emplace(key, 0);
+            if(inserted){
+                const std::shared_ptr<const Shape> shape = parser.parse_mesh_template(geometry, !instanced);
+                it->second = align_stream();
+                CRMesh::write(*dynamic_cast<const TriangleMesh*>(shape.get()), stream);
+            }
+
+            (*entry)["type"] = "crmesh";
+            (*entry)["snapshot_offset"] = it->second;
+            if(!instanced){
+                // Transformed to world space when stored
+                entry->erase("to_world");
+            }
+        }
+
+        // Image textures are stored as tiled mip pyramids, read through the texture cache, and
+        // environment maps as pixels. An image used as both is stored both ways.
+        std::vector<std::string> env_paths;
+        if(scene_json.contains("light") && scene_json["light"].is_array()){
+            for(const Json &light_json : scene_json["light"]){
+                if(light_json.value("type", "") == "image_env" && light_json.contains("path")){
+                    env_paths.emplace_back(light_json["path"].get<std::string>());
+                }
+            }
+        }
+        Json images = Json::object();
+        for(const std::string &path : parser.image_texture_paths()){
+            const Image image(path);
+            images[path]["tiled_offset"] = align_stream();
+            TiledImage::write(image, stream);
+        }
+        for(const std::string &path : env_paths){
+            if(images.contains(path) && images[path].contains("offset")){
+                continue;
+            }
+            const Image image(path);
+            const std::uint64_t offset = align_stream();
+            const std::span<const std::byte> pixels = std::as_bytes(image.pixels());
+            stream.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+            images[path]["offset"] = offset;
+            images[path]["width"] = image.size()[0];
+            images[path]["height"] = image.size()[1];
+        }
+
+        const std::string json = Json{{"scene", scene_json}, {"images", images}}.dump();
+        header.json_offset = align_stream();
+        header.json_size = json.size();
+        stream.write(json.data(), static_cast<std::streamsize>(json.size()));
+        stream.seekp(sizeof(FILE_MAGIC));
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.close();
+        if(!stream){
+            CRM_ERROR("Failed to write scene snapshot : " + tmp_filename);
+        }
+        // Processes which mapped the previous snapshot keep reading it
+        std::filesystem::rename(tmp_filename, output);
+        CRM_LOG("Saved scene snapshot : " + output.string() + " (" + std::to_string(mesh_offsets.size()) + " meshes, " +
+                std::to_string(images.size()) + " images)");
+    }
+
+    bool SceneSnapshot::is_snapshot(const std::filesystem::path &path) {
+        return path.extension() == ".crscene";
+    }
+
+    SceneSnapshot::SceneSnapshot(const std::filesystem::path &path) : m_path(std::filesystem::absolute(path)) {
+        CRM_LOG("Loading scene snapshot : " + path.string());
+        if(!std::filesystem::exists(path)){
+            CRM_ERROR("Scene snapshot does not exists : " + path.string());
+        }
+        m_file = std::make_shared<const MappedFile>(path);
+
+        FileHeader header;
+        if(m_file->size() < sizeof(FILE_MAGIC) + sizeof(FileHeader) ||
+           std::memcmp(m_file->data(), FILE_MAGIC, sizeof(FILE_MAGIC)) != 0){
+            CRM_ERROR("Invalid scene snapshot : " + path.string());
+        }
+        std::memcpy(&header, m_file->data() + sizeof(FILE_MAGIC), sizeof(FileHeader));
+        if(header.float_size != sizeof(Float)){
+            CRM_ERROR("Scene snapshot is written with another floating point type : " + path.string());
+        }
+        if(header.json_offset > m_file->size() || header.json_size > m_file->size() - header.json_offset){
+            CRM_ERROR("Truncated scene snapshot : " + path.string());
+        }
+
+        const char *json_begin = m_file->data() + header.json_offset;
+        Json json = Json::parse(json_begin, json_begin + header.json_size);
+        m_scene_json = std::move(json["scene"]);
+        for(const auto &[image_path, entry] : json["images"].items()){
+            if(entry.contains("tiled_offset")){
+                const auto offset = entry["tiled_offset"].get<std::uint64_t>();
+                if(offset > m_file->size()){
+                    CRM_ERROR("Truncated scene snapshot : " + path.string());
+                }
+                m_tiled_images.emplace(image_path, offset);
+            }
+            if(!entry.contains("offset")){
+                continue;
+            }
+            const ImageEntry image{entry["offset"].get<std::uint64_t>(), entry["width"].get<Index>(), entry["height"].get<Index>()};
+            const std::uint64_t byte_size = static_cast<std::uint64_t>(image.width) * image.height * Image::CHANNEL_NUM * sizeof(Float);
+            if(image.offset % alignof(Float) != 0 || image.offset > m_file->size() || byte_size > m_file->size() - image.offset){
+                CRM_ERROR("Truncated scene snapshot : " + path.string());
+            }
+            m_images.emplace(image_path, image);
+        }
+    }
+
+    SceneSnapshot::~SceneSnapshot() = default;
+
+    Image *SceneSnapshot::create_image(const std::string &path) const {
+        const auto it = m_images.find(path);
+        if(it == m_images.end()){
+            return nullptr;
+        }
+        const ImageEntry &image = it->second;
+        const std::span<const Float> pixels(reinterpret_cast<const Float*>(m_file->data() + image.offset),
+                                            static_cast<std::size_t>(image.width) * image.height * Image::CHANNEL_NUM);
+        return new Image(image.width, image.height, pixels, m_file);
+    }
+
+    std::shared_ptr<const TiledImage> SceneSnapshot::create_tiled_image(const std::string &path) const {
+        const auto it = m_tiled_images.find(path);
+        if(it == m_tiled_images.end()){
+            return nullptr;
+        }
+        return AssetRegistry::instance().get<TiledImage>("snapshot_tiled_image", m_path, path, [&](){
+            return new TiledImage(m_path, it->second);
+        });
+    }
+
+}
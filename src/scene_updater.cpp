@@ -0,0 +1,343 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <scene_updater.h>
+
+#include <fstream>
+#include <unordered_map>
+
+#include <camera.h>
+#include <integrators.h>
+#include <light.h>
+#include <light_cache.h>
+#include <logger.h>
+#include <scene.h>
+#include <scene_accel.h>
+#include <scene_parser.h>
+#include <shape.h>
+#include <textures.h>
+
+namespace Caramel{
+
+    namespace{
+        using Json = nlohmann::json;
+
+        // Adds modification times of referenced files, so that files edited on disk count as changes
+        Json with_file_times(const Json &json){
+            Json out = json;
+            if(out.is_object()){
+                for(auto &item : out.items()){
+                    item.value() = with_file_times(item.value());
+                }
+                if(out.contains("path") && out["path"].is_string()){
+                    std::error_code ec;
+                    const auto time = std::filesystem::last_write_time(out["path"].get<std::string>(), ec);
+                    out["path_time"] = ec ? 0 : time.time_since_epoch().count();
+                }
+            }
+            else if(out.is_array()){
+                for(auto &e : out){
+                    e = with_file_times(e);
+                }
+            }
+            return out;
+        }
+
+        // Replaces BSDF ids with their descriptions, so that editing a shared BSDF changes its users
+        Json resolve_bsdfs(const Json &json, const std::unordered_map<std::string, Json> &bsdfs, Index depth = 0){
+            if(depth > 32){
+                CRM_ERROR("BSDF references are nested too deep : " + to_string(json));
+            }
+            Json out = json;
+            if(out.is_object()){
+                for(auto &item : out.items()){
+                    const bool is_reference = (item.key() == "bsdf" || item.key() == "back_bsdf") && item.value().is_string();
+                    const auto it = is_reference ? bsdfs.find(item.value().get<std::string>()) : bsdfs.end();
+                    item.value() = resolve_bsdfs(it != bsdfs.end() ? it->second : item.value(), bsdfs, depth + 1);
+                }
+            }
+            else if(out.is_array()){
+                for(auto &e : out){
+                    e = resolve_bsdfs(e, bsdfs, depth + 1);
+                }
+            }
+            return out;
+        }
+    }
+
+    SceneUpdater::SceneUpdater() : m_scene{new Scene()} {}
+
+    SceneUpdater::~SceneUpdater() {
+        for(auto &entry : m_shape_entries){
+            for(Shape *s : entry.shapes){
+                delete s->get_arealight();
+                delete s;
+            }
+        }
+        for(auto &entry : m_light_entries){
+            delete entry.light;
+        }
+        for(Camera *c : m_cameras){
+            delete c;
+        }
+        for(auto &[key, texture] : m_textures){
+            delete texture;
+        }
+        delete m_integrator;
+        delete m_scene->m_accel;
+        delete m_scene->m_light_cache;
+        delete m_scene;
+    }
+
+    SceneUpdater::UpdateStats SceneUpdater::update(const std::filesystem::path &scene_path) {
+        CRM_LOG("Updating scene from " + scene_path.string());
+        std::ifstream stream(scene_path);
+        if(!stream){
+            CRM_ERROR("Scene file does not exists : " + scene_path.string());
+        }
+        const Json scene_json = Json::parse(stream);
+        std::filesystem::current_path(std::filesystem::absolute(scene_path).parent_path());
+        return update(scene_json);
+    }
+
+    SceneUpdater::UpdateStats SceneUpdater::update(const Json &scene_json) {
+        UpdateStats stats;
+        SceneParser parser(scene_json);
+        parser.set_texture_cache(&m_textures);
+
+        // Everything which changed is parsed before the scene is touched, so that a description with
+        // errors leaves the scene as it was
+        const std::string integrator_key = parser.get_unique_first_elem(scene_json, "integrator").dump();
+        Integrator *integrator = integrator_key != m_integrator_key ? parser.parse_integrator() : nullptr;
+
+        const std::string camera_key = parser.get_unique_first_elem(scene_json, "camera").dump();
+        std::vector<Camera*> cameras;
+        if(camera_key != m_camera_key){
+            cameras = parser.parse_cameras();
+        }
+
+        parser.load_textures();
+        parser.parse_bsdfs_map();
+        std::unordered_map<std::string, Json> bsdf_descs;
+        if(scene_json.contains("bsdfs") && scene_json["bsdfs"].is_array()){
+            for(const auto &b : scene_json["bsdfs"]){
+                bsdf_descs[parser.parse_string(b, "id")] = b;
+            }
+        }
+
+        struct PendingShape{
+            ShapeEntry entry;
+            // Index of the reused entry, -1 if the shapes are new
+            int old_idx = -1;
+            BSDF *bsdf = nullptr;
+            AreaLight *arealight = nullptr;
+            bool material_changed = false;
+            bool emission_changed = false;
+        };
+        std::unordered_multimap<std::string, int> old_shapes;
+        for(int i=0;i<static_cast<int>(m_shape_entries.size());i++){
+            old_shapes.emplace(m_shape_entries[i].geometry_key, i);
+        }
+
+        std::vector<PendingShape> pending_shapes;
+        const Json shape_list = parser.get_unique_first_elem(scene_json, "shape");
+        for(const auto &shape_json : shape_list){
+            const std::string type = parser.parse_string(shape_json, "type");
+            const Json desc = with_file_times(resolve_bsdfs(shape_json, bsdf_descs));
+            PendingShape pending;
+            ShapeEntry &entry = pending.entry;
+            if(type == "instance"){
+                entry.geometry_key = desc.dump();
+            }
+            else{
+                // Whether a mesh emits changes how it is prepared for light sampling, its radiance does not.
+                // Triangles ignore emission.
+                Json geometry = desc;
+                geometry.erase("bsdf");
+                geometry["arealight"] = desc.contains("arealight");
+                entry.geometry_key = geometry.dump();
+                entry.bsdf_key = desc.contains("bsdf") ? desc["bsdf"].dump() : "";
+                entry.light_key = type != "triangle" && desc.contains("arealight") ? desc["arealight"].dump() : "";
+            }
+
+            const auto it = old_shapes.find(entry.geometry_key);
+            if(it != old_shapes.end()){
+                pending.old_idx = it->second;
+                old_shapes.erase(it);
+                const ShapeEntry &old = m_shape_entries[pending.old_idx];
+                entry.shapes = old.shapes;
+                if(entry.bsdf_key != old.bsdf_key){
+                    pending.bsdf = parser.parse_bsdf(shape_json);
+                    pending.material_changed = true;
+                }
+                if(entry.light_key != old.light_key){
+                    pending.arealight = parser.parse_arealight(shape_json);
+                    pending.emission_changed = true;
+                }
+            }
+            else if(type == "instance"){
+                std::vector<Shape*> shapes;
+                parser.parse_instanced_shapes(shape_json, shapes);
+                entry.shapes = shapes;
+            }
+            else{
+                entry.shapes.push_back(parser.parse_shape(shape_json));
+            }
+            pending_shapes.push_back(std::move(pending));
+        }
+
+        std::unordered_multimap<std::string, int> old_lights;
+        for(int i=0;i<static_cast<int>(m_light_entries.size());i++){
+            old_lights.emplace(m_light_entries[i].key, i);
+        }
+        std::vector<LightEntry> light_entries;
+        bool lights_changed = false;
+        bool is_envmap_parsed = false;
+        const Json light_list = parser.get_unique_first_elem(scene_json, "light", true/*optional*/);
+        for(const auto &light_json : light_list){
+            const std::string key = with_file_times(light_json).dump();
+            const auto it = old_lights.find(key);
+            Light *light;
+            if(it != old_lights.end()){
+                light = m_light_entries[it->second].light;
+                old_lights.erase(it);
+            }
+            else{
+                light = parser.parse_light(light_json);
+                stats.lights_built++;
+                lights_changed = true;
+            }
+            if(light->is_envlight() && is_envmap_parsed){
+                CRM_ERROR("Environment map can't be more than 1");
+            }
+            is_envmap_parsed |= light->is_envlight();
+            light_entries.push_back({key, light});
+        }
+        lights_changed |= !old_lights.empty();
+
+        // Apply the changes
+        const bool first_update = m_scene->m_accel == nullptr;
+        bool geometry_changed = first_update;
+        bool emitters_changed = first_update || lights_changed;
+
+        std::vector<bool> old_shape_kept(m_shape_entries.size(), false);
+        std::vector<const Shape*> meshes;
+        std::vector<ShapeEntry> shape_entries;
+        for(auto &pending : pending_shapes){
+            ShapeEntry &entry = pending.entry;
+            if(pending.old_idx < 0){
+                geometry_changed = true;
+                stats.shapes_built += entry.shapes.size();
+                for(Shape *s : entry.shapes){
+                    emitters_changed |= s->is_light();
+                }
+            }
+            else{
+                old_shape_kept[pending.old_idx] = true;
+                stats.shapes_kept += entry.shapes.size();
+                for(Shape *s : entry.shapes){
+                    if(pending.material_changed){
+                        s->set_bsdf(pending.bsdf);
+                    }
+                    if(pending.emission_changed){
+                        delete s->get_arealight();
+                        s->set_arealight(pending.arealight);
+                    }
+                }
+                stats.materials_changed += pending.material_changed ? 1 : 0;
+                emitters_changed |= pending.emission_changed;
+            }
+            meshes.insert(meshes.end(), entry.shapes.begin(), entry.shapes.end());
+            shape_entries.push_back(std::move(entry));
+        }
+
+        std::vector<Shape*> removed_shapes;
+        for(std::size_t i=0;i<m_shape_entries.size();i++){
+            if(old_shape_kept[i]){
+                continue;
+            }
+            geometry_changed = true;
+            for(Shape *s : m_shape_entries[i].shapes){
+                emitters_changed |= s->is_light();
+                removed_shapes.push_back(s);
+            }
+        }
+        stats.shapes_removed = removed_shapes.size();
+
+        if(geometry_changed){
+            m_scene->set_meshes(meshes);
+            m_scene->build_accel();
+            stats.accel_rebuilt = true;
+            // Power of an environment light depends on the scene radius
+            emitters_changed |= m_scene->m_envmap_light != nullptr;
+        }
+        std::vector<Light*> lights;
+        for(const auto &entry : light_entries){
+            lights.push_back(entry.light);
+        }
+        if(emitters_changed){
+            m_scene->set_lights(lights);
+            m_scene->build_light_pdf();
+            stats.light_pdf_rebuilt = true;
+        }
+        // The light cache is trained for the lights and the integrator settings, the new
+        // integrator's `pre_process()` builds it again if it uses one
+        if(emitters_changed || integrator != nullptr){
+            m_scene->clear_light_cache();
+        }
+
+        if(!cameras.empty()){
+            m_scene->m_cameras.assign(cameras.begin(), cameras.end());
+            m_scene->set_camera(cameras.front());
+            for(Camera *c : m_cameras){
+                delete c;
+            }
+            m_cameras = cameras;
+            m_camera_key = camera_key;
+            stats.camera_changed = true;
+        }
+        if(integrator != nullptr){
+            delete m_integrator;
+            m_integrator = integrator;
+            m_integrator_key = integrator_key;
+            stats.integrator_changed = true;
+        }
+
+        // Nothing refers to removed shapes and lights anymore
+        for(Shape *s : removed_shapes){
+            delete s->get_arealight();
+            delete s;
+        }
+        for(const auto &[key, idx] : old_lights){
+            delete m_light_entries[idx].light;
+        }
+        m_shape_entries = std::move(shape_entries);
+        m_light_entries = std::move(light_entries);
+
+        CRM_LOG("Scene updated : " + std::to_string(stats.shapes_kept) + " shapes kept, " +
+                std::to_string(stats.shapes_built) + " built, " + std::to_string(stats.shapes_removed) + " removed, " +
+                std::to_string(stats.materials_changed) + " materials changed");
+        return stats;
+    }
+
+}
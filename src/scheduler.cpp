@@ -0,0 +1,98 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <scheduler.h>
+
+namespace Caramel{
+
+    JobScheduler::Job::Job(JobScheduler &scheduler, const JobOptions &options)
+        : m_scheduler{scheduler}, m_created{Clock::now()} {
+        m_group.priority = options.priority;
+        m_group.weight = options.weight;
+        m_group.max_threads = static_cast<unsigned int>(options.max_threads);
+    }
+
+    void JobScheduler::Job::parallel_for(int start_idx, int end_idx, const std::function<void(int)> &func) {
+        if(start_idx >= end_idx){
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_stats_mutex);
+            if(!m_started){
+                m_first_submit = Clock::now();
+            }
+        }
+
+        m_scheduler.m_pool.parallel_for(start_idx, end_idx, [&](int i){
+            const auto start = Clock::now();
+            {
+                std::lock_guard<std::mutex> lock(m_stats_mutex);
+                if(!m_started){
+                    m_started = true;
+                    m_stats.queue_seconds = std::chrono::duration<double>(start - m_first_submit).count();
+                }
+            }
+            func(i);
+            std::lock_guard<std::mutex> lock(m_stats_mutex);
+            m_stats.tasks_done++;
+            m_stats.busy_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        }, &m_group);
+    }
+
+    JobScheduler::JobStats JobScheduler::Job::stats() const {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        JobStats stats = m_stats;
+        stats.wall_seconds = std::chrono::duration<double>(Clock::now() - m_created).count();
+        return stats;
+    }
+
+    JobScheduler& JobScheduler::instance() {
+        static JobScheduler scheduler(ThreadPool::instance());
+        return scheduler;
+    }
+
+    JobScheduler::JobScheduler(ThreadPool &pool) : m_pool{pool} {}
+
+    JobScheduler::~JobScheduler() {
+        for(Job *job : m_jobs){
+            delete job;
+        }
+    }
+
+    JobScheduler::Job *JobScheduler::create_job(const JobOptions &options) {
+        Job *job = new Job(*this, options);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(job);
+        return job;
+    }
+
+    void JobScheduler::destroy_job(Job *job) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.remove(job);
+        }
+        delete job;
+    }
+
+}
@@ -0,0 +1,324 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <sd_tree.h>
+
+#include <common.h>
+#include <parallel_for.h>
+#include <sampler.h>
+
+namespace Caramel{
+    // Equal-area cylindrical mapping between directions and [0, 1)^2
+    static Vector2f dir_to_canonical(const Vector3f &dir){
+        using std::atan2;
+        const Float cos_theta = std::clamp(dir[2], -Float1, Float1);
+        Float phi = atan2(dir[1], dir[0]);
+        if(phi < Float0){
+            phi += PI_2;
+        }
+        constexpr Float ONE_MINUS_EPS = static_cast<Float>(1) - std::numeric_limits<Float>::epsilon();
+        return {std::clamp((cos_theta + Float1) * Float0_5, Float0, ONE_MINUS_EPS),
+                std::clamp(phi * PI_2_INV, Float0, ONE_MINUS_EPS)};
+    }
+
+    static Vector3f canonical_to_dir(const Vector2f &p){
+        using std::sqrt;
+        using std::sin;
+        using std::cos;
+        const Float cos_theta = 2 * p[0] - Float1;
+        const Float sin_theta = sqrt(std::max(Float0, Float1 - cos_theta * cos_theta));
+        const Float phi = PI_2 * p[1];
+        return {sin_theta * cos(phi), sin_theta * sin(phi), cos_theta};
+    }
+
+    // Returns quadrant index of `p` and remaps `p` into the quadrant
+    static Index quadrant(Vector2f &p){
+        const Index qx = p[0] >= Float0_5 ? 1 : 0;
+        const Index qy = p[1] >= Float0_5 ? 1 : 0;
+        p[0] = p[0] * 2 - static_cast<Float>(qx);
+        p[1] = p[1] * 2 - static_cast<Float>(qy);
+        return qx + 2 * qy;
+    }
+
+    DTree::Node::Node() : child{0, 0, 0, 0} {
+        for(auto &s : sum){
+            s.store(Float0, std::memory_order_relaxed);
+        }
+    }
+
+    DTree::Node::Node(const Node &node) : child{node.child} {
+        for(int q=0;q<4;q++){
+            sum[q].store(node.sum[q].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+    }
+
+    DTree::Node &DTree::Node::operator=(const Node &node){
+        child = node.child;
+        for(int q=0;q<4;q++){
+            sum[q].store(node.sum[q].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    Float DTree::Node::total() const{
+        return sum[0].load(std::memory_order_relaxed) + sum[1].load(std::memory_order_relaxed) +
+               sum[2].load(std::memory_order_relaxed) + sum[3].load(std::memory_order_relaxed);
+    }
+
+    DTree::DTree() : m_nodes(1) {}
+
+    void DTree::record(const Vector3f &dir, Float value){
+        if(!std::isfinite(value) || value <= Float0){
+            return;
+        }
+        Vector2f p = dir_to_canonical(dir);
+        Index idx = 0;
+        while(true){
+            Node &node = m_nodes[idx];
+            const Index q = quadrant(p);
+            atomic_add(node.sum[q], value);
+            if(node.is_leaf(q)){
+                return;
+            }
+            idx = node.child[q];
+        }
+    }
+
+    Float DTree::pdf(const Vector3f &dir) const{
+        if(total() <= Float0){
+            return PI_4_INV;
+        }
+
+        // Each level scales the density by (quadrant energy / node energy) / (quadrant area / node area)
+        Vector2f p = dir_to_canonical(dir);
+        Float result = Float1;
+        Index idx = 0;
+        while(true){
+            const Node &node = m_nodes[idx];
+            const Float node_total = node.total();
+            if(node_total <= Float0){
+                return Float0;
+            }
+            const Index q = quadrant(p);
+            result *= 4 * node.sum[q].load(std::memory_order_relaxed) / node_total;
+            if(node.is_leaf(q)){
+                break;
+            }
+            idx = node.child[q];
+        }
+
+        // Jacobian of the cylindrical mapping is 1 / (4 * pi)
+        return result * PI_4_INV;
+    }
+
+    Vector3f DTree::sample(Sampler &sampler) const{
+        if(total() <= Float0){
+            return canonical_to_dir({sampler.sample_1d(), sampler.sample_1d()});
+        }
+
+        Vector2f origin{Float0, Float0};
+        Float size = Float1;
+        Index idx = 0;
+        while(true){
+            const Node &node = m_nodes[idx];
+            const Float node_total = node.total();
+            if(node_total <= Float0){
+                break;
+            }
+
+            Float u = sampler.sample_1d() * node_total;
+            Index q = 0;
+            Index last_nonzero = 0;
+            for(;q<4;q++){
+                const Float s = node.sum[q].load(std::memory_order_relaxed);
+                if(s > Float0){
+                    last_nonzero = q;
+                    if(u < s){
+                        break;
+                    }
+                }
+                u -= s;
+            }
+            // Guard against rounding at the end of the cdf
+            if(q == 4){
+                q = last_nonzero;
+            }
+
+            size *= Float0_5;
+            origin[0] += size * static_cast<Float>(q & 1);
+            origin[1] += size * static_cast<Float>(q >> 1);
+            if(node.is_leaf(q)){
+                break;
+            }
+            idx = node.child[q];
+        }
+
+        return canonical_to_dir({origin[0] + size * sampler.sample_1d(),
+                                 origin[1] + size * sampler.sample_1d()});
+    }
+
+    Float DTree::total() const{
+        return m_nodes[0].total();
+    }
+
+    Index DTree::node_num() const{
+        return m_nodes.size();
+    }
+
+    DTree DTree::refined(Float threshold) const{
+        DTree out;
+        const Node &root = m_nodes[0];
+        const Float root_total = root.total();
+        if(root_total <= Float0){
+            return out;
+        }
+
+        std::array<Float, 4> energy;
+        for(int q=0;q<4;q++){
+            energy[q] = root.sum[q].load(std::memory_order_relaxed);
+        }
+        build_refined(out, 0, &root, energy, threshold * root_total, 1);
+        return out;
+    }
+
+    void DTree::build_refined(DTree &out, Index out_idx, const Node *node, const std::array<Float, 4> &energy,
+                              Float energy_threshold, Index depth) const{
+        if(depth >= MAX_DEPTH){
+            return;
+        }
+
+        for(Index q=0;q<4;q++){
+            if(energy[q] <= energy_threshold){
+                continue;
+            }
+
+            // Quadrants which were leaves are assumed to have uniformly distributed energy
+            const Node *child = nullptr;
+            std::array<Float, 4> child_energy;
+            if(node != nullptr && !node->is_leaf(q)){
+                child = &m_nodes[node->child[q]];
+                for(int c=0;c<4;c++){
+                    child_energy[c] = child->sum[c].load(std::memory_order_relaxed);
+                }
+            }
+            else{
+                child_energy.fill(energy[q] * static_cast<Float>(0.25));
+            }
+
+            const Index child_idx = out.m_nodes.size();
+            out.m_nodes.emplace_back();
+            out.m_nodes[out_idx].child[q] = child_idx;
+            build_refined(out, child_idx, child, child_energy, energy_threshold, depth + 1);
+        }
+    }
+
+    SDTree::Leaf::Leaf(const Leaf &leaf)
+        : sampling{leaf.sampling}, building{leaf.building}, sample_num{leaf.sample_num.load()} {}
+
+    SDTree::SDTree(const AABB &aabb) : m_nodes{{0, {0, 0}, 0}}, m_leaves(1) {
+        // Cubic bounds, so that cycling the split axis keeps cells roughly cubic
+        const Vector3f center = aabb.get_center();
+        const Vector3f extent = aabb.m_max - aabb.m_min;
+        Float half = std::max({extent[0], extent[1], extent[2]}) * Float0_5 * static_cast<Float>(1.001);
+        if(half <= Float0){
+            half = Float1;
+        }
+        const Vector3f half_vec{half, half, half};
+        m_aabb = AABB(center - half_vec, center + half_vec);
+        const Float extent_inv = Float1 / (2 * half);
+        m_extent_inv = Vector3f{extent_inv, extent_inv, extent_inv};
+    }
+
+    SDTree::Leaf &SDTree::lookup(const Vector3f &pos){
+        Vector3f p;
+        for(int a=0;a<3;a++){
+            p[a] = std::clamp((pos[a] - m_aabb.m_min[a]) * m_extent_inv[a], Float0, Float1);
+        }
+
+        Index idx = 0;
+        while(true){
+            const Node &node = m_nodes[idx];
+            if(node.child[0] == 0){
+                return m_leaves[node.leaf_idx];
+            }
+            const Index a = node.axis;
+            if(p[a] < Float0_5){
+                p[a] = p[a] * 2;
+                idx = node.child[0];
+            }
+            else{
+                p[a] = p[a] * 2 - Float1;
+                idx = node.child[1];
+            }
+        }
+    }
+
+    void SDTree::refine(Float spatial_threshold, Float directional_threshold){
+        split(0, spatial_threshold, 0);
+
+        for(auto &leaf : m_leaves){
+            // Keep the previous distribution if no radiance reached this leaf in the current pass
+            if(leaf.building.total() > Float0){
+                leaf.sampling = leaf.building;
+            }
+            leaf.building = leaf.sampling.refined(directional_threshold);
+            leaf.sample_num.store(0);
+        }
+    }
+
+    void SDTree::split(Index node_idx, Float spatial_threshold, Index depth){
+        if(m_nodes[node_idx].child[0] == 0){
+            const Index leaf_idx = m_nodes[node_idx].leaf_idx;
+            const Index sample_num = m_leaves[leaf_idx].sample_num.load();
+            if(depth >= MAX_DEPTH || static_cast<Float>(sample_num) <= spatial_threshold){
+                return;
+            }
+
+            // Both children start from the parent's distributions, each receiving half of its samples
+            m_leaves[leaf_idx].sample_num.store(sample_num / 2);
+            const Index new_leaf_idx = m_leaves.size();
+            m_leaves.push_back(m_leaves[leaf_idx]);
+
+            const Index child_axis = (m_nodes[node_idx].axis + 1) % 3;
+            const Index child_idx = m_nodes.size();
+            m_nodes.push_back({child_axis, {0, 0}, leaf_idx});
+            m_nodes.push_back({child_axis, {0, 0}, new_leaf_idx});
+            m_nodes[node_idx].child[0] = child_idx;
+            m_nodes[node_idx].child[1] = child_idx + 1;
+        }
+
+        const Index child0 = m_nodes[node_idx].child[0];
+        const Index child1 = m_nodes[node_idx].child[1];
+        split(child0, spatial_threshold, depth + 1);
+        split(child1, spatial_threshold, depth + 1);
+    }
+
+    Index SDTree::leaf_num() const{
+        return m_leaves.size();
+    }
+}
@@ -0,0 +1,235 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+
+#include <shape.h>
+
+#include <bvh_base.h>
+#include <light.h>
+#include <logger.h>
+#include <mapped_file.h>
+#include <mesh_accel.h>
+#include <transform.h>
+
+namespace Caramel {
+    namespace {
+        // Arrays of the file are used as arrays of these types
+        static_assert(sizeof(Vector2f) == 2 * sizeof(Float));
+        static_assert(sizeof(Vector3f) == 3 * sizeof(Float));
+        static_assert(sizeof(Vector3i) == 3 * sizeof(Int));
+        static_assert(sizeof(LinearBVHNode) == 6 * sizeof(Float) + 3 * sizeof(int));
+
+        // `count` elements at `offset` of the mesh, used in place
+        template <typename T>
+        std::span<const T> file_section(std::span<const char> mesh, std::uint64_t offset, std::uint64_t count, const std::string &name) {
+            if (offset % alignof(T) != 0 || offset > mesh.size() || count > (mesh.size() - offset) / sizeof(T)) {
+                CRM_ERROR("Truncated crmesh : " + name);
+            }
+            return std::span<const T>(reinterpret_cast<const T*>(mesh.data() + offset), count);
+        }
+
+        bool is_identity(const Matrix44f &mat) {
+            const Matrix44f identity = Matrix44f::identity();
+            for (Index r = 0; r < 4; ++r) {
+                for (Index c = 0; c < 4; ++c) {
+                    if (mat(r, c) != identity(r, c)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+    }
+
+    void CRMesh::convert(const TriangleMesh &mesh, const std::filesystem::path &path) {
+        const std::string tmp_filename = path.string() + ".tmp";
+        {
+            std::ofstream stream(tmp_filename, std::ios::binary | std::ios::trunc);
+            if (!stream) {
+                CRM_ERROR("Cannot write crmesh : " + tmp_filename);
+            }
+            write(mesh, stream);
+            if (!stream) {
+                CRM_ERROR("Failed to write crmesh : " + tmp_filename);
+            }
+        }
+        // Processes which mapped the previous file keep reading it
+        std::filesystem::rename(tmp_filename, path);
+        CRM_LOG("Saved crmesh : " + path.string());
+    }
+
+    void CRMesh::write(const TriangleMesh &mesh, std::ostream &stream) {
+        const auto *bvh = dynamic_cast<const BVHMesh*>(mesh.m_accel.get());
+        if (mesh.m_storage != MeshStorage::Full || bvh == nullptr) {
+            CRM_ERROR("Only meshes of full storage with a BVH can be written as crmesh");
+        }
+        const std::vector<Vector3f> polygon = mesh.boundary_polygon();
+        const std::vector<Float> &pdf = mesh.m_triangle_pdf.pdf_values();
+        const std::vector<Float> &cdf = mesh.m_triangle_pdf.cdf_values();
+
+        const std::span<const std::byte> sections[SECTION_COUNT] = {
+            std::as_bytes(mesh.m_vertex_view),
+            std::as_bytes(mesh.m_normal_view),
+            std::as_bytes(mesh.m_tex_coord_view),
+            std::as_bytes(mesh.m_face_view),
+            std::as_bytes(std::span(pdf)),
+            std::as_bytes(std::span(cdf)),
+            std::as_bytes(bvh->tree().nodes()),
+            std::as_bytes(bvh->tree().ordered_primitives()),
+            std::as_bytes(std::span(polygon)),
+        };
+
+        FileHeader header{};
+        header.float_size = sizeof(Float);
+        header.has_normals = mesh.is_vn_exists;
+        header.has_tex_coords = mesh.is_tx_exists;
+        header.vertex_count = mesh.m_vertex_view.size();
+        header.face_count = mesh.m_face_view.size();
+        header.bvh_node_count = bvh->tree().nodes().size();
+        header.bvh_primitive_count = bvh->tree().ordered_primitives().size();
+        header.polygon_vertex_count = polygon.size();
+        header.area = mesh.m_area;
+        for (int a = 0; a < 3; ++a) {
+            header.aabb_min[a] = mesh.m_aabb.m_min[a];
+            header.aabb_max[a] = mesh.m_aabb.m_max[a];
+        }
+        const auto align = [](std::uint64_t offset) {
+            return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+        };
+        std::uint64_t offset = align(sizeof(FILE_MAGIC) + sizeof(FileHeader));
+        for (int i = 0; i < SECTION_COUNT; ++i) {
+            header.offsets[i] = offset;
+            offset = align(offset + sections[i].size());
+        }
+
+        stream.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        std::uint64_t written = sizeof(FILE_MAGIC) + sizeof(FileHeader);
+        const char zeros[SECTION_ALIGNMENT] = {};
+        for (int i = 0; i < SECTION_COUNT; ++i) {
+            stream.write(zeros, static_cast<std::streamsize>(header.offsets[i] - written));
+            stream.write(reinterpret_cast<const char*>(sections[i].data()), static_cast<std::streamsize>(sections[i].size()));
+            written = header.offsets[i] + sections[i].size();
+        }
+    }
+
+    std::shared_ptr<const MappedFile> CRMesh::map_file(const std::filesystem::path &path) {
+        if (!std::filesystem::exists(path)) {
+            CRM_ERROR(path.string() + " does not exist");
+        }
+        CRM_LOG("Loading crmesh : " + path.string());
+        return std::make_shared<const MappedFile>(path);
+    }
+
+    CRMesh::FileHeader CRMesh::read_header(const MappedFile &file, std::uint64_t offset, const std::string &name) {
+        FileHeader header;
+        if (offset > file.size() || file.size() - offset < sizeof(FILE_MAGIC) + sizeof(FileHeader) ||
+            std::memcmp(file.data() + offset, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+            CRM_ERROR("Invalid crmesh : " + name);
+        }
+        std::memcpy(&header, file.data() + offset + sizeof(FILE_MAGIC), sizeof(FileHeader));
+        if (header.float_size != sizeof(Float)) {
+            CRM_ERROR("crmesh is written with another floating point type : " + name);
+        }
+        return header;
+    }
+
+    AABB CRMesh::read_aabb(const MappedFile &file, std::uint64_t offset, const std::string &name) {
+        const FileHeader header = read_header(file, offset, name);
+        return AABB(Vector3f{header.aabb_min[0], header.aabb_min[1], header.aabb_min[2]},
+                    Vector3f{header.aabb_max[0], header.aabb_max[1], header.aabb_max[2]});
+    }
+
+    AABB CRMesh::read_aabb(const std::filesystem::path &path) {
+        if (!std::filesystem::exists(path)) {
+            CRM_ERROR(path.string() + " does not exist");
+        }
+        return read_aabb(MappedFile(path), 0, path.string());
+    }
+
+    CRMesh::CRMesh(const std::filesystem::path &path, BSDF *bsdf, AreaLight *arealight, const Matrix44f &transform,
+                   MeshStorage storage)
+    : CRMesh(map_file(path), 0, path.string(), bsdf, arealight, transform, storage) {}
+
+    CRMesh::CRMesh(std::shared_ptr<const MappedFile> file, std::uint64_t offset, const std::string &name, BSDF *bsdf,
+                   AreaLight *arealight, const Matrix44f &transform, MeshStorage storage)
+    : TriangleMesh(bsdf, arealight), m_file(std::move(file)) {
+        const FileHeader header = read_header(*m_file, offset, name);
+        const std::span<const char> mesh(m_file->data() + offset, m_file->size() - offset);
+
+        // Only sizes are checked, contents are trusted as they are written by `write()`
+        const auto vertices = file_section<Vector3f>(mesh, header.offsets[VERTICES], header.vertex_count, name);
+        const auto normals = file_section<Vector3f>(mesh, header.offsets[NORMALS], header.has_normals ? header.vertex_count : 0, name);
+        const auto tex_coords = file_section<Vector2f>(mesh, header.offsets[TEX_COORDS], header.has_tex_coords ? header.vertex_count : 0, name);
+        const auto faces = file_section<Vector3i>(mesh, header.offsets[FACES], header.face_count, name);
+        const auto pdf = file_section<Float>(mesh, header.offsets[TRIANGLE_PDF], header.face_count, name);
+        const auto cdf = file_section<Float>(mesh, header.offsets[TRIANGLE_CDF], header.face_count, name);
+        const auto nodes = file_section<LinearBVHNode>(mesh, header.offsets[BVH_NODES], header.bvh_node_count, name);
+        const auto primitives = file_section<Index>(mesh, header.offsets[BVH_PRIMITIVES], header.bvh_primitive_count, name);
+        const auto polygon = file_section<Vector3f>(mesh, header.offsets[POLYGON], header.polygon_vertex_count, name);
+        is_vn_exists = header.has_normals != 0;
+        is_tx_exists = header.has_tex_coords != 0;
+
+        if (storage != MeshStorage::Full || !is_identity(transform)) {
+            const Matrix44f normal_transform = Inverse(T(transform));
+            m_vertices.reserve(vertices.size());
+            for (const Vector3f &v : vertices) {
+                m_vertices.emplace_back(transform_point(v, transform));
+            }
+            m_normals.reserve(normals.size());
+            for (const Vector3f &n : normals) {
+                m_normals.emplace_back(Block<0, 0, 3, 1>(normal_transform * Vector4f{n[0], n[1], n[2], Float0}));
+            }
+            m_tex_coords.assign(tex_coords.begin(), tex_coords.end());
+            m_face_indices.assign(faces.begin(), faces.end());
+            finalize(arealight, name, storage);
+            m_file.reset();
+            return;
+        }
+
+        m_vertex_view = vertices;
+        m_normal_view = normals;
+        m_tex_coord_view = tex_coords;
+        m_face_view = faces;
+        m_aabb = AABB(Vector3f{header.aabb_min[0], header.aabb_min[1], header.aabb_min[2]},
+                      Vector3f{header.aabb_max[0], header.aabb_max[1], header.aabb_max[2]});
+        m_area = header.area;
+        m_triangle_pdf = Distrib1D(std::vector<Float>(pdf.begin(), pdf.end()), std::vector<Float>(cdf.begin(), cdf.end()));
+
+        auto accel = std::make_unique<BVHMesh>(*this, Float1, Float1, 32, 1);
+        accel->build_from(nodes, primitives);
+        m_accel = std::move(accel);
+        log_memory(name);
+
+        if (AreaLight::TRY_SOLID_ANGLE_SAMPLING && arealight != nullptr) {
+            set_polygon_vertices(std::vector<Vector3f>(polygon.begin(), polygon.end()), name);
+        }
+    }
+
+    CRMesh::~CRMesh() = default;
+}
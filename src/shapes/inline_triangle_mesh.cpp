@@ -34,7 +34,7 @@ namespace Caramel {
                                            std::vector<Vector3i> indices,
                                            std::vector<Vector3f> normals,
                                            BSDF *bsdf, AreaLight *arealight,
-                                           const Matrix44f &transform)
+                                           const Matrix44f &transform, MeshStorage storage)
     : TriangleMesh(bsdf, arealight) {
         is_vn_exists = !normals.empty();
 
@@ -52,6 +52,6 @@ namespace Caramel {
 
         m_face_indices = std::move(indices);
 
-        finalize(arealight, "trianglemesh");
+        finalize(arealight, "trianglemesh", storage);
     }
 }
@@ -34,20 +34,6 @@
 
 namespace Caramel{
     namespace {
-        // World AABB = tight box around the 8 transformed corners of the local AABB.
-        AABB transform_aabb(const AABB &local, const Matrix44f &to_world){
-            Vector3f mn{INF, INF, INF};
-            Vector3f mx{-INF, -INF, -INF};
-            for(Index i = 0; i < 8; ++i){
-                const Vector3f c = transform_point(local.corner(i), to_world);
-                for(int a = 0; a < 3; ++a){
-                    mn[a] = std::min(mn[a], c[a]);
-                    mx[a] = std::max(mx[a], c[a]);
-                }
-            }
-            return {mn, mx};
-        }
-
         Float transformed_triangle_area(const Vector3f &a, const Vector3f &b, const Vector3f &c, const Matrix44f &m){
             const Vector3f w0 = transform_point(a, m);
             const Vector3f w1 = transform_point(b, m);
@@ -64,10 +50,15 @@ namespace Caramel{
         }
     }
 
+    Instance::Instance(std::shared_ptr<const Shape> geometry, const Matrix44f &to_world, BSDF *bsdf, AreaLight *arealight)
+        : Instance(geometry.get(), to_world, bsdf, arealight) {
+        m_geometry_owner = std::move(geometry);
+    }
+
     Instance::Instance(const Shape *geometry, const Matrix44f &to_world, BSDF *bsdf, AreaLight *arealight)
         : Shape{bsdf, arealight}, m_geometry{geometry}, m_to_world{to_world},
           m_to_local{Inverse(to_world)},
-          m_world_aabb{transform_aabb(geometry->get_aabb(), to_world)} {
+          m_world_aabb{geometry->get_aabb().transformed(to_world)} {
         if(arealight != nullptr){
             // World area must be exact under an arbitrary (non-uniform / sheared) to_world,
             // which no single scalar captures, so a mesh emitter is measured per-triangle in
@@ -109,6 +100,8 @@ namespace Caramel{
         }
 
         info.p = transform_point(info.p, m_to_world);
+        info.dpdu = transform_vector(info.dpdu, m_to_world);
+        info.dpdv = transform_vector(info.dpdv, m_to_world);
         // Normal transform = inverse-transpose of to_world = transpose(m_to_local).
         // Using the transpose avoids a per-ray matrix inverse.
         const Matrix44f normal_mat{T(m_to_local)};
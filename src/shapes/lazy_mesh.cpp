@@ -0,0 +1,119 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <shape.h>
+
+#include <geometry_cache.h>
+#include <logger.h>
+#include <rayintersectinfo.h>
+
+namespace Caramel{
+
+    LazyMesh::LazyMesh(std::function<TriangleMesh*()> loader, const AABB &aabb, BSDF *bsdf)
+        : Shape{bsdf, nullptr}, m_loader{std::move(loader)}, m_aabb{aabb} {}
+
+    LazyMesh::~LazyMesh(){
+        GeometryCache::instance().remove(this);
+    }
+
+    void LazyMesh::touch() const{
+        const std::uint64_t now = GeometryCache::instance().clock();
+        if(m_last_use.load(std::memory_order_relaxed) != now){
+            m_last_use.store(now, std::memory_order_relaxed);
+        }
+    }
+
+    std::shared_ptr<const TriangleMesh> LazyMesh::acquire() const{
+        touch();
+        if(auto mesh = m_mesh.load(std::memory_order_acquire)){
+            return mesh;
+        }
+        // Rays reaching the mesh while it loads wait for it
+        std::lock_guard<std::mutex> lock(m_load_mutex);
+        if(auto mesh = m_mesh.load(std::memory_order_acquire)){
+            return mesh;
+        }
+        std::shared_ptr<const TriangleMesh> mesh(m_loader());
+        m_mesh.store(mesh, std::memory_order_release);
+        m_raw.store(mesh.get(), std::memory_order_release);
+        GeometryCache::instance().loaded(this, mesh->memory_size());
+        return mesh;
+    }
+
+    std::shared_ptr<const TriangleMesh> LazyMesh::evict() const{
+        m_raw.store(nullptr, std::memory_order_relaxed);
+        return m_mesh.exchange(nullptr, std::memory_order_acq_rel);
+    }
+
+    bool LazyMesh::is_loaded() const{
+        return m_mesh.load(std::memory_order_acquire) != nullptr;
+    }
+
+    std::pair<bool, RayIntersectInfo> LazyMesh::ray_intersect(const Ray &ray, Float maxt) const{
+        // Inside a read scope an evicted mesh stays alive until the thread moves on, so no reference is taken
+        std::shared_ptr<const TriangleMesh> owner;
+        const TriangleMesh *mesh = nullptr;
+        if(GeometryCache::in_read_scope()){
+            GeometryCache::instance().enter_mesh();
+            mesh = m_raw.load(std::memory_order_acquire);
+        }
+        if(mesh != nullptr){
+            touch();
+        }
+        else{
+            owner = acquire();
+            mesh = owner.get();
+        }
+        auto [hit, info] = mesh->ray_intersect(ray, maxt);
+        if(hit){
+            // The material belongs to this shape, and the mesh may be evicted after the ray
+            info.shape = this;
+        }
+        return {hit, info};
+    }
+
+    AABB LazyMesh::get_aabb() const{
+        return m_aabb;
+    }
+
+    Float LazyMesh::get_area() const{
+        return acquire()->get_area();
+    }
+
+    std::tuple<Vector3f, Vector3f, Float> LazyMesh::sample_point(Sampler &sampler) const{
+        return acquire()->sample_point(sampler);
+    }
+
+    Float LazyMesh::pdf_solidangle(const Vector3f &hitpos_world, const Vector3f &shapepos_world, const Vector3f &shape_normal_world) const{
+        return acquire()->pdf_solidangle(hitpos_world, shapepos_world, shape_normal_world);
+    }
+
+    bool LazyMesh::is_solid_angle_sampling_possible() const{
+        return false;
+    }
+
+    const std::vector<Vector3f>& LazyMesh::get_polygon_vertices() const{
+        static const std::vector<Vector3f> empty;
+        return empty;
+    }
+}
@@ -22,26 +22,446 @@
 // SOFTWARE.
 //
 
+#include <charconv>
+#include <cstring>
 #include <filesystem>
 #include <map>
+#include <string>
 #include <tuple>
 
 #include <shape.h>
 
 #include <logger.h>
+#include <mapped_file.h>
 #include <mesh_accel.h>
+#include <parallel_for.h>
 #include <transform.h>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
 namespace Caramel {
-    OBJMesh::OBJMesh(const std::filesystem::path &path, BSDF *bsdf, AreaLight *arealight, const Matrix44f &transform)
-    : TriangleMesh(bsdf, arealight) {
-        if (!std::filesystem::exists(path)) {
-            CRM_ERROR(path.string() + " is not exists");
+
+    namespace {
+        // Files are split into chunks of about this size, which are parsed in parallel
+        constexpr std::size_t OBJ_CHUNK_SIZE = 4 << 20;
+
+        // Indices are 0-based, -1 if absent
+        struct Corner{
+            Int v;
+            Int t;
+            Int n;
+
+            bool operator==(const Corner &c) const{ return v == c.v && t == c.t && n == c.n; }
+        };
+
+        struct ObjChunk{
+            const char *begin;
+            const char *end;
+            // Counted before parsing, to resolve relative (negative) indices of later chunks
+            Index v_count = 0;
+            Index vt_count = 0;
+            Index vn_count = 0;
+
+            std::vector<Vector3f> positions;
+            std::vector<Vector2f> tex_coords;
+            std::vector<Vector3f> normals;
+            // Corners of faces, face i has face_sizes[i] corners
+            std::vector<Corner> corners;
+            std::vector<unsigned char> face_sizes;
+            // Corners of triangulated faces
+            std::vector<Corner> triangles;
+
+            std::string error;
+            // Polygons with more than 4 corners are left to tinyobjloader
+            bool unsupported = false;
+        };
+
+        bool is_blank(char c){
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        const char *skip_blank(const char *p, const char *end){
+            while(p < end && is_blank(*p)){
+                p++;
+            }
+            return p;
         }
 
+        const char *find_line_end(const char *p, const char *end){
+            const void *nl = std::memchr(p, '\n', end - p);
+            return nl != nullptr ? static_cast<const char*>(nl) : end;
+        }
+
+        enum class ObjStatement{ Vertex, TexCoord, Normal, Face, Other };
+
+        // Statement of the line at `p`, which is moved past the keyword
+        ObjStatement read_statement(const char *&p, const char *end){
+            p = skip_blank(p, end);
+            if(p + 1 < end && p[0] == 'v'){
+                if(is_blank(p[1])){
+                    p += 2;
+                    return ObjStatement::Vertex;
+                }
+                if(p + 2 < end && is_blank(p[2]) && (p[1] == 't' || p[1] == 'n')){
+                    const char c = p[1];
+                    p += 3;
+                    return c == 't' ? ObjStatement::TexCoord : ObjStatement::Normal;
+                }
+            }
+            if(p + 1 < end && p[0] == 'f' && is_blank(p[1])){
+                p += 2;
+                return ObjStatement::Face;
+            }
+            return ObjStatement::Other;
+        }
+
+        bool read_float(const char *&p, const char *end, Float &out){
+            p = skip_blank(p, end);
+            if(p < end && *p == '+'){
+                p++;
+            }
+            const auto [next, ec] = std::from_chars(p, end, out);
+            if(ec != std::errc()){
+                return false;
+            }
+            p = next;
+            return true;
+        }
+
+        // OBJ indices are 1-based, or negative to count back from the last element defined so far
+        bool read_index(const char *&p, const char *end, Index count, Int &out){
+            Int idx = 0;
+            const auto [next, ec] = std::from_chars(p, end, idx);
+            if(ec != std::errc() || idx == 0){
+                return false;
+            }
+            p = next;
+            out = idx > 0 ? idx - 1 : static_cast<Int>(count) + idx;
+            return true;
+        }
+
+        // Chunks of about OBJ_CHUNK_SIZE, which start at line beginnings
+        std::vector<ObjChunk> split_chunks(const char *data, const char *end){
+            std::vector<ObjChunk> chunks;
+            for(const char *p = data; p < end;){
+                const char *chunk_end = p + std::min<std::size_t>(OBJ_CHUNK_SIZE, end - p);
+                chunk_end = find_line_end(chunk_end, end);
+                chunk_end = chunk_end < end ? chunk_end + 1 : end;
+                chunks.push_back(ObjChunk{p, chunk_end});
+                p = chunk_end;
+            }
+            return chunks;
+        }
+
+        // Bounds of the transformed positions of the chunk, other statements are not parsed
+        AABB chunk_aabb(ObjChunk &chunk, const Matrix44f &transform){
+            AABB aabb;
+            for(const char *p = chunk.begin; p < chunk.end;){
+                const char *line_begin = p;
+                const char *line_end = find_line_end(p, chunk.end);
+                if(read_statement(p, line_end) == ObjStatement::Vertex){
+                    Float x, y, z;
+                    if(!(read_float(p, line_end, x) && read_float(p, line_end, y) && read_float(p, line_end, z))){
+                        chunk.error = "Can not parse obj line : " + std::string(line_begin, line_end);
+                        return aabb;
+                    }
+                    const Vector3f v = transform_point(Vector3f{x, y, z}, transform);
+                    aabb = AABB::merge(aabb, AABB(v, v));
+                }
+                p = line_end + 1;
+            }
+            return aabb;
+        }
+
+        void count_chunk(ObjChunk &chunk){
+            for(const char *p = chunk.begin; p < chunk.end;){
+                const char *line_end = find_line_end(p, chunk.end);
+                switch(read_statement(p, line_end)){
+                    case ObjStatement::Vertex:   chunk.v_count++;  break;
+                    case ObjStatement::TexCoord: chunk.vt_count++; break;
+                    case ObjStatement::Normal:   chunk.vn_count++; break;
+                    default: break;
+                }
+                p = line_end + 1;
+            }
+        }
+
+        // `v_offset`, `vt_offset` and `vn_offset` are numbers of elements in previous chunks
+        void parse_chunk(ObjChunk &chunk, Index v_offset, Index vt_offset, Index vn_offset){
+            chunk.positions.reserve(chunk.v_count);
+            chunk.tex_coords.reserve(chunk.vt_count);
+            chunk.normals.reserve(chunk.vn_count);
+
+            for(const char *p = chunk.begin; p < chunk.end;){
+                const char *line_begin = p;
+                const char *line_end = find_line_end(p, chunk.end);
+                const ObjStatement statement = read_statement(p, line_end);
+                bool ok = true;
+                if(statement == ObjStatement::Vertex || statement == ObjStatement::Normal){
+                    Float x, y, z;
+                    ok = read_float(p, line_end, x) && read_float(p, line_end, y) && read_float(p, line_end, z);
+                    (statement == ObjStatement::Vertex ? chunk.positions : chunk.normals).emplace_back(x, y, z);
+                }
+                else if(statement == ObjStatement::TexCoord){
+                    // v is optional
+                    Float u = Float0;
+                    Float v = Float0;
+                    ok = read_float(p, line_end, u);
+                    const char *q = p;
+                    if(ok && !read_float(q, line_end, v)){
+                        v = Float0;
+                    }
+                    chunk.tex_coords.emplace_back(u, v);
+                }
+                else if(statement == ObjStatement::Face){
+                    const Index v_count = v_offset + chunk.positions.size();
+                    const Index vt_count = vt_offset + chunk.tex_coords.size();
+                    const Index vn_count = vn_offset + chunk.normals.size();
+                    unsigned char size = 0;
+                    // v, v/vt, v//vn or v/vt/vn
+                    while(ok && (p = skip_blank(p, line_end)) < line_end){
+                        if(size == 4){
+                            chunk.unsupported = true;
+                            return;
+                        }
+                        Corner c{-1, -1, -1};
+                        ok = read_index(p, line_end, v_count, c.v);
+                        if(ok && p < line_end && *p == '/'){
+                            p++;
+                            if(p < line_end && *p != '/'){
+                                ok = read_index(p, line_end, vt_count, c.t);
+                            }
+                            if(ok && p < line_end && *p == '/'){
+                                p++;
+                                ok = read_index(p, line_end, vn_count, c.n);
+                            }
+                        }
+                        chunk.corners.push_back(c);
+                        size++;
+                    }
+                    ok = ok && size >= 3;
+                    chunk.face_sizes.push_back(size);
+                }
+                if(!ok){
+                    chunk.error = "Can not parse obj line : " + std::string(line_begin, line_end);
+                    return;
+                }
+                p = line_end + 1;
+            }
+        }
+
+        // Same split as tinyobjloader : triangles are fanned, quads are split along their shorter diagonal
+        void triangulate_chunk(ObjChunk &chunk, const std::vector<Vector3f> &positions){
+            chunk.triangles.reserve(chunk.face_sizes.size() * 3);
+            std::size_t c = 0;
+            for(const unsigned char size : chunk.face_sizes){
+                const Corner *f = &chunk.corners[c];
+                c += size;
+                for(int k=0;k<size;k++){
+                    if(f[k].v < 0 || static_cast<std::size_t>(f[k].v) >= positions.size()){
+                        chunk.error = "Vertex index of obj face is out of range";
+                        return;
+                    }
+                }
+                if(size == 3){
+                    chunk.triangles.insert(chunk.triangles.end(), {f[0], f[1], f[2]});
+                    continue;
+                }
+                const Vector3f e02 = positions[f[2].v] - positions[f[0].v];
+                const Vector3f e13 = positions[f[3].v] - positions[f[1].v];
+                const Float sqr02 = e02[0] * e02[0] + e02[1] * e02[1] + e02[2] * e02[2];
+                const Float sqr13 = e13[0] * e13[0] + e13[1] * e13[1] + e13[2] * e13[2];
+                if(sqr02 < sqr13){
+                    chunk.triangles.insert(chunk.triangles.end(), {f[0], f[1], f[2], f[0], f[2], f[3]});
+                }
+                else{
+                    chunk.triangles.insert(chunk.triangles.end(), {f[0], f[1], f[3], f[1], f[2], f[3]});
+                }
+            }
+        }
+
+        // Open addressing table from corners to welded vertex indices
+        class WeldTable{
+        public:
+            explicit WeldTable(std::size_t expected){
+                std::size_t capacity = 16;
+                while(capacity < expected * 2){
+                    capacity *= 2;
+                }
+                m_slots.assign(capacity, -1);
+            }
+
+            // Index of the vertex of `c`, a new one is `next` if c is not found
+            std::pair<Int, bool> find_or_insert(const Corner &c, Int next, const std::vector<Corner> &keys){
+                if(static_cast<std::size_t>(next) * 2 >= m_slots.size()){
+                    grow(keys);
+                }
+                const std::size_t mask = m_slots.size() - 1;
+                for(std::size_t i = hash(c) & mask;; i = (i + 1) & mask){
+                    if(m_slots[i] < 0){
+                        m_slots[i] = next;
+                        return {next, true};
+                    }
+                    if(keys[m_slots[i]] == c){
+                        return {m_slots[i], false};
+                    }
+                }
+            }
+
+        private:
+            static std::size_t hash(const Corner &c){
+                std::uint64_t h = static_cast<std::uint32_t>(c.v);
+                h = h * 0x9E3779B97F4A7C15ULL ^ static_cast<std::uint32_t>(c.t);
+                h = h * 0xBF58476D1CE4E5B9ULL ^ static_cast<std::uint32_t>(c.n);
+                h ^= h >> 31;
+                h *= 0x94D049BB133111EBULL;
+                h ^= h >> 29;
+                return static_cast<std::size_t>(h);
+            }
+
+            void grow(const std::vector<Corner> &keys){
+                m_slots.assign(m_slots.size() * 2, -1);
+                const std::size_t mask = m_slots.size() - 1;
+                for(Int v=0;v<static_cast<Int>(keys.size());v++){
+                    std::size_t i = hash(keys[v]) & mask;
+                    while(m_slots[i] >= 0){
+                        i = (i + 1) & mask;
+                    }
+                    m_slots[i] = v;
+                }
+            }
+
+            std::vector<Int> m_slots;
+        };
+    }
+
+    // Returns false if the file has faces the parser does not handle
+    bool OBJMesh::load_fast(const std::filesystem::path &path, const Matrix44f &transform) {
+        const MappedFile file(path);
+        const char *data = file.data();
+        const char *end = data + file.size();
+
+        std::vector<ObjChunk> chunks = split_chunks(data, end);
+        const auto for_each_chunk = [&chunks](auto &&func){
+            if(chunks.size() == 1){
+                func(0);
+            }
+            else{
+                parallel_for(0, static_cast<int>(chunks.size()), func);
+            }
+        };
+        const auto check_chunks = [&chunks](){
+            for(const auto &c : chunks){
+                if(!c.error.empty()){
+                    CRM_ERROR(c.error);
+                }
+            }
+        };
+
+        for_each_chunk([&](int i){ count_chunk(chunks[i]); });
+        std::vector<Index> v_offsets(chunks.size()), vt_offsets(chunks.size()), vn_offsets(chunks.size());
+        Index v_total = 0, vt_total = 0, vn_total = 0;
+        for(std::size_t i=0;i<chunks.size();i++){
+            v_offsets[i] = v_total;
+            vt_offsets[i] = vt_total;
+            vn_offsets[i] = vn_total;
+            v_total += chunks[i].v_count;
+            vt_total += chunks[i].vt_count;
+            vn_total += chunks[i].vn_count;
+        }
+
+        for_each_chunk([&](int i){ parse_chunk(chunks[i], v_offsets[i], vt_offsets[i], vn_offsets[i]); });
+        for(const auto &c : chunks){
+            if(c.unsupported){
+                return false;
+            }
+        }
+        check_chunks();
+
+        std::vector<Vector3f> positions;
+        std::vector<Vector2f> tex_coords;
+        std::vector<Vector3f> normals;
+        positions.reserve(v_total);
+        tex_coords.reserve(vt_total);
+        normals.reserve(vn_total);
+        for(const auto &c : chunks){
+            positions.insert(positions.end(), c.positions.begin(), c.positions.end());
+            tex_coords.insert(tex_coords.end(), c.tex_coords.begin(), c.tex_coords.end());
+            normals.insert(normals.end(), c.normals.begin(), c.normals.end());
+        }
+
+        for_each_chunk([&](int i){ triangulate_chunk(chunks[i], positions); });
+        check_chunks();
+
+        // Normals and texture coordinates are used only if every corner has them
+        is_vn_exists = !normals.empty();
+        is_tx_exists = !tex_coords.empty();
+        std::size_t corner_count = 0;
+        for(const auto &c : chunks){
+            corner_count += c.triangles.size();
+            for(const Corner &corner : c.triangles){
+                if(corner.n < 0 || corner.n >= static_cast<Int>(normals.size())) is_vn_exists = false;
+                if(corner.t < 0 || corner.t >= static_cast<Int>(tex_coords.size())) is_tx_exists = false;
+            }
+        }
+
+        // Corners are welded in order of first appearance, so that vertex order does not depend on chunking
+        const Matrix44f normal_transform = Inverse(T(transform));
+        std::vector<Corner> keys;
+        keys.reserve(positions.size());
+        WeldTable table(positions.size());
+        m_face_indices.reserve(corner_count / 3);
+        for(const auto &c : chunks){
+            for(std::size_t i = 0; i < c.triangles.size(); i += 3){
+                Int tri[3];
+                for(int k=0;k<3;k++){
+                    const Corner &corner = c.triangles[i + k];
+                    const Corner key{corner.v, is_tx_exists ? corner.t : 0, is_vn_exists ? corner.n : 0};
+                    const auto [idx, inserted] = table.find_or_insert(key, static_cast<Int>(keys.size()), keys);
+                    if(inserted){
+                        keys.push_back(key);
+                    }
+                    tri[k] = idx;
+                }
+                m_face_indices.emplace_back(tri[0], tri[1], tri[2]);
+            }
+        }
+
+        m_vertices.resize(keys.size());
+        if(is_vn_exists){
+            m_normals.resize(keys.size());
+        }
+        if(is_tx_exists){
+            m_tex_coords.resize(keys.size());
+        }
+        const auto transform_vertices = [&](int begin, int end){
+            for(int v=begin;v<end;v++){
+                const Corner &key = keys[v];
+                m_vertices[v] = transform_point(positions[key.v], transform);
+                if(is_vn_exists){
+                    const Vector3f &n = normals[key.n];
+                    m_normals[v] = Block<0, 0, 3, 1>(normal_transform * Vector4f{n[0], n[1], n[2], Float0});
+                }
+                if(is_tx_exists){
+                    m_tex_coords[v] = tex_coords[key.t];
+                }
+            }
+        };
+        const int vertex_count = static_cast<int>(keys.size());
+        if(chunks.size() == 1){
+            transform_vertices(0, vertex_count);
+        }
+        else{
+            constexpr int BLOCK = 1 << 16;
+            parallel_for(0, (vertex_count + BLOCK - 1) / BLOCK, [&](int b){
+                transform_vertices(b * BLOCK, std::min(vertex_count, (b + 1) * BLOCK));
+            });
+        }
+        return true;
+    }
+
+    void OBJMesh::load_tinyobj(const std::filesystem::path &path, const Matrix44f &transform) {
         tinyobj::ObjReader reader;
         // `triangulate` option is true by default
         if (!reader.ParseFromFile(path.string(), tinyobj::ObjReaderConfig())) {
@@ -54,48 +474,82 @@ namespace Caramel {
         const auto &attrib = reader.GetAttrib();
         const auto &shapes = reader.GetShapes();
 
-        CRM_LOG("Loading obj : " + path.string());
-        if (shapes.size() != 1) {
-            CRM_ERROR("We do not support obj file with several shapes");
-        }
-
         is_vn_exists = !attrib.normals.empty();
         is_tx_exists = !attrib.texcoords.empty();
 
-        const auto &indices = shapes[0].mesh.indices;
-        for(const auto &idx : indices){
-            if(idx.normal_index < 0)   is_vn_exists = false;
-            if(idx.texcoord_index < 0) is_tx_exists = false;
+        for (const auto &shape : shapes) {
+            for(const auto &idx : shape.mesh.indices){
+                if(idx.normal_index < 0)   is_vn_exists = false;
+                if(idx.texcoord_index < 0) is_tx_exists = false;
+            }
         }
 
+        // Objects and groups are merged into one mesh, as `load_fast()` does
+        const Matrix44f normal_transform = Inverse(T(transform));
         std::map<std::tuple<int, int, int>, Int> welded;
-        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
-            Int tri[3];
-            for (int k = 0; k < 3; ++k) {
-                const auto &idx = indices[i + k];
-                const auto key = std::make_tuple(idx.vertex_index,
-                                                 is_vn_exists ? idx.normal_index : 0,
-                                                 is_tx_exists ? idx.texcoord_index : 0);
-                auto [it, inserted] = welded.try_emplace(key, static_cast<Int>(m_vertices.size()));
-                if (inserted) {
-                    const int v = idx.vertex_index;
-                    m_vertices.emplace_back(transform_point(
-                        Vector3f{attrib.vertices[3 * v], attrib.vertices[3 * v + 1], attrib.vertices[3 * v + 2]}, transform));
-                    if (is_vn_exists) {
-                        const int n = idx.normal_index;
-                        m_normals.emplace_back(transform_normal(
-                            Vector3f{attrib.normals[3 * n], attrib.normals[3 * n + 1], attrib.normals[3 * n + 2]}, transform));
-                    }
-                    if (is_tx_exists) {
-                        const int t = idx.texcoord_index;
-                        m_tex_coords.emplace_back(attrib.texcoords[2 * t], attrib.texcoords[2 * t + 1]);
+        for (const auto &shape : shapes) {
+            const auto &indices = shape.mesh.indices;
+            for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+                Int tri[3];
+                for (int k = 0; k < 3; ++k) {
+                    const auto &idx = indices[i + k];
+                    const auto key = std::make_tuple(idx.vertex_index,
+                                                     is_vn_exists ? idx.normal_index : 0,
+                                                     is_tx_exists ? idx.texcoord_index : 0);
+                    auto [it, inserted] = welded.try_emplace(key, static_cast<Int>(m_vertices.size()));
+                    if (inserted) {
+                        const int v = idx.vertex_index;
+                        m_vertices.emplace_back(transform_point(
+                            Vector3f{attrib.vertices[3 * v], attrib.vertices[3 * v + 1], attrib.vertices[3 * v + 2]}, transform));
+                        if (is_vn_exists) {
+                            const int n = idx.normal_index;
+                            m_normals.emplace_back(Block<0, 0, 3, 1>(normal_transform *
+                                Vector4f{attrib.normals[3 * n], attrib.normals[3 * n + 1], attrib.normals[3 * n + 2], Float0}));
+                        }
+                        if (is_tx_exists) {
+                            const int t = idx.texcoord_index;
+                            m_tex_coords.emplace_back(attrib.texcoords[2 * t], attrib.texcoords[2 * t + 1]);
+                        }
                     }
+                    tri[k] = it->second;
                 }
-                tri[k] = it->second;
+                m_face_indices.emplace_back(tri[0], tri[1], tri[2]);
+            }
+        }
+    }
+
+    AABB OBJMesh::read_aabb(const std::filesystem::path &path, const Matrix44f &transform) {
+        if (!std::filesystem::exists(path)) {
+            CRM_ERROR(path.string() + " is not exists");
+        }
+        const MappedFile file(path);
+        std::vector<ObjChunk> chunks = split_chunks(file.data(), file.data() + file.size());
+        std::vector<AABB> bounds(chunks.size());
+        parallel_for(0, static_cast<int>(chunks.size()), [&](int i){ bounds[i] = chunk_aabb(chunks[i], transform); });
+
+        AABB aabb;
+        for (std::size_t i = 0; i < chunks.size(); i++) {
+            if (!chunks[i].error.empty()) {
+                CRM_ERROR(chunks[i].error);
             }
-            m_face_indices.emplace_back(tri[0], tri[1], tri[2]);
+            aabb = AABB::merge(aabb, bounds[i]);
+        }
+        return aabb;
+    }
+
+    OBJMesh::OBJMesh(const std::filesystem::path &path, BSDF *bsdf, AreaLight *arealight, const Matrix44f &transform,
+                      MeshStorage storage)
+    : TriangleMesh(bsdf, arealight) {
+        if (!std::filesystem::exists(path)) {
+            CRM_ERROR(path.string() + " is not exists");
+        }
+
+        CRM_LOG("Loading obj : " + path.string());
+        if (!load_fast(path, transform)) {
+            // Polygons with more than 4 vertices are triangulated by tinyobjloader
+            load_tinyobj(path, transform);
         }
 
-        finalize(arealight, path.string());
+        finalize(arealight, path.string(), storage);
     }
 }
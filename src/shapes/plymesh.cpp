@@ -22,25 +22,355 @@
 // SOFTWARE.
 //
 
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <sstream>
+#include <string>
 
 #include <shape.h>
 
 #include <logger.h>
+#include <mapped_file.h>
 #include <mesh_accel.h>
+#include <parallel_for.h>
 #include <transform.h>
 
 #include "happly.h"
 
 namespace Caramel {
-    PLYMesh::PLYMesh(const std::filesystem::path &path, BSDF *bsdf, AreaLight *arealight, const Matrix44f &transform)
-    : TriangleMesh(bsdf, arealight) {
-        if (!std::filesystem::exists(path)) {
-            CRM_ERROR(path.string() + " does not exist");
+
+    namespace {
+        enum class PLYType{ Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+        struct PLYProperty{
+            std::string name;
+            PLYType type;
+            // Count type of list properties
+            bool is_list = false;
+            PLYType count_type = PLYType::UInt8;
+        };
+
+        struct PLYElement{
+            std::string name;
+            std::size_t count;
+            std::vector<PLYProperty> properties;
+
+            // Byte size of an item, 0 if it has list properties
+            std::size_t stride() const{
+                std::size_t size = 0;
+                for(const auto &p : properties){
+                    if(p.is_list){
+                        return 0;
+                    }
+                    size += type_size(p.type);
+                }
+                return size;
+            }
+
+            // Byte offset of a scalar property in an item of fixed stride, or -1
+            long offset_of(const std::string &prop) const{
+                std::size_t offset = 0;
+                for(const auto &p : properties){
+                    if(p.name == prop && !p.is_list){
+                        return static_cast<long>(offset);
+                    }
+                    offset += type_size(p.type);
+                }
+                return -1;
+            }
+
+            static std::size_t type_size(PLYType type){
+                switch(type){
+                    case PLYType::Int8: case PLYType::UInt8: return 1;
+                    case PLYType::Int16: case PLYType::UInt16: return 2;
+                    case PLYType::Int32: case PLYType::UInt32: case PLYType::Float32: return 4;
+                    case PLYType::Float64: return 8;
+                }
+                return 0;
+            }
+        };
+
+        PLYType parse_ply_type(const std::string &name){
+            if(name == "char" || name == "int8") return PLYType::Int8;
+            if(name == "uchar" || name == "uint8") return PLYType::UInt8;
+            if(name == "short" || name == "int16") return PLYType::Int16;
+            if(name == "ushort" || name == "uint16") return PLYType::UInt16;
+            if(name == "int" || name == "int32") return PLYType::Int32;
+            if(name == "uint" || name == "uint32") return PLYType::UInt32;
+            if(name == "float" || name == "float32") return PLYType::Float32;
+            if(name == "double" || name == "float64") return PLYType::Float64;
+            CRM_ERROR("Unknown ply property type : " + name);
         }
 
-        CRM_LOG("Loading ply : " + path.string());
+        template <typename T>
+        T load_scalar(const char *p, bool swap){
+            std::uint8_t bytes[sizeof(T)];
+            std::memcpy(bytes, p, sizeof(T));
+            if(swap){
+                for(std::size_t i=0;i<sizeof(T)/2;i++){
+                    std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+                }
+            }
+            T val;
+            std::memcpy(&val, bytes, sizeof(T));
+            return val;
+        }
+
+        // Value of type `type` at `p`, converted to `T`
+        template <typename T>
+        T load_value(const char *p, PLYType type, bool swap){
+            switch(type){
+                case PLYType::Int8:    return static_cast<T>(load_scalar<std::int8_t>(p, swap));
+                case PLYType::UInt8:   return static_cast<T>(load_scalar<std::uint8_t>(p, swap));
+                case PLYType::Int16:   return static_cast<T>(load_scalar<std::int16_t>(p, swap));
+                case PLYType::UInt16:  return static_cast<T>(load_scalar<std::uint16_t>(p, swap));
+                case PLYType::Int32:   return static_cast<T>(load_scalar<std::int32_t>(p, swap));
+                case PLYType::UInt32:  return static_cast<T>(load_scalar<std::uint32_t>(p, swap));
+                case PLYType::Float32: return static_cast<T>(load_scalar<float>(p, swap));
+                case PLYType::Float64: return static_cast<T>(load_scalar<double>(p, swap));
+            }
+            return T{};
+        }
+
+        // Binary PLY header. `body` is the offset of the first element.
+        struct PLYHeader{
+            bool binary = false;
+            bool swap = false;
+            std::vector<PLYElement> elements;
+            std::size_t body = 0;
+        };
+
+        PLYHeader parse_ply_header(const char *data, std::size_t size){
+            const std::string_view text(data, size);
+            const std::size_t header_end = text.find("end_header");
+            if(text.substr(0, 3) != "ply" || header_end == std::string_view::npos){
+                CRM_ERROR("Invalid ply header");
+            }
+            PLYHeader header;
+            const std::size_t line_end = text.find('\n', header_end);
+            header.body = line_end == std::string_view::npos ? size : line_end + 1;
+
+            std::istringstream lines{std::string(text.substr(0, header_end))};
+            std::string line;
+            while(std::getline(lines, line)){
+                std::istringstream words(line);
+                std::string keyword;
+                words >> keyword;
+                if(keyword == "format"){
+                    std::string format;
+                    words >> format;
+                    header.binary = format != "ascii";
+                    header.swap = (format == "binary_big_endian") != (std::endian::native == std::endian::big);
+                }
+                else if(keyword == "element"){
+                    PLYElement element;
+                    words >> element.name >> element.count;
+                    header.elements.push_back(element);
+                }
+                else if(keyword == "property" && !header.elements.empty()){
+                    PLYProperty prop;
+                    std::string type;
+                    words >> type;
+                    if(type == "list"){
+                        std::string count_type, item_type;
+                        words >> count_type >> item_type;
+                        prop.is_list = true;
+                        prop.count_type = parse_ply_type(count_type);
+                        prop.type = parse_ply_type(item_type);
+                    }
+                    else{
+                        prop.type = parse_ply_type(type);
+                    }
+                    words >> prop.name;
+                    header.elements.back().properties.push_back(prop);
+                }
+            }
+            return header;
+        }
+
+        // Position past the items of a binary element at `p`
+        const char *skip_element(const PLYElement &element, const char *p, const char *end, bool swap){
+            const auto check_size = [&p, end](std::size_t size){
+                if(size > static_cast<std::size_t>(end - p)){
+                    CRM_ERROR("Unexpected end of ply file");
+                }
+            };
+            const std::size_t stride = element.stride();
+            if(stride != 0){
+                check_size(element.count * stride);
+                return p + element.count * stride;
+            }
+            for(std::size_t i=0;i<element.count;i++){
+                for(const PLYProperty &prop : element.properties){
+                    std::size_t size = PLYElement::type_size(prop.type);
+                    if(prop.is_list){
+                        check_size(PLYElement::type_size(prop.count_type));
+                        size *= load_value<std::size_t>(p, prop.count_type, swap);
+                        p += PLYElement::type_size(prop.count_type);
+                    }
+                    check_size(size);
+                    p += size;
+                }
+            }
+            return p;
+        }
+
+        // Index of the scalar property among the properties of an element, or -1
+        long property_index(const PLYElement &element, const std::string &name){
+            for(std::size_t i=0;i<element.properties.size();i++){
+                if(element.properties[i].name == name && !element.properties[i].is_list){
+                    return static_cast<long>(i);
+                }
+            }
+            return -1;
+        }
+    }
+
+    // Positions and normals are read straight from the mapped file into the mesh arrays
+    bool PLYMesh::load_binary(const std::filesystem::path &path, const Matrix44f &transform) {
+        const MappedFile file(path);
+        const PLYHeader header = parse_ply_header(file.data(), file.size());
+        if(!header.binary){
+            return false;
+        }
+
+        const char *p = file.data() + header.body;
+        const char *end = file.data() + file.size();
+        const auto check_size = [&p, end](std::size_t size){
+            if(size > static_cast<std::size_t>(end - p)){
+                CRM_ERROR("Unexpected end of ply file");
+            }
+        };
+
+        bool vertex_found = false;
+        bool face_found = false;
+        for(const PLYElement &element : header.elements){
+            const std::size_t stride = element.stride();
+
+            if(element.name == "vertex"){
+                if(stride == 0){
+                    CRM_ERROR("List properties of ply vertex are not supported");
+                }
+                const long ox = element.offset_of("x");
+                const long oy = element.offset_of("y");
+                const long oz = element.offset_of("z");
+                if(ox < 0 || oy < 0 || oz < 0){
+                    CRM_ERROR("Ply vertex has no position");
+                }
+                const long onx = element.offset_of("nx");
+                const long ony = element.offset_of("ny");
+                const long onz = element.offset_of("nz");
+                is_vn_exists = onx >= 0 && ony >= 0 && onz >= 0;
+
+                const auto type_of = [&element](const std::string &name){
+                    for(const auto &prop : element.properties){
+                        if(prop.name == name) return prop.type;
+                    }
+                    return PLYType::Float32;
+                };
+                const PLYType tx = type_of("x"), ty = type_of("y"), tz = type_of("z");
+                const PLYType tnx = type_of("nx"), tny = type_of("ny"), tnz = type_of("nz");
 
+                check_size(element.count * stride);
+                m_vertices.resize(element.count);
+                if(is_vn_exists){
+                    m_normals.resize(element.count);
+                }
+                const Matrix44f normal_transform = Inverse(T(transform));
+                const char *base = p;
+                const bool swap = header.swap;
+                const auto read_vertices = [&](std::size_t begin, std::size_t last){
+                    for(std::size_t i=begin;i<last;i++){
+                        const char *item = base + i * stride;
+                        m_vertices[i] = transform_point(Vector3f{load_value<Float>(item + ox, tx, swap),
+                                                                 load_value<Float>(item + oy, ty, swap),
+                                                                 load_value<Float>(item + oz, tz, swap)}, transform);
+                        if(is_vn_exists){
+                            m_normals[i] = Block<0, 0, 3, 1>(normal_transform * Vector4f{load_value<Float>(item + onx, tnx, swap),
+                                                                                         load_value<Float>(item + ony, tny, swap),
+                                                                                         load_value<Float>(item + onz, tnz, swap),
+                                                                                         Float0});
+                        }
+                    }
+                };
+                constexpr std::size_t BLOCK = 1 << 16;
+                if(element.count <= BLOCK){
+                    read_vertices(0, element.count);
+                }
+                else{
+                    parallel_for(0, static_cast<int>((element.count + BLOCK - 1) / BLOCK), [&](int b){
+                        read_vertices(b * BLOCK, std::min(element.count, (b + 1) * BLOCK));
+                    });
+                }
+                p += element.count * stride;
+                vertex_found = true;
+                continue;
+            }
+
+            if(element.name == "face"){
+                // Faces are fan triangulated while they are read
+                m_face_indices.reserve(element.count);
+                std::size_t degenerate_faces = 0;
+                for(std::size_t i=0;i<element.count;i++){
+                    for(const PLYProperty &prop : element.properties){
+                        const std::size_t count_size = PLYElement::type_size(prop.count_type);
+                        const std::size_t item_size = PLYElement::type_size(prop.type);
+                        if(!prop.is_list){
+                            check_size(item_size);
+                            p += item_size;
+                            continue;
+                        }
+                        check_size(count_size);
+                        const auto n = load_value<std::size_t>(p, prop.count_type, header.swap);
+                        p += count_size;
+                        check_size(n * item_size);
+                        if(prop.name != "vertex_indices" && prop.name != "vertex_index"){
+                            p += n * item_size;
+                            continue;
+                        }
+                        if(n < 3){
+                            degenerate_faces++;
+                            p += n * item_size;
+                            continue;
+                        }
+                        const Int v0 = load_value<Int>(p, prop.type, header.swap);
+                        for(std::size_t k=1;k+1<n;k++){
+                            m_face_indices.emplace_back(v0,
+                                                        load_value<Int>(p + k * item_size, prop.type, header.swap),
+                                                        load_value<Int>(p + (k + 1) * item_size, prop.type, header.swap));
+                        }
+                        p += n * item_size;
+                    }
+                }
+                if(degenerate_faces > 0){
+                    CRM_WARNING("Skipped " + std::to_string(degenerate_faces) + " degenerate faces with less than 3 vertices");
+                }
+                face_found = true;
+                continue;
+            }
+
+            // Other elements are skipped
+            p = skip_element(element, p, end, header.swap);
+        }
+
+        if(!vertex_found || !face_found){
+            CRM_ERROR("Ply file should have vertex and face elements");
+        }
+        for(const auto &f : m_face_indices){
+            for(int k=0;k<3;k++){
+                if(f[k] < 0 || static_cast<std::size_t>(f[k]) >= m_vertices.size()){
+                    CRM_ERROR("Vertex index of ply face is out of range");
+                }
+            }
+        }
+        return true;
+    }
+
+    void PLYMesh::load_happly(const std::filesystem::path &path, const Matrix44f &transform) {
         happly::PLYData plyData(path.string());
 
         // Get vertex positions
@@ -90,9 +420,10 @@ namespace Caramel {
         }
 
         // Process faces - triangulate polygons via fan triangulation
+        size_t degenerate_faces = 0;
         for (const auto& face : faces) {
             if (face.size() < 3) {
-                CRM_WARNING("Skipping degenerate face with less than 3 vertices");
+                degenerate_faces++;
                 continue;
             }
             for (size_t i = 1; i + 1 < face.size(); ++i) {
@@ -102,7 +433,118 @@ namespace Caramel {
                     static_cast<Int>(face[i + 1]));
             }
         }
+        if (degenerate_faces > 0) {
+            CRM_WARNING("Skipped " + std::to_string(degenerate_faces) + " degenerate faces with less than 3 vertices");
+        }
+    }
+
+    AABB PLYMesh::read_aabb(const std::filesystem::path &path, const Matrix44f &transform) {
+        if (!std::filesystem::exists(path)) {
+            CRM_ERROR(path.string() + " does not exist");
+        }
+        const MappedFile file(path);
+        const PLYHeader header = parse_ply_header(file.data(), file.size());
+        const char *p = file.data() + header.body;
+        const char *end = file.data() + file.size();
+
+        for (const PLYElement &element : header.elements) {
+            if (element.name != "vertex") {
+                if (header.binary) {
+                    p = skip_element(element, p, end, header.swap);
+                }
+                else {
+                    // An ascii item is a line
+                    for (std::size_t i = 0; i < element.count && p < end; i++) {
+                        const void *nl = std::memchr(p, '\n', end - p);
+                        p = nl != nullptr ? static_cast<const char*>(nl) + 1 : end;
+                    }
+                }
+                continue;
+            }
+
+            const long ix = property_index(element, "x");
+            const long iy = property_index(element, "y");
+            const long iz = property_index(element, "z");
+            if (ix < 0 || iy < 0 || iz < 0) {
+                CRM_ERROR("Ply vertex has no position");
+            }
+            std::vector<AABB> bounds;
+            if (header.binary) {
+                const std::size_t stride = element.stride();
+                if (stride == 0) {
+                    CRM_ERROR("List properties of ply vertex are not supported");
+                }
+                if (element.count * stride > static_cast<std::size_t>(end - p)) {
+                    CRM_ERROR("Unexpected end of ply file");
+                }
+                const PLYProperty &px = element.properties[ix], &py = element.properties[iy], &pz = element.properties[iz];
+                const long ox = element.offset_of("x"), oy = element.offset_of("y"), oz = element.offset_of("z");
+                constexpr std::size_t BLOCK = 1 << 16;
+                bounds.resize((element.count + BLOCK - 1) / BLOCK);
+                parallel_for(0, static_cast<int>(bounds.size()), [&](int b){
+                    for (std::size_t i = b * BLOCK; i < std::min(element.count, (b + 1) * BLOCK); i++) {
+                        const char *item = p + i * stride;
+                        const Vector3f v = transform_point(Vector3f{load_value<Float>(item + ox, px.type, header.swap),
+                                                                    load_value<Float>(item + oy, py.type, header.swap),
+                                                                    load_value<Float>(item + oz, pz.type, header.swap)}, transform);
+                        bounds[b] = AABB::merge(bounds[b], AABB(v, v));
+                    }
+                });
+            }
+            else {
+                bounds.resize(1);
+                for (std::size_t i = 0; i < element.count; i++) {
+                    Float coords[3];
+                    long prop = 0;
+                    for (; p < end && *p != '\n'; prop++) {
+                        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+                            p++;
+                        }
+                        if (p == end || *p == '\n') {
+                            break;
+                        }
+                        double value = 0;
+                        const auto [next, ec] = std::from_chars(p, end, value);
+                        if (ec != std::errc()) {
+                            CRM_ERROR("Can not parse ply vertex");
+                        }
+                        p = next;
+                        if (prop == ix || prop == iy || prop == iz) {
+                            coords[prop == ix ? 0 : prop == iy ? 1 : 2] = static_cast<Float>(value);
+                        }
+                    }
+                    if (prop <= std::max({ix, iy, iz})) {
+                        CRM_ERROR("Unexpected end of ply file");
+                    }
+                    p = p < end ? p + 1 : end;
+                    const Vector3f v = transform_point(Vector3f{coords[0], coords[1], coords[2]}, transform);
+                    bounds[0] = AABB::merge(bounds[0], AABB(v, v));
+                }
+            }
+
+            AABB aabb;
+            for (const AABB &b : bounds) {
+                aabb = AABB::merge(aabb, b);
+            }
+            return aabb;
+        }
+        CRM_ERROR("Ply file should have vertex and face elements");
+    }
+
+    PLYMesh::PLYMesh(const std::filesystem::path &path, BSDF *bsdf, AreaLight *arealight, const Matrix44f &transform,
+                      MeshStorage storage)
+    : TriangleMesh(bsdf, arealight) {
+        if (!std::filesystem::exists(path)) {
+            CRM_ERROR(path.string() + " does not exist");
+        }
+
+        CRM_LOG("Loading ply : " + path.string());
+
+        if (!load_binary(path, transform)) {
+            // ASCII files are read by happly
+            load_happly(path, transform);
+        }
 
-        finalize(arealight, path.string());
+        finalize(arealight, path.string(), storage);
     }
 }
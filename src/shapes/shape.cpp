@@ -39,6 +39,13 @@ namespace Caramel {
         }
     }
 
+    void Shape::set_arealight(AreaLight *arealight) {
+        m_arealight = arealight;
+        if(arealight != nullptr){
+            arealight->m_shape = this;
+        }
+    }
+
     Vector3f Shape::get_center() const {
         return get_aabb().get_center();
     }
@@ -100,7 +100,15 @@ namespace Caramel {
 
         RayIntersectInfo ret;
         ret.t = t;
-        ret.tex_uv = is_tx_exists ? interpolate(m_uv0, m_uv1, m_uv2, u, v) : Vector2f{u, v};
+        if(is_tx_exists){
+            ret.tex_uv = interpolate(m_uv0, m_uv1, m_uv2, u, v);
+            ret.set_triangle_derivatives(m_points[0], m_points[1], m_points[2], m_uv0, m_uv1, m_uv2);
+        }
+        else{
+            ret.tex_uv = Vector2f{u, v};
+            ret.dpdu = m_points[1] - m_points[0];
+            ret.dpdv = m_points[2] - m_points[0];
+        }
 
         ret.tex_uv[0] -= floor(ret.tex_uv[0]);
         ret.tex_uv[1] -= floor(ret.tex_uv[1]);
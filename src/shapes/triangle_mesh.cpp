@@ -23,7 +23,10 @@
 //
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <map>
+#include <string>
 
 #include <shape.h>
 
@@ -35,33 +38,114 @@
 #include <sampler.h>
 
 namespace Caramel {
+    namespace {
+        constexpr Float QUANTIZE_MAX = 65535;
+
+        std::uint32_t pack_16x2(long lo, long hi) {
+            return static_cast<std::uint32_t>(lo & 0xFFFF) | static_cast<std::uint32_t>(hi & 0xFFFF) << 16;
+        }
+
+        Float sign_not_zero(Float v) {
+            return v < Float0 ? -Float1 : Float1;
+        }
+
+        // Octahedral mapping with 16 bit snorm components
+        // Reference: https://jcgt.org/published/0003/02/01/paper.pdf
+        std::uint32_t encode_octahedral(const Vector3f &n) {
+            using std::abs;
+            const Float l1 = abs(n[0]) + abs(n[1]) + abs(n[2]);
+            if (l1 <= Float0) {
+                return pack_16x2(0, 0);
+            }
+            Float x = n[0] / l1;
+            Float y = n[1] / l1;
+            if (n[2] < Float0) {
+                const Float ox = x;
+                x = (Float1 - abs(y)) * sign_not_zero(ox);
+                y = (Float1 - abs(ox)) * sign_not_zero(y);
+            }
+            return pack_16x2(std::lround(std::clamp(x, -Float1, Float1) * 32767),
+                             std::lround(std::clamp(y, -Float1, Float1) * 32767));
+        }
+
+        Vector3f decode_octahedral(std::uint32_t packed) {
+            using std::abs;
+            const Float x = static_cast<Float>(static_cast<std::int16_t>(packed & 0xFFFF)) / 32767;
+            const Float y = static_cast<Float>(static_cast<std::int16_t>(packed >> 16)) / 32767;
+            Vector3f n{x, y, Float1 - abs(x) - abs(y)};
+            if (n[2] < Float0) {
+                n[0] = (Float1 - abs(y)) * sign_not_zero(x);
+                n[1] = (Float1 - abs(x)) * sign_not_zero(y);
+            }
+            return n.normalize();
+        }
+
+        std::uint16_t float_to_half(float f) {
+            std::uint32_t x;
+            std::memcpy(&x, &f, sizeof(x));
+            const auto sign = static_cast<std::uint16_t>((x >> 16) & 0x8000);
+            x &= 0x7FFFFFFF;
+            // Too large, infinity or nan
+            if (x >= 0x47800000) {
+                return sign | (x > 0x7F800000 ? 0x7E00 : 0x7C00);
+            }
+            // Subnormal half
+            if (x < 0x38800000) {
+                float a;
+                std::memcpy(&a, &x, sizeof(a));
+                return sign | static_cast<std::uint16_t>(std::lrint(a * 16777216.0f));
+            }
+            // Rebias exponent and round mantissa to nearest even
+            const std::uint32_t rounded = x + 0x0FFF + ((x >> 13) & 1);
+            return sign | static_cast<std::uint16_t>((rounded - 0x38000000) >> 13);
+        }
+
+        float half_to_float(std::uint16_t h) {
+            const std::uint32_t sign = static_cast<std::uint32_t>(h & 0x8000) << 16;
+            const std::uint32_t exponent = (h >> 10) & 0x1F;
+            const std::uint32_t mantissa = h & 0x3FF;
+            if (exponent == 0) {
+                const float f = std::ldexp(static_cast<float>(mantissa), -24);
+                return sign != 0 ? -f : f;
+            }
+            const std::uint32_t x = exponent == 31 ? sign | 0x7F800000 | mantissa << 13 :
+                                                     sign | (exponent + 112) << 23 | mantissa << 13;
+            float f;
+            std::memcpy(&f, &x, sizeof(f));
+            return f;
+        }
+    }
+
     TriangleMesh::TriangleMesh(BSDF *bsdf, AreaLight *arealight) : Shape{bsdf, arealight} {}
 
     TriangleMesh::~TriangleMesh() = default;
 
-    void TriangleMesh::finalize(AreaLight *arealight, const std::string &name) {
-        Vector3f mn{INF, INF, INF};
-        Vector3f mx{-INF, -INF, -INF};
-        for (const auto &v : m_vertices) {
-            for (int a = 0; a < 3; ++a) {
-                mn[a] = std::min(mn[a], v[a]);
-                mx[a] = std::max(mx[a], v[a]);
+    void TriangleMesh::finalize(AreaLight *arealight, const std::string &name, MeshStorage storage) {
+        bind_views();
+        compute_aabb();
+
+        if (storage != MeshStorage::Full) {
+            pack_attributes(storage);
+            bind_views();
+            // Quantized positions are what the mesh is intersected with from now on
+            if (storage == MeshStorage::Quantized) {
+                compute_aabb();
             }
         }
-        m_aabb = AABB(mn, mx);
+        log_memory(name);
 
         // Calculate triangle areas for sampling
         std::vector<Float> triangle_area_vec;
-        triangle_area_vec.resize(m_face_indices.size());
+        triangle_area_vec.resize(m_face_view.size());
 
         m_area = Float0;
-        for (size_t i = 0; i < m_face_indices.size(); ++i) {
+        for (size_t i = 0; i < m_face_view.size(); ++i) {
             const Float ith_tri_area = get_triangle_area(i);
             triangle_area_vec[i] = ith_tri_area;
             m_area += ith_tri_area;
         }
 
-        if(m_face_indices.empty() || m_area <= Float0){
+        if(m_face_view.empty() || m_area <= Float0){
             CRM_ERROR(name + " : mesh has no triangles or zero surface area");
         }
 
@@ -70,102 +154,230 @@ namespace Caramel {
         m_accel = std::make_unique<BVHMesh>(*this, Float1, Float1, 32, 1);
         m_accel->build();
 
-        if (AreaLight::TRY_SOLID_ANGLE_SAMPLING && arealight != nullptr && !m_face_indices.empty()) {
-            // Check coplanarity of all triangles
-            const auto& idx0 = m_face_indices[0];
-            const Vector3f ref_normal = Vector3f::cross(
-                m_vertices[idx0[1]] - m_vertices[idx0[0]],
-                m_vertices[idx0[2]] - m_vertices[idx0[0]]).normalize();
+        if (AreaLight::TRY_SOLID_ANGLE_SAMPLING && arealight != nullptr) {
+            set_polygon_vertices(boundary_polygon(), name);
+        }
+    }
 
-            bool coplanar = true;
-            constexpr Float coplanar_eps = Float(1e-4);
+    void TriangleMesh::set_polygon_vertices(std::vector<Vector3f> polygon, const std::string &name) {
+        if (polygon.empty()) {
+            return;
+        }
+        m_is_solid_angle_sampling_possible = true;
+        CRM_LOG("Area light solid angle sampling enabled : " + name)
+        m_polygon_vertices = std::move(polygon);
+    }
+
+    std::vector<Vector3f> TriangleMesh::boundary_polygon() const {
+        if (m_face_view.empty()) {
+            return {};
+        }
 
-            for (Index i = 0; i < m_face_indices.size() && coplanar; ++i) {
-                const auto& idx = m_face_indices[i];
-                const Vector3f tri_normal = Vector3f::cross(
-                    m_vertices[idx[1]] - m_vertices[idx[0]],
-                    m_vertices[idx[2]] - m_vertices[idx[0]]).normalize();
+        // Check coplanarity of all triangles
+        const auto& idx0 = m_face_view[0];
+        const Vector3f ref_normal = Vector3f::cross(
+            vertex(idx0[1]) - vertex(idx0[0]),
+            vertex(idx0[2]) - vertex(idx0[0])).normalize();
 
-                if (ref_normal.dot(tri_normal) <= Float1 - coplanar_eps) {
+        bool coplanar = true;
+        constexpr Float coplanar_eps = Float(1e-4);
+
+        for (Index i = 0; i < m_face_view.size() && coplanar; ++i) {
+            const auto& idx = m_face_view[i];
+            const Vector3f tri_normal = Vector3f::cross(
+                vertex(idx[1]) - vertex(idx[0]),
+                vertex(idx[2]) - vertex(idx[0])).normalize();
+
+            if (ref_normal.dot(tri_normal) <= Float1 - coplanar_eps) {
+                coplanar = false;
+                break;
+            }
+
+            for (int j = 0; j < 3; ++j) {
+                using std::abs;
+                if (abs(ref_normal.dot(vertex(idx[j]) - vertex(idx0[0]))) > coplanar_eps) {
                     coplanar = false;
                     break;
                 }
-
-                for (int j = 0; j < 3; ++j) {
-                    using std::abs;
-                    if (abs(ref_normal.dot(m_vertices[idx[j]] - m_vertices[idx0[0]])) > coplanar_eps) {
-                        coplanar = false;
-                        break;
-                    }
-                }
             }
+        }
 
-            if (!coplanar) {
-                return;
+        if (!coplanar) {
+            return {};
+        }
+
+        // Build edge map: (min_idx, max_idx) -> count
+        std::map<std::pair<Int, Int>, int> edge_count;
+        for (Index i = 0; i < m_face_view.size(); ++i) {
+            const auto& idx = m_face_view[i];
+            for (int e = 0; e < 3; ++e) {
+                Int a = idx[e];
+                Int b = idx[(e + 1) % 3];
+                auto edge = std::make_pair(std::min(a, b), std::max(a, b));
+                edge_count[edge]++;
             }
+        }
 
-            // Build edge map: (min_idx, max_idx) -> count
-            std::map<std::pair<Int, Int>, int> edge_count;
-            for (Index i = 0; i < m_face_indices.size(); ++i) {
-                const auto& idx = m_face_indices[i];
-                for (int e = 0; e < 3; ++e) {
-                    Int a = idx[e];
-                    Int b = idx[(e + 1) % 3];
-                    auto edge = std::make_pair(std::min(a, b), std::max(a, b));
-                    edge_count[edge]++;
-                }
+        // Find boundary edges (count == 1) and build adjacency
+        std::map<Int, std::vector<Int>> adjacency;
+        for (const auto& [edge, count] : edge_count) {
+            if (count == 1) {
+                adjacency[edge.first].push_back(edge.second);
+                adjacency[edge.second].push_back(edge.first);
             }
+        }
 
-            // Find boundary edges (count == 1) and build adjacency
-            std::map<Int, std::vector<Int>> adjacency;
-            for (const auto& [edge, count] : edge_count) {
-                if (count == 1) {
-                    adjacency[edge.first].push_back(edge.second);
-                    adjacency[edge.second].push_back(edge.first);
-                }
+        if (adjacency.empty()) {
+            return {};
+        }
+        for (const auto& kv : adjacency) {
+            if (kv.second.size() != 2) {
+                return {};
             }
+        }
 
-            if (adjacency.empty()) {
-                return;
+        // Walk boundary edges to get ordered vertex indices
+        std::vector<Int> boundary_indices;
+        Int start = adjacency.begin()->first;
+        Int current = start;
+        Int prev = -1;
+        do {
+            boundary_indices.push_back(current);
+            const auto& neighbors = adjacency[current];
+            Int next = (neighbors[0] != prev) ? neighbors[0] : neighbors[1];
+            prev = current;
+            current = next;
+        } while (current != start);
+
+        if (boundary_indices.size() > MAX_POLYGON_VERTEX_COUNT) {
+            return {};
+        }
+
+        // Ensure boundary winding matches original triangle winding
+        const Vector3f boundary_normal = Vector3f::cross(
+            vertex(boundary_indices[1]) - vertex(boundary_indices[0]),
+            vertex(boundary_indices[2]) - vertex(boundary_indices[0]));
+        if (ref_normal.dot(boundary_normal) < Float0) {
+            std::reverse(boundary_indices.begin(), boundary_indices.end());
+        }
+
+        std::vector<Vector3f> polygon(boundary_indices.size());
+        for (Index i = 0; i < boundary_indices.size(); ++i) {
+            polygon[i] = vertex(boundary_indices[i]);
+        }
+        return polygon;
+    }
+
+    void TriangleMesh::bind_views() {
+        m_vertex_view = m_vertices;
+        m_normal_view = m_normals;
+        m_tex_coord_view = m_tex_coords;
+        m_face_view = m_face_indices;
+    }
+
+    void TriangleMesh::compute_aabb() {
+        Vector3f mn{INF, INF, INF};
+        Vector3f mx{-INF, -INF, -INF};
+        const Index vertex_num = m_storage == MeshStorage::Quantized ? m_quantized_vertices.size() : m_vertex_view.size();
+        for (Index i = 0; i < vertex_num; ++i) {
+            const Vector3f v = vertex(static_cast<Int>(i));
+            for (int a = 0; a < 3; ++a) {
+                mn[a] = std::min(mn[a], v[a]);
+                mx[a] = std::max(mx[a], v[a]);
             }
-            for (const auto& kv : adjacency) {
-                if (kv.second.size() != 2) {
-                    return;
+        }
+        m_aabb = AABB(mn, mx);
+    }
+
+    void TriangleMesh::pack_attributes(MeshStorage storage) {
+        if (storage == MeshStorage::Quantized) {
+            m_quantize_origin = m_aabb.m_min;
+            const Vector3f extent = m_aabb.m_max - m_aabb.m_min;
+            m_quantize_scale = extent / static_cast<Float>(QUANTIZE_MAX);
+            m_quantized_vertices.resize(m_vertices.size());
+            for (Index i = 0; i < m_vertices.size(); ++i) {
+                for (int a = 0; a < 3; ++a) {
+                    const Float t = extent[a] > Float0 ? (m_vertices[i][a] - m_quantize_origin[a]) / extent[a] : Float0;
+                    m_quantized_vertices[i][a] = static_cast<std::uint16_t>(std::lround(std::clamp(t, Float0, Float1) * QUANTIZE_MAX));
                 }
             }
+            std::vector<Vector3f>().swap(m_vertices);
+        }
 
-            // Walk boundary edges to get ordered vertex indices
-            std::vector<Int> boundary_indices;
-            Int start = adjacency.begin()->first;
-            Int current = start;
-            Int prev = -1;
-            do {
-                boundary_indices.push_back(current);
-                const auto& neighbors = adjacency[current];
-                Int next = (neighbors[0] != prev) ? neighbors[0] : neighbors[1];
-                prev = current;
-                current = next;
-            } while (current != start);
-
-            if (boundary_indices.size() > MAX_POLYGON_VERTEX_COUNT) {
-                return;
+        if (is_vn_exists) {
+            m_packed_normals.resize(m_normals.size());
+            for (Index i = 0; i < m_normals.size(); ++i) {
+                m_packed_normals[i] = encode_octahedral(m_normals[i]);
             }
+            std::vector<Vector3f>().swap(m_normals);
+        }
 
-            // Ensure boundary winding matches original triangle winding
-            const Vector3f boundary_normal = Vector3f::cross(
-                m_vertices[boundary_indices[1]] - m_vertices[boundary_indices[0]],
-                m_vertices[boundary_indices[2]] - m_vertices[boundary_indices[0]]);
-            if (ref_normal.dot(boundary_normal) < Float0) {
-                std::reverse(boundary_indices.begin(), boundary_indices.end());
+        if (is_tx_exists) {
+            m_tex_coords_unorm = std::ranges::all_of(m_tex_coords, [](const Vector2f &uv) {
+                return uv[0] >= Float0 && uv[0] <= Float1 && uv[1] >= Float0 && uv[1] <= Float1;
+            });
+            m_packed_tex_coords.resize(m_tex_coords.size());
+            for (Index i = 0; i < m_tex_coords.size(); ++i) {
+                const Vector2f &uv = m_tex_coords[i];
+                m_packed_tex_coords[i] = m_tex_coords_unorm ?
+                                         pack_16x2(std::lround(uv[0] * QUANTIZE_MAX), std::lround(uv[1] * QUANTIZE_MAX)) :
+                                         pack_16x2(float_to_half(uv[0]), float_to_half(uv[1]));
             }
+            std::vector<Vector2f>().swap(m_tex_coords);
+        }
 
-            m_is_solid_angle_sampling_possible = true;
-            CRM_LOG("Area light solid angle sampling enabled : " + name)
-            m_polygon_vertices.resize(boundary_indices.size());
-            for (Index i = 0; i < boundary_indices.size(); ++i) {
-                m_polygon_vertices[i] = m_vertices[boundary_indices[i]];
-            }
+        m_storage = storage;
+    }
+
+    std::size_t TriangleMesh::memory_size() const {
+        // Mapped arrays are counted too, as their pages are resident while the mesh is used
+        std::size_t bytes = m_vertex_view.size_bytes() + m_normal_view.size_bytes() + m_tex_coord_view.size_bytes() +
+                            m_face_view.size_bytes() + m_quantized_vertices.size() * sizeof(m_quantized_vertices[0]) +
+                            (m_packed_normals.size() + m_packed_tex_coords.size()) * sizeof(std::uint32_t) +
+                            (m_triangle_pdf.pdf_values().size() + m_triangle_pdf.cdf_values().size()) * sizeof(Float);
+        if(const auto *bvh = dynamic_cast<const BVHMesh*>(m_accel.get())){
+            bytes += bvh->tree().nodes().size_bytes() + bvh->tree().ordered_primitives().size_bytes();
+        }
+        return bytes;
+    }
+
+    void TriangleMesh::log_memory(const std::string &name) const {
+        const std::size_t vertex_bytes = m_vertex_view.size_bytes() +
+                                         m_quantized_vertices.size() * sizeof(m_quantized_vertices[0]);
+        const std::size_t normal_bytes = m_normal_view.size_bytes() + m_packed_normals.size() * sizeof(std::uint32_t);
+        const std::size_t tex_coord_bytes = m_tex_coord_view.size_bytes() + m_packed_tex_coords.size() * sizeof(std::uint32_t);
+        const std::size_t face_bytes = m_face_view.size_bytes();
+        const auto kb = [](std::size_t bytes) { return std::to_string((bytes + 1023) / 1024) + " KB"; };
+        CRM_LOG("Mesh memory : " + name + " : " + kb(vertex_bytes + normal_bytes + tex_coord_bytes + face_bytes) +
+                " (positions " + kb(vertex_bytes) + ", normals " + kb(normal_bytes) +
+                ", texture coordinates " + kb(tex_coord_bytes) + ", faces " + kb(face_bytes) + ")");
+    }
+
+    Vector3f TriangleMesh::vertex(Int i) const {
+        if (m_storage != MeshStorage::Quantized) {
+            return m_vertex_view[i];
+        }
+        const auto &q = m_quantized_vertices[i];
+        return Vector3f{m_quantize_origin[0] + static_cast<Float>(q[0]) * m_quantize_scale[0],
+                        m_quantize_origin[1] + static_cast<Float>(q[1]) * m_quantize_scale[1],
+                        m_quantize_origin[2] + static_cast<Float>(q[2]) * m_quantize_scale[2]};
+    }
+
+    Vector3f TriangleMesh::vertex_normal(Int i) const {
+        return m_storage == MeshStorage::Full ? m_normal_view[i] : decode_octahedral(m_packed_normals[i]);
+    }
+
+    Vector2f TriangleMesh::vertex_tex_coord(Int i) const {
+        if (m_storage == MeshStorage::Full) {
+            return m_tex_coord_view[i];
+        }
+        const std::uint32_t packed = m_packed_tex_coords[i];
+        const auto lo = static_cast<std::uint16_t>(packed & 0xFFFF);
+        const auto hi = static_cast<std::uint16_t>(packed >> 16);
+        if (m_tex_coords_unorm) {
+            return Vector2f{static_cast<Float>(lo) / QUANTIZE_MAX, static_cast<Float>(hi) / QUANTIZE_MAX};
         }
+        return Vector2f{half_to_float(lo), half_to_float(hi)};
     }
 
     std::pair<bool, RayIntersectInfo> TriangleMesh::ray_intersect(const Ray &ray, Float maxt) const {
@@ -199,19 +411,19 @@ namespace Caramel {
     }
 
     Float TriangleMesh::get_triangle_area(Index i) const {
-        const Vector3i& idx = m_face_indices[i];
-        const Vector3f &p0 = m_vertices[idx[0]];
-        const Vector3f &p1 = m_vertices[idx[1]];
-        const Vector3f &p2 = m_vertices[idx[2]];
+        const Vector3i& idx = m_face_view[i];
+        const Vector3f p0 = vertex(idx[0]);
+        const Vector3f p1 = vertex(idx[1]);
+        const Vector3f p2 = vertex(idx[2]);
 
         return Vector3f::cross(p1 - p0, p2 - p0).length() * Float0_5;
     }
 
     std::tuple<Vector3f, Vector3f, Float> TriangleMesh::get_triangle_sample_point(Index i, Sampler &sampler) const {
-        const Vector3i& idx = m_face_indices[i];
-        const Vector3f &p0 = m_vertices[idx[0]];
-        const Vector3f &p1 = m_vertices[idx[1]];
-        const Vector3f &p2 = m_vertices[idx[2]];
+        const Vector3i& idx = m_face_view[i];
+        const Vector3f p0 = vertex(idx[0]);
+        const Vector3f p1 = vertex(idx[1]);
+        const Vector3f p2 = vertex(idx[2]);
 
         const Float u = sampler.sample_1d();
         const Float v = sampler.sample_1d();
@@ -221,9 +433,9 @@ namespace Caramel {
 
         Vector3f n;
         if (is_vn_exists) {
-            const Vector3f &n0 = m_normals[idx[0]];
-            const Vector3f &n1 = m_normals[idx[1]];
-            const Vector3f &n2 = m_normals[idx[2]];
+            const Vector3f n0 = vertex_normal(idx[0]);
+            const Vector3f n1 = vertex_normal(idx[1]);
+            const Vector3f n2 = vertex_normal(idx[2]);
             n = interpolate(n0, n1, n2, x, y).normalize();
         } else {
             n = Vector3f::cross(p1 - p0, p2 - p0).normalize();
@@ -235,10 +447,10 @@ namespace Caramel {
     }
 
     std::pair<bool, RayIntersectInfo> TriangleMesh::get_triangle_ray_intersect(Index i, const Ray &ray, Float maxt) const {
-        const Vector3i& idx = m_face_indices[i];
-        const Vector3f &p0 = m_vertices[idx[0]];
-        const Vector3f &p1 = m_vertices[idx[1]];
-        const Vector3f &p2 = m_vertices[idx[2]];
+        const Vector3i& idx = m_face_view[i];
+        const Vector3f p0 = vertex(idx[0]);
+        const Vector3f p1 = vertex(idx[1]);
+        const Vector3f p2 = vertex(idx[2]);
 
 #ifdef USE_MOLLER_TRUMBORE
         auto [u, v, t] = moller_trumbore(ray, p0, p1, p2, maxt);
@@ -257,12 +469,15 @@ namespace Caramel {
         ret.tri_index = i;
 
         if (is_tx_exists) {
-            const Vector2f &uv0 = m_tex_coords[idx[0]];
-            const Vector2f &uv1 = m_tex_coords[idx[1]];
-            const Vector2f &uv2 = m_tex_coords[idx[2]];
+            const Vector2f uv0 = vertex_tex_coord(idx[0]);
+            const Vector2f uv1 = vertex_tex_coord(idx[1]);
+            const Vector2f uv2 = vertex_tex_coord(idx[2]);
             ret.tex_uv = interpolate(uv0, uv1, uv2, u, v);
+            ret.set_triangle_derivatives(p0, p1, p2, uv0, uv1, uv2);
         } else {
             ret.tex_uv = Vector2f{u, v};
+            ret.dpdu = p1 - p0;
+            ret.dpdv = p2 - p0;
         }
 
         ret.tex_uv[0] -= floor(ret.tex_uv[0]);
@@ -272,9 +487,9 @@ namespace Caramel {
 
         Vector3f n;
         if (is_vn_exists) {
-            const Vector3f &n0 = m_normals[idx[0]];
-            const Vector3f &n1 = m_normals[idx[1]];
-            const Vector3f &n2 = m_normals[idx[2]];
+            const Vector3f n0 = vertex_normal(idx[0]);
+            const Vector3f n1 = vertex_normal(idx[1]);
+            const Vector3f n2 = vertex_normal(idx[2]);
             n = interpolate(n0, n1, n2, u, v).normalize();
         } else {
             n = Vector3f::cross(p1 - p0, p2 - p0).normalize();
@@ -285,10 +500,10 @@ namespace Caramel {
     }
 
     AABB TriangleMesh::get_triangle_aabb(Index i) const {
-        const Vector3i& idx = m_face_indices[i];
-        const Vector3f &p0 = m_vertices[idx[0]];
-        const Vector3f &p1 = m_vertices[idx[1]];
-        const Vector3f &p2 = m_vertices[idx[2]];
+        const Vector3i& idx = m_face_view[i];
+        const Vector3f p0 = vertex(idx[0]);
+        const Vector3f p1 = vertex(idx[1]);
+        const Vector3f p2 = vertex(idx[2]);
 
         return AABB(Vector3f{std::min({p0[0], p1[0], p2[0]}),
                              std::min({p0[1], p1[1], p2[1]}),
@@ -299,8 +514,8 @@ namespace Caramel {
     }
 
     std::tuple<Vector3f, Vector3f, Vector3f> TriangleMesh::get_triangle_vertices(Index i) const {
-        const Vector3i& idx = m_face_indices[i];
-        return {m_vertices[idx[0]], m_vertices[idx[1]], m_vertices[idx[2]]};
+        const Vector3i& idx = m_face_view[i];
+        return {vertex(idx[0]), vertex(idx[1]), vertex(idx[2])};
     }
 
     Index TriangleMesh::sample_triangle_index(Float u) const {
@@ -0,0 +1,126 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <array>
+
+#include <texture_cache.h>
+
+#include <tiled_image.h>
+
+namespace Caramel{
+
+    void TextureCache::set_budget(std::size_t bytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget = bytes;
+    }
+
+    std::size_t TextureCache::budget() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_budget;
+    }
+
+    std::size_t TextureCache::resident_bytes() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_resident_bytes;
+    }
+
+    Index TextureCache::load_count() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_load_count;
+    }
+
+    Index TextureCache::eviction_count() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_eviction_count;
+    }
+
+    Vector3f TextureCache::texel(const TiledImage &image, Index level, Index x, Index y) {
+        struct ThreadEntry{
+            TileKey key{0, 0, 0};
+            std::shared_ptr<const Tile> tile;
+        };
+        // Direct mapped, image ids start from 1 so that empty entries never match
+        thread_local std::array<ThreadEntry, THREAD_CACHE_SIZE> thread_cache;
+
+        const Index tile_x = x / TiledImage::TILE_SIZE;
+        const Index tile_y = y / TiledImage::TILE_SIZE;
+        const Index tiles_x = (image.size(level)[0] + TiledImage::TILE_SIZE - 1) / TiledImage::TILE_SIZE;
+        const TileKey key{image.id(), level, tile_y * tiles_x + tile_x};
+        ThreadEntry &entry = thread_cache[TileKeyHash()(key) % THREAD_CACHE_SIZE];
+        if(!(entry.key == key)){
+            entry.tile = fetch(image, key, tile_x, tile_y);
+            entry.key = key;
+        }
+        const Float *t = entry.tile->data() + ((y % TiledImage::TILE_SIZE) * TiledImage::TILE_SIZE + x % TiledImage::TILE_SIZE) * 3;
+        return Vector3f{t[0], t[1], t[2]};
+    }
+
+    std::shared_ptr<const TextureCache::Tile> TextureCache::fetch(const TiledImage &image, const TileKey &key, Index tile_x, Index tile_y) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const auto it = m_tiles.find(key);
+            if(it != m_tiles.end()){
+                m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+                return it->second.tile;
+            }
+        }
+
+        // Read without the lock, another thread may have read the same tile meanwhile
+        auto tile = std::make_shared<const Tile>(image.read_tile(key.level, tile_x, tile_y));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto [it, inserted] = m_tiles.try_emplace(key);
+        if(!inserted){
+            m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+            return it->second.tile;
+        }
+        m_lru.push_front(key);
+        it->second = Entry{tile, m_lru.begin()};
+        m_resident_bytes += TiledImage::TILE_BYTES;
+        m_load_count++;
+
+        // Oldest first, the tile just read is kept even if it alone is over the budget
+        while(m_budget != 0 && m_resident_bytes > m_budget && m_lru.size() > 1){
+            m_tiles.erase(m_lru.back());
+            m_lru.pop_back();
+            m_resident_bytes -= TiledImage::TILE_BYTES;
+            m_eviction_count++;
+        }
+        return tile;
+    }
+
+    void TextureCache::remove(std::uint64_t image_id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(auto it = m_tiles.begin(); it != m_tiles.end();){
+            if(it->first.image_id == image_id){
+                m_lru.erase(it->second.lru);
+                m_resident_bytes -= TiledImage::TILE_BYTES;
+                it = m_tiles.erase(it);
+            }
+            else{
+                ++it;
+            }
+        }
+    }
+
+}
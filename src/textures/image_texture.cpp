@@ -2,25 +2,53 @@
 // Created by Jino on 8/6/23.
 //
 
+#include <algorithm>
+#include <cmath>
+
 #include <textures.h>
-#include <image.h>
+#include <asset_registry.h>
+#include <tiled_image.h>
 
 namespace Caramel{
 
     ImageTexture::ImageTexture(const std::string &path)
-    : Texture() {
-        m_img = new Image(path);
-    }
+    : ImageTexture(AssetRegistry::instance().get<TiledImage>("tiled_image", path, "", [&path](){ return new TiledImage(path); })) {}
 
-    ImageTexture::~ImageTexture(){
-        delete m_img;
-    }
+    ImageTexture::ImageTexture(std::shared_ptr<const TiledImage> image)
+    : Texture(), m_img{std::move(image)} {}
 
-    Vector3f ImageTexture::get_val(const Vector2f &uv) const{
-        const auto sz = m_img->size();
-        return m_img->get_pixel_value(std::clamp(static_cast<Int>(sz[0] * uv[0]), 0, static_cast<Int>(sz[0]) - 1),
-                                      std::clamp(static_cast<Int>(sz[1] * (Float1 - uv[1])), 0, static_cast<Int>(sz[1]) - 1));
+    Vector3f ImageTexture::get_val(const Vector2f &uv, Float width) const{
+        const auto sz = m_img->size(0);
+        if(!(width > Float0)){
+            return m_img->texel(0, static_cast<Int>(sz[0] * uv[0]), static_cast<Int>(sz[1] * (Float1 - uv[1])));
+        }
+
+        // Texels of level l are 2^l / size wide
+        using std::log2;
+        const Float level = std::clamp(log2(width * static_cast<Float>(std::max(sz[0], sz[1]))),
+                                       Float0, static_cast<Float>(m_img->level_count() - 1));
+        const Index fine = static_cast<Index>(level);
+        const Float t = level - static_cast<Float>(fine);
+        if(t == Float0){
+            return bilinear(fine, uv);
+        }
+        return bilinear(fine, uv) * (Float1 - t) + bilinear(fine + 1, uv) * t;
     }
 
+    Vector3f ImageTexture::bilinear(Index level, const Vector2f &uv) const{
+        const auto sz = m_img->size(level);
+        // Texel centers are at half-integer coordinates
+        const Float x = uv[0] * static_cast<Float>(sz[0]) - Float0_5;
+        const Float y = (Float1 - uv[1]) * static_cast<Float>(sz[1]) - Float0_5;
+        using std::floor;
+        const Float x0 = floor(x);
+        const Float y0 = floor(y);
+        const Float dx = x - x0;
+        const Float dy = y - y0;
+        const Int ix = static_cast<Int>(x0);
+        const Int iy = static_cast<Int>(y0);
+        return (m_img->texel(level, ix, iy) * (Float1 - dx) + m_img->texel(level, ix + 1, iy) * dx) * (Float1 - dy) +
+               (m_img->texel(level, ix, iy + 1) * (Float1 - dx) + m_img->texel(level, ix + 1, iy + 1) * dx) * dy;
+    }
 
 }
\ No newline at end of file
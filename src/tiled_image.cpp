@@ -0,0 +1,239 @@
+//
+// This software is released under the MIT license.
+//
+// Copyright (c) 2022-2026 Jino Park
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <tiled_image.h>
+
+#include <image.h>
+#include <logger.h>
+#include <mapped_file.h>
+#include <texture_cache.h>
+
+namespace Caramel{
+
+    namespace{
+        // Tiles start at this offset from the start of a pyramid
+        constexpr std::uint64_t DATA_OFFSET = 64;
+
+        std::uint64_t next_image_id() {
+            static std::atomic<std::uint64_t> id = 1;
+            return id.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        Index tile_count(Index size) {
+            return (size + TiledImage::TILE_SIZE - 1) / TiledImage::TILE_SIZE;
+        }
+
+        // Name of a file to write `path` through, unique among processes building the same cache entry
+        std::string tmp_filename(const std::filesystem::path &path) {
+#ifdef _WIN32
+            const long pid = _getpid();
+#else
+            const long pid = getpid();
+#endif
+            std::random_device rd;
+            std::ostringstream name;
+            name << path.string() << "." << pid << "." << std::hex << rd() << ".tmp";
+            return name.str();
+        }
+    }
+
+    TiledImage::TiledImage(const std::filesystem::path &image_path) : m_id(next_image_id()) {
+        if(!std::filesystem::exists(image_path)){
+            CRM_ERROR(image_path.string() + " does not exist");
+        }
+        const std::uint64_t source_size = std::filesystem::file_size(image_path);
+        const std::int64_t source_time = std::filesystem::last_write_time(image_path).time_since_epoch().count();
+        const std::filesystem::path path = cache_path(image_path);
+
+        const auto is_cached = [&](){
+            FileHeader header{};
+            std::ifstream cached(path, std::ios::binary);
+            return read_header(cached, 0, header) && header.source_size == source_size && header.source_time == source_time;
+        };
+        if(!is_cached()){
+            CRM_LOG("Building mip pyramid of " + image_path.string() + " : " + path.string());
+            std::filesystem::create_directories(path.parent_path());
+            // Other processes may build the same pyramid at the same time, each writes its own file
+            const std::string tmp = tmp_filename(path);
+            {
+                const Image image(image_path.string());
+                std::ofstream stream(tmp, std::ios::binary | std::ios::trunc);
+                if(!stream){
+                    CRM_ERROR("Cannot write mip pyramid : " + tmp);
+                }
+                write(image, stream, source_size, source_time);
+                if(!stream){
+                    stream.close();
+                    std::filesystem::remove(tmp);
+                    CRM_ERROR("Failed to write mip pyramid : " + tmp);
+                }
+            }
+            // Images which opened the previous file keep reading it. Where the file in place can not
+            // be replaced (e.g. open by another process on Windows), use it if another process built it.
+            std::error_code ec;
+            std::filesystem::rename(tmp, path, ec);
+            if(ec){
+                std::filesystem::remove(tmp);
+                if(!is_cached()){
+                    CRM_ERROR("Cannot replace mip pyramid : " + path.string() + " (" + ec.message() + ")");
+                }
+            }
+        }
+        open(path, 0);
+    }
+
+    TiledImage::TiledImage(const std::filesystem::path &file_path, std::uint64_t offset) : m_id(next_image_id()) {
+        open(file_path, offset);
+    }
+
+    TiledImage::~TiledImage() {
+        TextureCache::instance().remove(m_id);
+    }
+
+    void TiledImage::open(const std::filesystem::path &file_path, std::uint64_t offset) {
+        {
+            std::ifstream stream(file_path, std::ios::binary);
+            FileHeader header{};
+            if(!read_header(stream, offset, header)){
+                CRM_ERROR("Invalid mip pyramid : " + file_path.string());
+            }
+            m_levels = levels(header.width, header.height, offset);
+        }
+        m_file = std::make_unique<const MappedFile>(file_path, MappedFile::Access::Random);
+        const Level &last = m_levels.back();
+        if(m_file->size() < last.offset + TILE_BYTES){
+            CRM_ERROR("Truncated mip pyramid : " + file_path.string());
+        }
+    }
+
+    std::vector<TiledImage::Level> TiledImage::levels(Index width, Index height, std::uint64_t offset) {
+        std::vector<Level> levels;
+        offset += DATA_OFFSET;
+        while(true){
+            levels.push_back({width, height, tile_count(width), offset});
+            offset += std::uint64_t(tile_count(width)) * tile_count(height) * TILE_BYTES;
+            if(width == 1 && height == 1){
+                return levels;
+            }
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+        }
+    }
+
+    bool TiledImage::read_header(std::istream &stream, std::uint64_t offset, FileHeader &header) {
+        char magic[sizeof(FILE_MAGIC)];
+        stream.seekg(static_cast<std::streamoff>(offset));
+        stream.read(magic, sizeof(magic));
+        stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+        return stream && std::memcmp(magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0 && header.float_size == sizeof(Float) &&
+               header.tile_size == TILE_SIZE && header.width > 0 && header.height > 0;
+    }
+
+    Vector3f TiledImage::texel(Index level, Int x, Int y) const {
+        const Level &l = m_levels[level];
+        return TextureCache::instance().texel(*this, level, static_cast<Index>(std::clamp(x, 0, static_cast<Int>(l.width) - 1)),
+                                              static_cast<Index>(std::clamp(y, 0, static_cast<Int>(l.height) - 1)));
+    }
+
+    std::vector<Float> TiledImage::read_tile(Index level, Index tile_x, Index tile_y) const {
+        const Level &l = m_levels[level];
+        std::vector<Float> tile(TILE_SIZE * TILE_SIZE * 3);
+        // Size of the file is checked against the last tile when it is opened
+        const std::uint64_t offset = l.offset + (std::uint64_t(tile_y) * l.tiles_x + tile_x) * TILE_BYTES;
+        std::memcpy(tile.data(), m_file->data() + offset, TILE_BYTES);
+        return tile;
+    }
+
+    void TiledImage::write(const Image &image, std::ostream &stream, std::uint64_t source_size, std::int64_t source_time) {
+        Index width = image.size()[0];
+        Index height = image.size()[1];
+        const FileHeader header{sizeof(Float), TILE_SIZE, width, height, source_size, source_time};
+        const char zeros[DATA_OFFSET] = {};
+        stream.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(zeros, DATA_OFFSET - sizeof(FILE_MAGIC) - sizeof(header));
+
+        std::vector<Float> level(image.pixels().begin(), image.pixels().end());
+        std::vector<Float> tile(TILE_SIZE * TILE_SIZE * 3);
+        while(true){
+            const auto at = [&](Index x, Index y){
+                return level.data() + (std::uint64_t(std::min(y, height - 1)) * width + std::min(x, width - 1)) * 3;
+            };
+            for(Index ty = 0; ty < tile_count(height); ty++){
+                for(Index tx = 0; tx < tile_count(width); tx++){
+                    for(Index y = 0; y < TILE_SIZE; y++){
+                        for(Index x = 0; x < TILE_SIZE; x++){
+                            std::copy_n(at(tx * TILE_SIZE + x, ty * TILE_SIZE + y), 3, tile.data() + (y * TILE_SIZE + x) * 3);
+                        }
+                    }
+                    stream.write(reinterpret_cast<const char*>(tile.data()), TILE_BYTES);
+                }
+            }
+            if(width == 1 && height == 1){
+                return;
+            }
+
+            // Box filter of 2x2 texels, the last row or column is repeated for odd sizes
+            const Index next_width = (width + 1) / 2;
+            const Index next_height = (height + 1) / 2;
+            std::vector<Float> next(std::uint64_t(next_width) * next_height * 3);
+            for(Index y = 0; y < next_height; y++){
+                for(Index x = 0; x < next_width; x++){
+                    for(int c = 0; c < 3; c++){
+                        next[(std::uint64_t(y) * next_width + x) * 3 + c] =
+                                (at(2 * x, 2 * y)[c] + at(2 * x + 1, 2 * y)[c] + at(2 * x, 2 * y + 1)[c] + at(2 * x + 1, 2 * y + 1)[c]) * Float(0.25);
+                    }
+                }
+            }
+            level = std::move(next);
+            width = next_width;
+            height = next_height;
+        }
+    }
+
+    std::filesystem::path TiledImage::cache_path(const std::filesystem::path &image_path) {
+        std::error_code ec;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(image_path, ec);
+        if(ec){
+            canonical = std::filesystem::absolute(image_path);
+        }
+        std::ostringstream name;
+        name << canonical.stem().string() << "_" << std::hex << std::hash<std::string>()(canonical.string()) << ".crtex";
+        return std::filesystem::temp_directory_path() / "caramel_textures" / name.str();
+    }
+
+}
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+# Small client of `caramel --server`, for testing the render server locally.
+#
+#   python3 render_server_client.py [path to caramel] [path to scene file]
+#   python3 render_server_client.py --socket [socket path] [path to scene file]
+#
+# Loads the scene once, then renders a few jobs reusing it and prints every response.
+# Finally it submits a long batch job and a high priority preview of a second copy of the scene
+# without waiting, so the preview preempts the batch and answers first.
+
+import json
+import socket
+import subprocess
+import sys
+
+
+def jobs(scene_path):
+    yield {"cmd": "load", "id": "scene", "scene": scene_path}
+    yield {"cmd": "render", "id": "scene", "output": "server_full.exr", "spp": 16}
+    yield {"cmd": "render", "id": "scene", "output": "server_crop.exr", "spp": 16,
+           "crop": {"x_min": 0, "y_min": 0, "x_max": 16, "y_max": 16}}
+    yield {"cmd": "render", "id": "scene", "output": "server_budget.exr", "time_budget": 0.5}
+    yield {"cmd": "load", "id": "preview", "scene": scene_path}
+
+
+def concurrent_jobs():
+    yield {"cmd": "render", "id": "scene", "job": "batch", "output": "server_batch.exr", "spp": 256}
+    yield {"cmd": "render", "id": "preview", "job": "preview", "output": "server_preview.exr", "spp": 4,
+           "priority": 1}
+
+
+def exchange(write, readline):
+    ok = True
+    for job in jobs(scene_path_arg):
+        write(json.dumps(job) + "\n")
+        response = json.loads(readline())
+        print(json.dumps(job), "->", response)
+        ok = ok and response["status"] == "ok"
+    submitted = list(concurrent_jobs())
+    for job in submitted:
+        write(json.dumps(job) + "\n")
+    finished = []
+    for _ in submitted:
+        response = json.loads(readline())
+        print(response)
+        ok = ok and response["status"] == "ok"
+        finished.append(response.get("job"))
+    print("finish order :", finished)
+    write(json.dumps({"cmd": "quit"}) + "\n")
+    return ok
+
+
+def run_stdin(caramel):
+    server = subprocess.Popen([caramel, "--server"], stdin=subprocess.PIPE, stdout=subprocess.PIPE, text=True)
+
+    def write(line):
+        server.stdin.write(line)
+        server.stdin.flush()
+
+    ok = exchange(write, server.stdout.readline)
+    server.wait()
+    return ok
+
+
+def run_socket(socket_path):
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+        s.connect(socket_path)
+        stream = s.makefile("rw")
+
+        def write(line):
+            stream.write(line)
+            stream.flush()
+
+        return exchange(write, stream.readline)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3 and not (len(sys.argv) == 4 and sys.argv[1] == "--socket"):
+        print("usage : render_server_client.py [path to caramel] [path to scene file]\n"
+              "        render_server_client.py --socket [socket path] [path to scene file]")
+        sys.exit(1)
+    scene_path_arg = sys.argv[-1]
+    if sys.argv[1] == "--socket":
+        success = run_socket(sys.argv[2])
+    else:
+        success = run_stdin(sys.argv[1])
+    sys.exit(0 if success else 1)
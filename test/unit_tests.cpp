@@ -25,19 +25,48 @@
 // caramel headers
 #include <common.h>
 
+#include <asset_registry.h>
+#include <bsdf.h>
 #include <utils.h>
 #include <image.h>
+#include <integrators.h>
 #include <ray.h>
 #include <shape.h>
 #include <rayintersectinfo.h>
 #include <sampler.h>
 #include <scene.h>
+#include <scene_parser.h>
+#include <scene_snapshot.h>
+#include <scene_updater.h>
+#include <render.h>
+#include <camera.h>
+#include <textures.h>
 #include <transform.h>
 #include <light.h>
+#include <light_cache.h>
+#include <film.h>
+#include <geometry_cache.h>
+#include <texture_cache.h>
+#include <tiled_image.h>
+#include <parallel_for.h>
+#include <render_server.h>
+#include <scheduler.h>
+#include <sd_tree.h>
+#include <warp_sample.h>
 
 // Dependencies headers
 #include "catch_amalgamated.hpp"
 #include <random>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 
 namespace Caramel {
 // Helper class to create Ray objects for testing (must be in Caramel namespace for friend access)
@@ -1858,3 +1887,1169 @@ TEST_CASE("instanced area-light get_area is exact under non-uniform scale", "[Un
     CHECK(is_approx(inst.get_area(), 10.0f));
 }
 
+
+// =============================================================================
+// ImageEnvLight Tests
+// =============================================================================
+
+TEST_CASE("ImageEnvLight direction lookup matches equirectangular mapping", "[UnitTest]") {
+    const Index width = 64;
+    const Index height = 32;
+    Image img(width, height);
+    for (Index i = 0; i < width; i++) {
+        for (Index j = 0; j < height; j++) {
+            img.set_pixel_value(i, j, 1.0f + i, 1.0f + j, 1.0f + ((i * 7 + j * 13) % 5));
+        }
+    }
+    const std::string path = (std::filesystem::temp_directory_path() / "caramel_envmap_lookup_test.exr").string();
+    img.write_exr(path);
+
+    ImageEnvLight light(path, 1.0f, rotate_y(30.0f));
+    light.set_scene_radius(1.0f);
+    std::filesystem::remove(path);
+
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<Float> dis(0.0f, 1.0f);
+    for (int n = 0; n < 2000; n++) {
+        const Float z = 1.0f - 2.0f * dis(gen);
+        const Float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        const Float phi = PI_2 * dis(gen);
+        const Vector3f dir{r * std::cos(phi), r * std::sin(phi), z};
+
+        // Reference : trigonometric mapping followed by nearest pixel lookup
+        const Vector2f uv = vec_to_normalized_uv(light.m_to_local * dir);
+        int i = static_cast<int>(uv[0] * width);
+        const int j = static_cast<int>(uv[1] * height);
+        if (i >= static_cast<int>(width)) {
+            i -= width;
+        }
+        const Vector3f ref_radiance = light.m_image->get_pixel_value(i, j);
+        const Float ref_pdf = width * height * light.m_imageDistrib.pdf(i, j) / (2 * PI * PI * std::sin(uv[1] * PI));
+
+        const Vector3f radiance = light.radiance(vec3f_zero, dir, -dir);
+        CHECK(is_approx(radiance[0], ref_radiance[0]));
+        CHECK(is_approx(radiance[1], ref_radiance[1]));
+        CHECK(is_approx(radiance[2], ref_radiance[2]));
+        CHECK(is_approx(light.pdf_solidangle(vec3f_zero, dir, -dir), ref_pdf, 1e-3f));
+    }
+}
+
+// =============================================================================
+// DTree (path guiding) Tests
+// =============================================================================
+
+TEST_CASE("DTree pdf is normalized and matches its sampling", "[UnitTest]") {
+    // Train on radiance concentrated around +z, refine twice so the tree gets deeper
+    UniformStdSampler sampler(3);
+    DTree tree;
+    for (int pass = 0; pass < 3; pass++) {
+        for (int n = 0; n < 20000; n++) {
+            const auto [dir, pdf] = sample_unit_sphere_uniformly(sampler);
+            const Float value = dir[2] > 0.8f ? 10.0f : 0.1f;
+            tree.record(dir, value / pdf);
+        }
+        // `refined()` returns the new structure without energy, which is recorded again in the next pass
+        if (pass < 2) {
+            tree = tree.refined(0.01f);
+        }
+    }
+    REQUIRE(tree.total() > 0.0f);
+    CHECK(tree.node_num() > 1);
+
+    // Integral of pdf over the sphere, estimated with uniform directions
+    double integral = 0.0;
+    const int N = 200000;
+    for (int n = 0; n < N; n++) {
+        const auto [dir, pdf] = sample_unit_sphere_uniformly(sampler);
+        integral += tree.pdf(dir) / pdf;
+    }
+    CHECK(std::abs(integral / N - 1.0) < 0.02);
+
+    // E[1 / pdf(x)] over samples x ~ pdf equals the area of the support (4 pi)
+    double inv_pdf = 0.0;
+    int upper = 0;
+    int non_unit = 0;
+    for (int n = 0; n < N; n++) {
+        const Vector3f dir = tree.sample(sampler);
+        non_unit += is_approx(dir.length(), 1.0f, 1e-4f) ? 0 : 1;
+        inv_pdf += 1.0 / tree.pdf(dir);
+        upper += dir[2] > 0.8f ? 1 : 0;
+    }
+    CHECK(non_unit == 0);
+    CHECK(std::abs(inv_pdf / N - PI_4) < PI_4 * 0.02);
+    // Most samples go toward the bright region, which covers 10% of the sphere
+    CHECK(upper > N / 2);
+}
+
+TEST_CASE("Film running mean and variance match two-pass statistics", "[UnitTest]") {
+    UniformStdSampler sampler(5);
+    Film film(2, 1);
+    std::vector<Vector3f> samples;
+    for (int n = 0; n < 1000; n++) {
+        const Vector3f rgb{sampler.sample_1d(), 2.0f * sampler.sample_1d(), 0.5f};
+        samples.push_back(rgb);
+        film.add_sample(1, 0, rgb);
+    }
+
+    double mean[3] = {0.0, 0.0, 0.0};
+    double lum_mean = 0.0;
+    for (const auto &s : samples) {
+        for (int c = 0; c < 3; c++) mean[c] += s[c];
+        lum_mean += luminance(s);
+    }
+    for (double &m : mean) m /= samples.size();
+    lum_mean /= samples.size();
+    double lum_var = 0.0;
+    for (const auto &s : samples) {
+        lum_var += (luminance(s) - lum_mean) * (luminance(s) - lum_mean);
+    }
+    lum_var /= samples.size() - 1;
+
+    const Film::Pixel &p = film.pixel(1, 0);
+    CHECK(p.spp == 1000);
+    for (int c = 0; c < 3; c++) {
+        CHECK(is_approx(p.mean[c], static_cast<Float>(mean[c]), 1e-4f));
+    }
+    CHECK(is_approx(film.relative_error(1, 0), static_cast<Float>(std::sqrt(lum_var / samples.size()) / lum_mean), 1e-4f));
+
+    // Untouched pixel has no estimate of its error yet
+    CHECK(film.spp(0, 0) == 0);
+    CHECK(film.relative_error(0, 0) == INF);
+}
+
+TEST_CASE("Film error is not trusted before the minimum sample count", "[UnitTest]") {
+    // First samples miss a small bright light, so the estimate looks exact
+    Film film(1, 1);
+    for (int n = 0; n < 8; n++) {
+        film.add_sample(0, 0, vec3f_zero);
+    }
+    CHECK(film.relative_error(0, 0) == 0);
+    CHECK(film.is_converged(0, 0, 0.05f, 2));
+    CHECK_FALSE(film.is_converged(0, 0, 0.05f, 16));
+
+    // Keeps sampling until it hits the light, and the error then tells it is far from converged
+    for (int n = 0; n < 8; n++) {
+        film.add_sample(0, 0, n == 7 ? Vector3f{100, 100, 100} : vec3f_zero);
+    }
+    CHECK(film.spp(0, 0) == 16);
+    CHECK(film.relative_error(0, 0) > 0.5f);
+    CHECK_FALSE(film.is_converged(0, 0, 0.05f, 16));
+}
+
+TEST_CASE("Film file round trip restores every pixel exactly", "[UnitTest]") {
+    UniformStdSampler sampler(9);
+    Film film(3, 2);
+    for (int n = 0; n < 50; n++) {
+        film.add_sample(n % 3, (n / 3) % 2, Vector3f{sampler.sample_1d(), sampler.sample_1d(), sampler.sample_1d()});
+    }
+    const std::string path = (std::filesystem::temp_directory_path() / "caramel_film_checkpoint.bin").string();
+    film.save(path, film.full_region(), 7, 1234);
+
+    Film restored(3, 2);
+    const auto [next_pass, seed] = restored.load(path, restored.full_region());
+    std::filesystem::remove(path);
+    CHECK(next_pass == 7);
+    CHECK(seed == 1234);
+    for (Index y = 0; y < 2; y++) {
+        for (Index x = 0; x < 3; x++) {
+            const Film::Pixel &a = film.pixel(x, y);
+            const Film::Pixel &b = restored.pixel(x, y);
+            CHECK(a.spp == b.spp);
+            CHECK(a.lum_m2 == b.lum_m2);
+            for (int c = 0; c < 3; c++) {
+                CHECK(a.mean[c] == b.mean[c]);
+            }
+        }
+    }
+}
+
+TEST_CASE("Per-pixel samplers depend only on pixel, pass and seed", "[UnitTest]") {
+    const auto first_values = [](UniformStdSampler sampler) {
+        std::array<Float, 4> v{};
+        for (auto &x : v) x = sampler.sample_1d();
+        return v;
+    };
+    // Creating samplers of other pixels in between does not change the sequence
+    const auto a = first_values(UniformStdSampler::for_pixel(5, 7, 2, 11));
+    first_values(UniformStdSampler::for_pixel(6, 7, 2, 11));
+    CHECK(a == first_values(UniformStdSampler::for_pixel(5, 7, 2, 11)));
+
+    CHECK(a != first_values(UniformStdSampler::for_pixel(7, 5, 2, 11)));
+    CHECK(a != first_values(UniformStdSampler::for_pixel(5, 7, 3, 11)));
+    CHECK(a != first_values(UniformStdSampler::for_pixel(5, 7, 2, 12)));
+}
+
+TEST_CASE("Merging partial films matches a film of all samples", "[UnitTest]") {
+    UniformStdSampler sampler(13);
+    Film all(4, 4);
+    Film left(4, 4);
+    Film right(4, 4);
+    for (int n = 0; n < 300; n++) {
+        const Vector3f rgb{sampler.sample_1d(), sampler.sample_1d(), 3.0f * sampler.sample_1d()};
+        all.add_sample(1, 2, rgb);
+        // Uneven split of the samples of pixel (1, 2) between two partial films
+        (n % 3 == 0 ? left : right).add_sample(1, 2, rgb);
+        all.add_sample(3, 0, rgb);
+        right.add_sample(3, 0, rgb);
+    }
+    const std::string left_path = (std::filesystem::temp_directory_path() / "caramel_film_left.bin").string();
+    const std::string right_path = (std::filesystem::temp_directory_path() / "caramel_film_right.bin").string();
+    left.save(left_path, ImageRegion{0, 0, 2, 4});
+    right.save(right_path, right.full_region());
+
+    Film merged;
+    merged.merge(left_path);
+    merged.merge(right_path);
+    std::filesystem::remove(left_path);
+    std::filesystem::remove(right_path);
+
+    REQUIRE(merged.width() == 4);
+    REQUIRE(merged.height() == 4);
+    for (const auto &[x, y] : {std::pair<Index, Index>{1, 2}, {3, 0}}) {
+        CHECK(merged.spp(x, y) == all.spp(x, y));
+        CHECK(is_approx(merged.relative_error(x, y), all.relative_error(x, y), 1e-4f));
+        for (int c = 0; c < 3; c++) {
+            CHECK(is_approx(merged.pixel(x, y).mean[c], all.pixel(x, y).mean[c], 1e-5f));
+        }
+    }
+    CHECK(merged.spp(0, 0) == 0);
+}
+
+TEST_CASE("Cropped EXR holds the pixels of its data window", "[UnitTest]") {
+    Image img(7, 5);
+    for (Index y = 0; y < 5; y++) {
+        for (Index x = 0; x < 7; x++) {
+            img.set_pixel_value(x, y, x, y, x * 10.0f + y);
+        }
+    }
+    const std::string path = (std::filesystem::temp_directory_path() / "caramel_crop.exr").string();
+    img.write_exr(path, ImageRegion{2, 1, 6, 4});
+
+    const Image cropped(path);
+    std::filesystem::remove(path);
+    REQUIRE(cropped.size()[0] == 4);
+    REQUIRE(cropped.size()[1] == 3);
+    for (Index y = 0; y < 3; y++) {
+        for (Index x = 0; x < 4; x++) {
+            const Vector3f v = cropped.get_pixel_value(x, y);
+            CHECK(v[0] == static_cast<Float>(x + 2));
+            CHECK(v[1] == static_cast<Float>(y + 1));
+            CHECK(v[2] == (x + 2) * 10.0f + (y + 1));
+        }
+    }
+}
+
+TEST_CASE("Keyframed camera path is interpolated into evenly spaced views", "[UnitTest]") {
+    const nlohmann::json scene_json = nlohmann::json::parse(R"({"camera" : {
+        "type" : "pinhole", "width" : 8, "height" : 8, "fov" : 45, "frames" : 5,
+        "keyframes" : [{"time" : 0, "pos" : [0, 0, 0], "dir" : [0, 0, -1], "up" : [0, 1, 0]},
+                       {"time" : 1, "pos" : [2, 0, 0], "dir" : [0, 0, -1], "up" : [0, 1, 0]},
+                       {"time" : 3, "pos" : [2, 4, 0], "dir" : [0, 0, -1], "up" : [0, 1, 0]}]}})");
+    const std::vector<Camera*> cameras = SceneParser(scene_json).parse_cameras();
+    REQUIRE(cameras.size() == 5);
+    // Views at t = 0, 0.75, 1.5, 2.25, 3
+    const std::array<Vector3f, 5> expected{Vector3f{0, 0, 0}, Vector3f{1.5f, 0, 0}, Vector3f{2, 1, 0},
+                                           Vector3f{2, 2.5f, 0}, Vector3f{2, 4, 0}};
+    for (Index i = 0; i < 5; i++) {
+        const Matrix44f m = cameras[i]->get_cam_to_world();
+        CHECK(Vector3f{m(0, 3), m(1, 3), m(2, 3)}.length() == Catch::Approx(expected[i].length()));
+        CHECK(m(0, 3) == Catch::Approx(expected[i][0]).margin(1e-5));
+        CHECK(m(1, 3) == Catch::Approx(expected[i][1]).margin(1e-5));
+        delete cameras[i];
+    }
+
+    // Opposite directions turn around the up vector, instead of passing through a zero direction
+    const nlohmann::json turn_json = nlohmann::json::parse(R"({"camera" : {
+        "type" : "pinhole", "width" : 8, "height" : 8, "fov" : 45, "frames" : 3,
+        "keyframes" : [{"time" : 0, "pos" : [0, 0, 0], "dir" : [0, 0, -1], "up" : [0, 1, 0]},
+                       {"time" : 1, "pos" : [0, 0, 0], "dir" : [0, 0, 1], "up" : [0, 1, 0]}]}})");
+    const std::vector<Camera*> turn = SceneParser(turn_json).parse_cameras();
+    REQUIRE(turn.size() == 3);
+    for (Index i = 0; i < 3; i++) {
+        const Matrix44f m = turn[i]->get_cam_to_world();
+        const Vector3f dir{m(0, 2), m(1, 2), m(2, 2)};
+        const Vector3f up{m(0, 1), m(1, 1), m(2, 1)};
+        CHECK(dir.length() == Catch::Approx(1));
+        CHECK(up[1] == Catch::Approx(1));
+        CHECK(dir[2] == Catch::Approx(i == 0 ? -1 : i == 1 ? 0 : 1).margin(1e-5));
+        CHECK(std::abs(dir[0]) == Catch::Approx(i == 1 ? 1 : 0).margin(1e-5));
+        delete turn[i];
+    }
+
+    nlohmann::json parallel_json = turn_json;
+    parallel_json["camera"]["keyframes"][1]["up"] = {0, 0, 2};
+    CHECK_THROWS(SceneParser(parallel_json).parse_cameras());
+    parallel_json["camera"]["keyframes"][1]["up"] = {0, 0, 0};
+    CHECK_THROWS(SceneParser(parallel_json).parse_cameras());
+
+    const nlohmann::json list_json = nlohmann::json::parse(R"({"camera" : [
+        {"type" : "pinhole", "pos" : [0, 0, 0], "dir" : [0, 0, -1], "up" : [0, 1, 0], "width" : 8, "height" : 8, "fov" : 45},
+        {"type" : "thinlens", "pos" : [1, 0, 0], "dir" : [0, 0, -1], "up" : [0, 1, 0], "width" : 4, "height" : 2, "fov" : 30,
+         "lens_radius" : 0.1, "focal_dist" : 2}]})");
+    const std::vector<Camera*> views = SceneParser(list_json).parse_cameras();
+    REQUIRE(views.size() == 2);
+    CHECK(views[1]->get_size() == std::pair<Index, Index>{4, 2});
+    CHECK_THROWS(SceneParser(list_json).parse_camera());
+    for (Camera *c : views) {
+        delete c;
+    }
+}
+
+TEST_CASE("Nested parallel_for runs on the workers of the thread pool", "[UnitTest]") {
+    ThreadPool pool(4);
+    std::array<std::atomic<int>, 16 * 64> counts{};
+    std::mutex ids_mutex;
+    std::vector<std::thread::id> ids;
+    pool.parallel_for(0, 16, [&](int i) {
+        pool.parallel_for(0, 64, [&](int j) {
+            counts[i * 64 + j]++;
+            std::lock_guard<std::mutex> lock(ids_mutex);
+            if (std::find(ids.begin(), ids.end(), std::this_thread::get_id()) == ids.end()) {
+                ids.push_back(std::this_thread::get_id());
+            }
+        });
+    });
+    int wrong_counts = 0;
+    for (const auto &c : counts) {
+        wrong_counts += c != 1;
+    }
+    CHECK(wrong_counts == 0);
+    CHECK(ids.size() <= 4);
+
+    // An exception of an inner loop reaches the outermost caller
+    CHECK_THROWS_AS(pool.parallel_for(0, 8, [&](int i) {
+        pool.parallel_for(0, 8, [&](int j) {
+            if (i == 3 && j == 5) {
+                throw std::runtime_error("failed");
+            }
+        });
+    }), std::runtime_error);
+}
+
+TEST_CASE("ordered_parallel_for reduces results in index order", "[UnitTest]") {
+    std::vector<int> order;
+    ordered_parallel_for<int>(0, 32, [](int i) {
+        // Earlier iterations finish later
+        std::this_thread::sleep_for(std::chrono::microseconds(50 * (32 - i)));
+        return i * i;
+    }, [&](int i, int &&result) {
+        CHECK(result == i * i);
+        order.push_back(i);
+    });
+    REQUIRE(order.size() == 32);
+    for (int i = 0; i < 32; i++) {
+        CHECK(order[i] == i);
+    }
+}
+
+TEST_CASE("Shapes loaded in parallel keep the order of the scene file", "[UnitTest]") {
+    nlohmann::json desc;
+    for (int i = 0; i < 32; i++) {
+        const float x = static_cast<float>(i);
+        desc["shape"].push_back({{"type", "trianglemesh"},
+                                 {"P", {x, 0, 0, x + 1, 0, 0, x, 1, 0}},
+                                 {"indices", {0, 1, 2}},
+                                 {"bsdf", {{"type", "diffuse"}}}});
+    }
+    const std::vector<Shape*> shapes = SceneParser(desc).parse_shapes();
+    REQUIRE(shapes.size() == 32);
+    for (int i = 0; i < 32; i++) {
+        CHECK(shapes[i]->get_aabb().m_min[0] == static_cast<Float>(i));
+        delete shapes[i];
+    }
+
+    desc["shape"][20]["indices"] = {0, 1, 7};
+    CHECK_THROWS(SceneParser(desc).parse_shapes());
+}
+
+TEST_CASE("OBJ loader triangulates quads and resolves relative indices", "[UnitTest]") {
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "caramel_obj_test";
+    std::filesystem::create_directories(dir);
+    const auto write = [&dir](const std::string &name, const std::string &text) {
+        std::ofstream(dir / name) << text;
+        return dir / name;
+    };
+
+    // A unit quad and a triangle with relative indices, sharing two corners
+    const OBJMesh mesh(write("quad.obj",
+        "# comment\n"
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+        "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+        "vn 0 0 1\n"
+        "g quad\nf 1/1/1 2/2/1 3/3/1 4/4/1\r\n"
+        "v 2 0.5 0\nvt 1 0.5\n"
+        "f -4/-4/1 -1/-1/-1 -3/-3/1\n"), nullptr);
+    CHECK(mesh.get_triangle_num() == 3);
+    CHECK(mesh.get_area() == Catch::Approx(1.5));
+    const auto [a, b, c] = mesh.get_triangle_vertices(2);
+    CHECK(Vector3f::L2(a, Vector3f{1, 0, 0}) == 0);
+    CHECK(Vector3f::L2(b, Vector3f{2, 0.5, 0}) == 0);
+    CHECK(Vector3f::L2(c, Vector3f{1, 1, 0}) == 0);
+
+    // Polygons with more than 4 vertices are handled by tinyobjloader
+    const OBJMesh pentagon(write("pentagon.obj", "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0.5 1.5 0\nv 0 1 0\nf 1 2 3 4 5\n"), nullptr);
+    CHECK(pentagon.get_triangle_num() == 3);
+
+    // Both loaders merge the objects of a file into one mesh
+    const std::string vertices = "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0.5 1.5 0\nv 0 1 0\n";
+    const OBJMesh fast_objects(write("objects.obj", vertices + "o a\nf 1 2 3 5\no b\ng c\nf 1 2 3 5\n"), nullptr);
+    CHECK(fast_objects.get_triangle_num() == 4);
+    CHECK(fast_objects.get_area() == Catch::Approx(2));
+    const OBJMesh tinyobj_objects(write("objects_pentagon.obj", vertices + "o a\nf 1 2 3 5\no b\nf 1 2 3 4 5\n"), nullptr);
+    CHECK(tinyobj_objects.get_triangle_num() == 5);
+    CHECK(tinyobj_objects.get_area() == Catch::Approx(2.25));
+
+    // Bounds read from positions only match the loaded mesh
+    const Matrix44f transform = translate(1, 2, 3) * rotate_z(30) * scale(2, 1, 1);
+    const AABB loaded = OBJMesh(dir / "quad.obj", nullptr, nullptr, transform).get_aabb();
+    const AABB read = OBJMesh::read_aabb(dir / "quad.obj", transform);
+    CHECK(Vector3f::L2(loaded.m_min, read.m_min) == 0);
+    CHECK(Vector3f::L2(loaded.m_max, read.m_max) == 0);
+
+    CHECK_THROWS(OBJMesh::read_aabb(write("bad_aabb.obj", "v 0 0 0\nv 1 x 0\n")));
+    CHECK_THROWS(OBJMesh(write("bad.obj", "v 0 0 0\nv 1 0 0\nv 1 x 0\nf 1 2 3\n"), nullptr));
+    CHECK_THROWS(OBJMesh(write("range.obj", "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 4\n"), nullptr));
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Binary PLY is streamed into the same mesh as its ascii version", "[UnitTest]") {
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "caramel_ply_test";
+    std::filesystem::create_directories(dir);
+    const std::string properties =
+        "element vertex 5\nproperty float x\nproperty float y\nproperty float z\nproperty uchar red\n"
+        "element face 4\nproperty list uchar int vertex_indices\n"
+        "element edge 1\nproperty int vertex1\nproperty int vertex2\nend_header\n";
+    const float positions[5][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}, {2, 0.5f, 0}};
+
+    std::ofstream(dir / "ascii.ply") << "ply\nformat ascii 1.0\n" << properties
+                                     << "0 0 0 1\n1 0 0 1\n1 1 0 1\n0 1 0 1\n2 0.5 0 1\n"
+                                     << "4 0 1 2 3\n0\n2 0 1\n3 1 4 2\n0 1\n";
+
+    // Big endian file, to be byte swapped on load
+    std::ofstream binary(dir / "binary.ply", std::ios::binary);
+    binary << "ply\nformat binary_big_endian 1.0\n" << properties;
+    const auto put = [&binary](auto val) {
+        char bytes[sizeof(val)];
+        std::memcpy(bytes, &val, sizeof(val));
+        std::reverse(bytes, bytes + sizeof(val));
+        binary.write(bytes, sizeof(val));
+    };
+    for (const auto &p : positions) {
+        put(p[0]); put(p[1]); put(p[2]); put(std::uint8_t{1});
+    }
+    put(std::uint8_t{4}); put(0); put(1); put(2); put(3);
+    // Degenerate faces are skipped
+    put(std::uint8_t{0});
+    put(std::uint8_t{2}); put(0); put(1);
+    put(std::uint8_t{3}); put(1); put(4); put(2);
+    put(0); put(1);
+    binary.close();
+
+    const PLYMesh ascii(dir / "ascii.ply", nullptr);
+    const PLYMesh mesh(dir / "binary.ply", nullptr);
+    REQUIRE(mesh.get_triangle_num() == 3);
+    REQUIRE(ascii.get_triangle_num() == 3);
+    CHECK(mesh.get_area() == Catch::Approx(1.5));
+    for (Index i = 0; i < 3; i++) {
+        const auto [a0, a1, a2] = ascii.get_triangle_vertices(i);
+        const auto [b0, b1, b2] = mesh.get_triangle_vertices(i);
+        CHECK(Vector3f::L2(a0, b0) == 0);
+        CHECK(Vector3f::L2(a1, b1) == 0);
+        CHECK(Vector3f::L2(a2, b2) == 0);
+    }
+
+    // Bounds read from positions only match the loaded mesh
+    const Matrix44f transform = translate(1, 2, 3) * rotate_x(45);
+    const AABB loaded = PLYMesh(dir / "binary.ply", nullptr, nullptr, transform).get_aabb();
+    for (const char *name : {"ascii.ply", "binary.ply"}) {
+        const AABB read = PLYMesh::read_aabb(dir / name, transform);
+        CHECK(Vector3f::L2(loaded.m_min, read.m_min) == 0);
+        CHECK(Vector3f::L2(loaded.m_max, read.m_max) == 0);
+    }
+
+    // Truncated file
+    std::filesystem::resize_file(dir / "binary.ply", std::filesystem::file_size(dir / "binary.ply") - 12);
+    CHECK_THROWS(PLYMesh(dir / "binary.ply", nullptr));
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Compact mesh storage decodes close to full storage", "[UnitTest]") {
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "caramel_storage_test.obj";
+    // Texture coordinates out of [0, 1] are stored as half floats. Normals are unit length, as octahedral
+    // encoding keeps only directions
+    std::ofstream(path) << "v 0 0 0\nv 3 0 0\nv 0 2 0.5\n"
+                        << "vt 0.25 3.5\nvt -1.75 0.5\nvt 1 1\n"
+                        << "vn 0.6 -0.48 0.64\nvn -0.6 0 0.8\nvn 0 0 -1\n"
+                        << "f 1/1/1 2/2/2 3/3/3\n";
+    const OBJMesh full(path, nullptr);
+    const OBJMesh compact(path, nullptr, nullptr, Matrix44f::identity(), MeshStorage::Compact);
+    const OBJMesh quantized(path, nullptr, nullptr, Matrix44f::identity(), MeshStorage::Quantized);
+    std::filesystem::remove(path);
+
+    const Ray ray(Vector3f{0.5, 0.4, 5}, Vector3f{0, 0, -1});
+    const auto [hit_full, info_full] = full.get_triangle_ray_intersect(0, ray, INF);
+    const auto [hit_compact, info_compact] = compact.get_triangle_ray_intersect(0, ray, INF);
+    const auto [hit_quantized, info_quantized] = quantized.get_triangle_ray_intersect(0, ray, INF);
+    REQUIRE((hit_full && hit_compact && hit_quantized));
+
+    // Positions are not compressed by the compact storage
+    CHECK(info_compact.t == info_full.t);
+    CHECK(Vector3f::L2(info_compact.p, info_full.p) == 0);
+    CHECK(Vector3f::L2(info_quantized.p, info_full.p) < 1e-4);
+    for (const auto &info : {info_compact, info_quantized}) {
+        CHECK(Vector3f::L2(info.sh_coord.m_world_n, info_full.sh_coord.m_world_n) < 1e-3);
+        CHECK(std::abs(info.tex_uv[0] - info_full.tex_uv[0]) < 1e-3);
+        CHECK(std::abs(info.tex_uv[1] - info_full.tex_uv[1]) < 1e-3);
+    }
+    CHECK(compact.get_area() == full.get_area());
+    CHECK(quantized.get_area() == Catch::Approx(full.get_area()).epsilon(1e-4));
+}
+
+TEST_CASE("CRMesh loads the mesh it was converted from", "[UnitTest]") {
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "caramel_crmesh_test";
+    std::filesystem::create_directories(dir);
+    // A planar quad, whose boundary is used for solid angle sampling, and a bent strip
+    std::ofstream(dir / "quad.obj") << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nf 1 2 3 4\n";
+    std::ofstream(dir / "strip.obj") << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 2 0 1\nv 2 1 1\n"
+                                     << "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\nvt 2 0\nvt 2 1\n"
+                                     << "f 1/1 2/2 3/3 4/4\nf 2/2 5/5 6/6 3/3\n";
+
+    AreaLight light(Vector3f{1, 1, 1});
+    CRMesh::convert(OBJMesh(dir / "quad.obj", nullptr), dir / "quad.crmesh");
+    const CRMesh quad(dir / "quad.crmesh", nullptr, &light);
+    CHECK(quad.get_triangle_num() == 2);
+    CHECK(quad.get_area() == Catch::Approx(1));
+    CHECK(quad.is_solid_angle_sampling_possible() == AreaLight::TRY_SOLID_ANGLE_SAMPLING);
+    if (AreaLight::TRY_SOLID_ANGLE_SAMPLING) {
+        CHECK(quad.get_polygon_vertices().size() == 4);
+    }
+
+    const OBJMesh strip(dir / "strip.obj", nullptr);
+    CRMesh::convert(strip, dir / "strip.crmesh");
+    const CRMesh mapped(dir / "strip.crmesh", nullptr);
+    const CRMesh moved(dir / "strip.crmesh", nullptr, nullptr, translate(0, 0, 1));
+    REQUIRE(mapped.get_triangle_num() == strip.get_triangle_num());
+    CHECK(mapped.get_area() == strip.get_area());
+    CHECK(Vector3f::L2(mapped.get_aabb().m_max, strip.get_aabb().m_max) == 0);
+
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<Float> dis(-0.5, 2.5);
+    for (int i = 0; i < 64; i++) {
+        const Vector3f o{dis(gen), dis(gen), 3};
+        const Ray ray(o, Vector3f{0.1, -0.05, -1}.normalize());
+        const auto [hit, info] = strip.ray_intersect(ray, INF);
+        const auto [mapped_hit, mapped_info] = mapped.ray_intersect(ray, INF);
+        const auto [moved_hit, moved_info] = moved.ray_intersect(Ray(o + Vector3f{0, 0, 1}, ray.m_d), INF);
+        REQUIRE(hit == mapped_hit);
+        REQUIRE(hit == moved_hit);
+        if (hit) {
+            CHECK(mapped_info.t == info.t);
+            CHECK(mapped_info.tri_index == info.tri_index);
+            CHECK(mapped_info.tex_uv[0] == info.tex_uv[0]);
+            CHECK(mapped_info.tex_uv[1] == info.tex_uv[1]);
+            CHECK(moved_info.t == Catch::Approx(info.t));
+        }
+    }
+
+    // Truncated file
+    std::filesystem::resize_file(dir / "strip.crmesh", std::filesystem::file_size(dir / "strip.crmesh") - 64);
+    CHECK_THROWS(CRMesh(dir / "strip.crmesh", nullptr));
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Scene snapshot renders the scene it was written from", "[UnitTest]") {
+    const std::filesystem::path cwd = std::filesystem::current_path();
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "caramel_snapshot_test";
+    std::filesystem::create_directories(dir);
+    std::ofstream(dir / "quad.obj") << "v -1 -1 0\nv 1 -1 0\nv 1 1 0\nv -1 1 0\nvt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+                                    << "f 1/1 2/2 3/3 4/4\n";
+    Image texture(4, 2);
+    for (int h = 0; h < 2; h++) {
+        for (int w = 0; w < 4; w++) {
+            texture.set_pixel_value(w, h, 0.2f * w, 0.5f * h, 0.3f);
+        }
+    }
+    texture.write_exr((dir / "texture.exr").string());
+    // Transformed meshes, instances, image textures and environment maps are stored
+    std::ofstream(dir / "scene.json") << R"({
+        "integrator" : {"type" : "path", "depth_rr" : 3, "depth_max" : 4, "spp" : 2},
+        "camera" : {"type" : "pinhole", "pos" : [0, 0, 5], "dir" : [0, 0, -1], "up" : [0, 1, 0], "width" : 8, "height" : 8, "fov" : 45},
+        "shape" : [
+            {"type" : "obj", "path" : "quad.obj", "to_world" : [{"type" : "translate", "value" : [0.5, 0, 0]}],
+             "bsdf" : {"type" : "diffuse", "texture" : {"type" : "image", "path" : "texture.exr"}}},
+            {"type" : "instance", "shapes" : [{"type" : "obj", "path" : "quad.obj", "bsdf" : {"type" : "diffuse"},
+                                               "arealight" : {"radiance" : [2, 2, 2]}}],
+             "instances" : [{"to_world" : [{"type" : "translate", "value" : [0, 0, -1]}]}]}],
+        "light" : [{"type" : "image_env", "path" : "texture.exr", "scale" : 1}]})";
+
+    SceneSnapshot::write(dir / "scene.json", dir / "scene.crscene");
+    const SceneSnapshot snapshot(dir / "scene.crscene");
+    CHECK(snapshot.scene_json()["shape"][0]["type"] == "crmesh");
+    CHECK_FALSE(snapshot.scene_json()["shape"][0].contains("to_world"));
+    CHECK(snapshot.create_image("missing.exr") == nullptr);
+    const std::unique_ptr<Image> image(snapshot.create_image("texture.exr"));
+    REQUIRE(image != nullptr);
+    CHECK(Vector3f::L2(image->get_pixel_value(3, 1), texture.get_pixel_value(3, 1)) == 0);
+    CHECK_THROWS(image->set_pixel_value(0, 0, 1, 1, 1));
+
+    const auto [scene, integrator] = build_scene(dir / "scene.json");
+    const auto [snapshot_scene, snapshot_integrator] = build_scene(dir / "scene.crscene");
+    REQUIRE(snapshot_scene->m_meshes.size() == scene->m_meshes.size());
+    CHECK(snapshot_scene->m_lights.size() == scene->m_lights.size());
+    const Image img = render(scene, integrator);
+    const Image snapshot_img = render(snapshot_scene, snapshot_integrator);
+    for (int h = 0; h < 8; h++) {
+        for (int w = 0; w < 8; w++) {
+            CHECK(Vector3f::L2(img.get_pixel_value(w, h), snapshot_img.get_pixel_value(w, h)) == 0);
+        }
+    }
+
+    // Truncated file
+    std::filesystem::resize_file(dir / "scene.crscene", 32);
+    CHECK_THROWS(SceneSnapshot(dir / "scene.crscene"));
+    std::filesystem::current_path(cwd);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Repeated mesh files are loaded once and placed as instances", "[UnitTest]") {
+    const std::filesystem::path cwd = std::filesystem::current_path();
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "caramel_asset_test";
+    std::filesystem::create_directories(dir);
+    std::filesystem::current_path(dir);
+    std::ofstream("quad.obj") << "v -1 -1 0\nv 1 -1 0\nv 1 1 0\nv -1 1 0\nf 1 2 3 4\n";
+    std::ofstream("tri.obj") << "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n";
+    const Index assets = AssetRegistry::instance().size();
+    {
+        const SceneParser parser(nlohmann::json::parse(R"({"shape" : [
+            {"type" : "obj", "path" : "quad.obj", "bsdf" : {"type" : "diffuse"}},
+            {"type" : "obj", "path" : "./quad.obj", "bsdf" : {"type" : "mirror"},
+             "to_world" : [{"type" : "translate", "value" : [0, 0, -2]}], "arealight" : {"radiance" : [1, 1, 1]}},
+            {"type" : "obj", "path" : "tri.obj", "bsdf" : {"type" : "diffuse"}}]})"));
+        const std::vector<Shape*> shapes = parser.parse_shapes();
+        REQUIRE(shapes.size() == 3);
+        const auto *first = dynamic_cast<const Instance*>(shapes[0]);
+        const auto *second = dynamic_cast<const Instance*>(shapes[1]);
+        REQUIRE(first != nullptr);
+        REQUIRE(second != nullptr);
+        CHECK(first->geometry() == second->geometry());
+        CHECK(first->get_bsdf() != second->get_bsdf());
+        CHECK(second->get_aabb().m_max[2] == Catch::Approx(-2));
+        CHECK(second->get_area() == Catch::Approx(4));
+        // A file referenced once keeps its own mesh
+        CHECK(dynamic_cast<const TriangleMesh*>(shapes[2]) != nullptr);
+        CHECK(AssetRegistry::instance().size() == assets + 1);
+
+        // Images are shared by every texture of the same file, environment maps keep their pixels
+        const Image image(2, 2);
+        image.write_exr("texture.exr");
+        const ImageTexture texture("texture.exr");
+        const ImageTexture other_texture("./texture.exr");
+        CHECK(AssetRegistry::instance().size() == assets + 2);
+        const ImageEnvLight envmap("texture.exr", 1, Matrix44f::identity());
+        const ImageEnvLight other_envmap("texture.exr", 1, Matrix44f::identity());
+        CHECK(AssetRegistry::instance().size() == assets + 3);
+        for (auto s : shapes) {
+            delete s;
+        }
+    }
+    // Released with their last user
+    CHECK(AssetRegistry::instance().size() == assets);
+    std::filesystem::current_path(cwd);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Lazy meshes load on the first ray and are evicted over the budget", "[UnitTest]") {
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "caramel_lazy_test.obj";
+    std::ofstream(path) << "v -1 -1 0\nv 1 -1 0\nv 1 1 0\nv -1 1 0\nf 1 2 3 4\n";
+    const OBJMesh eager(path, nullptr);
+    std::atomic<int> loads = 0;
+    const auto loader = [&](){
+        loads++;
+        return new OBJMesh(path, nullptr, nullptr, translate(0, 0, -1));
+    };
+    LazyMesh first(loader, eager.get_aabb().transformed(translate(0, 0, -1)), nullptr);
+    LazyMesh second(loader, eager.get_aabb().transformed(translate(0, 0, -1)), nullptr);
+    CHECK(first.get_aabb().m_min[2] == Catch::Approx(-1));
+    CHECK_FALSE(first.is_loaded());
+    CHECK(loads == 0);
+
+    // Rays reaching the mesh at once load it once
+    std::atomic<int> hits = 0;
+    parallel_for(0, 256, [&](int i){
+        const Ray ray(Vector3f{-0.9f + 0.007f * i, 0.1f, 1}, Vector3f{0, 0, -1});
+        const auto [hit, info] = first.ray_intersect(ray, INF);
+        if (hit && info.shape == &first && info.t == Catch::Approx(2)) {
+            hits++;
+        }
+    });
+    CHECK(hits == 256);
+    CHECK(loads == 1);
+    CHECK(first.is_loaded());
+
+    // Only one of them fits in the budget, the least recently used one is evicted
+    const Index evictions = GeometryCache::instance().eviction_count();
+    GeometryCache::instance().set_budget(GeometryCache::instance().resident_bytes() + 1);
+    second.ray_intersect(Ray(Vector3f{0, 0, 1}, Vector3f{0, 0, -1}), INF);
+    CHECK(loads == 2);
+    CHECK_FALSE(first.is_loaded());
+    CHECK(second.is_loaded());
+    CHECK(GeometryCache::instance().eviction_count() == evictions + 1);
+    // Loaded again when a ray reaches it
+    CHECK(first.ray_intersect(Ray(Vector3f{0, 0, 1}, Vector3f{0, 0, -1}), INF).first);
+    CHECK(loads == 3);
+    CHECK_FALSE(second.is_loaded());
+
+    // A mesh evicted while a read scope is open is freed once the scope moves on to another mesh
+    {
+        GeometryCache::ReadScope scope;
+        CHECK(first.ray_intersect(Ray(Vector3f{0, 0, 1}, Vector3f{0, 0, -1}), INF).first);
+        CHECK(second.ray_intersect(Ray(Vector3f{0, 0, 1}, Vector3f{0, 0, -1}), INF).first);
+        CHECK_FALSE(first.is_loaded());
+        CHECK(GeometryCache::instance().retired_count() == 1);
+        // The evicted mesh is loaded again, and the scope no longer reads the old copy
+        CHECK(first.ray_intersect(Ray(Vector3f{0, 0, 1}, Vector3f{0, 0, -1}), INF).first);
+        CHECK(loads == 5);
+        CHECK(GeometryCache::instance().retired_count() == 1);
+    }
+    CHECK(GeometryCache::instance().retired_count() == 0);
+    GeometryCache::instance().set_budget(0);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Image textures are read as tiles of a mip pyramid under the texture budget", "[UnitTest]") {
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "caramel_tiled_test.exr";
+    Image image(100, 70);
+    for (int h = 0; h < 70; h++) {
+        for (int w = 0; w < 100; w++) {
+            image.set_pixel_value(w, h, static_cast<Float>(w), static_cast<Float>(h), 1);
+        }
+    }
+    image.write_exr(path.string());
+    std::filesystem::remove(TiledImage::cache_path(path));
+
+    const std::size_t budget = TextureCache::instance().budget();
+    {
+        const TiledImage tiled(path);
+        // 100x70, 50x35, 25x18, 13x9, 7x5, 4x3, 2x2, 1x1
+        REQUIRE(tiled.level_count() == 8);
+        CHECK(tiled.size(2)[0] == 25);
+        CHECK(tiled.size(2)[1] == 18);
+        CHECK(std::filesystem::exists(TiledImage::cache_path(path)));
+        CHECK(Vector3f::L2(tiled.texel(0, 99, 69), image.get_pixel_value(99, 69)) == 0);
+        CHECK(Vector3f::L2(tiled.texel(0, 70, 5), image.get_pixel_value(70, 5)) == 0);
+        // Clamped to the level
+        CHECK(Vector3f::L2(tiled.texel(0, 120, -3), image.get_pixel_value(99, 0)) == 0);
+        // Box filtered
+        CHECK(Vector3f::L2(tiled.texel(1, 10, 4), Vector3f{20.5, 8.5, 1}) == 0);
+        CHECK(tiled.texel(7, 0, 0)[2] == Catch::Approx(1));
+
+        // Over a budget of one tile, only the last tile stays
+        TextureCache::instance().set_budget(TiledImage::TILE_BYTES);
+        const Index evictions = TextureCache::instance().eviction_count();
+        std::atomic<int> mismatches = 0;
+        parallel_for(0, 64, [&](int i){
+            const int x = (i % 8) * 13;
+            const int y = (i / 8) * 9;
+            if (Vector3f::L2(tiled.texel(0, x, y), image.get_pixel_value(x, y)) != 0) {
+                mismatches++;
+            }
+        });
+        CHECK(mismatches == 0);
+        CHECK(TextureCache::instance().resident_bytes() == TiledImage::TILE_BYTES);
+        CHECK(TextureCache::instance().eviction_count() > evictions);
+
+        const ImageTexture texture(path.string());
+        CHECK(Vector3f::L2(texture.get_val(Vector2f{0.705, 0.92}, Float0), image.get_pixel_value(70, 5)) == 0);
+    }
+    // Tiles of destroyed images are dropped
+    CHECK(TextureCache::instance().resident_bytes() == 0);
+    TextureCache::instance().set_budget(budget);
+
+    // The cached pyramid is rebuilt when the image changes
+    image.set_pixel_value(0, 0, 5, 5, 5);
+    image.write_exr(path.string());
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(1));
+    CHECK(TiledImage(path).texel(0, 0, 0)[0] == 5);
+    std::filesystem::remove(TiledImage::cache_path(path));
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Ray differentials select coarser texture levels for larger footprints", "[UnitTest]") {
+    UniformStdSampler sampler(11);
+    const Pinhole pinhole(Vector3f{0, 0, 0}, Vector3f{0, 0, -1}, Vector3f{0, 1, 0}, 100, 100, 45);
+    const Ray ray = pinhole.sample_ray(50, 50, sampler);
+    REQUIRE(ray.m_differential.has_value());
+
+    // Plane at z whose texture coordinates span 40 units, so that texture widths are twice the footprint / 40
+    const auto hit_plane = [](const Ray &r, Float z){
+        const Triangle plane(Vector3f{-10, -10, z}, Vector3f{30, -10, z}, Vector3f{-10, 30, z}, nullptr);
+        auto [hit, info] = plane.ray_intersect(r, INF);
+        REQUIRE(hit);
+        info.compute_differentials(r);
+        CHECK(info.has_differentials);
+        return info;
+    };
+    // Pixel footprint at distance 1
+    const Float pixel = 2 * std::tan(deg_to_rad(Float(22.5))) / 100;
+    CHECK(hit_plane(ray, -1).tex_width == Catch::Approx(2 * pixel / 40).epsilon(1e-3));
+    CHECK(hit_plane(ray, -3).tex_width == Catch::Approx(3 * hit_plane(ray, -1).tex_width).epsilon(1e-3));
+
+    // Rays of a thin lens meet at the focal plane
+    const ThinLens thinlens(Vector3f{0, 0, 0}, Vector3f{0, 0, -1}, Vector3f{0, 1, 0}, 100, 100, 45, 0.5, 4);
+    const Ray lens_ray = thinlens.sample_ray(50, 50, sampler);
+    REQUIRE(lens_ray.m_differential.has_value());
+    CHECK(hit_plane(lens_ray, -4).tex_width == Catch::Approx(hit_plane(ray, -4).tex_width).epsilon(1e-3));
+
+    // A flat mirror keeps the footprint of the unfolded path
+    const RayIntersectInfo mirror = hit_plane(ray, -1);
+    const Vector3f reflected{ray.m_d[0], ray.m_d[1], -ray.m_d[2]};
+    Ray reflected_ray(mirror.p, reflected);
+    reflected_ray.m_differential = mirror.specular_differential(ray, reflected, 1);
+    REQUIRE(reflected_ray.m_differential.has_value());
+    CHECK(hit_plane(reflected_ray, 1).tex_width == Catch::Approx(hit_plane(ray, -3).tex_width).epsilon(1e-3));
+
+    // Refraction into glass narrows the spread by the IOR ratio
+    const Dielectric glass;
+    CHECK(glass.eta(true) == Catch::Approx(IOR::VACUUM / IOR::GLASS));
+    Ray refracted_ray(mirror.p, ray.m_d);
+    refracted_ray.m_differential = mirror.specular_differential(ray, ray.m_d, glass.eta(true));
+    CHECK(hit_plane(refracted_ray, -2).tex_width ==
+          Catch::Approx(hit_plane(ray, -1).tex_width * (1 + glass.eta(true))).epsilon(1e-3));
+
+    // A diffuse bounce spreads over a wide cone
+    Ray diffuse_ray(mirror.p, reflected);
+    diffuse_ray.m_differential = mirror.rough_differential(reflected, PI_INV);
+    CHECK(hit_plane(diffuse_ray, 1).tex_width > 10 * hit_plane(reflected_ray, 1).tex_width);
+    CHECK_FALSE(RayIntersectInfo().rough_differential(reflected, PI_INV).has_value());
+
+    // Wide footprints read a few texels of coarse levels
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "caramel_filter_test.exr";
+    Image image(512, 512);
+    for (int h = 0; h < 512; h++) {
+        for (int w = 0; w < 512; w++) {
+            image.set_pixel_value(w, h, static_cast<Float>(w), 1, 0);
+        }
+    }
+    image.write_exr(path.string());
+    {
+        const ImageTexture texture(path.string());
+        CHECK(texture.get_val(Vector2f{0.3, 0.6}, 1)[0] == Catch::Approx(255.5));
+        const auto loads_of = [&](Float width){
+            const Index loads = TextureCache::instance().load_count();
+            for (int s = 0; s < 256; s++) {
+                const Vector3f v = texture.get_val(Vector2f{sampler.sample_1d(), sampler.sample_1d()}, width);
+                CHECK(v[1] == Catch::Approx(1));
+            }
+            return TextureCache::instance().load_count() - loads;
+        };
+        const Index coarse_loads = loads_of(0.25);
+        const Index fine_loads = loads_of(0);
+        CHECK(coarse_loads <= 2);
+        CHECK(fine_loads > 10 * coarse_loads);
+    }
+    std::filesystem::remove(TiledImage::cache_path(path));
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("SceneUpdater rebuilds only changed parts of a scene", "[UnitTest]") {
+    nlohmann::json desc = nlohmann::json::parse(R"({
+        "integrator" : {"type" : "normal"},
+        "camera" : {"type" : "pinhole", "pos" : [0, 0, 5], "dir" : [0, 0, -1], "up" : [0, 1, 0], "width" : 8, "height" : 8, "fov" : 45},
+        "bsdfs" : [{"id" : "grey", "type" : "diffuse", "albedo" : [0.5, 0.5, 0.5]}],
+        "shape" : [
+            {"type" : "trianglemesh", "P" : [0, 0, 0, 1, 0, 0, 0, 1, 0], "indices" : [0, 1, 2], "bsdf" : "grey"},
+            {"type" : "trianglemesh", "P" : [0, 0, 1, 1, 0, 1, 0, 1, 1], "indices" : [0, 1, 2], "bsdf" : {"type" : "mirror"},
+             "arealight" : {"radiance" : [1, 1, 1]}}],
+        "light" : [{"type" : "point", "pos" : [0, 2, 0], "radiance" : [1, 1, 1]}]})");
+
+    SceneUpdater updater;
+    auto stats = updater.update(desc);
+    CHECK(stats.shapes_built == 2);
+    CHECK(stats.accel_rebuilt);
+    CHECK(stats.light_pdf_rebuilt);
+    CHECK(stats.camera_changed);
+    CHECK(stats.integrator_changed);
+    Scene *scene = updater.scene();
+    REQUIRE(scene->m_meshes.size() == 2);
+    CHECK(scene->m_lights.size() == 2);
+    const Shape *first = scene->m_meshes[0];
+
+    // Editing a shared BSDF changes the material of its users only
+    desc["bsdfs"][0]["albedo"] = {0.9, 0.1, 0.1};
+    stats = updater.update(desc);
+    CHECK(stats.shapes_kept == 2);
+    CHECK(stats.shapes_built == 0);
+    CHECK(stats.materials_changed == 1);
+    CHECK_FALSE(stats.accel_rebuilt);
+    CHECK_FALSE(stats.light_pdf_rebuilt);
+    CHECK_FALSE(stats.camera_changed);
+    CHECK_FALSE(stats.integrator_changed);
+    CHECK(scene->m_meshes[0] == first);
+
+    // Emission changes keep the geometry, and drop the light cache trained for the old lights
+    scene->build_light_cache(2, 1);
+    REQUIRE(scene->m_light_cache != nullptr);
+    desc["shape"][1]["arealight"]["radiance"] = {5, 5, 5};
+    stats = updater.update(desc);
+    CHECK(stats.shapes_kept == 2);
+    CHECK_FALSE(stats.accel_rebuilt);
+    CHECK(stats.light_pdf_rebuilt);
+    CHECK(scene->m_light_cache == nullptr);
+    CHECK(scene->m_meshes[1]->get_arealight()->m_radiance[0] == 5);
+    CHECK(scene->pdf_light(scene->m_meshes[1]->get_arealight()) > 0);
+
+    // Removing a shape rebuilds the scene BVH, a moved shape is rebuilt
+    desc["shape"].erase(1);
+    desc["shape"][0]["P"][0] = -1;
+    stats = updater.update(desc);
+    CHECK(stats.shapes_removed == 2);
+    CHECK(stats.shapes_built == 1);
+    CHECK(stats.accel_rebuilt);
+    CHECK(stats.light_pdf_rebuilt);
+    CHECK(scene->m_meshes.size() == 1);
+    CHECK(scene->m_lights.size() == 1);
+
+    // A description with errors leaves the scene as it was
+    nlohmann::json broken = desc;
+    broken["shape"].push_back({{"type", "unknown"}});
+    CHECK_THROWS(updater.update(broken));
+    CHECK(scene->m_meshes.size() == 1);
+    stats = updater.update(desc);
+    CHECK(stats.shapes_kept == 1);
+    CHECK_FALSE(stats.accel_rebuilt);
+}
+
+TEST_CASE("Integrators render the camera of the config instead of the scene camera", "[UnitTest]") {
+    const nlohmann::json desc = nlohmann::json::parse(R"({
+        "integrator" : {"type" : "normal"},
+        "camera" : {"type" : "pinhole", "pos" : [0, 0, 5], "dir" : [0, 0, -1], "up" : [0, 1, 0], "width" : 8, "height" : 8, "fov" : 45},
+        "shape" : [{"type" : "trianglemesh", "P" : [-1, -1, 0, 1, -1, 0, 0, 1, 0], "indices" : [0, 1, 2], "bsdf" : {"type" : "diffuse"}}],
+        "light" : [{"type" : "point", "pos" : [0, 2, 0], "radiance" : [1, 1, 1]}]})");
+    SceneUpdater updater;
+    updater.update(desc);
+    Scene *scene = updater.scene();
+    Integrator *integrator = updater.integrator();
+    const Camera *scene_camera = scene->m_cam;
+
+    std::unique_ptr<Camera> other(SceneParser(nlohmann::json::parse(R"({"camera" :
+        {"type" : "pinhole", "pos" : [3, 0, 4], "dir" : [-3, 0, -4], "up" : [0, 1, 0], "width" : 6, "height" : 4, "fov" : 45}})")).parse_camera());
+    RenderConfig config;
+    config.camera = other.get();
+    const Image with_config = integrator->render(*scene, config);
+    CHECK(scene->m_cam == scene_camera);
+    CHECK(with_config.size()[0] == 6);
+    CHECK(with_config.size()[1] == 4);
+
+    scene->set_camera(other.get());
+    const Image with_scene = integrator->render(*scene);
+    scene->set_camera(scene_camera);
+    REQUIRE(with_scene.size()[0] == 6);
+    REQUIRE(with_scene.size()[1] == 4);
+    for (Index i = 0; i < 6; i++) {
+        for (Index j = 0; j < 4; j++) {
+            CHECK(Vector3f::L2(with_config.get_pixel_value(i, j), with_scene.get_pixel_value(i, j)) == 0);
+        }
+    }
+}
+
+TEST_CASE("Light cache samples lights with the pdf it reports and keeps every light possible", "[UnitTest]") {
+    // A wall at x = 0 hides each point light from the other half of the floor
+    const nlohmann::json desc = nlohmann::json::parse(R"({
+        "integrator" : {"type" : "path", "depth_rr" : 3, "depth_max" : 4, "spp" : 1},
+        "camera" : {"type" : "pinhole", "pos" : [0, 6, 0], "dir" : [0, -1, 0], "up" : [0, 0, 1], "width" : 16, "height" : 16, "fov" : 60},
+        "shape" : [
+            {"type" : "trianglemesh", "P" : [-2, 0, -2, 2, 0, -2, 2, 0, 2, -2, 0, 2], "indices" : [0, 1, 2, 0, 2, 3], "bsdf" : {"type" : "diffuse"}},
+            {"type" : "trianglemesh", "P" : [0, 0, -2, 0, 3, -2, 0, 3, 2, 0, 0, 2], "indices" : [0, 1, 2, 0, 2, 3], "bsdf" : {"type" : "diffuse"}}],
+        "light" : [{"type" : "point", "pos" : [-1, 1, 0], "radiance" : [1, 1, 1]},
+                   {"type" : "point", "pos" : [1, 1, 0], "radiance" : [1, 1, 1]}]})");
+    SceneUpdater updater;
+    updater.update(desc);
+    Scene *scene = updater.scene();
+    scene->build_light_cache(4, 4);
+    REQUIRE(scene->m_light_cache != nullptr);
+    REQUIRE(scene->m_lights.size() == 2);
+    const Light *left = scene->m_lights[0];
+    const Light *right = scene->m_lights[1];
+
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 16; j++) {
+            const Vector3f pos{static_cast<Float>(-1.9 + 3.8 * i / 15), static_cast<Float>(0.01), static_cast<Float>(-1.9 + 3.8 * j / 15)};
+            UniformStdSampler sampler = UniformStdSampler::for_pixel(i, j, 0, 0);
+            for (int s = 0; s < 4; s++) {
+                const auto [light, pdf] = scene->sample_light(pos, sampler);
+                CHECK(pdf == scene->pdf_light(light, pos));
+            }
+            // The global distribution mixed into every cell keeps hidden lights possible
+            const Float pdf_left = scene->pdf_light(left, pos);
+            const Float pdf_right = scene->pdf_light(right, pos);
+            CHECK(pdf_left >= LightCache::GLOBAL_MIX * scene->pdf_light(left) * static_cast<Float>(0.999));
+            CHECK(pdf_right >= LightCache::GLOBAL_MIX * scene->pdf_light(right) * static_cast<Float>(0.999));
+            CHECK(pdf_left + pdf_right == Catch::Approx(1));
+        }
+    }
+
+    // Each half of the floor prefers the light it sees
+    const Vector3f left_floor{-1.5, 0.01, 0};
+    const Vector3f right_floor{1.5, 0.01, 0};
+    CHECK(scene->pdf_light(left, left_floor) > scene->pdf_light(left));
+    CHECK(scene->pdf_light(right, right_floor) > scene->pdf_light(right));
+}
+
+TEST_CASE("RIS direct lighting matches plain light sampling and its pdf used in MIS", "[UnitTest]") {
+    // Two area lights of different size and a point light over a floor, partly shadowed by a blocker
+    nlohmann::json desc = nlohmann::json::parse(R"({
+        "integrator" : {"type" : "path", "depth_rr" : 3, "depth_max" : 2, "spp" : 1024},
+        "camera" : {"type" : "pinhole", "pos" : [0, 6, 0], "dir" : [0, -1, 0], "up" : [0, 0, 1], "width" : 8, "height" : 8, "fov" : 45},
+        "shape" : [
+            {"type" : "trianglemesh", "P" : [-2, 0, -2, 2, 0, -2, 2, 0, 2, -2, 0, 2], "indices" : [0, 2, 1, 0, 3, 2],
+             "bsdf" : {"type" : "diffuse", "albedo" : [0.5, 0.5, 0.5]}},
+            {"type" : "trianglemesh", "P" : [-0.5, 0.5, -0.5, 0.5, 0.5, -0.5, 0.5, 0.5, 0.5], "indices" : [0, 2, 1], "bsdf" : {"type" : "diffuse"}},
+            {"type" : "trianglemesh", "P" : [-1.5, 2, -1.5, -0.5, 2, -1.5, -0.5, 2, -0.5, -1.5, 2, -0.5], "indices" : [0, 1, 2, 0, 2, 3],
+             "bsdf" : {"type" : "diffuse"}, "arealight" : {"radiance" : [4, 4, 4]}},
+            {"type" : "trianglemesh", "P" : [1, 1.5, 1, 1.2, 1.5, 1, 1.2, 1.5, 1.2], "indices" : [0, 1, 2],
+             "bsdf" : {"type" : "diffuse"}, "arealight" : {"radiance" : [20, 20, 20]}}],
+        "light" : [{"type" : "point", "pos" : [1, 1, -1], "radiance" : [1, 1, 1]}]})");
+    SceneUpdater updater;
+    updater.update(desc);
+    Scene *scene = updater.scene();
+    REQUIRE(scene->m_lights.size() == 3);
+
+    // The candidate pdf of RIS is the pdf a bsdf ray hitting the same light point is weighted with
+    Index area_samples = 0;
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++) {
+            const Vector3f above{static_cast<Float>(-1.9 + 3.8 * i / 7), static_cast<Float>(0.1), static_cast<Float>(-1.9 + 3.8 * j / 7)};
+            const auto [floor_hit, info] = scene->ray_intersect(Ray(above, Vector3f{0, -1, 0}));
+            REQUIRE(floor_hit);
+            UniformStdSampler sampler = UniformStdSampler::for_pixel(i, j, 0, 0);
+            for (int s = 0; s < 8; s++) {
+                const auto [light, light_pick_pdf] = scene->sample_light(info.p, sampler);
+                CHECK(light_pick_pdf == scene->pdf_light(light, info.p));
+                const LightSample candidate = light->sample_unoccluded(*scene, info, sampler);
+                if (light->is_delta() || is_zero(candidate.radiance)) {
+                    continue;
+                }
+                const auto light_shape = std::find_if(scene->m_meshes.begin(), scene->m_meshes.end(),
+                                                      [light](const Shape *shape) { return shape->get_arealight() == light; });
+                REQUIRE(light_shape != scene->m_meshes.end());
+                const auto [light_hit, light_info] = (*light_shape)->ray_intersect(Ray(info.p, (candidate.pos - info.p).normalize()), INF);
+                REQUIRE(light_hit);
+                const Float mis_pdf = scene->pdf_light(light, info.p) * light->pdf_solidangle(info.p, light_info.p, light_info.sh_coord.m_world_n);
+                CHECK(light_pick_pdf * candidate.pdf == Catch::Approx(mis_pdf).epsilon(1e-3));
+                area_samples++;
+            }
+        }
+    }
+    CHECK(area_samples > 0);
+
+    // The direct lighting estimate is the same in expectation for any number of candidates
+    const auto mean = [](const Image &image) {
+        Float sum = 0;
+        for (Index i = 0; i < image.size()[0]; i++) {
+            for (Index j = 0; j < image.size()[1]; j++) {
+                sum += luminance(image.get_pixel_value(i, j));
+            }
+        }
+        return sum / static_cast<Float>(image.size()[0] * image.size()[1]);
+    };
+    const Float plain = mean(updater.integrator()->render(*scene));
+    desc["integrator"]["ris_candidates"] = 8;
+    updater.update(desc);
+    const Float ris = mean(updater.integrator()->render(*scene));
+    CHECK(plain > 0);
+    CHECK(ris == Catch::Approx(plain).epsilon(0.02));
+}
+
+TEST_CASE("JobScheduler runs every task once and honours the thread cap", "[UnitTest]") {
+    ThreadPool pool(4);
+    JobScheduler scheduler(pool);
+    JobScheduler::JobOptions capped;
+    capped.max_threads = 2;
+    JobScheduler::Job *job = scheduler.create_job(capped);
+
+    std::array<std::atomic<int>, 64> counts{};
+    std::atomic<int> running = 0;
+    std::atomic<int> max_running = 0;
+    job->parallel_for(0, 64, [&](int i) {
+        const int now = ++running;
+        int prev = max_running;
+        while (now > prev && !max_running.compare_exchange_weak(prev, now)) {}
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        counts[i]++;
+        running--;
+    });
+    for (const auto &c : counts) {
+        CHECK(c == 1);
+    }
+    CHECK(max_running <= 2);
+    CHECK(job->stats().tasks_done == 64);
+
+    // An empty range returns immediately
+    job->parallel_for(3, 3, [&](int) { FAIL("should not run"); });
+    scheduler.destroy_job(job);
+}
+
+TEST_CASE("JobScheduler runs concurrent jobs on the threads of its pool", "[UnitTest]") {
+    ThreadPool pool(2);
+    JobScheduler scheduler(pool);
+    JobScheduler::Job *job_a = scheduler.create_job({});
+    JobScheduler::Job *job_b = scheduler.create_job({});
+
+    std::atomic<int> running = 0;
+    std::atomic<int> max_running = 0;
+    std::atomic<int> count = 0;
+    const auto task = [&](int) {
+        const int now = ++running;
+        int prev = max_running;
+        while (now > prev && !max_running.compare_exchange_weak(prev, now)) {}
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        count++;
+        running--;
+    };
+    std::thread other([&]() { job_b->parallel_for(0, 32, task); });
+    job_a->parallel_for(0, 32, task);
+    other.join();
+
+    CHECK(count == 64);
+    CHECK(max_running <= 2);
+    scheduler.destroy_job(job_a);
+    scheduler.destroy_job(job_b);
+}
+
+TEST_CASE("JobScheduler rethrows an exception of a task on the submitting thread", "[UnitTest]") {
+    ThreadPool pool(4);
+    JobScheduler scheduler(pool);
+    JobScheduler::Job *job = scheduler.create_job({});
+
+    std::atomic<int> ran = 0;
+    CHECK_THROWS_AS(job->parallel_for(0, 64, [&](int i) {
+        ran++;
+        if (i == 5) {
+            throw std::runtime_error("tile failed");
+        }
+    }), std::runtime_error);
+    CHECK(ran <= 64);
+
+    // The job and its workers stay usable after a failed call
+    std::atomic<int> count = 0;
+    job->parallel_for(0, 16, [&](int) { count++; });
+    CHECK(count == 16);
+    scheduler.destroy_job(job);
+}
+
+TEST_CASE("RenderServer answers malformed and unknown requests with errors", "[UnitTest]") {
+    RenderServer server;
+    const auto status = [&](const std::string &request) {
+        std::string response;
+        server.handle(request, [&](const std::string &r) { response = r; });
+        server.wait_jobs();
+        return nlohmann::json::parse(response).at("status").get<std::string>();
+    };
+    CHECK(status("not json") == "error");
+    CHECK(status(R"({"cmd" : "unknown"})") == "error");
+    CHECK(status(R"({"cmd" : "render", "id" : "missing", "output" : "out.exr"})") == "error");
+    CHECK(status(R"({"cmd" : "load", "id" : "missing"})") == "error");
+    CHECK_FALSE(server.is_quit());
+    CHECK(status(R"({"cmd" : "quit"})") == "ok");
+    CHECK(server.is_quit());
+}